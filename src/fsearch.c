@@ -26,6 +26,8 @@
 #include "fsearch_clipboard.h"
 #include "fsearch_config.h"
 #include "fsearch_database.h"
+#include "fsearch_database_monitor.h"
+#include "fsearch_database_search.h"
 #include "fsearch_file_utils.h"
 #include "fsearch_limits.h"
 #include "fsearch_preferences_ui.h"
@@ -42,6 +44,7 @@
 struct _FsearchApplication {
     GtkApplication parent;
     FsearchDatabase *db;
+    FsearchDatabaseMonitor *db_monitor;
     FsearchConfig *config;
     FsearchThreadPool *pool;
 
@@ -74,7 +77,7 @@ static const char *fsearch_bus_name = "io.github.cboxdoerfer.FSearch";
 static const char *fsearch_db_worker_bus_name = "io.github.cboxdoerfer.FSearchDatabaseWorker";
 static const char *fsearch_object_path = "/io/github/cboxdoerfer/FSearch";
 
-enum { DATABASE_SCAN_STARTED, DATABASE_UPDATE_FINISHED, DATABASE_LOAD_STARTED, NUM_SIGNALS };
+enum { DATABASE_SCAN_STARTED, DATABASE_UPDATE_FINISHED, DATABASE_LOAD_STARTED, DATABASE_CHANGED, NUM_SIGNALS };
 
 static guint fsearch_signals[NUM_SIGNALS];
 
@@ -86,6 +89,9 @@ database_update(FsearchApplication *app, bool rescan);
 static void
 action_set_enabled(const char *action_name, gboolean enabled);
 
+static void
+database_update_add(bool scan);
+
 static gboolean
 on_database_auto_update(gpointer user_data) {
     FsearchApplication *self = FSEARCH_APPLICATION(user_data);
@@ -100,7 +106,8 @@ database_auto_update_init(FsearchApplication *fsearch) {
         g_source_remove(fsearch->db_timeout_id);
         fsearch->db_timeout_id = 0;
     }
-    if (fsearch->config->update_database_every) {
+    // rescans aren't needed while file system changes are applied to the database right away
+    if (fsearch->config->update_database_every && !fsearch->db_monitor) {
         guint seconds =
             fsearch->config->update_database_every_hours * 3600 + fsearch->config->update_database_every_minutes * 60;
         if (seconds < 60) {
@@ -112,6 +119,40 @@ database_auto_update_init(FsearchApplication *fsearch) {
     }
 }
 
+static void
+on_database_monitor_notify(FsearchDatabaseMonitor *monitor, FsearchDatabaseMonitorNotify id, gpointer user_data) {
+    FsearchApplication *self = FSEARCH_APPLICATION(user_data);
+    switch (id) {
+    case DATABASE_MONITOR_NOTIFY_CHANGED:
+        g_signal_emit(self, fsearch_signals[DATABASE_CHANGED], 0);
+        break;
+    case DATABASE_MONITOR_NOTIFY_OVERFLOW:
+        // a new monitor gets attached to the database once the rescan has finished
+        g_debug("[app] file system events were lost, rescan database");
+        g_clear_pointer(&self->db_monitor, db_monitor_free);
+        database_update_add(true);
+        break;
+    case DATABASE_MONITOR_NOTIFY_FAILED:
+        g_debug("[app] file system monitoring failed, fall back to scheduled database updates");
+        g_clear_pointer(&self->db_monitor, db_monitor_free);
+        database_auto_update_init(self);
+        // changes which were applied before the failure still need to show up
+        g_signal_emit(self, fsearch_signals[DATABASE_CHANGED], 0);
+        break;
+    }
+}
+
+static void
+database_monitor_init(FsearchApplication *fsearch) {
+    if (!fsearch->config->monitor_changes || !fsearch->db) {
+        g_clear_pointer(&fsearch->db_monitor, db_monitor_free);
+    }
+    else if (!fsearch->db_monitor) {
+        fsearch->db_monitor = db_monitor_new(fsearch->db, on_database_monitor_notify, fsearch);
+    }
+    database_auto_update_init(fsearch);
+}
+
 static gboolean
 on_database_update_status(gpointer user_data) {
     char *text = user_data;
@@ -161,6 +202,7 @@ on_database_update_finished(gpointer user_data) {
     FsearchDatabase *db = user_data;
     if (!g_cancellable_is_cancelled(self->db_thread_cancellable)) {
         prepare_windows_for_db_update(self);
+        g_clear_pointer(&self->db_monitor, db_monitor_free);
         g_clear_pointer(&self->db, db_unref);
         self->db = g_steal_pointer(&db);
     }
@@ -173,6 +215,7 @@ on_database_update_finished(gpointer user_data) {
         action_set_enabled("update_database", TRUE);
         action_set_enabled("cancel_update_database", FALSE);
     }
+    database_monitor_init(self);
     fsearch_application_state_unlock(self);
     g_signal_emit(self, fsearch_signals[DATABASE_UPDATE_FINISHED], 0);
     return G_SOURCE_REMOVE;
@@ -250,10 +293,8 @@ database_update_scan_and_save(FsearchApplication *app, FsearchDatabase *db) {
     if (!g_cancellable_is_cancelled(app->db_thread_cancellable)) {
         char *db_path = fsearch_application_get_database_dir();
         if (db_path) {
-            if (app->config->show_indexing_status) {
-                database_update_status_cb(_("Saving…"));
-            }
-            db_save(db, db_path);
+            // the database can already be used while it's being saved
+            db_save_in_background(db, db_path);
             g_clear_pointer(&db_path, free);
         }
     }
@@ -269,6 +310,14 @@ database_update(FsearchApplication *app, bool rescan) {
                                  app->config->exclude_locations,
                                  app->config->exclude_files,
                                  app->config->exclude_hidden_items);
+    db_set_num_scan_threads(db, app->config->scan_threads);
+    db_set_scan_queue_depth(db, app->config->scan_queue_depth);
+    db_set_sorted_entries_memory_limit(db, (size_t)app->config->sort_index_memory_limit * 1024 * 1024);
+    db_set_compression(db, app->config->compress_database);
+    db_set_trigram_index(db, app->config->trigram_index);
+    if (rescan && app->config->rescan_incrementally) {
+        db_set_previous_database(db, app->db);
+    }
     fsearch_application_state_unlock(app);
 
     if (rescan) {
@@ -369,9 +418,10 @@ on_preferences_ui_finished(FsearchConfig *new_config) {
     }
     app->config = new_config;
     config_save(app->config);
+    db_search_set_result_cache_size((size_t)app->config->result_cache_size * 1024 * 1024);
 
     g_object_set(gtk_settings_get_default(), "gtk-application-prefer-dark-theme", new_config->enable_dark_theme, NULL);
-    database_auto_update_init(app);
+    database_monitor_init(app);
 
     if (config_diff.database_config_changed) {
         database_update_add(true);
@@ -458,6 +508,7 @@ fsearch_application_shutdown(GApplication *app) {
         g_debug("[app] database thread finished.");
     }
 
+    g_clear_pointer(&fsearch->db_monitor, db_monitor_free);
     g_clear_pointer(&fsearch->db, db_unref);
     g_clear_object(&fsearch->db_thread_cancellable);
 
@@ -524,6 +575,7 @@ fsearch_application_startup(GApplication *app) {
     if (!config_load(fsearch->config)) {
         config_load_default(fsearch->config);
     }
+    db_search_set_result_cache_size((size_t)fsearch->config->result_cache_size * 1024 * 1024);
     fsearch->db = NULL;
     fsearch->db_state = FSEARCH_DATABASE_STATE_IDLE;
     fsearch->filters = fsearch_filter_get_default();
@@ -733,6 +785,24 @@ database_update_in_local_instance() {
 
     FsearchDatabase *db =
         db_new(config->indexes, config->exclude_locations, config->exclude_files, config->exclude_hidden_items);
+    db_set_num_scan_threads(db, config->scan_threads);
+    db_set_scan_queue_depth(db, config->scan_queue_depth);
+    db_set_compression(db, config->compress_database);
+
+    if (config->rescan_incrementally) {
+        char *db_file_path = fsearch_application_get_database_file_path();
+        if (db_file_path) {
+            FsearchDatabase *previous_db = db_new(config->indexes,
+                                                  config->exclude_locations,
+                                                  config->exclude_files,
+                                                  config->exclude_hidden_items);
+            if (db_load(previous_db, db_file_path, NULL)) {
+                db_set_previous_database(db, previous_db);
+            }
+            g_clear_pointer(&previous_db, db_unref);
+            g_clear_pointer(&db_file_path, free);
+        }
+    }
 
     int res = EXIT_FAILURE;
     if (db_scan(db, NULL, NULL)) {
@@ -872,6 +942,15 @@ fsearch_application_class_init(FsearchApplicationClass *klass) {
                                                           NULL,
                                                           G_TYPE_NONE,
                                                           0);
+    fsearch_signals[DATABASE_CHANGED] = g_signal_new("database-changed",
+                                                     G_TYPE_FROM_CLASS(klass),
+                                                     G_SIGNAL_RUN_LAST,
+                                                     0,
+                                                     NULL,
+                                                     NULL,
+                                                     NULL,
+                                                     G_TYPE_NONE,
+                                                     0);
 }
 
 // Public functions
@@ -189,6 +189,15 @@ darray_add_items(DynamicArray *array, void **items, uint32_t num_items) {
     array->num_items += num_items;
 }
 
+void
+darray_add_array_items(DynamicArray *array, DynamicArray *source, uint32_t start, uint32_t num_items) {
+    assert(source != NULL);
+    assert(start + num_items <= source->num_items);
+    if (num_items > 0) {
+        darray_add_items(array, source->data + start, num_items);
+    }
+}
+
 void
 darray_add_item(DynamicArray *array, void *data) {
     assert(array != NULL);
@@ -202,6 +211,15 @@ darray_add_item(DynamicArray *array, void *data) {
     array->data[array->num_items++] = data;
 }
 
+void
+darray_set_item(DynamicArray *array, void *data, uint32_t idx) {
+    assert(array != NULL);
+    assert(array->data != NULL);
+    assert(idx < array->num_items);
+
+    array->data[idx] = data;
+}
+
 
 bool
 darray_get_item_idx(DynamicArray *array,
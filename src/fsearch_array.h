@@ -66,9 +66,16 @@ darray_get_item_idx(DynamicArray *array,
 void
 darray_add_items(DynamicArray *array, void **items, uint32_t num_items);
 
+// Appends num_items items of source, starting with the one at index start
+void
+darray_add_array_items(DynamicArray *array, DynamicArray *source, uint32_t start, uint32_t num_items);
+
 void
 darray_add_item(DynamicArray *array, void *data);
 
+void
+darray_set_item(DynamicArray *array, void *data, uint32_t idx);
+
 DynamicArray *
 darray_new(size_t num_items);
 
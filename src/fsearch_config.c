@@ -254,6 +254,7 @@ config_load(FsearchConfig *config) {
         config->search_in_path = config_load_boolean(key_file, "Search", "search_in_path", false);
         config->hide_results_on_empty_search =
             config_load_boolean(key_file, "Search", "hide_results_on_empty_search", true);
+        config->result_cache_size = config_load_integer(key_file, "Search", "result_cache_size", 32);
 
         // Database
         config->update_database_on_launch =
@@ -263,9 +264,16 @@ config_load(FsearchConfig *config) {
             config_load_integer(key_file, "Database", "update_database_every_hours", 0);
         config->update_database_every_minutes =
             config_load_integer(key_file, "Database", "update_database_every_minutes", 15);
+        config->monitor_changes = config_load_boolean(key_file, "Database", "monitor_changes", false);
+        config->rescan_incrementally = config_load_boolean(key_file, "Database", "rescan_incrementally", false);
         config->exclude_hidden_items =
             config_load_boolean(key_file, "Database", "exclude_hidden_files_and_folders", false);
         config->follow_symlinks = config_load_boolean(key_file, "Database", "follow_symbolic_links", false);
+        config->scan_threads = config_load_integer(key_file, "Database", "scan_threads", 0);
+        config->scan_queue_depth = config_load_integer(key_file, "Database", "scan_queue_depth", 0);
+        config->sort_index_memory_limit = config_load_integer(key_file, "Database", "sort_index_memory_limit", 0);
+        config->compress_database = config_load_boolean(key_file, "Database", "compress_database", false);
+        config->trigram_index = config_load_boolean(key_file, "Database", "trigram_index", false);
 
         char *exclude_files_str = config_load_string(key_file, "Database", "exclude_files", NULL);
         if (exclude_files_str) {
@@ -307,6 +315,7 @@ config_load_default(FsearchConfig *config) {
     config->enable_regex = false;
     config->search_in_path = false;
     config->hide_results_on_empty_search = true;
+    config->result_cache_size = 32;
 
     // Interface
     config->single_click_open = false;
@@ -363,8 +372,15 @@ config_load_default(FsearchConfig *config) {
     config->update_database_every = false;
     config->update_database_every_hours = 0;
     config->update_database_every_minutes = 15;
+    config->monitor_changes = false;
+    config->rescan_incrementally = false;
     config->exclude_hidden_items = false;
     config->follow_symlinks = false;
+    config->scan_threads = 0;
+    config->scan_queue_depth = 0;
+    config->sort_index_memory_limit = 0;
+    config->compress_database = false;
+    config->trigram_index = false;
 
     // Locations
     config->indexes = NULL;
@@ -509,6 +525,7 @@ config_save(FsearchConfig *config) {
     g_key_file_set_boolean(key_file, "Search", "enable_regex", config->enable_regex);
     g_key_file_set_boolean(key_file, "Search", "match_case", config->match_case);
     g_key_file_set_boolean(key_file, "Search", "hide_results_on_empty_search", config->hide_results_on_empty_search);
+    g_key_file_set_integer(key_file, "Search", "result_cache_size", config->result_cache_size);
 
     // Database
     g_key_file_set_boolean(key_file, "Database", "update_database_on_launch", config->update_database_on_launch);
@@ -518,8 +535,15 @@ config_save(FsearchConfig *config) {
                            "Database",
                            "update_database_every_minutes",
                            config->update_database_every_minutes);
+    g_key_file_set_boolean(key_file, "Database", "monitor_changes", config->monitor_changes);
+    g_key_file_set_boolean(key_file, "Database", "rescan_incrementally", config->rescan_incrementally);
     g_key_file_set_boolean(key_file, "Database", "exclude_hidden_files_and_folders", config->exclude_hidden_items);
     g_key_file_set_boolean(key_file, "Database", "follow_symbolic_links", config->follow_symlinks);
+    g_key_file_set_integer(key_file, "Database", "scan_threads", config->scan_threads);
+    g_key_file_set_integer(key_file, "Database", "scan_queue_depth", config->scan_queue_depth);
+    g_key_file_set_integer(key_file, "Database", "sort_index_memory_limit", config->sort_index_memory_limit);
+    g_key_file_set_boolean(key_file, "Database", "compress_database", config->compress_database);
+    g_key_file_set_boolean(key_file, "Database", "trigram_index", config->trigram_index);
 
     config_save_indexes(key_file, config->indexes, "location");
     config_save_exclude_locations(key_file, config->exclude_locations, "exclude_location");
@@ -47,6 +47,8 @@ struct _FsearchConfig {
     bool auto_match_case;
     bool search_as_you_type;
     bool show_base_2_units;
+    // result_cache_size: MiB the results of recent searches may take to be reused, 0 disables the cache
+    uint32_t result_cache_size;
 
     // Applications
     char *folder_open_cmd;
@@ -107,10 +109,26 @@ struct _FsearchConfig {
     bool update_database_every;
     uint32_t update_database_every_hours;
     uint32_t update_database_every_minutes;
+    // monitor_changes: keep the database up to date with inotify instead of rescanning it periodically
+    bool monitor_changes;
+    // rescan_incrementally: reuse the contents of folders whose modification time didn't change since the last scan
+    bool rescan_incrementally;
 
     bool exclude_hidden_items;
     bool follow_symlinks;
 
+    // scan_threads: 0 uses one thread per processor, 1 disables parallel scanning
+    uint32_t scan_threads;
+    // scan_queue_depth: number of concurrent io_uring metadata requests per scan thread, 0 disables io_uring
+    uint32_t scan_queue_depth;
+    // sort_index_memory_limit: MiB the entries sorted by anything but their name may take, 0 for no limit
+    uint32_t sort_index_memory_limit;
+    // compress_database: store the database file compressed, fewer bytes to read at the cost of some CPU time
+    bool compress_database;
+    // trigram_index: index the trigrams of all names, so searches only need to compare names which contain the ones
+    // of the query
+    bool trigram_index;
+
     GList *indexes;
     GList *exclude_locations;
     char **exclude_files;
@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <glib/gi18n.h>
@@ -30,6 +31,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -37,23 +40,113 @@
 
 #include "fsearch_database.h"
 #include "fsearch_database_entry.h"
+#include "fsearch_database_search.h"
 #include "fsearch_exclude_path.h"
 #include "fsearch_index.h"
-#include "fsearch_memory_pool.h"
+#include "fsearch_limits.h"
+#include "fsearch_statx_batch.h"
+#include "fsearch_string_arena.h"
 #include "fsearch_task.h"
+#include "fsearch_task_ids.h"
+#include "fsearch_trigram_index.h"
+#include "fsearch_utf.h"
 
-#define NUM_DB_ENTRIES_FOR_POOL_BLOCK 10000
 
-#define DATABASE_MAJOR_VERSION 0
-#define DATABASE_MINOR_VERSION 9
+#define DATABASE_MAJOR_VERSION 1
+#define DATABASE_MINOR_VERSION 0
 #define DATABASE_MAGIC_NUMBER "FSDB"
 
+// Databases with major version 0 are a single stream which has to be read front to back, they can still be loaded
+#define DATABASE_LEGACY_MAJOR_VERSION 0
+#define DATABASE_LEGACY_MINOR_VERSION 10
+
+// Starting with major version 1 a database file is made of sections:
+//
+// header:   magic number (4 bytes), major version (1 byte), minor version (1 byte), reserved (2 bytes)
+// sections: the content of all sections, each one starts at an offset aligned to 8 bytes
+// toc:      number of sections (4 bytes), reserved (4 bytes), one DatabaseFileSection per section
+// trailer:  offset of the toc (8 bytes), checksum of the toc (4 bytes), magic number (4 bytes)
+//
+// Sections whose type isn't known are skipped when loading, which allows adding new ones without breaking older
+// versions. Every section has its own CRC-32 checksum, so only the ones which are actually used need to be verified.
+typedef enum {
+    // info: index flags (8 bytes), number of folders (4 bytes), number of files (4 bytes), scan timestamp (8 bytes)
+    DATABASE_SECTION_TYPE_INFO = 1,
+    // folders: all folders, sorted by name
+    DATABASE_SECTION_TYPE_FOLDERS,
+    // files: all files, sorted by name
+    DATABASE_SECTION_TYPE_FILES,
+    // sorted_entries: positions of all folders followed by all files in the sort order given by param
+    DATABASE_SECTION_TYPE_SORTED_ENTRIES,
+} DatabaseSectionType;
+
+// The entries of the folders and files sections are split into blocks of DATABASE_FILE_RESTART_INTERVAL entries. Names
+// are front-coded against the previous entry, except for the first entry of each block which stores its full name, so
+// every block can be encoded and decoded on its own thread.
+typedef enum {
+    // restart_points: the section starts with the restart interval (4 bytes), the number of blocks (4 bytes) and the
+    // offset of every block relative to the end of this index (8 bytes each)
+    DATABASE_SECTION_FLAG_RESTART_POINTS = 1 << 0,
+    // compressed: every block is compressed on its own with raw deflate, the offsets of the restart points are followed
+    // by the uncompressed size of every block (8 bytes each)
+    DATABASE_SECTION_FLAG_COMPRESSED = 1 << 1,
+} DatabaseSectionFlags;
+
+typedef struct DatabaseFileSection {
+    uint32_t type;
+    // flags: encoding of the section content, sections with unknown flags can't be loaded
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t checksum;
+    // param: additional information depending on the type, e.g. the sort order
+    uint32_t param;
+} DatabaseFileSection;
+
+G_STATIC_ASSERT(sizeof(DatabaseFileSection) == 32);
+
+#define DATABASE_FILE_HEADER_SIZE 8
+#define DATABASE_FILE_TOC_HEADER_SIZE 8
+#define DATABASE_FILE_TRAILER_SIZE 16
+// sections of at least this size get their checksum computed on their own thread
+#define DATABASE_FILE_PARALLEL_CHECKSUM_SIZE (1 << 20)
+#define DATABASE_FILE_RESTART_INTERVAL 1024
+// database index, name offset and length, name, size, modification time and parent index
+#define DATABASE_FILE_MAX_ENTRY_SIZE (2 + 2 + 255 + 8 + 8 + 4)
+#define DATABASE_FILE_WRITE_BUFFER_SIZE (1 << 20)
+// nice value of the thread saving the database in the background
+#define DATABASE_SAVE_THREAD_NICE 10
+
+// The sorted arrays of the database at one point in time. A generation is never modified once it's published, changes
+// to the database publish a new one instead, so readers can use it without holding the database lock. The arrays are
+// shared with the database and with other generations.
+struct FsearchDatabaseGeneration {
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    FsearchTrigramIndex *file_trigram_index;
+    FsearchTrigramIndex *folder_trigram_index;
+    // id: unique among the generations of all databases
+    uint32_t id;
+
+    volatile int ref_count;
+};
+
+// db_generation_last_id: id of the generation which was created last
+static volatile int db_generation_last_id = 0;
+
 struct FsearchDatabase {
+    // sorted_files, sorted_folders: the arrays writers work on, they're only accessed with the database locked
     DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
     DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    // generation: the arrays readers see, replaced once writers are done with their changes
+    FsearchDatabaseGeneration *generation;
+    // generation_mutex: only held to swap or reference the generation and to track which sorted arrays are in use, so
+    // readers never wait for writers
+    GMutex generation_mutex;
 
-    FsearchMemoryPool *file_pool;
-    FsearchMemoryPool *folder_pool;
+    FsearchDatabaseEntryStore *file_store;
+    FsearchDatabaseEntryStore *folder_store;
+    FsearchStringArena *name_arena;
 
     GList *db_views;
     FsearchThreadPool *thread_pool;
@@ -70,6 +163,43 @@ struct FsearchDatabase {
 
     bool exclude_hidden;
     time_t timestamp;
+    // scan_timestamp: time when the file system scan started, folders modified later than that might be incomplete
+    time_t scan_timestamp;
+
+    // num_scan_threads: number of threads walking the file system, 1 selects the sequential walker
+    uint32_t num_scan_threads;
+    // scan_queue_depth: number of concurrent metadata requests per scan thread, 0 disables io_uring
+    uint32_t scan_queue_depth;
+    // previous: database of an earlier scan whose unchanged folders get reused by the next scan
+    FsearchDatabase *previous;
+
+    // sort_queue: builds the sorted arrays of the secondary sort types once they're requested
+    FsearchTaskQueue *sort_queue;
+    // sorted_entries_pending: sort types which are queued to be built
+    bool sorted_entries_pending[NUM_DATABASE_INDEX_TYPES];
+    // sorted_entries_last_used: monotonic time when the sorted arrays were requested last
+    int64_t sorted_entries_last_used[NUM_DATABASE_INDEX_TYPES];
+    // sorted_entries_memory_limit: number of bytes the sorted arrays of the secondary sort types may take, 0 for no
+    // limit
+    size_t sorted_entries_memory_limit;
+
+    // compress: store the folders and files compressed when saving the database
+    bool compress;
+    // save_mutex: held while the database file is written
+    GMutex save_mutex;
+
+    // trigram_index: build trigram indexes of the file and folder names, which searches use to skip names
+    bool trigram_index;
+    // trigram_index_pending: a build of the trigram indexes is queued on the sort queue
+    bool trigram_index_pending;
+    // file_trigram_index, folder_trigram_index: the indexes of the entries of the file and folder store, entries which
+    // were allocated after they were built aren't covered by them
+    FsearchTrigramIndex *file_trigram_index;
+    FsearchTrigramIndex *folder_trigram_index;
+
+    // num_folded_files, num_folded_folders: number of entries of the file and folder store whose folded names are set
+    uint32_t num_folded_files;
+    uint32_t num_folded_folders;
 
     volatile int ref_count;
 
@@ -80,6 +210,8 @@ enum {
     WALK_OK = 0,
     WALK_BADIO,
     WALK_CANCEL,
+    // the entry store or the name arena have no room left for more entries
+    WALK_NOSPACE,
 };
 
 bool
@@ -102,6 +234,77 @@ db_unregister_view(FsearchDatabase *db, gpointer view) {
     return true;
 }
 
+static FsearchDatabaseGeneration *
+db_generation_new(FsearchDatabase *db) {
+    FsearchDatabaseGeneration *generation = calloc(1, sizeof(FsearchDatabaseGeneration));
+    assert(generation != NULL);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        generation->sorted_files[i] = darray_ref(db->sorted_files[i]);
+        generation->sorted_folders[i] = darray_ref(db->sorted_folders[i]);
+    }
+    generation->file_trigram_index = fsearch_trigram_index_ref(db->file_trigram_index);
+    generation->folder_trigram_index = fsearch_trigram_index_ref(db->folder_trigram_index);
+    generation->id = (uint32_t)g_atomic_int_add(&db_generation_last_id, 1) + 1;
+    generation->ref_count = 1;
+    return generation;
+}
+
+FsearchDatabaseGeneration *
+db_generation_ref(FsearchDatabaseGeneration *generation) {
+    if (!generation || generation->ref_count <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&generation->ref_count);
+    return generation;
+}
+
+void
+db_generation_unref(FsearchDatabaseGeneration *generation) {
+    if (!generation || generation->ref_count <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&generation->ref_count)) {
+        for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+            g_clear_pointer(&generation->sorted_files[i], darray_unref);
+            g_clear_pointer(&generation->sorted_folders[i], darray_unref);
+        }
+        g_clear_pointer(&generation->file_trigram_index, fsearch_trigram_index_unref);
+        g_clear_pointer(&generation->folder_trigram_index, fsearch_trigram_index_unref);
+        g_clear_pointer(&generation, free);
+    }
+}
+
+// Makes the current state of the sorted arrays visible to readers. Must be called by the writer which changed them,
+// after it's done with its changes. From then on the entries are read-only, later changes modify copies of them.
+static void
+db_publish_generation(FsearchDatabase *db) {
+    db_entry_store_publish(db->folder_store);
+    db_entry_store_publish(db->file_store);
+    FsearchDatabaseGeneration *generation = db_generation_new(db);
+
+    g_mutex_lock(&db->generation_mutex);
+    FsearchDatabaseGeneration *previous = g_steal_pointer(&db->generation);
+    db->generation = generation;
+    g_mutex_unlock(&db->generation_mutex);
+
+    // readers which still work with the previous generation hold their own reference
+    g_clear_pointer(&previous, db_generation_unref);
+}
+
+uint32_t
+db_generation_get_id(FsearchDatabaseGeneration *generation) {
+    return generation ? generation->id : 0;
+}
+
+FsearchDatabaseGeneration *
+db_get_generation(FsearchDatabase *db) {
+    assert(db != NULL);
+    g_mutex_lock(&db->generation_mutex);
+    FsearchDatabaseGeneration *generation = db_generation_ref(db->generation);
+    g_mutex_unlock(&db->generation_mutex);
+    return generation;
+}
+
 static void
 db_sorted_entries_free(FsearchDatabase *db) {
     for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
@@ -110,26 +313,262 @@ db_sorted_entries_free(FsearchDatabase *db) {
     }
 }
 
+static size_t
+db_sorted_entries_get_size(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    size_t num_items = 0;
+    // arrays which are shared with the name index don't take up any additional memory
+    if (db->sorted_folders[sort_type]
+        && db->sorted_folders[sort_type] != db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
+        num_items += darray_get_num_items(db->sorted_folders[sort_type]);
+    }
+    if (db->sorted_files[sort_type] && db->sorted_files[sort_type] != db->sorted_files[DATABASE_INDEX_TYPE_NAME]) {
+        num_items += darray_get_num_items(db->sorted_files[sort_type]);
+    }
+    return num_items * sizeof(void *);
+}
+
+static void
+db_sorted_entries_evict(FsearchDatabase *db, FsearchDatabaseIndexType keep_sort_type) {
+    if (db->sorted_entries_memory_limit == 0) {
+        return;
+    }
+    // readers update the usage times without holding the database lock
+    int64_t last_used[NUM_DATABASE_INDEX_TYPES];
+    g_mutex_lock(&db->generation_mutex);
+    memcpy(last_used, db->sorted_entries_last_used, sizeof(last_used));
+    g_mutex_unlock(&db->generation_mutex);
+
+    while (true) {
+        size_t size = 0;
+        FsearchDatabaseIndexType lru_sort_type = NUM_DATABASE_INDEX_TYPES;
+        for (FsearchDatabaseIndexType i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+            // the name index is needed for everything else, so it's never dropped
+            if (i == DATABASE_INDEX_TYPE_NAME || !db->sorted_folders[i]) {
+                continue;
+            }
+            size += db_sorted_entries_get_size(db, i);
+            if (i != keep_sort_type
+                && (lru_sort_type == NUM_DATABASE_INDEX_TYPES
+                    || last_used[i] < last_used[lru_sort_type])) {
+                lru_sort_type = i;
+            }
+        }
+        if (size <= db->sorted_entries_memory_limit || lru_sort_type == NUM_DATABASE_INDEX_TYPES) {
+            break;
+        }
+        // views might still hold references to the arrays, they stay valid until those are gone
+        g_debug("[db_sort] dropping sorted arrays of type %d", lru_sort_type);
+        g_clear_pointer(&db->sorted_folders[lru_sort_type], darray_unref);
+        g_clear_pointer(&db->sorted_files[lru_sort_type], darray_unref);
+    }
+}
+
+static bool
+db_can_build_sorted_entries(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_PATH:
+    case DATABASE_INDEX_TYPE_EXTENSION:
+        return true;
+    case DATABASE_INDEX_TYPE_SIZE:
+        return (db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return (db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0;
+    default:
+        return false;
+    }
+}
+
+static DynamicArray *
+db_build_sorted_array(DynamicArray *entries, DynamicArray *folders, FsearchDatabaseIndexType sort_type) {
+    DynamicArray *sorted = darray_copy(entries);
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_PATH:
+        db_entry_sort_entries_by_path(sorted, folders);
+        break;
+    case DATABASE_INDEX_TYPE_SIZE:
+        darray_sort_multi_threaded(sorted, (DynamicArrayCompareFunc)db_entry_compare_entries_by_size);
+        break;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        darray_sort_multi_threaded(sorted, (DynamicArrayCompareFunc)db_entry_compare_entries_by_modification_time);
+        break;
+    case DATABASE_INDEX_TYPE_EXTENSION:
+        db_entry_sort_entries_by_extension(sorted);
+        break;
+    default:
+        g_clear_pointer(&sorted, darray_unref);
+        break;
+    }
+    return sorted;
+}
+
+static void
+db_build_sorted_entries(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files || db->sorted_folders[sort_type] || !db_can_build_sorted_entries(db, sort_type)) {
+        return;
+    }
+
+    GTimer *timer = g_timer_new();
+
+    db->sorted_files[sort_type] = db_build_sorted_array(files, folders, sort_type);
+    if (sort_type == DATABASE_INDEX_TYPE_EXTENSION) {
+        // Folders don't have a file extension -> use the name array instead
+        db->sorted_folders[sort_type] = darray_ref(folders);
+    }
+    else {
+        db->sorted_folders[sort_type] = db_build_sorted_array(folders, folders, sort_type);
+    }
+    g_mutex_lock(&db->generation_mutex);
+    db->sorted_entries_last_used[sort_type] = g_get_monotonic_time();
+    g_mutex_unlock(&db->generation_mutex);
+
+    g_debug("[db_sort] built sorted arrays of type %d in %f s", sort_type, g_timer_elapsed(timer, NULL));
+    g_clear_pointer(&timer, g_timer_destroy);
+
+    db_sorted_entries_evict(db, sort_type);
+}
+
+typedef struct DatabaseSortTask {
+    FsearchDatabase *db;
+    FsearchDatabaseIndexType sort_type;
+} DatabaseSortTask;
+
+static gpointer
+db_sort_task(gpointer data, GCancellable *cancellable) {
+    DatabaseSortTask *task = data;
+    FsearchDatabase *db = task->db;
+
+    db_lock(db);
+    if (!g_cancellable_is_cancelled(cancellable)) {
+        db_build_sorted_entries(db, task->sort_type);
+        db_publish_generation(db);
+    }
+    db_unlock(db);
+
+    // only cleared once the arrays are published, to not queue another build of them in the meantime
+    g_mutex_lock(&db->generation_mutex);
+    db->sorted_entries_pending[task->sort_type] = false;
+    g_mutex_unlock(&db->generation_mutex);
+
+    return NULL;
+}
+
+static void
+db_sort_task_cancelled(gpointer data) {
+    DatabaseSortTask *task = data;
+    g_clear_pointer(&task, free);
+}
+
+static void
+db_sort_task_finished(gpointer result, gpointer data) {
+    db_sort_task_cancelled(data);
+}
+
+typedef struct DatabaseTrigramIndexTask {
+    FsearchDatabase *db;
+} DatabaseTrigramIndexTask;
+
+static gpointer
+db_trigram_index_task(gpointer data, GCancellable *cancellable) {
+    DatabaseTrigramIndexTask *task = data;
+    FsearchDatabase *db = task->db;
+
+    db_lock(db);
+    const bool enabled = db->trigram_index && !g_cancellable_is_cancelled(cancellable);
+    const uint32_t num_files = db_entry_store_get_num_entries(db->file_store);
+    const uint32_t num_folders = db_entry_store_get_num_entries(db->folder_store);
+    db_unlock(db);
+
+    FsearchTrigramIndex *file_index = NULL;
+    FsearchTrigramIndex *folder_index = NULL;
+    if (enabled) {
+        // entries which were allocated already never change their name, so they can be indexed without holding the
+        // lock while changes add new ones
+        GTimer *timer = g_timer_new();
+        file_index = fsearch_trigram_index_new(db->file_store, num_files);
+        folder_index = fsearch_trigram_index_new(db->folder_store, num_folders);
+        g_debug("[db_trigram_index] indexed %d files and %d folders in %f s (%zu bytes)",
+                num_files,
+                num_folders,
+                g_timer_elapsed(timer, NULL),
+                fsearch_trigram_index_get_size(file_index) + fsearch_trigram_index_get_size(folder_index));
+        g_clear_pointer(&timer, g_timer_destroy);
+    }
+
+    db_lock(db);
+    if (enabled && db->trigram_index && !g_cancellable_is_cancelled(cancellable)) {
+        g_clear_pointer(&db->file_trigram_index, fsearch_trigram_index_unref);
+        g_clear_pointer(&db->folder_trigram_index, fsearch_trigram_index_unref);
+        db->file_trigram_index = g_steal_pointer(&file_index);
+        db->folder_trigram_index = g_steal_pointer(&folder_index);
+        db_publish_generation(db);
+    }
+    db_unlock(db);
+
+    g_clear_pointer(&file_index, fsearch_trigram_index_unref);
+    g_clear_pointer(&folder_index, fsearch_trigram_index_unref);
+
+    g_mutex_lock(&db->generation_mutex);
+    db->trigram_index_pending = false;
+    g_mutex_unlock(&db->generation_mutex);
+
+    return NULL;
+}
+
+static void
+db_trigram_index_task_cancelled(gpointer data) {
+    DatabaseTrigramIndexTask *task = data;
+    g_clear_pointer(&task, free);
+}
+
+static void
+db_trigram_index_task_finished(gpointer result, gpointer data) {
+    db_trigram_index_task_cancelled(data);
+}
+
+// Queues a build of the trigram indexes of all entries on the sort queue, unless one is queued already
 static void
-db_sort_entries(FsearchDatabase *db, DynamicArray *entries, DynamicArray **sorted_entries) {
-    // first sort by path
-    darray_sort_multi_threaded(entries, (DynamicArrayCompareFunc)db_entry_compare_entries_by_path);
-    sorted_entries[DATABASE_INDEX_TYPE_PATH] = darray_copy(entries);
+db_request_trigram_index(FsearchDatabase *db) {
+    if (!db->trigram_index) {
+        return;
+    }
+
+    g_mutex_lock(&db->generation_mutex);
+    if (!db->trigram_index_pending) {
+        if (!db->sort_queue) {
+            db->sort_queue = fsearch_task_queue_new("fsearch_db_sort_queue");
+        }
 
-    // then by name
-    darray_sort(entries, (DynamicArrayCompareFunc)db_entry_compare_entries_by_name);
+        DatabaseTrigramIndexTask *task = calloc(1, sizeof(DatabaseTrigramIndexTask));
+        assert(task != NULL);
+        task->db = db;
 
-    // now build individual lists sorted by all of the indexed metadata
-    if ((db->index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
-        sorted_entries[DATABASE_INDEX_TYPE_SIZE] = darray_copy(entries);
-        darray_sort_multi_threaded(sorted_entries[DATABASE_INDEX_TYPE_SIZE],
-                                   (DynamicArrayCompareFunc)db_entry_compare_entries_by_size);
+        db->trigram_index_pending = true;
+        fsearch_task_queue(db->sort_queue,
+                           FSEARCH_TASK_ID_TRIGRAM_INDEX,
+                           db_trigram_index_task,
+                           db_trigram_index_task_finished,
+                           db_trigram_index_task_cancelled,
+                           FSEARCH_TASK_CLEAR_NONE,
+                           g_steal_pointer(&task));
     }
+    g_mutex_unlock(&db->generation_mutex);
+}
 
-    if ((db->index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
-        sorted_entries[DATABASE_INDEX_TYPE_MODIFICATION_TIME] = darray_copy(entries);
-        darray_sort_multi_threaded(sorted_entries[DATABASE_INDEX_TYPE_MODIFICATION_TIME],
-                                   (DynamicArrayCompareFunc)db_entry_compare_entries_by_modification_time);
+// Entries which were added after the trigram indexes were built have to be compared with every query, so the
+// indexes are built again once those make up a noticeable part of the database
+static void
+db_update_trigram_index(FsearchDatabase *db) {
+    if (!db->trigram_index || !db->file_trigram_index || !db->folder_trigram_index) {
+        return;
+    }
+    const uint32_t num_indexed = fsearch_trigram_index_get_num_entries(db->file_trigram_index)
+                               + fsearch_trigram_index_get_num_entries(db->folder_trigram_index);
+    const uint32_t num_entries =
+        db_entry_store_get_num_entries(db->file_store) + db_entry_store_get_num_entries(db->folder_store);
+    if (num_entries - num_indexed > num_indexed / 16) {
+        db_request_trigram_index(db);
     }
 }
 
@@ -139,34 +578,35 @@ db_sort(FsearchDatabase *db) {
 
     GTimer *timer = g_timer_new();
 
-    // first we sort all the files
+    // the path order is derived from the folder tree, which is built from the folders sorted by name
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *folders_by_name = folders ? darray_copy(folders) : NULL;
+    if (folders_by_name) {
+        db_entry_sort_entries_by_name(folders_by_name);
+    }
+
+    // entries with the same name are sorted by path, all other sort types (including the path) are built when
+    // they're requested for the first time
     DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
     if (files) {
-        db_sort_entries(db, files, db->sorted_files);
-
-        // now build extension sort array
-        db->sorted_files[DATABASE_INDEX_TYPE_EXTENSION] = darray_copy(files);
-        darray_sort_multi_threaded(db->sorted_files[DATABASE_INDEX_TYPE_EXTENSION],
-                                   (DynamicArrayCompareFunc)db_entry_compare_entries_by_extension);
+        db_entry_sort_entries_by_name_and_path(files, folders_by_name);
 
         const double seconds = g_timer_elapsed(timer, NULL);
         g_timer_reset(timer);
         g_debug("[db_sort] sorted files: %f s", seconds);
     }
 
-    // then we sort all the folders
-    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
     if (folders) {
-        db_sort_entries(db, folders, db->sorted_folders);
-
-        // Folders don't have a file extension -> use the name array instead
-        db->sorted_folders[DATABASE_INDEX_TYPE_EXTENSION] = darray_ref(folders);
+        db_entry_sort_entries_by_name_and_path(folders, folders_by_name);
 
         const double seconds = g_timer_elapsed(timer, NULL);
         g_debug("[db_sort] sorted folders: %f s", seconds);
     }
 
+    g_clear_pointer(&folders_by_name, darray_unref);
     g_clear_pointer(&timer, g_timer_destroy);
+
+    db_sorted_entries_evict(db, DATABASE_INDEX_TYPE_NAME);
 }
 
 static void
@@ -175,21 +615,6 @@ db_update_timestamp(FsearchDatabase *db) {
     db->timestamp = time(NULL);
 }
 
-static void
-db_entry_update_folder_indices(FsearchDatabase *db) {
-    if (!db || !db->sorted_folders[DATABASE_INDEX_TYPE_NAME]) {
-        return;
-    }
-    const uint32_t num_folders = darray_get_num_items(db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
-    for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntryFolder *folder = darray_get_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], i);
-        if (!folder) {
-            continue;
-        }
-        db_entry_set_idx((FsearchDatabaseEntry *)folder, i);
-    }
-}
-
 static uint8_t
 get_name_offset(const char *old, const char *new) {
     if (!old || !new) {
@@ -221,33 +646,247 @@ db_file_open_locked(const char *file_path, const char *mode) {
     return file_pointer;
 }
 
+typedef struct DatabaseFileMapping {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} DatabaseFileMapping;
+
+static bool
+db_file_mapping_open(DatabaseFileMapping *mapping, FILE *fp) {
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0) {
+        g_debug("[db_load] failed to stat database file");
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (data == MAP_FAILED) {
+        g_debug("[db_load] failed to map database file");
+        return false;
+    }
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    mapping->data = data;
+    mapping->size = st.st_size;
+    mapping->pos = 0;
+    return true;
+}
+
+static void
+db_file_mapping_close(DatabaseFileMapping *mapping) {
+    if (mapping->data) {
+        munmap((void *)mapping->data, mapping->size);
+    }
+    mapping->data = NULL;
+    mapping->size = 0;
+    mapping->pos = 0;
+}
+
+static bool
+db_file_mapping_read(DatabaseFileMapping *mapping, void *dest, size_t size) {
+    if (size > mapping->size - mapping->pos) {
+        return false;
+    }
+    memcpy(dest, mapping->data + mapping->pos, size);
+    mapping->pos += size;
+    return true;
+}
+
+static const uint8_t *
+db_file_mapping_get_block(DatabaseFileMapping *mapping, uint64_t size) {
+    if (size > mapping->size - mapping->pos) {
+        return NULL;
+    }
+    const uint8_t *block = mapping->data + mapping->pos;
+    mapping->pos += size;
+    return block;
+}
+
+typedef struct DatabaseEntryBlocks {
+    const uint8_t *data;
+    // offsets: start of each block relative to data, followed by the size of all blocks
+    uint64_t *offsets;
+    // sizes: uncompressed size of each block, NULL if the blocks aren't compressed
+    uint64_t *sizes;
+    uint32_t num_blocks;
+    uint32_t interval;
+} DatabaseEntryBlocks;
+
+static uint32_t
+db_entry_blocks_get_num_workers(FsearchThreadPool *pool, uint32_t num_blocks, uint32_t *blocks_per_worker) {
+    const uint32_t num_threads = pool ? MAX(fsearch_thread_pool_get_num_threads(pool), 1) : 1;
+    *blocks_per_worker = MAX((num_blocks + num_threads - 1) / num_threads, 1);
+    return MAX((num_blocks + *blocks_per_worker - 1) / *blocks_per_worker, 1);
+}
+
+static void
+db_thread_pool_run(FsearchThreadPool *pool, FsearchThreadPoolFunc func, gpointer *data, uint32_t num_data) {
+    if (!pool || num_data < 2) {
+        for (uint32_t i = 0; i < num_data; i++) {
+            func(data[i]);
+        }
+        return;
+    }
+    fsearch_thread_pool_lock(pool);
+    GList *threads = fsearch_thread_pool_get_threads(pool);
+    for (uint32_t i = 0; i < num_data && threads; i++) {
+        fsearch_thread_pool_push_data(pool, threads, func, data[i]);
+        threads = threads->next;
+    }
+    threads = fsearch_thread_pool_get_threads(pool);
+    while (threads) {
+        fsearch_thread_pool_wait_for_thread(pool, threads);
+        threads = threads->next;
+    }
+    fsearch_thread_pool_unlock(pool);
+}
+
+// entries which are folded by one worker at least, fewer aren't worth waking up another thread
+#define DATABASE_FOLD_NAMES_MIN_WORKER_SIZE 8192
+
+typedef struct DatabaseFoldNamesWorker {
+    FsearchDatabaseEntryStore *store;
+    uint32_t start;
+    uint32_t end;
+    // folded_names: the null terminated folded names of the entries from start to end, empty for names which don't
+    // need one
+    GString *folded_names;
+} DatabaseFoldNamesWorker;
+
+static void
+db_fold_names_worker(void *data) {
+    DatabaseFoldNamesWorker *worker = data;
+
+    UErrorCode status = U_ZERO_ERROR;
+    // tokens fold their text with the same options, unless the locale requires special handling of the dotted I
+    UCaseMap *case_map = ucasemap_open("", U_FOLD_CASE_DEFAULT, &status);
+    const UNormalizer2 *normalizer = unorm2_getNFDInstance(&status);
+    assert(U_SUCCESS(status));
+
+    FsearchUtfConversionBuffer buffer = {};
+    fsearch_utf_conversion_buffer_init(&buffer, 4 * PATH_MAX);
+    char folded_name[FSEARCH_STRING_ARENA_MAX_STRING_SIZE];
+
+    for (uint32_t id = worker->start; id < worker->end; id++) {
+        FsearchDatabaseEntry *entry = db_entry_store_get_entry(worker->store, id);
+        const char *name = db_entry_get_name_raw(entry);
+        // pure ASCII names are folded by lowering the case of their letters and are already normalized,
+        // copies of entries keep the folded name of the entry they were made from
+        if (!db_entry_has_ascii_name(entry) && !db_entry_get_folded_name(entry)
+            && fsearch_utf_normalize_and_fold_case(normalizer, case_map, &buffer, name)) {
+            const int32_t folded_len = fsearch_utf_normalized_folded_to_utf8(&buffer, folded_name, sizeof(folded_name));
+            if (folded_len >= 0
+                && ((size_t)folded_len != strlen(name) || g_ascii_strncasecmp(folded_name, name, folded_len) != 0)) {
+                g_string_append_len(worker->folded_names, folded_name, folded_len);
+            }
+        }
+        g_string_append_c(worker->folded_names, '\0');
+    }
+
+    fsearch_utf_conversion_buffer_clear(&buffer);
+    g_clear_pointer(&case_map, ucasemap_close);
+}
+
+static bool
+db_fold_names_of_store(FsearchDatabase *db, FsearchDatabaseEntryStore *store, uint32_t *num_folded) {
+    const uint32_t num_entries = db_entry_store_get_num_entries(store);
+    if (*num_folded >= num_entries) {
+        return true;
+    }
+
+    const uint32_t num_threads = db->thread_pool ? MAX(fsearch_thread_pool_get_num_threads(db->thread_pool), 1) : 1;
+    const uint32_t num_workers =
+        CLAMP((num_entries - *num_folded) / DATABASE_FOLD_NAMES_MIN_WORKER_SIZE, 1, num_threads);
+    const uint32_t entries_per_worker = (num_entries - *num_folded + num_workers - 1) / num_workers;
+
+    DatabaseFoldNamesWorker **workers = calloc(num_workers, sizeof(DatabaseFoldNamesWorker *));
+    assert(workers != NULL);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers[i] = calloc(1, sizeof(DatabaseFoldNamesWorker));
+        assert(workers[i] != NULL);
+        workers[i]->store = store;
+        workers[i]->start = *num_folded + i * entries_per_worker;
+        workers[i]->end = MIN(workers[i]->start + entries_per_worker, num_entries);
+        workers[i]->folded_names = g_string_sized_new(workers[i]->end - workers[i]->start);
+    }
+    db_thread_pool_run(db->thread_pool, db_fold_names_worker, (gpointer *)workers, num_workers);
+
+    // the name arena can't be shared between threads, so the folded names are added here
+    bool res = true;
+    for (uint32_t i = 0; i < num_workers; i++) {
+        DatabaseFoldNamesWorker *worker = workers[i];
+        const char *folded_name = worker->folded_names->str;
+        for (uint32_t id = worker->start; id < worker->end && res; id++) {
+            if (folded_name[0] != '\0') {
+                res = db_entry_set_folded_name(db_entry_store_get_entry(store, id), folded_name);
+            }
+            folded_name += strlen(folded_name) + 1;
+        }
+        g_string_free(g_steal_pointer(&worker->folded_names), TRUE);
+        g_clear_pointer(&workers[i], free);
+    }
+    g_clear_pointer(&workers, free);
+
+    *num_folded = num_entries;
+    return res;
+}
+
+// Sets the folded names of all entries which were allocated since the last call, so searches can match them without
+// folding them again. Has to be called before those entries get published. Returns false when the name arena ran out
+// of space for them.
+static bool
+db_fold_names(FsearchDatabase *db) {
+    GTimer *timer = g_timer_new();
+    const uint32_t num_folded = db->num_folded_files + db->num_folded_folders;
+    bool res = db_fold_names_of_store(db, db->folder_store, &db->num_folded_folders);
+    res = db_fold_names_of_store(db, db->file_store, &db->num_folded_files) && res;
+    if (db->num_folded_files + db->num_folded_folders != num_folded) {
+        g_debug("[db_fold_names] folded %d names in %f s",
+                db->num_folded_files + db->num_folded_folders - num_folded,
+                g_timer_elapsed(timer, NULL));
+    }
+    g_clear_pointer(&timer, g_timer_destroy);
+    return res;
+}
+
 static const uint8_t *
 db_load_entry_shared_from_memory(const uint8_t *data_block,
+                                 const uint8_t *data_block_end,
                                  FsearchDatabaseIndexFlags index_flags,
                                  FsearchDatabaseEntry *entry,
-                                 GString *previous_entry_name) {
+                                 char *previous_entry_name,
+                                 size_t previous_entry_name_size,
+                                 uint32_t *previous_entry_name_len) {
+    if (data_block_end - data_block < 2) {
+        return NULL;
+    }
     // name_offset: character position after which previous_entry_name and entry_name differ
-    uint8_t name_offset = *data_block++;
+    const uint8_t name_offset = *data_block++;
 
     // name_len: length of the new name characters
-    uint8_t name_len = *data_block++;
-
-    // erase previous name starting at name_offset
-    g_string_erase(previous_entry_name, name_offset, -1);
+    const uint8_t name_len = *data_block++;
 
-    char name[256] = "";
-    // name: new characters to be appended to previous_entry_name
-    if (name_len > 0) {
-        memcpy(name, data_block, name_len);
-        name[name_len] = '\0';
+    if (name_offset > *previous_entry_name_len || data_block_end - data_block < name_len) {
+        return NULL;
+    }
+    if ((size_t)name_offset + name_len >= previous_entry_name_size) {
+        // the name and its terminator don't fit, which only happens with a corrupted file
+        return NULL;
     }
-    data_block += name_len;
 
-    // now we can build the new full file name
-    g_string_append(previous_entry_name, name);
-    db_entry_set_name(entry, previous_entry_name->str);
+    // now we can build the new full file name:
+    // the previous name up to name_offset followed by the new characters
+    // the name itself is added to the entry by the caller, because the name arena can't be shared between threads
+    memcpy(previous_entry_name + name_offset, data_block, name_len);
+    *previous_entry_name_len = name_offset + name_len;
+    previous_entry_name[*previous_entry_name_len] = '\0';
+    data_block += name_len;
 
     if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+        if (data_block_end - data_block < 8) {
+            return NULL;
+        }
         // size: size of file/folder
         off_t size = 0;
         memcpy(&size, data_block, 8);
@@ -257,6 +896,9 @@ db_load_entry_shared_from_memory(const uint8_t *data_block,
     }
 
     if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+        if (data_block_end - data_block < 8) {
+            return NULL;
+        }
         // mtime: modification time file/folder
         time_t mtime = 0;
         memcpy(&mtime, data_block, 8);
@@ -268,54 +910,152 @@ db_load_entry_shared_from_memory(const uint8_t *data_block,
     return data_block;
 }
 
-static bool
-db_load_entry_shared(FILE *fp, FsearchDatabaseEntry *entry, GString *previous_entry_name) {
-    // name_offset: character position after which previous_entry_name and entry_name differ
-    uint8_t name_offset = 0;
-    if (fread(&name_offset, 1, 1, fp) != 1) {
-        g_debug("[db_load] failed to load name offset");
-        return false;
-    }
+static uint32_t crc32_table[8][256];
 
-    // name_len: length of the new name characters
-    uint8_t name_len = 0;
-    if (fread(&name_len, 1, 1, fp) != 1) {
-        g_debug("[db_load] failed to load name length");
-        return false;
+static void
+crc32_table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (uint32_t j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+        crc32_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (uint32_t j = 1; j < 8; j++) {
+            crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^ crc32_table[0][crc32_table[j - 1][i] & 0xff];
+        }
     }
+}
 
-    // erase previous name starting at name_offset
-    g_string_erase(previous_entry_name, name_offset, -1);
+static uint32_t
+db_file_crc32(const uint8_t *data, uint64_t size) {
+    static gsize table_initialized = 0;
+    if (g_once_init_enter(&table_initialized)) {
+        crc32_table_init();
+        g_once_init_leave(&table_initialized, 1);
+    }
 
-    char name[256] = "";
-    // name: new characters to be appended to previous_entry_name
-    if (name_len > 0) {
-        if (fread(name, name_len, 1, fp) != 1) {
-            g_debug("[db_load] failed to load name");
-            return false;
-        }
-        name[name_len] = '\0';
+    // CRC-32 (as used by zlib), processing eight bytes per step
+    uint32_t crc = 0xffffffff;
+    while (size >= 8) {
+        crc ^= (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+        crc = crc32_table[7][crc & 0xff] ^ crc32_table[6][(crc >> 8) & 0xff] ^ crc32_table[5][(crc >> 16) & 0xff]
+            ^ crc32_table[4][crc >> 24] ^ crc32_table[3][data[4]] ^ crc32_table[2][data[5]] ^ crc32_table[1][data[6]]
+            ^ crc32_table[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xff];
     }
+    return ~crc;
+}
 
-    // now we can build the new full file name
-    g_string_append(previous_entry_name, name);
-    db_entry_set_name(entry, previous_entry_name->str);
+typedef struct DatabaseFileChecksum {
+    const uint8_t *data;
+    uint64_t size;
+    uint32_t checksum;
+} DatabaseFileChecksum;
+
+static gpointer
+db_file_checksum_thread(gpointer data) {
+    DatabaseFileChecksum *checksum = data;
+    checksum->checksum = db_file_crc32(checksum->data, checksum->size);
+    return NULL;
+}
 
-    // size: size of file/folder
-    uint64_t size = 0;
-    if (fread(&size, 8, 1, fp) != 1) {
-        g_debug("[db_load] failed to load size");
-        return false;
+static void
+db_file_compute_checksums(DatabaseFileChecksum *checksums, uint32_t num_checksums) {
+    GThread **threads = calloc(num_checksums + 1, sizeof(GThread *));
+    assert(threads != NULL);
+
+    for (uint32_t i = 0; i < num_checksums; i++) {
+        if (checksums[i].size >= DATABASE_FILE_PARALLEL_CHECKSUM_SIZE) {
+            threads[i] = g_thread_new("fsearch_db_checksum", db_file_checksum_thread, &checksums[i]);
+        }
+        else {
+            db_file_checksum_thread(&checksums[i]);
+        }
     }
-    db_entry_set_size(entry, (off_t)size);
+    for (uint32_t i = 0; i < num_checksums; i++) {
+        if (threads[i]) {
+            g_thread_join(g_steal_pointer(&threads[i]));
+        }
+    }
+    g_clear_pointer(&threads, free);
+}
 
+static bool
+db_file_compress(GConverter *compressor, const uint8_t *data, size_t size, GByteArray *dest) {
+    g_converter_reset(compressor);
+
+    const size_t dest_start = dest->len;
+    size_t dest_pos = dest_start;
+    size_t data_pos = 0;
+    g_byte_array_set_size(dest, dest_start + size / 2 + 64);
+    while (true) {
+        gsize bytes_read = 0;
+        gsize bytes_written = 0;
+        GError *error = NULL;
+        const GConverterResult res = g_converter_convert(compressor,
+                                                         data + data_pos,
+                                                         size - data_pos,
+                                                         dest->data + dest_pos,
+                                                         dest->len - dest_pos,
+                                                         G_CONVERTER_INPUT_AT_END,
+                                                         &bytes_read,
+                                                         &bytes_written,
+                                                         &error);
+        data_pos += bytes_read;
+        dest_pos += bytes_written;
+        if (res == G_CONVERTER_FINISHED) {
+            break;
+        }
+        if (res == G_CONVERTER_ERROR && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+            g_debug("[db_save] failed to compress block: %s", error->message);
+            g_clear_pointer(&error, g_error_free);
+            g_byte_array_set_size(dest, dest_start);
+            return false;
+        }
+        g_clear_pointer(&error, g_error_free);
+        // the output buffer is full, grow it and continue where we left off
+        g_byte_array_set_size(dest, dest->len + dest->len / 2 + 64);
+    }
+    g_byte_array_set_size(dest, dest_pos);
     return true;
 }
 
 static bool
-db_load_header(FILE *fp) {
+db_file_decompress(GConverter *decompressor, const uint8_t *data, size_t size, GByteArray *dest, size_t dest_size) {
+    g_converter_reset(decompressor);
+
+    // the uncompressed size is known up front, so everything is decompressed in a single call
+    g_byte_array_set_size(dest, dest_size);
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+    GError *error = NULL;
+    const GConverterResult res = g_converter_convert(decompressor,
+                                                     data,
+                                                     size,
+                                                     dest->data,
+                                                     dest_size,
+                                                     G_CONVERTER_INPUT_AT_END,
+                                                     &bytes_read,
+                                                     &bytes_written,
+                                                     &error);
+    const bool success = res == G_CONVERTER_FINISHED && bytes_read == size && bytes_written == dest_size;
+    if (!success) {
+        g_debug("[db_load] failed to decompress block: %s", error ? error->message : "wrong size");
+    }
+    g_clear_pointer(&error, g_error_free);
+    return success;
+}
+
+static bool
+db_load_header(DatabaseFileMapping *mapping, uint8_t *majorver, uint8_t *minorver) {
     char magic[5] = "";
-    if (fread(magic, strlen(DATABASE_MAGIC_NUMBER), 1, fp) != 1) {
+    if (!db_file_mapping_read(mapping, magic, strlen(DATABASE_MAGIC_NUMBER))) {
         return false;
     }
     magic[4] = '\0';
@@ -324,227 +1064,311 @@ db_load_header(FILE *fp) {
         return false;
     }
 
-    uint8_t majorver = 0;
-    if (fread(&majorver, 1, 1, fp) != 1) {
+    if (!db_file_mapping_read(mapping, majorver, 1) || !db_file_mapping_read(mapping, minorver, 1)) {
         return false;
     }
-    if (majorver != DATABASE_MAJOR_VERSION) {
-        g_debug("[db_load] invalid major version: %d", majorver);
-        g_debug("[db_load] expected major version: %d", DATABASE_MAJOR_VERSION);
-        return false;
-    }
-
-    uint8_t minorver = 0;
-    if (fread(&minorver, 1, 1, fp) != 1) {
-        return false;
+    if (*majorver == DATABASE_MAJOR_VERSION && *minorver <= DATABASE_MINOR_VERSION) {
+        return true;
     }
-    if (minorver > DATABASE_MINOR_VERSION) {
-        g_debug("[db_load] invalid minor version: %d", minorver);
-        g_debug("[db_load] expected minor version: <= %d", DATABASE_MINOR_VERSION);
-        return false;
+    if (*majorver == DATABASE_LEGACY_MAJOR_VERSION && *minorver <= DATABASE_LEGACY_MINOR_VERSION) {
+        return true;
     }
-
-    return true;
+    g_debug("[db_load] unsupported version: %d.%d", *majorver, *minorver);
+    g_debug("[db_load] expected version: <= %d.%d", DATABASE_MAJOR_VERSION, DATABASE_MINOR_VERSION);
+    return false;
 }
 
 static bool
-db_load_parent_idx(FILE *fp, uint32_t *parent_idx) {
-    if (fread(parent_idx, 4, 1, fp) != 1) {
-        g_debug("[db_load] failed to load parent_idx");
-        return false;
+db_load_entry_blocks(const uint8_t *block,
+                     uint64_t block_size,
+                     uint32_t flags,
+                     uint32_t num_entries,
+                     DatabaseEntryBlocks *blocks) {
+    if ((flags & DATABASE_SECTION_FLAG_RESTART_POINTS) == 0) {
+        if ((flags & DATABASE_SECTION_FLAG_COMPRESSED) != 0) {
+            g_debug("[db_load] compressed sections need restart points");
+            return false;
+        }
+        // the whole block is front-coded in one go and has to be decoded serially
+        blocks->interval = MAX(num_entries, 1);
+        blocks->num_blocks = 1;
+        blocks->offsets = calloc(2, sizeof(uint64_t));
+        assert(blocks->offsets != NULL);
+        blocks->offsets[1] = block_size;
+        blocks->data = block;
+        return true;
+    }
+
+    if (block_size < 8) {
+        return false;
+    }
+    memcpy(&blocks->interval, block, 4);
+    memcpy(&blocks->num_blocks, block + 4, 4);
+    // bytes the index takes per block: its offset and, for compressed blocks, its uncompressed size
+    const uint64_t index_entry_size = (flags & DATABASE_SECTION_FLAG_COMPRESSED) != 0 ? 16 : 8;
+    if (blocks->interval == 0 || blocks->num_blocks != (num_entries + (uint64_t)blocks->interval - 1) / blocks->interval
+        || (block_size - 8) / index_entry_size < blocks->num_blocks) {
+        g_debug("[db_load] invalid restart points: %d blocks of %d entries", blocks->num_blocks, blocks->interval);
+        return false;
+    }
+    const uint64_t index_size = 8 + blocks->num_blocks * index_entry_size;
+    const uint64_t data_size = block_size - index_size;
+
+    blocks->offsets = calloc(blocks->num_blocks + 1, sizeof(uint64_t));
+    assert(blocks->offsets != NULL);
+    memcpy(blocks->offsets, block + 8, (size_t)blocks->num_blocks * 8);
+    blocks->offsets[blocks->num_blocks] = data_size;
+    blocks->data = block + index_size;
+
+    for (uint32_t i = 0; i < blocks->num_blocks; i++) {
+        if ((i == 0 && blocks->offsets[0] != 0) || blocks->offsets[i] > blocks->offsets[i + 1]) {
+            g_debug("[db_load] invalid restart point: %lu", blocks->offsets[i]);
+            return false;
+        }
+    }
+
+    if ((flags & DATABASE_SECTION_FLAG_COMPRESSED) != 0) {
+        blocks->sizes = calloc(blocks->num_blocks + 1, sizeof(uint64_t));
+        assert(blocks->sizes != NULL);
+        memcpy(blocks->sizes, block + 8 + (size_t)blocks->num_blocks * 8, (size_t)blocks->num_blocks * 8);
+        for (uint32_t i = 0; i < blocks->num_blocks; i++) {
+            if (blocks->sizes[i] > (uint64_t)blocks->interval * DATABASE_FILE_MAX_ENTRY_SIZE) {
+                g_debug("[db_load] invalid block size: %lu", blocks->sizes[i]);
+                return false;
+            }
+        }
     }
     return true;
 }
 
-static bool
-db_load_folders(FILE *fp,
-                FsearchDatabaseIndexFlags index_flags,
-                DynamicArray *folders,
-                uint32_t num_folders,
-                uint64_t folder_block_size) {
-    bool res = true;
-
-    GString *previous_entry_name = g_string_sized_new(256);
+typedef struct DatabaseLoadEntriesWorker {
+    const DatabaseEntryBlocks *blocks;
+    FsearchDatabaseIndexFlags index_flags;
+    FsearchDatabaseEntryType type;
+    DynamicArray *entries;
+    DynamicArray *folders;
+    uint32_t num_entries;
+    uint32_t block_start;
+    uint32_t block_end;
+    // names: the names of all decoded entries, separated by null characters
+    GString *names;
+    // decompressor, buffer: used to decompress one block at a time, if the blocks are compressed
+    GConverter *decompressor;
+    GByteArray *buffer;
+    bool failed;
+} DatabaseLoadEntriesWorker;
 
-    uint8_t *folder_block = calloc(folder_block_size + 1, sizeof(uint8_t));
-    assert(folder_block != NULL);
+static bool
+db_load_entry_block(DatabaseLoadEntriesWorker *worker, uint32_t block_idx) {
+    const DatabaseEntryBlocks *blocks = worker->blocks;
+    const uint8_t *fb = blocks->data + blocks->offsets[block_idx];
+    const uint8_t *block_end = blocks->data + blocks->offsets[block_idx + 1];
 
-    if (fread(folder_block, sizeof(uint8_t), folder_block_size, fp) != folder_block_size) {
-        g_debug("[db_load] failed to read file block");
-        goto out;
+    if (blocks->sizes) {
+        if (!db_file_decompress(worker->decompressor, fb, block_end - fb, worker->buffer, blocks->sizes[block_idx])) {
+            return false;
+        }
+        fb = worker->buffer->data;
+        block_end = fb + worker->buffer->len;
     }
 
-    const uint8_t *fb = folder_block;
-    // load folders
-    uint32_t idx = 0;
-    for (idx = 0; idx < num_folders; idx++) {
-        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, idx);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
+    // every block starts with a full name
+    char previous_entry_name[256] = "";
+    uint32_t previous_entry_name_len = 0;
+
+    const uint32_t start = block_idx * blocks->interval;
+    const uint32_t end = MIN((uint64_t)start + blocks->interval, worker->num_entries);
+    for (uint32_t idx = start; idx < end; idx++) {
+        FsearchDatabaseEntry *entry = darray_get_item(worker->entries, idx);
 
-        // TODO: db_index is currently unused
-        // db_index: the database index this folder belongs to
-        uint16_t db_index = 0;
-        memcpy(&db_index, fb, 2);
-        fb += 2;
+        if (worker->type == DATABASE_ENTRY_TYPE_FOLDER) {
+            if (block_end - fb < 2) {
+                return false;
+            }
+            // TODO: db_index is currently unused
+            // db_index: the database index this folder belongs to
+            uint16_t db_index = 0;
+            memcpy(&db_index, fb, 2);
+            fb += 2;
+        }
 
-        fb = db_load_entry_shared_from_memory(fb, index_flags, entry, previous_entry_name);
+        fb = db_load_entry_shared_from_memory(fb,
+                                              block_end,
+                                              worker->index_flags,
+                                              entry,
+                                              previous_entry_name,
+                                              sizeof(previous_entry_name),
+                                              &previous_entry_name_len);
+        if (!fb || block_end - fb < 4) {
+            return false;
+        }
+        g_string_append_len(worker->names, previous_entry_name, previous_entry_name_len + 1);
 
         // parent_idx: index of parent folder
         uint32_t parent_idx = 0;
         memcpy(&parent_idx, fb, 4);
         fb += 4;
 
-        if (parent_idx != db_entry_get_idx(entry)) {
-            FsearchDatabaseEntryFolder *parent = darray_get_item(folders, parent_idx);
-            db_entry_set_parent(entry, parent);
-        }
-        else {
+        if (worker->type == DATABASE_ENTRY_TYPE_FOLDER && parent_idx == idx) {
             // parent_idx and idx are the same (i.e. folder is a root index) so it has no parent
             db_entry_set_parent(entry, NULL);
         }
+        else {
+            db_entry_set_parent(entry, darray_get_item(worker->folders, parent_idx));
+        }
     }
 
     // fail if we didn't read the correct number of bytes
-    if (fb - folder_block != folder_block_size) {
-        g_debug("[db_load] wrong amount of memory read: %lu != %lu", fb - folder_block, folder_block_size);
-        res = false;
-        goto out;
-    }
+    return fb == block_end;
+}
 
-    // fail if we didn't read the correct number of folders
-    if (idx != num_folders) {
-        g_debug("[db_load] failed to read folders (read %d of %d)", idx, num_folders);
-        res = false;
+static void
+db_load_entries_worker(void *data) {
+    DatabaseLoadEntriesWorker *worker = data;
+    if (worker->blocks->sizes) {
+        worker->decompressor = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+        worker->buffer = g_byte_array_new();
+    }
+
+    for (uint32_t i = worker->block_start; i < worker->block_end; i++) {
+        if (!db_load_entry_block(worker, i)) {
+            g_debug("[db_load] block %d is truncated", i);
+            worker->failed = true;
+            break;
+        }
     }
 
-out:
-    g_clear_pointer(&folder_block, free);
-
-    g_string_free(g_steal_pointer(&previous_entry_name), TRUE);
-
-    return res;
+    g_clear_object(&worker->decompressor);
+    if (worker->buffer) {
+        g_byte_array_free(g_steal_pointer(&worker->buffer), TRUE);
+    }
 }
 
 static bool
-db_load_files(FILE *fp,
-              FsearchDatabaseIndexFlags index_flags,
-              FsearchMemoryPool *pool,
-              DynamicArray *folders,
-              DynamicArray *files,
-              uint32_t num_files,
-              uint64_t file_block_size) {
-    bool result = true;
-    GString *previous_entry_name = g_string_sized_new(256);
-
-    uint8_t *file_block = calloc(file_block_size + 1, sizeof(uint8_t));
-    assert(file_block != NULL);
-
-    if (fread(file_block, sizeof(uint8_t), file_block_size, fp) != file_block_size) {
-        g_debug("[db_load] failed to read file block");
-        goto out;
+db_load_entries(DatabaseFileMapping *mapping,
+                uint32_t flags,
+                FsearchThreadPool *pool,
+                FsearchDatabaseIndexFlags index_flags,
+                FsearchDatabaseEntryType type,
+                DynamicArray *entries,
+                DynamicArray *folders,
+                uint32_t num_entries,
+                uint64_t block_size) {
+    // the block is decoded straight from the mapped file, but every entry is still copied into the entry store, so
+    // loading takes time proportional to the number of entries
+    const uint8_t *block = db_file_mapping_get_block(mapping, block_size);
+    if (!block) {
+        g_debug("[db_load] failed to read entry block");
+        return false;
     }
 
-    const uint8_t *fb = file_block;
-    // load folders
-    uint32_t idx = 0;
-    for (idx = 0; idx < num_files; idx++) {
-        FsearchDatabaseEntryFile *file = fsearch_memory_pool_malloc(pool);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)file;
-        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FILE);
-        db_entry_set_idx(entry, idx);
-
-        fb = db_load_entry_shared_from_memory(fb, index_flags, entry, previous_entry_name);
-
-        // parent_idx: index of parent folder
-        uint32_t parent_idx = 0;
-        memcpy(&parent_idx, fb, 4);
-        fb += 4;
-
-        FsearchDatabaseEntryFolder *parent = darray_get_item(folders, parent_idx);
-        db_entry_set_parent(entry, parent);
-
-        darray_add_item(files, file);
-    }
-    if (fb - file_block != file_block_size) {
-        g_debug("[db_load] wrong amount of memory read: %lu != %lu", fb - file_block, file_block_size);
+    bool res = false;
+    DatabaseEntryBlocks blocks = {};
+    if (!db_load_entry_blocks(block, block_size, flags, num_entries, &blocks)) {
         goto out;
     }
 
-    // fail if we didn't read the correct number of files
-    if (result && idx != num_files) {
-        g_debug("[db_load] failed to read files (read %d of %d)", idx, num_files);
-        result = false;
+    uint32_t blocks_per_worker = 0;
+    const uint32_t num_workers = db_entry_blocks_get_num_workers(pool, blocks.num_blocks, &blocks_per_worker);
+    DatabaseLoadEntriesWorker **workers = calloc(num_workers + 1, sizeof(DatabaseLoadEntriesWorker *));
+    assert(workers != NULL);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers[i] = calloc(1, sizeof(DatabaseLoadEntriesWorker));
+        assert(workers[i] != NULL);
+        workers[i]->block_start = i * blocks_per_worker;
+        workers[i]->block_end = MIN((i + 1) * blocks_per_worker, blocks.num_blocks);
+        workers[i]->blocks = &blocks;
+        workers[i]->index_flags = index_flags;
+        workers[i]->type = type;
+        workers[i]->entries = entries;
+        workers[i]->folders = folders;
+        workers[i]->num_entries = num_entries;
+        workers[i]->names = g_string_sized_new(1024);
+    }
+    db_thread_pool_run(pool, db_load_entries_worker, (gpointer *)workers, num_workers);
+
+    res = true;
+    for (uint32_t i = 0; i < num_workers; i++) {
+        DatabaseLoadEntriesWorker *worker = workers[i];
+        if (worker->failed) {
+            res = false;
+        }
+        if (res) {
+            // the names are added in the same order as before, which keeps the name arena layout unchanged
+            const char *name = worker->names->str;
+            const uint32_t start = worker->block_start * blocks.interval;
+            const uint32_t end = MIN((uint64_t)worker->block_end * blocks.interval, num_entries);
+            for (uint32_t idx = start; idx < end && res; idx++) {
+                res = db_entry_set_name(darray_get_item(entries, idx), name);
+                name += strlen(name) + 1;
+            }
+        }
+        g_string_free(g_steal_pointer(&worker->names), TRUE);
+        g_clear_pointer(&workers[i], free);
     }
+    g_clear_pointer(&workers, free);
 
 out:
-    g_clear_pointer(&file_block, free);
-
-    g_string_free(g_steal_pointer(&previous_entry_name), TRUE);
-
-    return result;
+    g_clear_pointer(&blocks.offsets, free);
+    g_clear_pointer(&blocks.sizes, free);
+    return res;
 }
 
 static bool
-db_load_sorted_entries(FILE *fp, DynamicArray *src, uint32_t num_src_entries, DynamicArray *dest) {
-
-    uint32_t *indexes = calloc(num_src_entries + 1, sizeof(uint32_t));
-    assert(indexes != NULL);
-
-    bool res = true;
-
-    if (fread(indexes, 4, num_src_entries, fp) != num_src_entries) {
-        res = false;
+db_load_sorted_entries(DatabaseFileMapping *mapping, DynamicArray *src, uint32_t num_src_entries, DynamicArray *dest) {
+    // the sorted index list is read from the mapped file and every index is resolved to its loaded entry
+    const uint8_t *indexes = db_file_mapping_get_block(mapping, (uint64_t)num_src_entries * 4);
+    if (!indexes) {
+        return false;
     }
-    else {
-        for (uint32_t i = 0; i < num_src_entries; i++) {
-            uint32_t idx = indexes[i];
-            void *entry = darray_get_item(src, idx);
-            if (!entry) {
-                return false;
-            }
-            darray_add_item(dest, entry);
+
+    for (uint32_t i = 0; i < num_src_entries; i++) {
+        uint32_t idx = 0;
+        memcpy(&idx, indexes + (size_t)i * 4, 4);
+        void *entry = darray_get_item(src, idx);
+        if (!entry) {
+            return false;
         }
+        darray_add_item(dest, entry);
     }
 
-    g_clear_pointer(&indexes, free);
-
-    return res;
+    return true;
 }
 
 static bool
-db_load_sorted_arrays(FILE *fp, DynamicArray **sorted_folders, DynamicArray **sorted_files) {
+db_load_sorted_arrays(DatabaseFileMapping *mapping, DynamicArray **sorted_folders, DynamicArray **sorted_files) {
     uint32_t num_sorted_arrays = 0;
 
     DynamicArray *files = sorted_files[0];
     DynamicArray *folders = sorted_folders[0];
 
-    if (fread(&num_sorted_arrays, 4, 1, fp) != 1) {
+    if (!db_file_mapping_read(mapping, &num_sorted_arrays, 4)) {
         g_debug("[db_load] failed to load number of sorted arrays");
         return false;
     }
 
     for (uint32_t i = 0; i < num_sorted_arrays; i++) {
         uint32_t sorted_array_id = 0;
-        if (fread(&sorted_array_id, 4, 1, fp) != 1) {
+        if (!db_file_mapping_read(mapping, &sorted_array_id, 4)) {
             g_debug("[db_load] failed to load sorted array id");
             return false;
         }
 
-        if (sorted_array_id < 1 || sorted_array_id >= NUM_DATABASE_INDEX_TYPES) {
+        if (sorted_array_id < 1 || sorted_array_id >= NUM_DATABASE_INDEX_TYPES || sorted_folders[sorted_array_id]) {
             g_debug("[db_load] sorted array id is not supported: %d", sorted_array_id);
             return false;
         }
 
         const uint32_t num_folders = darray_get_num_items(folders);
         sorted_folders[sorted_array_id] = darray_new(num_folders);
-        if (!db_load_sorted_entries(fp, folders, num_folders, sorted_folders[sorted_array_id])) {
+        if (!db_load_sorted_entries(mapping, folders, num_folders, sorted_folders[sorted_array_id])) {
             g_debug("[db_load] failed to load sorted folder indexes: %d", sorted_array_id);
             return false;
         }
 
         const uint32_t num_files = darray_get_num_items(files);
         sorted_files[sorted_array_id] = darray_new(num_files);
-        if (!db_load_sorted_entries(fp, files, num_files, sorted_files[sorted_array_id])) {
+        if (!db_load_sorted_entries(mapping, files, num_files, sorted_files[sorted_array_id])) {
             g_debug("[db_load] failed to load sorted file indexes: %d", sorted_array_id);
             return false;
         }
@@ -553,448 +1377,962 @@ db_load_sorted_arrays(FILE *fp, DynamicArray **sorted_folders, DynamicArray **so
     return true;
 }
 
-bool
-db_load(FsearchDatabase *db, const char *file_path, void (*status_cb)(const char *)) {
-    assert(file_path != NULL);
-    assert(db != NULL);
-
-    FILE *fp = db_file_open_locked(file_path, "rb");
-    if (!fp) {
-        return false;
+typedef struct DatabaseLoadContext {
+    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES];
+    uint64_t index_flags;
+    uint32_t num_folders;
+    uint32_t num_files;
+    time_t scan_timestamp;
+} DatabaseLoadContext;
+
+static DynamicArray *
+db_load_alloc_entries(FsearchDatabaseEntryStore *store, FsearchDatabaseEntryType type, uint32_t num_entries) {
+    // the entries are allocated up front, so the blocks can be decoded in parallel and
+    // parent indices can be mapped to the corresponding folders
+    DynamicArray *entries = darray_new(num_entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = db_entry_store_alloc(store, type);
+        if (!entry) {
+            g_debug("[db_load] no room left for %d entries", num_entries);
+            g_clear_pointer(&entries, darray_unref);
+            break;
+        }
+        darray_add_item(entries, entry);
     }
+    return entries;
+}
 
-    DynamicArray *folders = NULL;
-    DynamicArray *files = NULL;
-    DynamicArray *sorted_folders[NUM_DATABASE_INDEX_TYPES] = {NULL};
-    DynamicArray *sorted_files[NUM_DATABASE_INDEX_TYPES] = {NULL};
+static bool
+db_load_alloc_folders_and_files(FsearchDatabase *db, DatabaseLoadContext *ctx) {
+    ctx->sorted_folders[DATABASE_INDEX_TYPE_NAME] =
+        db_load_alloc_entries(db->folder_store, DATABASE_ENTRY_TYPE_FOLDER, ctx->num_folders);
+    ctx->sorted_files[DATABASE_INDEX_TYPE_NAME] =
+        db_load_alloc_entries(db->file_store, DATABASE_ENTRY_TYPE_FILE, ctx->num_files);
+    return ctx->sorted_folders[DATABASE_INDEX_TYPE_NAME] && ctx->sorted_files[DATABASE_INDEX_TYPE_NAME];
+}
 
-    if (!db_load_header(fp)) {
-        goto load_fail;
+static bool
+db_load_legacy(FsearchDatabase *db,
+               DatabaseFileMapping *mapping,
+               uint8_t minorver,
+               DatabaseLoadContext *ctx,
+               void (*status_cb)(const char *)) {
+    // older databases don't know when they were scanned
+    int64_t timestamp = 0;
+    if (minorver >= 10 && !db_file_mapping_read(mapping, &timestamp, 8)) {
+        return false;
     }
+    ctx->scan_timestamp = (time_t)timestamp;
 
-    uint64_t index_flags = 0;
-    if (fread(&index_flags, 8, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &ctx->index_flags, 8)) {
+        return false;
     }
 
-    uint32_t num_folders = 0;
-    if (fread(&num_folders, 4, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &ctx->num_folders, 4)) {
+        return false;
     }
 
-    uint32_t num_files = 0;
-    if (fread(&num_files, 4, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &ctx->num_files, 4)) {
+        return false;
     }
-    g_debug("[db_load] load %d folders, %d files", num_folders, num_files);
+    g_debug("[db_load] load %d folders, %d files", ctx->num_folders, ctx->num_files);
 
     uint64_t folder_block_size = 0;
-    if (fread(&folder_block_size, 8, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &folder_block_size, 8)) {
+        return false;
     }
 
     uint64_t file_block_size = 0;
-    if (fread(&file_block_size, 8, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &file_block_size, 8)) {
+        return false;
     }
     g_debug("[db_load] folder size: %lu, file size: %lu", folder_block_size, file_block_size);
 
     // TODO: implement index loading
     uint32_t num_indexes = 0;
-    if (fread(&num_indexes, 4, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &num_indexes, 4)) {
+        return false;
     }
 
     // TODO: implement exclude loading
     uint32_t num_excludes = 0;
-    if (fread(&num_excludes, 4, 1, fp) != 1) {
-        goto load_fail;
+    if (!db_file_mapping_read(mapping, &num_excludes, 4)) {
+        return false;
     }
 
-    // pre-allocate the folders array so we can later map parent indices to the corresponding pointers
-    sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(num_folders);
-    folders = sorted_folders[DATABASE_INDEX_TYPE_NAME];
-
-    for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntryFolder *folder = fsearch_memory_pool_malloc(db->folder_pool);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
-        db_entry_set_idx(entry, i);
-        db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
-        db_entry_set_parent(entry, NULL);
-        darray_add_item(folders, folder);
+    if (!db_load_alloc_folders_and_files(db, ctx)) {
+        return false;
     }
+    DynamicArray *folders = ctx->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = ctx->sorted_files[DATABASE_INDEX_TYPE_NAME];
 
     if (status_cb) {
         status_cb(_("Loading folders…"));
     }
     // load folders
-    if (!db_load_folders(fp, index_flags, folders, num_folders, folder_block_size)) {
-        goto load_fail;
+    if (!db_load_entries(mapping,
+                         0,
+                         db->thread_pool,
+                         ctx->index_flags,
+                         DATABASE_ENTRY_TYPE_FOLDER,
+                         folders,
+                         folders,
+                         ctx->num_folders,
+                         folder_block_size)) {
+        return false;
     }
 
     if (status_cb) {
         status_cb(_("Loading files…"));
     }
     // load files
-    sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(num_files);
-    files = sorted_files[DATABASE_INDEX_TYPE_NAME];
-    if (!db_load_files(fp, index_flags, db->file_pool, folders, files, num_files, file_block_size)) {
-        goto load_fail;
-    }
-
-    if (!db_load_sorted_arrays(fp, sorted_folders, sorted_files)) {
-        goto load_fail;
+    if (!db_load_entries(mapping,
+                         0,
+                         db->thread_pool,
+                         ctx->index_flags,
+                         DATABASE_ENTRY_TYPE_FILE,
+                         files,
+                         folders,
+                         ctx->num_files,
+                         file_block_size)) {
+        return false;
     }
 
-    db_sorted_entries_free(db);
+    return db_load_sorted_arrays(mapping, ctx->sorted_folders, ctx->sorted_files);
+}
 
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        db->sorted_files[i] = sorted_files[i];
-        db->sorted_folders[i] = sorted_folders[i];
+static DatabaseFileSection *
+db_load_toc(DatabaseFileMapping *mapping, uint32_t *num_sections) {
+    if (mapping->size < DATABASE_FILE_HEADER_SIZE + DATABASE_FILE_TOC_HEADER_SIZE + DATABASE_FILE_TRAILER_SIZE) {
+        g_debug("[db_load] database file is truncated");
+        return NULL;
     }
 
-    db->num_entries = num_files + num_folders;
-    db->num_files = num_files;
-    db->num_folders = num_folders;
-    db->index_flags = index_flags;
+    const uint8_t *trailer = mapping->data + mapping->size - DATABASE_FILE_TRAILER_SIZE;
+    if (memcmp(trailer + 12, DATABASE_MAGIC_NUMBER, 4) != 0) {
+        g_debug("[db_load] database file is incomplete");
+        return NULL;
+    }
+    uint64_t toc_offset = 0;
+    memcpy(&toc_offset, trailer, 8);
+    uint32_t toc_checksum = 0;
+    memcpy(&toc_checksum, trailer + 8, 4);
 
-    g_clear_pointer(&fp, fclose);
+    const uint64_t toc_end = mapping->size - DATABASE_FILE_TRAILER_SIZE;
+    if (toc_offset < DATABASE_FILE_HEADER_SIZE || toc_offset > toc_end - DATABASE_FILE_TOC_HEADER_SIZE) {
+        g_debug("[db_load] invalid offset of table of contents: %lu", toc_offset);
+        return NULL;
+    }
+    const uint8_t *toc = mapping->data + toc_offset;
+    uint32_t n = 0;
+    memcpy(&n, toc, 4);
+    if (n > (toc_end - toc_offset - DATABASE_FILE_TOC_HEADER_SIZE) / sizeof(DatabaseFileSection)
+        || toc_end - toc_offset != DATABASE_FILE_TOC_HEADER_SIZE + (uint64_t)n * sizeof(DatabaseFileSection)) {
+        g_debug("[db_load] invalid size of table of contents: %d sections", n);
+        return NULL;
+    }
+    if (db_file_crc32(toc, toc_end - toc_offset) != toc_checksum) {
+        g_debug("[db_load] table of contents is corrupt");
+        return NULL;
+    }
 
-    return true;
+    DatabaseFileSection *sections = calloc(n + 1, sizeof(DatabaseFileSection));
+    assert(sections != NULL);
+    memcpy(sections, toc + DATABASE_FILE_TOC_HEADER_SIZE, (size_t)n * sizeof(DatabaseFileSection));
 
-load_fail:
-    g_debug("[db_load] load failed");
+    for (uint32_t i = 0; i < n; i++) {
+        if (sections[i].offset < DATABASE_FILE_HEADER_SIZE || sections[i].offset > toc_offset
+            || sections[i].size > toc_offset - sections[i].offset) {
+            g_debug("[db_load] section %d is out of bounds", i);
+            g_clear_pointer(&sections, free);
+            return NULL;
+        }
+    }
 
-    g_clear_pointer(&fp, fclose);
+    *num_sections = n;
+    return sections;
+}
 
-    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        g_clear_pointer(&sorted_folders[i], darray_unref);
-        g_clear_pointer(&sorted_files[i], darray_unref);
+static const DatabaseFileSection *
+db_load_find_section(const DatabaseFileSection *sections, uint32_t num_sections, uint32_t type, uint32_t param) {
+    for (uint32_t i = 0; i < num_sections; i++) {
+        if (sections[i].type == type && sections[i].param == param) {
+            return &sections[i];
+        }
     }
+    return NULL;
+}
 
-    return false;
+static DatabaseFileMapping
+db_load_get_section_mapping(DatabaseFileMapping *mapping, const DatabaseFileSection *section) {
+    DatabaseFileMapping section_mapping = {
+        .data = mapping->data + section->offset,
+        .size = section->size,
+        .pos = 0,
+    };
+    return section_mapping;
 }
 
-size_t
-write_data_to_file(FILE *fp, const void *data, size_t data_size, size_t num_elements, bool *write_failed) {
-    if (data_size == 0 || num_elements == 0) {
-        return 0;
+static bool
+db_load_sorted_section(DatabaseFileMapping *mapping, const DatabaseFileSection *section, DatabaseLoadContext *ctx) {
+    const FsearchDatabaseIndexType sort_type = section->param;
+    if (sort_type < 1 || sort_type >= NUM_DATABASE_INDEX_TYPES || ctx->sorted_folders[sort_type]) {
+        g_debug("[db_load] sorted array id is not supported: %d", sort_type);
+        return false;
     }
-    if (fwrite(data, data_size, num_elements, fp) != num_elements) {
-        *write_failed = true;
-        return 0;
+
+    DatabaseFileMapping section_mapping = db_load_get_section_mapping(mapping, section);
+    DynamicArray *folders = ctx->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = ctx->sorted_files[DATABASE_INDEX_TYPE_NAME];
+
+    ctx->sorted_folders[sort_type] = darray_new(ctx->num_folders);
+    ctx->sorted_files[sort_type] = darray_new(ctx->num_files);
+    if (!db_load_sorted_entries(&section_mapping, folders, ctx->num_folders, ctx->sorted_folders[sort_type])
+        || !db_load_sorted_entries(&section_mapping, files, ctx->num_files, ctx->sorted_files[sort_type])) {
+        g_debug("[db_load] failed to load sorted indexes: %d", sort_type);
+        return false;
     }
-    return data_size * num_elements;
+    return section_mapping.pos == section_mapping.size;
 }
 
-static size_t
-db_save_entry_shared(FILE *fp,
-                     FsearchDatabaseIndexFlags index_flags,
-                     FsearchDatabaseEntry *entry,
-                     uint32_t parent_idx,
-                     GString *previous_entry_name,
-                     GString *new_entry_name,
-                     bool *write_failed) {
-    // init new_entry_name with the name of the current entry
-    g_string_erase(new_entry_name, 0, -1);
-    g_string_append(new_entry_name, db_entry_get_name_raw(entry));
-
-    size_t bytes_written = 0;
-    // name_offset: character position after which previous_entry_name and new_entry_name differ
-    const uint8_t name_offset = get_name_offset(previous_entry_name->str, new_entry_name->str);
-    bytes_written += write_data_to_file(fp, &name_offset, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save name offset");
-        goto out;
+static bool
+db_load_sections(FsearchDatabase *db,
+                 DatabaseFileMapping *mapping,
+                 DatabaseLoadContext *ctx,
+                 void (*status_cb)(const char *)) {
+    bool res = false;
+    uint32_t num_sections = 0;
+    DatabaseFileSection *sections = db_load_toc(mapping, &num_sections);
+    if (!sections) {
+        return false;
     }
 
-    // name_len: length of the new name characters
-    const uint8_t name_len = new_entry_name->len - name_offset;
-    bytes_written += write_data_to_file(fp, &name_len, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save name length");
+    // pick the sections which are needed, everything else is skipped without being read at all
+    const DatabaseFileSection **needed = calloc(num_sections + 1, sizeof(DatabaseFileSection *));
+    DatabaseFileChecksum *checksums = calloc(num_sections + 1, sizeof(DatabaseFileChecksum));
+    assert(needed != NULL);
+    assert(checksums != NULL);
+    uint32_t num_needed = 0;
+
+    const DatabaseFileSection *info = db_load_find_section(sections, num_sections, DATABASE_SECTION_TYPE_INFO, 0);
+    const DatabaseFileSection *folder_section =
+        db_load_find_section(sections, num_sections, DATABASE_SECTION_TYPE_FOLDERS, 0);
+    const DatabaseFileSection *file_section =
+        db_load_find_section(sections, num_sections, DATABASE_SECTION_TYPE_FILES, 0);
+    if (!info || !folder_section || !file_section) {
+        g_debug("[db_load] database file is missing sections");
         goto out;
     }
-
-    // append new unique characters to previous_entry_name starting at name_offset
-    g_string_erase(previous_entry_name, name_offset, -1);
-    g_string_append(previous_entry_name, new_entry_name->str + name_offset);
-
-    if (name_len > 0) {
-        // name: new characters to be written to file
-        const char *name = previous_entry_name->str + name_offset;
-        bytes_written += write_data_to_file(fp, name, name_len, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save name");
-            goto out;
+    for (uint32_t i = 0; i < num_sections; i++) {
+        uint32_t supported_flags = 0;
+        switch (sections[i].type) {
+        case DATABASE_SECTION_TYPE_FOLDERS:
+        case DATABASE_SECTION_TYPE_FILES:
+            supported_flags = DATABASE_SECTION_FLAG_RESTART_POINTS | DATABASE_SECTION_FLAG_COMPRESSED;
+            break;
+        case DATABASE_SECTION_TYPE_INFO:
+        case DATABASE_SECTION_TYPE_SORTED_ENTRIES:
+            break;
+        default:
+            continue;
         }
-    }
-
-    if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
-        // size: file or folder size (folder size: sum of all children sizes)
-        const uint64_t size = db_entry_get_size(entry);
-        bytes_written += write_data_to_file(fp, &size, 8, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save size");
+        if ((sections[i].flags & ~supported_flags) != 0) {
+            g_debug("[db_load] section %d has unsupported flags: %d", i, sections[i].flags);
             goto out;
         }
+        checksums[num_needed].data = mapping->data + sections[i].offset;
+        checksums[num_needed].size = sections[i].size;
+        needed[num_needed++] = &sections[i];
     }
 
-    if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
-        // mtime: modification time of file/folder
-        const uint64_t mtime = db_entry_get_mtime(entry);
-        bytes_written += write_data_to_file(fp, &mtime, 8, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save modification time");
+    // all sections are verified up front, so a corrupt file never gets partially loaded
+    db_file_compute_checksums(checksums, num_needed);
+    for (uint32_t i = 0; i < num_needed; i++) {
+        if (checksums[i].checksum != needed[i]->checksum) {
+            g_debug("[db_load] checksum mismatch in section of type %d", needed[i]->type);
             goto out;
         }
     }
 
-    // parent_idx: index of parent folder
-    bytes_written += write_data_to_file(fp, &parent_idx, 4, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save parent_idx");
+    DatabaseFileMapping info_mapping = db_load_get_section_mapping(mapping, info);
+    int64_t timestamp = 0;
+    if (!db_file_mapping_read(&info_mapping, &ctx->index_flags, 8)
+        || !db_file_mapping_read(&info_mapping, &ctx->num_folders, 4)
+        || !db_file_mapping_read(&info_mapping, &ctx->num_files, 4)
+        || !db_file_mapping_read(&info_mapping, &timestamp, 8)) {
+        g_debug("[db_load] info section is truncated");
         goto out;
     }
+    ctx->scan_timestamp = (time_t)timestamp;
+    g_debug("[db_load] load %d folders, %d files", ctx->num_folders, ctx->num_files);
 
-out:
-    return bytes_written;
-}
-
-static size_t
-db_save_header(FILE *fp, bool *write_failed) {
-    size_t bytes_written = 0;
-
-    const char magic[] = DATABASE_MAGIC_NUMBER;
-    bytes_written += write_data_to_file(fp, magic, strlen(magic), 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save magic number");
+    if (!db_load_alloc_folders_and_files(db, ctx)) {
         goto out;
     }
+    DynamicArray *folders = ctx->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = ctx->sorted_files[DATABASE_INDEX_TYPE_NAME];
 
-    const uint8_t majorver = DATABASE_MAJOR_VERSION;
-    bytes_written += write_data_to_file(fp, &majorver, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save major version number");
+    if (status_cb) {
+        status_cb(_("Loading folders…"));
+    }
+    DatabaseFileMapping folder_mapping = db_load_get_section_mapping(mapping, folder_section);
+    if (!db_load_entries(&folder_mapping,
+                         folder_section->flags,
+                         db->thread_pool,
+                         ctx->index_flags,
+                         DATABASE_ENTRY_TYPE_FOLDER,
+                         folders,
+                         folders,
+                         ctx->num_folders,
+                         folder_section->size)) {
         goto out;
     }
 
-    const uint8_t minorver = DATABASE_MINOR_VERSION;
-    bytes_written += write_data_to_file(fp, &minorver, 1, 1, write_failed);
-    if (*write_failed == true) {
-        g_debug("[db_save] failed to save minor version number");
+    if (status_cb) {
+        status_cb(_("Loading files…"));
+    }
+    DatabaseFileMapping file_mapping = db_load_get_section_mapping(mapping, file_section);
+    if (!db_load_entries(&file_mapping,
+                         file_section->flags,
+                         db->thread_pool,
+                         ctx->index_flags,
+                         DATABASE_ENTRY_TYPE_FILE,
+                         files,
+                         folders,
+                         ctx->num_files,
+                         file_section->size)) {
         goto out;
     }
 
+    for (uint32_t i = 0; i < num_needed; i++) {
+        if (needed[i]->type == DATABASE_SECTION_TYPE_SORTED_ENTRIES
+            && !db_load_sorted_section(mapping, needed[i], ctx)) {
+            goto out;
+        }
+    }
+    res = true;
+
 out:
-    return bytes_written;
+    g_clear_pointer(&checksums, free);
+    g_clear_pointer(&needed, free);
+    g_clear_pointer(&sections, free);
+    return res;
 }
 
-static size_t
-db_save_files(FILE *fp,
-              FsearchDatabaseIndexFlags index_flags,
-              DynamicArray *files,
-              uint32_t num_files,
-              bool *write_failed) {
-    size_t bytes_written = 0;
+bool
+db_load(FsearchDatabase *db, const char *file_path, void (*status_cb)(const char *)) {
+    assert(file_path != NULL);
+    assert(db != NULL);
 
-    GString *name_prev = g_string_sized_new(256);
-    GString *name_new = g_string_sized_new(256);
+    FILE *fp = db_file_open_locked(file_path, "rb");
+    if (!fp) {
+        return false;
+    }
 
-    for (uint32_t i = 0; i < num_files; i++) {
-        FsearchDatabaseEntryFile *file = darray_get_item(files, i);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)file;
+    DatabaseLoadContext ctx = {};
 
-        // let's also update the idx of the file here while we're at it to make sure we have the correct
-        // idx set when we store the fast sort indexes
-        db_entry_set_idx(entry, i);
+    DatabaseFileMapping mapping = {};
+    if (!db_file_mapping_open(&mapping, fp)) {
+        goto load_fail;
+    }
 
-        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
-        const uint32_t parent_idx = db_entry_get_idx((FsearchDatabaseEntry *)parent);
-        bytes_written += db_save_entry_shared(fp, index_flags, entry, parent_idx, name_prev, name_new, write_failed);
-        if (*write_failed == true)
-            goto out;
+    uint8_t majorver = 0;
+    uint8_t minorver = 0;
+    if (!db_load_header(&mapping, &majorver, &minorver)) {
+        goto load_fail;
     }
 
-out:
-    g_string_free(g_steal_pointer(&name_prev), TRUE);
-    g_string_free(g_steal_pointer(&name_new), TRUE);
+    if (majorver == DATABASE_LEGACY_MAJOR_VERSION) {
+        if (!db_load_legacy(db, &mapping, minorver, &ctx, status_cb)) {
+            goto load_fail;
+        }
+    }
+    else if (!db_load_sections(db, &mapping, &ctx, status_cb)) {
+        goto load_fail;
+    }
 
-    return bytes_written;
-}
+    db_file_mapping_close(&mapping);
 
-static uint32_t *
-build_sorted_entry_index_list(DynamicArray *entries, uint32_t num_entries) {
-    if (num_entries < 1) {
-        return NULL;
+    if (!db_fold_names(db)) {
+        goto load_fail;
     }
+
+    db_sorted_entries_free(db);
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        db->sorted_files[i] = ctx.sorted_files[i];
+        db->sorted_folders[i] = ctx.sorted_folders[i];
+    }
+
+    db->num_entries = ctx.num_files + ctx.num_folders;
+    db->num_files = ctx.num_files;
+    db->num_folders = ctx.num_folders;
+    db->index_flags = ctx.index_flags;
+    db->scan_timestamp = ctx.scan_timestamp;
+
+    db_sorted_entries_evict(db, DATABASE_INDEX_TYPE_NAME);
+    db_publish_generation(db);
+    db_request_trigram_index(db);
+
+    g_clear_pointer(&fp, fclose);
+
+    return true;
+
+load_fail:
+    g_debug("[db_load] load failed");
+
+    db_file_mapping_close(&mapping);
+    g_clear_pointer(&fp, fclose);
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&ctx.sorted_folders[i], darray_unref);
+        g_clear_pointer(&ctx.sorted_files[i], darray_unref);
+    }
+
+    return false;
+}
+
+size_t
+write_data_to_file(FILE *fp, const void *data, size_t data_size, size_t num_elements, bool *write_failed) {
+    if (data_size == 0 || num_elements == 0) {
+        return 0;
+    }
+    if (fwrite(data, data_size, num_elements, fp) != num_elements) {
+        *write_failed = true;
+        return 0;
+    }
+    return data_size * num_elements;
+}
+
+// An immutable copy of everything db_save writes. It's taken with the database locked and written to disk afterwards,
+// while the database can be searched and changed. The entries themselves are only referenced, because the arrays
+// holding them are replaced instead of modified and published entries never change. Only the positions the file
+// refers to are computed, since the entries don't store them.
+typedef struct DatabaseSnapshotEntries {
+    DynamicArray *entries;
+    uint32_t num_entries;
+    // parents: index of the parent folder of every entry, folders without a parent refer to themselves
+    uint32_t *parents;
+} DatabaseSnapshotEntries;
+
+typedef struct DatabaseSnapshot {
+    DatabaseSnapshotEntries folders;
+    DatabaseSnapshotEntries files;
+    // sorted_folders, sorted_files: indexes of the entries in the order of every secondary sort type which is built
+    uint32_t *sorted_folders[NUM_DATABASE_INDEX_TYPES];
+    uint32_t *sorted_files[NUM_DATABASE_INDEX_TYPES];
+    FsearchDatabaseIndexFlags index_flags;
+    time_t scan_timestamp;
+    bool compress;
+} DatabaseSnapshot;
+
+// Returns the index of every entry within entries, indexed by the id of the entry
+static uint32_t *
+db_snapshot_get_positions(DynamicArray *entries, FsearchDatabaseEntryStore *store) {
+    uint32_t *positions = calloc(db_entry_store_get_num_entries(store) + 1, sizeof(uint32_t));
+    assert(positions != NULL);
+
+    const uint32_t num_entries = darray_get_num_items(entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        positions[db_entry_get_id(darray_get_item(entries, i))] = i;
+    }
+    return positions;
+}
+
+static void
+db_snapshot_entries_init(DatabaseSnapshotEntries *snapshot, DynamicArray *entries, const uint32_t *folder_positions) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    snapshot->entries = darray_ref(entries);
+    snapshot->num_entries = num_entries;
+    snapshot->parents = calloc(num_entries + 1, sizeof(uint32_t));
+    assert(snapshot->parents != NULL);
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
+        if (parent) {
+            snapshot->parents[i] = folder_positions[db_entry_get_id((FsearchDatabaseEntry *)parent)];
+        }
+        else if (db_entry_get_type(entry) == DATABASE_ENTRY_TYPE_FOLDER) {
+            snapshot->parents[i] = i;
+        }
+    }
+}
+
+static void
+db_snapshot_entries_clear(DatabaseSnapshotEntries *snapshot) {
+    g_clear_pointer(&snapshot->entries, darray_unref);
+    g_clear_pointer(&snapshot->parents, free);
+}
+
+static uint32_t *
+build_sorted_entry_index_list(DynamicArray *entries, uint32_t num_entries, const uint32_t *positions) {
     uint32_t *indexes = calloc(num_entries + 1, sizeof(uint32_t));
     assert(indexes != NULL);
 
     for (int i = 0; i < num_entries; i++) {
         FsearchDatabaseEntry *entry = darray_get_item(entries, i);
-        indexes[i] = db_entry_get_idx(entry);
+        indexes[i] = positions[db_entry_get_id(entry)];
     }
     return indexes;
 }
 
+static void
+db_snapshot_free(DatabaseSnapshot *snapshot) {
+    db_snapshot_entries_clear(&snapshot->folders);
+    db_snapshot_entries_clear(&snapshot->files);
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        g_clear_pointer(&snapshot->sorted_folders[i], free);
+        g_clear_pointer(&snapshot->sorted_files[i], free);
+    }
+    g_clear_pointer(&snapshot, free);
+}
+
+// Must be called with the database locked
+static DatabaseSnapshot *
+db_snapshot_new(FsearchDatabase *db) {
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
+    if (!folders || !files) {
+        return NULL;
+    }
+
+    // the positions of the entries in the name arrays are what the database file refers to
+    uint32_t *folder_positions = db_snapshot_get_positions(folders, db->folder_store);
+    uint32_t *file_positions = db_snapshot_get_positions(files, db->file_store);
+
+    DatabaseSnapshot *snapshot = calloc(1, sizeof(DatabaseSnapshot));
+    assert(snapshot != NULL);
+    snapshot->index_flags = db->index_flags;
+    snapshot->scan_timestamp = db->scan_timestamp;
+    snapshot->compress = db->compress;
+    db_snapshot_entries_init(&snapshot->folders, folders, folder_positions);
+    db_snapshot_entries_init(&snapshot->files, files, folder_positions);
+
+    for (uint32_t id = 1; id < NUM_DATABASE_INDEX_TYPES; id++) {
+        if (!db->sorted_folders[id] || !db->sorted_files[id]) {
+            continue;
+        }
+        snapshot->sorted_folders[id] =
+            build_sorted_entry_index_list(db->sorted_folders[id], snapshot->folders.num_entries, folder_positions);
+        snapshot->sorted_files[id] =
+            build_sorted_entry_index_list(db->sorted_files[id], snapshot->files.num_entries, file_positions);
+    }
+    g_clear_pointer(&file_positions, free);
+    g_clear_pointer(&folder_positions, free);
+    return snapshot;
+}
+
+static void
+db_save_entry_shared(GByteArray *data,
+                     FsearchDatabaseIndexFlags index_flags,
+                     const DatabaseSnapshotEntries *snapshot,
+                     uint32_t idx,
+                     GString *previous_entry_name) {
+    FsearchDatabaseEntry *entry = darray_get_item(snapshot->entries, idx);
+    const char *entry_name = db_entry_get_name_raw(entry);
+
+    // name_offset: character position after which previous_entry_name and entry_name differ
+    const uint8_t name_offset = get_name_offset(previous_entry_name->str, entry_name);
+    g_byte_array_append(data, &name_offset, 1);
+
+    // name_len: length of the new name characters
+    const uint8_t name_len = strlen(entry_name) - name_offset;
+    g_byte_array_append(data, &name_len, 1);
+
+    // name: new characters, previous_entry_name up to name_offset is reused
+    g_byte_array_append(data, (const uint8_t *)entry_name + name_offset, name_len);
+
+    g_string_truncate(previous_entry_name, name_offset);
+    g_string_append_len(previous_entry_name, entry_name + name_offset, name_len);
+
+    if ((index_flags & DATABASE_INDEX_FLAG_SIZE) != 0) {
+        // size: file or folder size (folder size: sum of all children sizes)
+        const int64_t size = db_entry_get_size(entry);
+        g_byte_array_append(data, (const uint8_t *)&size, 8);
+    }
+
+    if ((index_flags & DATABASE_INDEX_FLAG_MODIFICATION_TIME) != 0) {
+        // mtime: modification time of file/folder
+        const int64_t mtime = db_entry_get_mtime(entry);
+        g_byte_array_append(data, (const uint8_t *)&mtime, 8);
+    }
+
+    // parent_idx: index of parent folder
+    g_byte_array_append(data, (const uint8_t *)&snapshot->parents[idx], 4);
+}
+
 static size_t
-db_save_sorted_entries(FILE *fp, DynamicArray *entries, uint32_t num_entries, bool *write_failed) {
+db_save_header(FILE *fp, bool *write_failed) {
     size_t bytes_written = 0;
-    uint32_t *sorted_entry_index_list = NULL;
-    if (num_entries < 1) {
-        // nothing to write, we're done here
+
+    const char magic[] = DATABASE_MAGIC_NUMBER;
+    bytes_written += write_data_to_file(fp, magic, strlen(magic), 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save magic number");
         goto out;
     }
 
-    sorted_entry_index_list = build_sorted_entry_index_list(entries, num_entries);
-    if (!sorted_entry_index_list) {
-        *write_failed = true;
-        g_debug("[db_save] failed to create sorted index list");
+    const uint8_t majorver = DATABASE_MAJOR_VERSION;
+    bytes_written += write_data_to_file(fp, &majorver, 1, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save major version number");
+        goto out;
+    }
+
+    const uint8_t minorver = DATABASE_MINOR_VERSION;
+    bytes_written += write_data_to_file(fp, &minorver, 1, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save minor version number");
         goto out;
     }
 
-    bytes_written += write_data_to_file(fp, sorted_entry_index_list, 4, num_entries, write_failed);
+    const uint16_t reserved = 0;
+    bytes_written += write_data_to_file(fp, &reserved, 2, 1, write_failed);
     if (*write_failed == true) {
-        g_debug("[db_save] failed to save sorted index list");
+        g_debug("[db_save] failed to save header");
         goto out;
     }
 
 out:
-    g_clear_pointer(&sorted_entry_index_list, free);
+    return bytes_written;
+}
 
+static size_t
+db_save_section_begin(FILE *fp,
+                      GArray *sections,
+                      uint32_t type,
+                      uint32_t flags,
+                      uint32_t param,
+                      size_t offset,
+                      bool *write_failed) {
+    // sections start at offsets aligned to 8 bytes
+    const uint8_t padding[8] = {0};
+    const size_t padding_size = (8 - offset % 8) % 8;
+    const size_t bytes_written = write_data_to_file(fp, padding, 1, padding_size, write_failed);
+
+    DatabaseFileSection section = {
+        .type = type,
+        .flags = flags,
+        .param = param,
+        .offset = offset + bytes_written,
+    };
+    g_array_append_val(sections, section);
     return bytes_written;
 }
 
+static void
+db_save_section_end(GArray *sections, size_t offset) {
+    DatabaseFileSection *section = &g_array_index(sections, DatabaseFileSection, sections->len - 1);
+    section->size = offset - section->offset;
+}
+
 static size_t
-db_save_sorted_arrays(FILE *fp, FsearchDatabase *db, uint32_t num_files, uint32_t num_folders, bool *write_failed) {
+db_save_info(FILE *fp, DatabaseSnapshot *snapshot, bool *write_failed) {
     size_t bytes_written = 0;
-    uint32_t num_sorted_arrays = 0;
-    for (uint32_t i = 1; i < NUM_DATABASE_INDEX_TYPES; i++) {
-        if (db->sorted_folders[i] && db->sorted_files[i]) {
-            num_sorted_arrays++;
-        }
-    }
 
-    bytes_written += write_data_to_file(fp, &num_sorted_arrays, 4, 1, write_failed);
+    const uint64_t index_flags = snapshot->index_flags;
+    bytes_written += write_data_to_file(fp, &index_flags, 8, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save index flags");
+        goto out;
+    }
+    bytes_written += write_data_to_file(fp, &snapshot->folders.num_entries, 4, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save number of folders: %d", snapshot->folders.num_entries);
+        goto out;
+    }
+    bytes_written += write_data_to_file(fp, &snapshot->files.num_entries, 4, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save number of files: %d", snapshot->files.num_entries);
+        goto out;
+    }
+    const int64_t timestamp = snapshot->scan_timestamp;
+    bytes_written += write_data_to_file(fp, &timestamp, 8, 1, write_failed);
     if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of sorted arrays: %d", num_sorted_arrays);
+        g_debug("[db_save] failed to save scan timestamp");
         goto out;
     }
 
-    if (num_sorted_arrays < 1) {
+out:
+    return bytes_written;
+}
+
+static size_t
+db_save_toc(FILE *fp, GArray *sections, size_t offset, bool *write_failed) {
+    // the toc is written to memory first, because its checksum is stored in the trailer
+    const size_t toc_size = DATABASE_FILE_TOC_HEADER_SIZE + sections->len * sizeof(DatabaseFileSection);
+    uint8_t *toc = calloc(toc_size, 1);
+    assert(toc != NULL);
+    const uint32_t num_sections = sections->len;
+    memcpy(toc, &num_sections, 4);
+    memcpy(toc + DATABASE_FILE_TOC_HEADER_SIZE, sections->data, sections->len * sizeof(DatabaseFileSection));
+
+    uint8_t trailer[DATABASE_FILE_TRAILER_SIZE] = {0};
+    const uint64_t toc_offset = offset;
+    const uint32_t toc_checksum = db_file_crc32(toc, toc_size);
+    memcpy(trailer, &toc_offset, 8);
+    memcpy(trailer + 8, &toc_checksum, 4);
+    memcpy(trailer + 12, DATABASE_MAGIC_NUMBER, 4);
+
+    size_t bytes_written = write_data_to_file(fp, toc, toc_size, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save table of contents");
+        goto out;
+    }
+    bytes_written += write_data_to_file(fp, trailer, DATABASE_FILE_TRAILER_SIZE, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save trailer");
         goto out;
     }
 
+out:
+    g_clear_pointer(&toc, free);
+    return bytes_written;
+}
+
+static bool
+db_save_checksums(FILE *fp, GArray *sections, size_t file_size) {
+    // the checksums are computed from the written file, which is still in the page cache at this point
+    if (fflush(fp) != 0) {
+        return false;
+    }
+    uint8_t *data = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (data == MAP_FAILED) {
+        g_debug("[db_save] failed to map database file: %s", strerror(errno));
+        return false;
+    }
+
+    DatabaseFileChecksum *checksums = calloc(sections->len + 1, sizeof(DatabaseFileChecksum));
+    assert(checksums != NULL);
+    for (uint32_t i = 0; i < sections->len; i++) {
+        DatabaseFileSection *section = &g_array_index(sections, DatabaseFileSection, i);
+        checksums[i].data = data + section->offset;
+        checksums[i].size = section->size;
+    }
+    db_file_compute_checksums(checksums, sections->len);
+    for (uint32_t i = 0; i < sections->len; i++) {
+        g_array_index(sections, DatabaseFileSection, i).checksum = checksums[i].checksum;
+    }
+
+    g_clear_pointer(&checksums, free);
+    munmap(data, file_size);
+    return true;
+}
+
+static size_t
+db_save_sorted_arrays(FILE *fp, DatabaseSnapshot *snapshot, GArray *sections, size_t offset, bool *write_failed) {
+    size_t bytes_written = 0;
+
     for (uint32_t id = 1; id < NUM_DATABASE_INDEX_TYPES; id++) {
-        DynamicArray *folders = db->sorted_folders[id];
-        DynamicArray *files = db->sorted_files[id];
+        const uint32_t *folders = snapshot->sorted_folders[id];
+        const uint32_t *files = snapshot->sorted_files[id];
         if (!files || !folders) {
             continue;
         }
 
-        // id: this is the id of the sorted files
-        bytes_written += write_data_to_file(fp, &id, 4, 1, write_failed);
+        bytes_written += db_save_section_begin(fp,
+                                               sections,
+                                               DATABASE_SECTION_TYPE_SORTED_ENTRIES,
+                                               0,
+                                               id,
+                                               offset + bytes_written,
+                                               write_failed);
         if (*write_failed == true) {
-            g_debug("[db_save] failed to save sorted arrays id: %d", id);
             goto out;
         }
-
-        bytes_written += db_save_sorted_entries(fp, folders, num_folders, write_failed);
+        bytes_written += write_data_to_file(fp, folders, 4, snapshot->folders.num_entries, write_failed);
         if (*write_failed == true) {
             g_debug("[db_save] failed to save sorted folders");
             goto out;
         }
-        bytes_written += db_save_sorted_entries(fp, files, num_files, write_failed);
+        bytes_written += write_data_to_file(fp, files, 4, snapshot->files.num_entries, write_failed);
         if (*write_failed == true) {
             g_debug("[db_save] failed to save sorted files");
             goto out;
         }
+        db_save_section_end(sections, offset + bytes_written);
     }
 
 out:
     return bytes_written;
 }
 
-static size_t
-db_save_folders(FILE *fp,
-                FsearchDatabaseIndexFlags index_flags,
-                DynamicArray *folders,
-                uint32_t num_folders,
-                bool *write_failed) {
-    size_t bytes_written = 0;
+typedef struct DatabaseSaveEntriesWorker {
+    const DatabaseSnapshotEntries *entries;
+    FsearchDatabaseIndexFlags index_flags;
+    uint32_t num_entries;
+    uint32_t interval;
+    uint32_t block_start;
+    uint32_t block_end;
+    // block_offsets: start of each block relative to data
+    uint64_t *block_offsets;
+    // block_sizes: uncompressed size of each block, NULL if the blocks don't get compressed
+    uint64_t *block_sizes;
+    GByteArray *data;
+    bool failed;
+} DatabaseSaveEntriesWorker;
 
-    GString *name_prev = g_string_sized_new(256);
-    GString *name_new = g_string_sized_new(256);
+static void
+db_save_entries_worker(void *data) {
+    DatabaseSaveEntriesWorker *worker = data;
+    GString *previous_entry_name = g_string_sized_new(256);
 
-    for (uint32_t i = 0; i < num_folders; i++) {
-        FsearchDatabaseEntryFolder *folder = darray_get_item(folders, i);
-        FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder;
+    // compressed blocks are encoded to block_data first
+    GConverter *compressor = NULL;
+    GByteArray *block_data = worker->data;
+    if (worker->block_sizes) {
+        compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+        block_data = g_byte_array_new();
+    }
 
-        // TODO: actually store the folders db_index instead of always 0
-        const uint16_t db_index = 0;
-        bytes_written += write_data_to_file(fp, &db_index, 2, 1, write_failed);
-        if (*write_failed == true) {
-            g_debug("[db_save] failed to save folder's database index: %d", db_index);
-            goto out;
+    for (uint32_t block_idx = worker->block_start; block_idx < worker->block_end; block_idx++) {
+        worker->block_offsets[block_idx] = worker->data->len;
+        // the first entry of every block stores its full name
+        g_string_truncate(previous_entry_name, 0);
+        if (compressor) {
+            g_byte_array_set_size(block_data, 0);
         }
 
-        FsearchDatabaseEntryFolder *parent = db_entry_get_parent(entry);
-        const uint32_t parent_idx = parent ? db_entry_get_idx((FsearchDatabaseEntry *)parent) : db_entry_get_idx(entry);
-        bytes_written += db_save_entry_shared(fp, index_flags, entry, parent_idx, name_prev, name_new, write_failed);
-        if (*write_failed == true) {
-            goto out;
+        const uint32_t start = block_idx * worker->interval;
+        const uint32_t end = MIN((uint64_t)start + worker->interval, worker->num_entries);
+        for (uint32_t idx = start; idx < end; idx++) {
+            FsearchDatabaseEntry *entry = darray_get_item(worker->entries->entries, idx);
+            if (db_entry_get_type(entry) == DATABASE_ENTRY_TYPE_FOLDER) {
+                // TODO: actually store the folders db_index instead of always 0
+                const uint16_t db_index = 0;
+                g_byte_array_append(block_data, (const uint8_t *)&db_index, 2);
+            }
+            db_save_entry_shared(block_data, worker->index_flags, worker->entries, idx, previous_entry_name);
         }
-    }
 
-out:
-    g_string_free(g_steal_pointer(&name_prev), TRUE);
-    g_string_free(g_steal_pointer(&name_new), TRUE);
+        if (compressor) {
+            worker->block_sizes[block_idx] = block_data->len;
+            if (!db_file_compress(compressor, block_data->data, block_data->len, worker->data)) {
+                worker->failed = true;
+                break;
+            }
+        }
+    }
 
-    return bytes_written;
+    if (compressor) {
+        g_byte_array_free(g_steal_pointer(&block_data), TRUE);
+        g_clear_object(&compressor);
+    }
+    g_string_free(g_steal_pointer(&previous_entry_name), TRUE);
 }
 
 static size_t
-db_save_indexes(FILE *fp, FsearchDatabase *db, bool *write_failed) {
+db_save_entries(FILE *fp,
+                FsearchThreadPool *pool,
+                FsearchDatabaseIndexFlags index_flags,
+                const DatabaseSnapshotEntries *entries,
+                bool compress,
+                bool *write_failed) {
     size_t bytes_written = 0;
+    const uint32_t num_entries = entries->num_entries;
+
+    const uint32_t interval = DATABASE_FILE_RESTART_INTERVAL;
+    const uint32_t num_blocks = (num_entries + interval - 1) / interval;
+    uint64_t *block_offsets = calloc(num_blocks + 1, sizeof(uint64_t));
+    assert(block_offsets != NULL);
+    uint64_t *block_sizes = NULL;
+    if (compress) {
+        block_sizes = calloc(num_blocks + 1, sizeof(uint64_t));
+        assert(block_sizes != NULL);
+    }
+
+    // the blocks are encoded to memory in parallel and written to the file afterwards
+    uint32_t blocks_per_worker = 0;
+    const uint32_t num_workers = db_entry_blocks_get_num_workers(pool, num_blocks, &blocks_per_worker);
+    DatabaseSaveEntriesWorker **workers = calloc(num_workers + 1, sizeof(DatabaseSaveEntriesWorker *));
+    assert(workers != NULL);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers[i] = calloc(1, sizeof(DatabaseSaveEntriesWorker));
+        assert(workers[i] != NULL);
+        workers[i]->entries = entries;
+        workers[i]->index_flags = index_flags;
+        workers[i]->num_entries = num_entries;
+        workers[i]->interval = interval;
+        workers[i]->block_start = i * blocks_per_worker;
+        workers[i]->block_end = MIN((i + 1) * blocks_per_worker, num_blocks);
+        workers[i]->block_offsets = block_offsets;
+        workers[i]->block_sizes = block_sizes;
+        workers[i]->data = g_byte_array_new();
+    }
+    db_thread_pool_run(pool, db_save_entries_worker, (gpointer *)workers, num_workers);
+    for (uint32_t i = 0; i < num_workers; i++) {
+        if (workers[i]->failed) {
+            *write_failed = true;
+            goto out;
+        }
+    }
+
+    // make the block offsets relative to the start of the first block
+    uint64_t worker_offset = 0;
+    for (uint32_t i = 0; i < num_workers; i++) {
+        for (uint32_t block_idx = workers[i]->block_start; block_idx < workers[i]->block_end; block_idx++) {
+            block_offsets[block_idx] += worker_offset;
+        }
+        worker_offset += workers[i]->data->len;
+    }
 
-    // TODO: actually implement storing all index information
-    const uint32_t num_indexes = 0;
-    bytes_written += write_data_to_file(fp, &num_indexes, 4, 1, write_failed);
+    bytes_written += write_data_to_file(fp, &interval, 4, 1, write_failed);
     if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of indexes: %d", num_indexes);
+        g_debug("[db_save] failed to save restart interval");
         goto out;
     }
-out:
-    return bytes_written;
-}
-
-static size_t
-db_save_excludes(FILE *fp, FsearchDatabase *db, bool *write_failed) {
-    size_t bytes_written = 0;
-
-    // TODO: actually implement storing all exclude information
-    const uint32_t num_excludes = 0;
-    bytes_written += write_data_to_file(fp, &num_excludes, 4, 1, write_failed);
+    bytes_written += write_data_to_file(fp, &num_blocks, 4, 1, write_failed);
+    if (*write_failed == true) {
+        g_debug("[db_save] failed to save number of blocks: %d", num_blocks);
+        goto out;
+    }
+    bytes_written += write_data_to_file(fp, block_offsets, 8, num_blocks, write_failed);
     if (*write_failed == true) {
-        g_debug("[db_save] failed to save number of indexes: %d", num_excludes);
+        g_debug("[db_save] failed to save restart points");
         goto out;
     }
+    if (block_sizes) {
+        bytes_written += write_data_to_file(fp, block_sizes, 8, num_blocks, write_failed);
+        if (*write_failed == true) {
+            g_debug("[db_save] failed to save block sizes");
+            goto out;
+        }
+    }
+    for (uint32_t i = 0; i < num_workers; i++) {
+        bytes_written += write_data_to_file(fp, workers[i]->data->data, 1, workers[i]->data->len, write_failed);
+        if (*write_failed == true) {
+            g_debug("[db_save] failed to save entries");
+            goto out;
+        }
+    }
+
 out:
+    for (uint32_t i = 0; i < num_workers; i++) {
+        g_byte_array_free(g_steal_pointer(&workers[i]->data), TRUE);
+        g_clear_pointer(&workers[i], free);
+    }
+    g_clear_pointer(&workers, free);
+    g_clear_pointer(&block_offsets, free);
+    g_clear_pointer(&block_sizes, free);
+
     return bytes_written;
 }
 
-static size_t
-db_save_exclude_pattern(FILE *fp, FsearchDatabase *db, bool *write_failed) {
-    // TODO
-    return 0;
+static void
+db_file_sync_dir(const char *path) {
+    // makes sure the rename of the database file is persisted as well
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return;
+    }
+    fsync(fd);
+    close(fd);
 }
 
-bool
-db_save(FsearchDatabase *db, const char *path) {
-    assert(path != NULL);
-    assert(db != NULL);
-
+static bool
+db_snapshot_save(DatabaseSnapshot *snapshot, const char *path, FsearchThreadPool *pool) {
     g_debug("[db_save] saving database to file...");
 
     if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
@@ -1012,16 +2350,18 @@ db_save(FsearchDatabase *db, const char *path) {
     GString *path_full_temp = g_string_new(path_full->str);
     g_string_append(path_full_temp, ".tmp");
 
+    // sections: table of contents, filled in while the sections get written
+    GArray *sections = g_array_new(FALSE, TRUE, sizeof(DatabaseFileSection));
+
     g_debug("[db_save] trying to open temporary database file: %s", path_full_temp->str);
 
-    FILE *fp = db_file_open_locked(path_full_temp->str, "wb");
+    // the file is opened for reading as well, because the checksums are computed from the written data
+    FILE *fp = db_file_open_locked(path_full_temp->str, "w+b");
     if (!fp) {
         g_debug("[db_save] failed to open temporary database file: %s", path_full_temp->str);
         goto save_fail;
     }
-
-    g_debug("[db_save] updating folder indices...");
-    db_entry_update_folder_indices(db);
+    setvbuf(fp, NULL, _IOFBF, DATABASE_FILE_WRITE_BUFFER_SIZE);
 
     bool write_failed = false;
 
@@ -1033,108 +2373,86 @@ db_save(FsearchDatabase *db, const char *path) {
         goto save_fail;
     }
 
-    g_debug("[db_save] saving database index flags...");
-    const uint64_t index_flags = db->index_flags;
-    bytes_written += write_data_to_file(fp, &index_flags, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-
-    DynamicArray *files = db->sorted_files[DATABASE_INDEX_TYPE_NAME];
-    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    const FsearchDatabaseIndexFlags index_flags = snapshot->index_flags;
+    const uint32_t entry_section_flags =
+        DATABASE_SECTION_FLAG_RESTART_POINTS | (snapshot->compress ? DATABASE_SECTION_FLAG_COMPRESSED : 0);
 
-    const uint32_t num_folders = darray_get_num_items(folders);
-    g_debug("[db_save] saving number of folders: %d", num_folders);
-    bytes_written += write_data_to_file(fp, &num_folders, 4, 1, &write_failed);
+    g_debug("[db_save] saving database info: %d folders, %d files",
+            snapshot->folders.num_entries,
+            snapshot->files.num_entries);
+    bytes_written +=
+        db_save_section_begin(fp, sections, DATABASE_SECTION_TYPE_INFO, 0, 0, bytes_written, &write_failed);
+    bytes_written += db_save_info(fp, snapshot, &write_failed);
     if (write_failed == true) {
         goto save_fail;
     }
+    db_save_section_end(sections, bytes_written);
 
-    const uint32_t num_files = darray_get_num_items(files);
-    g_debug("[db_save] saving number of files: %d", num_files);
-    bytes_written += write_data_to_file(fp, &num_files, 4, 1, &write_failed);
+    g_debug("[db_save] saving folders...");
+    bytes_written += db_save_section_begin(fp,
+                                           sections,
+                                           DATABASE_SECTION_TYPE_FOLDERS,
+                                           entry_section_flags,
+                                           0,
+                                           bytes_written,
+                                           &write_failed);
+    bytes_written += db_save_entries(fp, pool, index_flags, &snapshot->folders, snapshot->compress, &write_failed);
     if (write_failed == true) {
         goto save_fail;
     }
+    db_save_section_end(sections, bytes_written);
 
-    uint64_t folder_block_size = 0;
-    const uint64_t folder_block_size_offset = bytes_written;
-    g_debug("[db_save] saving folder block size...");
-    bytes_written += write_data_to_file(fp, &folder_block_size, 8, 1, &write_failed);
+    g_debug("[db_save] saving files...");
+    bytes_written += db_save_section_begin(fp,
+                                           sections,
+                                           DATABASE_SECTION_TYPE_FILES,
+                                           entry_section_flags,
+                                           0,
+                                           bytes_written,
+                                           &write_failed);
+    bytes_written += db_save_entries(fp, pool, index_flags, &snapshot->files, snapshot->compress, &write_failed);
     if (write_failed == true) {
         goto save_fail;
     }
+    db_save_section_end(sections, bytes_written);
 
-    uint64_t file_block_size = 0;
-    const uint64_t file_block_size_offset = bytes_written;
-    g_debug("[db_save] saving file block size...");
-    bytes_written += write_data_to_file(fp, &file_block_size, 8, 1, &write_failed);
+    g_debug("[db_save] saving sorted arrays...");
+    bytes_written += db_save_sorted_arrays(fp, snapshot, sections, bytes_written, &write_failed);
     if (write_failed == true) {
         goto save_fail;
     }
 
-    g_debug("[db_save] saving indices...");
-    bytes_written += db_save_indexes(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-    g_debug("[db_save] saving excludes...");
-    bytes_written += db_save_excludes(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-    g_debug("[db_save] saving exclude pattern...");
-    bytes_written += db_save_exclude_pattern(fp, db, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-    g_debug("[db_save] saving folders...");
-    folder_block_size = db_save_folders(fp, index_flags, folders, num_folders, &write_failed);
-    bytes_written += folder_block_size;
-    if (write_failed == true) {
+    g_debug("[db_save] computing checksums of %d sections...", sections->len);
+    if (!db_save_checksums(fp, sections, bytes_written)) {
         goto save_fail;
     }
-    g_debug("[db_save] saving files...");
-    file_block_size = db_save_files(fp, index_flags, files, num_files, &write_failed);
-    bytes_written += file_block_size;
+
+    g_debug("[db_save] saving table of contents...");
+    bytes_written += db_save_toc(fp, sections, bytes_written, &write_failed);
     if (write_failed == true) {
         goto save_fail;
     }
-    g_debug("[db_save] saving sorted arrays...");
-    bytes_written += db_save_sorted_arrays(fp, db, num_files, num_folders, &write_failed);
-    if (write_failed == true) {
+
+    // the temporary file must be on disk before it replaces the current database file, otherwise a crash could
+    // leave us with neither of them
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        g_debug("[db_save] failed to flush temporary database file");
         goto save_fail;
     }
 
-    // now that we know the size of the file/folder block we've written, store it in the file header
-    if (fseek(fp, (long int)folder_block_size_offset, SEEK_SET) != 0) {
-        goto save_fail;
-    }
-    g_debug("[db_save] updating file and folder block size: %lu, %lu", folder_block_size, file_block_size);
-    bytes_written += write_data_to_file(fp, &folder_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-    bytes_written += write_data_to_file(fp, &file_block_size, 8, 1, &write_failed);
-    if (write_failed == true) {
-        goto save_fail;
-    }
-
-    g_debug("[db_save] removing current database file...");
-    // remove current database file
-    unlink(path_full->str);
-
-    g_clear_pointer(&fp, fclose);
-
-    g_debug("[db_save] renaming temporary database file: %s -> %s", path_full_temp->str, path_full->str);
-    // rename temporary fsearch.db.tmp to fsearch.db
-    if (rename(path_full_temp->str, path_full->str) != 0) {
+    g_clear_pointer(&fp, fclose);
+
+    g_debug("[db_save] renaming temporary database file: %s -> %s", path_full_temp->str, path_full->str);
+    // rename temporary fsearch.db.tmp to fsearch.db, this atomically replaces the current database file
+    if (rename(path_full_temp->str, path_full->str) != 0) {
         goto save_fail;
     }
+    db_file_sync_dir(path);
 
     g_string_free(g_steal_pointer(&path_full), TRUE);
 
     g_string_free(g_steal_pointer(&path_full_temp), TRUE);
+    g_array_free(g_steal_pointer(&sections), TRUE);
 
     const double seconds = g_timer_elapsed(timer, NULL);
     g_timer_stop(timer);
@@ -1155,12 +2473,102 @@ save_fail:
 
     g_string_free(g_steal_pointer(&path_full), TRUE);
     g_string_free(g_steal_pointer(&path_full_temp), TRUE);
+    g_array_free(g_steal_pointer(&sections), TRUE);
 
     g_clear_pointer(&timer, g_timer_destroy);
 
     return false;
 }
 
+static bool
+db_save_with_pool(FsearchDatabase *db, const char *path, FsearchThreadPool *pool) {
+    // only one save at a time, they'd write to the same temporary file otherwise
+    g_mutex_lock(&db->save_mutex);
+
+    db_lock(db);
+    DatabaseSnapshot *snapshot = db_snapshot_new(db);
+    db_unlock(db);
+
+    bool res = false;
+    if (snapshot) {
+        res = db_snapshot_save(snapshot, path, pool);
+        g_clear_pointer(&snapshot, db_snapshot_free);
+    }
+
+    g_mutex_unlock(&db->save_mutex);
+    return res;
+}
+
+bool
+db_save(FsearchDatabase *db, const char *path) {
+    assert(path != NULL);
+    assert(db != NULL);
+
+    return db_save_with_pool(db, path, db->thread_pool);
+}
+
+typedef struct DatabaseSaveTask {
+    FsearchDatabase *db;
+    char *path;
+} DatabaseSaveTask;
+
+static void
+db_save_task_cancelled(gpointer data) {
+    DatabaseSaveTask *task = data;
+    // this might drop the last reference, the save queue isn't owned by the database for that reason
+    g_clear_pointer(&task->db, db_unref);
+    g_clear_pointer(&task->path, free);
+    g_clear_pointer(&task, free);
+}
+
+static void
+db_save_task_finished(gpointer result, gpointer data) {
+    db_save_task_cancelled(data);
+}
+
+static gpointer
+db_save_task(gpointer data, GCancellable *cancellable) {
+    DatabaseSaveTask *task = data;
+
+    // saving isn't urgent, keep it from competing with searches. On Linux this only affects the save thread.
+    setpriority(PRIO_PROCESS, 0, DATABASE_SAVE_THREAD_NICE);
+
+    // the thread pool might be in use by a search, so the entries are encoded on this thread alone. Cancellation is
+    // ignored, once started the save is completed.
+    db_save_with_pool(task->db, task->path, NULL);
+    return NULL;
+}
+
+static FsearchTaskQueue *
+db_get_save_queue(void) {
+    // shared by all databases, it's never freed
+    static gsize save_queue = 0;
+    if (g_once_init_enter(&save_queue)) {
+        g_once_init_leave(&save_queue, (gsize)fsearch_task_queue_new("fsearch_db_save_queue"));
+    }
+    return (FsearchTaskQueue *)save_queue;
+}
+
+void
+db_save_in_background(FsearchDatabase *db, const char *path) {
+    assert(path != NULL);
+    assert(db != NULL);
+
+    DatabaseSaveTask *task = calloc(1, sizeof(DatabaseSaveTask));
+    assert(task != NULL);
+    task->db = db_ref(db);
+    task->path = strdup(path);
+
+    // a newer save makes pending ones obsolete, they'd write the same database file
+    fsearch_task_queue(db_get_save_queue(),
+                       FSEARCH_TASK_ID_SAVE,
+                       db_save_task,
+                       db_save_task_finished,
+                       db_save_task_cancelled,
+                       FSEARCH_TASK_CLEAR_SAME_ID,
+                       g_steal_pointer(&task));
+}
+
 static bool
 file_is_excluded(const char *name, char **exclude_files) {
     if (exclude_files) {
@@ -1188,52 +2596,223 @@ directory_is_excluded(const char *name, GList *excludes) {
     return false;
 }
 
+static bool
+exclude_files_equal(char **exclude_files_a, char **exclude_files_b) {
+    if (!exclude_files_a || !exclude_files_b) {
+        return (!exclude_files_a || !exclude_files_a[0]) && (!exclude_files_b || !exclude_files_b[0]);
+    }
+    uint32_t i = 0;
+    for (; exclude_files_a[i] && exclude_files_b[i]; i++) {
+        if (strcmp(exclude_files_a[i], exclude_files_b[i]) != 0) {
+            return false;
+        }
+    }
+    return !exclude_files_a[i] && !exclude_files_b[i];
+}
+
+static bool
+excludes_equal(GList *excludes_a, GList *excludes_b) {
+    // both lists are sorted by path
+    for (; excludes_a && excludes_b; excludes_a = excludes_a->next, excludes_b = excludes_b->next) {
+        FsearchExcludePath *exclude_a = excludes_a->data;
+        FsearchExcludePath *exclude_b = excludes_b->data;
+        if (strcmp(exclude_a->path, exclude_b->path) != 0 || exclude_a->enabled != exclude_b->enabled) {
+            return false;
+        }
+    }
+    return !excludes_a && !excludes_b;
+}
+
+// The entries of a previous database, which get reused for folders that didn't change since it was scanned
+typedef struct DatabaseScanPrevious {
+    // db: keeps the entries alive
+    FsearchDatabase *db;
+    // folders, files: sorted by parent and name, so the children of a folder form a contiguous range
+    DynamicArray *folders;
+    DynamicArray *files;
+    time_t scan_timestamp;
+} DatabaseScanPrevious;
+
+// The previous database might still be modified, which replaces its folders with copies, so entries are related to
+// their parents through the original they all share (see db_entry_get_original)
+static FsearchDatabaseEntryFolder *
+db_scan_previous_get_parent(FsearchDatabaseEntry *entry) {
+    return (FsearchDatabaseEntryFolder *)db_entry_get_original((FsearchDatabaseEntry *)db_entry_get_parent(entry));
+}
+
+static bool
+db_scan_previous_is_child(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent) {
+    return db_scan_previous_get_parent(entry)
+        == (FsearchDatabaseEntryFolder *)db_entry_get_original((FsearchDatabaseEntry *)parent);
+}
+
+static int32_t
+db_scan_previous_compare_entries(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
+    const uintptr_t parent_a = (uintptr_t)db_scan_previous_get_parent(*a);
+    const uintptr_t parent_b = (uintptr_t)db_scan_previous_get_parent(*b);
+    if (parent_a != parent_b) {
+        return parent_a < parent_b ? -1 : 1;
+    }
+    return strcmp(db_entry_get_name(*a), db_entry_get_name(*b));
+}
+
+static void
+db_scan_previous_free(DatabaseScanPrevious *previous) {
+    if (!previous) {
+        return;
+    }
+    g_clear_pointer(&previous->folders, darray_unref);
+    g_clear_pointer(&previous->files, darray_unref);
+    g_clear_pointer(&previous->db, db_unref);
+    g_clear_pointer(&previous, free);
+}
+
+static DatabaseScanPrevious *
+db_scan_previous_new(FsearchDatabase *db, FsearchDatabase *previous_db) {
+    if (previous_db->exclude_hidden != db->exclude_hidden || !excludes_equal(previous_db->excludes, db->excludes)
+        || !exclude_files_equal(previous_db->exclude_files, db->exclude_files)) {
+        // entries which are no longer excluded aren't part of the previous database
+        g_debug("[db_scan] exclude rules changed, can't reuse previous database");
+        return NULL;
+    }
+
+    // the arrays are copies, so the previous database can still be modified while we're scanning
+    db_lock(previous_db);
+    DynamicArray *folders = db_get_folders_sorted_copy(previous_db, DATABASE_INDEX_TYPE_NAME);
+    DynamicArray *files = db_get_files_sorted_copy(previous_db, DATABASE_INDEX_TYPE_NAME);
+    const time_t scan_timestamp = previous_db->scan_timestamp;
+    db_unlock(previous_db);
+
+    if (!folders || !files || scan_timestamp == 0) {
+        g_clear_pointer(&folders, darray_unref);
+        g_clear_pointer(&files, darray_unref);
+        return NULL;
+    }
+
+    darray_sort_multi_threaded(folders, (DynamicArrayCompareFunc)db_scan_previous_compare_entries);
+    darray_sort_multi_threaded(files, (DynamicArrayCompareFunc)db_scan_previous_compare_entries);
+
+    DatabaseScanPrevious *previous = calloc(1, sizeof(DatabaseScanPrevious));
+    assert(previous != NULL);
+    previous->db = db_ref(previous_db);
+    previous->folders = folders;
+    previous->files = files;
+    previous->scan_timestamp = scan_timestamp;
+    return previous;
+}
+
+// Returns the index of the first entry in entries which doesn't sort before (parent, name).
+// name == NULL returns the first child of parent.
+static uint32_t
+db_scan_previous_lower_bound(DynamicArray *entries, FsearchDatabaseEntryFolder *parent, const char *name) {
+    parent = (FsearchDatabaseEntryFolder *)db_entry_get_original((FsearchDatabaseEntry *)parent);
+    uint32_t lo = 0;
+    uint32_t hi = darray_get_num_items(entries);
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        FsearchDatabaseEntry *entry = darray_get_item(entries, mid);
+        const uintptr_t entry_parent = (uintptr_t)db_scan_previous_get_parent(entry);
+        bool before = entry_parent < (uintptr_t)parent;
+        if (entry_parent == (uintptr_t)parent) {
+            before = name && strcmp(db_entry_get_name(entry), name) < 0;
+        }
+        if (before) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static FsearchDatabaseEntryFolder *
+db_scan_previous_find_folder(DatabaseScanPrevious *previous, FsearchDatabaseEntryFolder *parent, const char *name) {
+    if (!previous) {
+        return NULL;
+    }
+    const uint32_t idx = db_scan_previous_lower_bound(previous->folders, parent, name);
+    if (idx >= darray_get_num_items(previous->folders)) {
+        return NULL;
+    }
+    FsearchDatabaseEntry *entry = darray_get_item(previous->folders, idx);
+    if (!db_scan_previous_is_child(entry, parent) || strcmp(db_entry_get_name(entry), name) != 0) {
+        return NULL;
+    }
+    return (FsearchDatabaseEntryFolder *)entry;
+}
+
+static bool
+db_scan_previous_folder_is_unchanged(DatabaseScanPrevious *previous,
+                                     FsearchDatabaseEntryFolder *folder,
+                                     FsearchDatabaseEntryFolder *previous_folder) {
+    if (!previous || !previous_folder) {
+        return false;
+    }
+    // index roots carry no modification time
+    if (!db_entry_get_parent((FsearchDatabaseEntry *)folder)) {
+        return false;
+    }
+    // Creating, deleting or renaming an entry updates the modification time of its folder. When that happened during
+    // the previous scan in the same second as the folder was read, the timestamps are equal although the previous
+    // contents are incomplete, so those folders are always read again.
+    const time_t mtime = db_entry_get_mtime((FsearchDatabaseEntry *)folder);
+    return mtime == db_entry_get_mtime((FsearchDatabaseEntry *)previous_folder) && mtime < previous->scan_timestamp;
+}
+
 typedef struct DatabaseWalkContext {
     FsearchDatabase *db;
     GString *path;
     GTimer *timer;
     GCancellable *cancellable;
     void (*status_cb)(const char *);
+    // folders, files: receive the entries found by the walker
+    DynamicArray *folders;
+    DynamicArray *files;
+    // previous: NULL unless unchanged folders of a previous database can be reused
+    DatabaseScanPrevious *previous;
+    // entry_mutex: protects the entry stores and counters of the database when several roots are scanned at once
+    GMutex *entry_mutex;
     bool exclude_hidden;
 } DatabaseWalkContext;
 
-static int
-db_folder_scan_recursive(DatabaseWalkContext *walk_context, FsearchDatabaseEntryFolder *parent) {
-    if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
-        g_debug("[db_scan] cancelled");
-        return WALK_CANCEL;
+static void
+db_walk_context_lock(DatabaseWalkContext *walk_context) {
+    if (walk_context->entry_mutex) {
+        g_mutex_lock(walk_context->entry_mutex);
     }
+}
 
-    GString *path = walk_context->path;
-    g_string_append_c(path, G_DIR_SEPARATOR);
-
-    // remember end of parent path
-    const gsize path_len = path->len;
-
-    DIR *dir = NULL;
-    if (!(dir = opendir(path->str))) {
-        g_debug("[db_scan] failed to open directory: %s", path->str);
-        return WALK_BADIO;
+static void
+db_walk_context_unlock(DatabaseWalkContext *walk_context) {
+    if (walk_context->entry_mutex) {
+        g_mutex_unlock(walk_context->entry_mutex);
     }
+}
 
-    const int dir_fd = dirfd(dir);
-
-    const double elapsed_seconds = g_timer_elapsed(walk_context->timer, NULL);
-    if (elapsed_seconds > 0.1) {
-        if (walk_context->status_cb) {
-            walk_context->status_cb(path->str);
-        }
-        g_timer_start(walk_context->timer);
+// Allocates an entry from the store of its type and names it, returns NULL when the database has no room left for it
+static FsearchDatabaseEntry *
+db_alloc_entry(FsearchDatabase *db, FsearchDatabaseEntryType type, const char *name) {
+    FsearchDatabaseEntryStore *store = type == DATABASE_ENTRY_TYPE_FOLDER ? db->folder_store : db->file_store;
+    FsearchDatabaseEntry *entry = db_entry_store_alloc(store, type);
+    if (!entry || !db_entry_set_name(entry, name)) {
+        return NULL;
     }
+    return entry;
+}
 
+// Returns the next entry of dir which isn't excluded by the scan settings. Returns NULL once dir has no more entries
+// or when the scan was cancelled, in which case cancelled is set.
+static struct dirent *
+db_walk_context_read_dir(DatabaseWalkContext *walk_context, DIR *dir, bool *cancelled) {
     FsearchDatabase *db = walk_context->db;
 
     struct dirent *dent = NULL;
     while ((dent = readdir(dir))) {
         if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
             g_debug("[db_scan] cancelled");
-            g_clear_pointer(&dir, closedir);
-            return WALK_CANCEL;
+            *cancelled = true;
+            return NULL;
         }
         if (walk_context->exclude_hidden && dent->d_name[0] == '.') {
             // file is dotfile, skip
@@ -1253,7 +2832,149 @@ db_folder_scan_recursive(DatabaseWalkContext *walk_context, FsearchDatabaseEntry
             g_warning("[db_scan] file name too long, skipping: \"%s\" (len: %lu)", dent->d_name, d_name_len);
             continue;
         }
+        return dent;
+    }
+    return NULL;
+}
+
+static int
+db_folder_scan_recursive(DatabaseWalkContext *walk_context,
+                         FsearchDatabaseEntryFolder *parent,
+                         FsearchDatabaseEntryFolder *previous_parent);
+
+static int
+db_folder_scan_reuse(DatabaseWalkContext *walk_context,
+                     FsearchDatabaseEntryFolder *parent,
+                     FsearchDatabaseEntryFolder *previous_parent) {
+    GString *path = walk_context->path;
+    const gsize path_len = path->len;
+
+    // the folder is only opened to look up the modification times of its sub folders
+    const int dir_fd = open(path->str, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        g_debug("[db_scan] failed to open directory: %s", path->str);
+        return WALK_BADIO;
+    }
+
+    FsearchDatabase *db = walk_context->db;
+    DatabaseScanPrevious *previous = walk_context->previous;
+
+    int res = WALK_OK;
+    db_walk_context_lock(walk_context);
+    const uint32_t num_previous_files = darray_get_num_items(previous->files);
+    for (uint32_t i = db_scan_previous_lower_bound(previous->files, previous_parent, NULL); i < num_previous_files;
+         i++) {
+        FsearchDatabaseEntry *previous_entry = darray_get_item(previous->files, i);
+        if (!db_scan_previous_is_child(previous_entry, previous_parent)) {
+            break;
+        }
+        FsearchDatabaseEntry *entry = db_alloc_entry(db, DATABASE_ENTRY_TYPE_FILE, db_entry_get_name(previous_entry));
+        if (!entry) {
+            res = WALK_NOSPACE;
+            break;
+        }
+        db_entry_set_size(entry, db_entry_get_size(previous_entry));
+        db_entry_set_mtime(entry, db_entry_get_mtime(previous_entry));
+        db_entry_set_parent(entry, parent);
+        if (!db_entry_update_parent_size(entry)) {
+            res = WALK_NOSPACE;
+            break;
+        }
+
+        darray_add_item(walk_context->files, entry);
+
+        db->num_files++;
+        db->num_entries++;
+    }
+    db_walk_context_unlock(walk_context);
+
+    const uint32_t num_previous_folders = darray_get_num_items(previous->folders);
+    for (uint32_t i = db_scan_previous_lower_bound(previous->folders, previous_parent, NULL);
+         res == WALK_OK && i < num_previous_folders;
+         i++) {
+        FsearchDatabaseEntry *previous_entry = darray_get_item(previous->folders, i);
+        if (!db_scan_previous_is_child(previous_entry, previous_parent)) {
+            break;
+        }
+        const char *name = db_entry_get_name(previous_entry);
+
+        struct stat st;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) || !S_ISDIR(st.st_mode)) {
+            g_debug("[db_scan] can't stat: %s%s", path->str, name);
+            continue;
+        }
+
+        db_walk_context_lock(walk_context);
+        FsearchDatabaseEntry *entry = db_alloc_entry(db, DATABASE_ENTRY_TYPE_FOLDER, name);
+        if (!entry) {
+            db_walk_context_unlock(walk_context);
+            res = WALK_NOSPACE;
+            break;
+        }
+        db_entry_set_mtime(entry, st.st_mtime);
+        db_entry_set_parent(entry, parent);
+
+        db->num_folders++;
+        db->num_entries++;
+        db_walk_context_unlock(walk_context);
+
+        darray_add_item(walk_context->folders, entry);
+
+        // the contents of sub folders might have changed nevertheless
+        g_string_truncate(path, path_len);
+        g_string_append(path, name);
+        const int sub_res = db_folder_scan_recursive(walk_context,
+                                                     (FsearchDatabaseEntryFolder *)entry,
+                                                     (FsearchDatabaseEntryFolder *)previous_entry);
+        if (sub_res == WALK_CANCEL || sub_res == WALK_NOSPACE) {
+            res = sub_res;
+        }
+    }
+
+    close(dir_fd);
+    return res;
+}
+
+static int
+db_folder_scan_recursive(DatabaseWalkContext *walk_context,
+                         FsearchDatabaseEntryFolder *parent,
+                         FsearchDatabaseEntryFolder *previous_parent) {
+    if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
+        g_debug("[db_scan] cancelled");
+        return WALK_CANCEL;
+    }
+
+    GString *path = walk_context->path;
+    g_string_append_c(path, G_DIR_SEPARATOR);
+
+    // remember end of parent path
+    const gsize path_len = path->len;
+
+    if (db_scan_previous_folder_is_unchanged(walk_context->previous, parent, previous_parent)) {
+        return db_folder_scan_reuse(walk_context, parent, previous_parent);
+    }
+
+    DIR *dir = NULL;
+    if (!(dir = opendir(path->str))) {
+        g_debug("[db_scan] failed to open directory: %s", path->str);
+        return WALK_BADIO;
+    }
+
+    const int dir_fd = dirfd(dir);
+
+    const double elapsed_seconds = g_timer_elapsed(walk_context->timer, NULL);
+    if (elapsed_seconds > 0.1) {
+        if (walk_context->status_cb) {
+            walk_context->status_cb(path->str);
+        }
+        g_timer_start(walk_context->timer);
+    }
+
+    FsearchDatabase *db = walk_context->db;
 
+    bool cancelled = false;
+    struct dirent *dent = NULL;
+    while ((dent = db_walk_context_read_dir(walk_context, dir, &cancelled))) {
         // create full path of file/folder
         g_string_truncate(path, path_len);
         g_string_append(path, dent->d_name);
@@ -1270,94 +2991,746 @@ db_folder_scan_recursive(DatabaseWalkContext *walk_context, FsearchDatabaseEntry
             continue;
         }
 
+        db_walk_context_lock(walk_context);
+        FsearchDatabaseEntry *entry =
+            db_alloc_entry(db, is_dir ? DATABASE_ENTRY_TYPE_FOLDER : DATABASE_ENTRY_TYPE_FILE, dent->d_name);
+        if (!entry) {
+            db_walk_context_unlock(walk_context);
+            g_clear_pointer(&dir, closedir);
+            return WALK_NOSPACE;
+        }
+        db->num_entries++;
         if (is_dir) {
-            FsearchDatabaseEntryFolder *folder_entry = fsearch_memory_pool_malloc(db->folder_pool);
-            FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)folder_entry;
-            db_entry_set_name(entry, dent->d_name);
-            db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+            FsearchDatabaseEntryFolder *folder_entry = (FsearchDatabaseEntryFolder *)entry;
             db_entry_set_mtime(entry, st.st_mtime);
             db_entry_set_parent(entry, parent);
 
-            darray_add_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], folder_entry);
-
             db->num_folders++;
-
-            db_folder_scan_recursive(walk_context, folder_entry);
+            db_walk_context_unlock(walk_context);
+
+            darray_add_item(walk_context->folders, folder_entry);
+
+            const int sub_res = db_folder_scan_recursive(walk_context,
+                                                         folder_entry,
+                                                         previous_parent
+                                                             ? db_scan_previous_find_folder(walk_context->previous,
+                                                                                            previous_parent,
+                                                                                            dent->d_name)
+                                                             : NULL);
+            if (sub_res == WALK_NOSPACE) {
+                g_clear_pointer(&dir, closedir);
+                return WALK_NOSPACE;
+            }
         }
         else {
-            FsearchDatabaseEntryFile *file_entry = fsearch_memory_pool_malloc(db->file_pool);
-            db_entry_set_name(file_entry, dent->d_name);
-            db_entry_set_size(file_entry, st.st_size);
-            db_entry_set_mtime(file_entry, st.st_mtime);
-            db_entry_set_type(file_entry, DATABASE_ENTRY_TYPE_FILE);
-            db_entry_set_parent(file_entry, parent);
-            db_entry_update_parent_size(file_entry);
-
-            darray_add_item(db->sorted_files[DATABASE_INDEX_TYPE_NAME], file_entry);
+            db_entry_set_size(entry, st.st_size);
+            db_entry_set_mtime(entry, st.st_mtime);
+            db_entry_set_parent(entry, parent);
+            const bool updated = db_entry_update_parent_size(entry);
 
             db->num_files++;
-        }
+            db_walk_context_unlock(walk_context);
 
-        db->num_entries++;
+            darray_add_item(walk_context->files, entry);
+            if (!updated) {
+                g_clear_pointer(&dir, closedir);
+                return WALK_NOSPACE;
+            }
+        }
     }
 
     g_clear_pointer(&dir, closedir);
-    return WALK_OK;
+    return cancelled ? WALK_CANCEL : WALK_OK;
 }
 
-static bool
-db_scan_folder(FsearchDatabase *db, const char *dname, GCancellable *cancellable, void (*status_cb)(const char *)) {
-    assert(dname != NULL);
-    assert(dname[0] == G_DIR_SEPARATOR);
-    g_debug("[db_scan] scan path: %s", dname);
+typedef struct DatabaseScanTask {
+    // path: path of the directory without a trailing separator
+    char *path;
+    FsearchDatabaseEntryFolder *folder;
+    // previous: the same folder in the previous database or NULL
+    FsearchDatabaseEntryFolder *previous;
+} DatabaseScanTask;
+
+typedef struct DatabaseScanItem {
+    FsearchDatabaseEntryFolder *folder;
+    FsearchDatabaseEntryFolder *previous;
+    size_t name_offset;
+    off_t size;
+    time_t mtime;
+    bool is_dir;
+    bool is_valid;
+} DatabaseScanItem;
+
+typedef struct DatabaseParallelWalkContext DatabaseParallelWalkContext;
+
+typedef struct DatabaseScanWorker {
+    DatabaseParallelWalkContext *ctx;
+    GThread *thread;
+    uint32_t id;
+
+    // tasks: the worker takes its own tasks from the tail, idle workers steal from the head
+    GQueue tasks;
+    GMutex tasks_mutex;
+
+    // folders, files: entries found by this worker, they get merged into the database at the end
+    DynamicArray *folders;
+    DynamicArray *files;
+
+    // statx_batch: NULL when the metadata is fetched with fstatat
+    FsearchStatxBatch *statx_batch;
+
+    // buffers which get reused for every directory
+    GString *path;
+    GString *names;
+    GArray *items;
+    GPtrArray *stat_names;
+    GArray *stat_results;
+    GArray *stat_errors;
+} DatabaseScanWorker;
+
+struct DatabaseParallelWalkContext {
+    DatabaseWalkContext *walk_context;
+
+    DatabaseScanWorker *workers;
+    uint32_t num_workers;
+
+    // num_pending: directories which are either queued or being processed
+    volatile gint num_pending;
+    // num_queued: directories which are waiting in any of the task queues
+    volatile gint num_queued;
+    volatile gint num_idle;
+    GMutex idle_mutex;
+    GCond idle_cond;
+
+    // entry_mutex: the entry stores and counters of the database are shared by all workers
+    GMutex *entry_mutex;
+
+    volatile gint root_failed;
+    // no_space: set once the database ran out of room for entries, the remaining tasks are only drained afterwards
+    volatile gint no_space;
+};
 
-    if (!g_file_test(dname, G_FILE_TEST_IS_DIR)) {
-        g_warning("[db_scan] %s doesn't exist", dname);
-        return false;
-    }
+static DatabaseScanTask *
+db_scan_task_new(const char *path, FsearchDatabaseEntryFolder *folder, FsearchDatabaseEntryFolder *previous) {
+    DatabaseScanTask *task = calloc(1, sizeof(DatabaseScanTask));
+    assert(task != NULL);
+    task->path = g_strdup(path);
+    task->folder = folder;
+    task->previous = previous;
+    return task;
+}
 
-    GString *path = g_string_new(dname);
-    // remove leading path separator '/' for root directory
-    if (strcmp(path->str, G_DIR_SEPARATOR_S) == 0) {
-        g_string_erase(path, 0, 1);
+static void
+db_scan_task_free(DatabaseScanTask *task) {
+    if (!task) {
+        return;
     }
+    g_clear_pointer(&task->path, g_free);
+    g_clear_pointer(&task, free);
+}
 
-    GTimer *timer = g_timer_new();
-    g_timer_start(timer);
-    DatabaseWalkContext walk_context = {
-        .db = db,
-        .path = path,
-        .timer = timer,
-        .cancellable = cancellable,
-        .status_cb = status_cb,
-        .exclude_hidden = db->exclude_hidden,
-    };
+static void
+db_scan_worker_push_task(DatabaseScanWorker *worker, DatabaseScanTask *task) {
+    DatabaseParallelWalkContext *ctx = worker->ctx;
 
-    FsearchDatabaseEntryFolder *parent = fsearch_memory_pool_malloc(db->folder_pool);
-    FsearchDatabaseEntry *entry = (FsearchDatabaseEntry *)parent;
-    db_entry_set_name(entry, path->str);
-    db_entry_set_parent(entry, NULL);
-    db_entry_set_type(entry, DATABASE_ENTRY_TYPE_FOLDER);
+    g_atomic_int_inc(&ctx->num_pending);
+    g_atomic_int_inc(&ctx->num_queued);
 
-    darray_add_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], parent);
-    db->num_folders++;
-    db->num_entries++;
+    g_mutex_lock(&worker->tasks_mutex);
+    g_queue_push_tail(&worker->tasks, task);
+    g_mutex_unlock(&worker->tasks_mutex);
 
-    uint32_t res = db_folder_scan_recursive(&walk_context, parent);
+    if (g_atomic_int_get(&ctx->num_idle) > 0) {
+        g_mutex_lock(&ctx->idle_mutex);
+        g_cond_signal(&ctx->idle_cond);
+        g_mutex_unlock(&ctx->idle_mutex);
+    }
+}
+
+static DatabaseScanTask *
+db_scan_worker_pop_task(DatabaseScanWorker *worker) {
+    DatabaseParallelWalkContext *ctx = worker->ctx;
+
+    // depth first on our own queue keeps the working set of a worker small
+    g_mutex_lock(&worker->tasks_mutex);
+    DatabaseScanTask *task = g_queue_pop_tail(&worker->tasks);
+    g_mutex_unlock(&worker->tasks_mutex);
+
+    // otherwise steal the oldest task of another worker, which is usually the biggest subtree
+    for (uint32_t i = 1; !task && i < ctx->num_workers; i++) {
+        DatabaseScanWorker *victim = &ctx->workers[(worker->id + i) % ctx->num_workers];
+        g_mutex_lock(&victim->tasks_mutex);
+        task = g_queue_pop_head(&victim->tasks);
+        g_mutex_unlock(&victim->tasks_mutex);
+    }
+
+    if (task) {
+        g_atomic_int_add(&ctx->num_queued, -1);
+    }
+    return task;
+}
+
+static void
+db_scan_worker_stat_items(DatabaseScanWorker *worker, int dir_fd) {
+    const uint32_t num_items = worker->items->len;
+
+    bool batched = false;
+    if (worker->statx_batch && num_items > 1) {
+        g_ptr_array_set_size(worker->stat_names, 0);
+        for (uint32_t i = 0; i < num_items; i++) {
+            DatabaseScanItem *item = &g_array_index(worker->items, DatabaseScanItem, i);
+            g_ptr_array_add(worker->stat_names, worker->names->str + item->name_offset);
+        }
+        g_array_set_size(worker->stat_results, num_items);
+        g_array_set_size(worker->stat_errors, num_items);
+
+        batched = fsearch_statx_batch_run(worker->statx_batch,
+                                          dir_fd,
+                                          (const char **)worker->stat_names->pdata,
+                                          num_items,
+                                          (struct statx *)worker->stat_results->data,
+                                          (int32_t *)worker->stat_errors->data);
+        if (!batched) {
+            // a ring which failed once isn't used again, the worker falls back to fstatat for the rest of the scan
+            if (fsearch_statx_batch_get_num_pending(worker->statx_batch) > 0) {
+                // the kernel might still write to the results of the requests it didn't finish, so their buffer is
+                // left to it and never freed
+                g_array_free(g_steal_pointer(&worker->stat_results), FALSE);
+                worker->stat_results = g_array_new(FALSE, FALSE, sizeof(struct statx));
+            }
+            g_clear_pointer(&worker->statx_batch, fsearch_statx_batch_free);
+        }
+    }
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        DatabaseScanItem *item = &g_array_index(worker->items, DatabaseScanItem, i);
+        if (batched && g_array_index(worker->stat_errors, int32_t, i) == 0) {
+            struct statx *stx = &g_array_index(worker->stat_results, struct statx, i);
+            item->is_dir = S_ISDIR(stx->stx_mode);
+            item->size = (off_t)stx->stx_size;
+            item->mtime = stx->stx_mtime.tv_sec;
+            item->is_valid = true;
+            continue;
+        }
+
+        // failed batch requests are retried synchronously, e.g. when the kernel doesn't support statx in io_uring
+        struct stat st;
+        if (fstatat(dir_fd, worker->names->str + item->name_offset, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT)) {
+            item->is_valid = false;
+            continue;
+        }
+        item->is_dir = S_ISDIR(st.st_mode);
+        item->size = st.st_size;
+        item->mtime = st.st_mtime;
+        item->is_valid = true;
+    }
+}
+
+static bool
+db_scan_worker_read_items(DatabaseScanWorker *worker, DIR *dir) {
+    bool cancelled = false;
+    struct dirent *dent = NULL;
+    while ((dent = db_walk_context_read_dir(worker->ctx->walk_context, dir, &cancelled))) {
+        DatabaseScanItem item = {
+            .name_offset = worker->names->len,
+        };
+        // store the name together with its terminating null byte
+        g_string_append_len(worker->names, dent->d_name, (gssize)strlen(dent->d_name) + 1);
+        g_array_append_val(worker->items, item);
+    }
+    return !cancelled;
+}
+
+static void
+db_scan_worker_reuse_items(DatabaseScanWorker *worker, FsearchDatabaseEntryFolder *previous_folder, int dir_fd) {
+    DatabaseScanPrevious *previous = worker->ctx->walk_context->previous;
+
+    const uint32_t num_previous_files = darray_get_num_items(previous->files);
+    for (uint32_t i = db_scan_previous_lower_bound(previous->files, previous_folder, NULL); i < num_previous_files;
+         i++) {
+        FsearchDatabaseEntry *previous_entry = darray_get_item(previous->files, i);
+        if (!db_scan_previous_is_child(previous_entry, previous_folder)) {
+            break;
+        }
+        DatabaseScanItem item = {
+            .name_offset = worker->names->len,
+            .size = db_entry_get_size(previous_entry),
+            .mtime = db_entry_get_mtime(previous_entry),
+            .is_valid = true,
+        };
+        const char *name = db_entry_get_name(previous_entry);
+        g_string_append_len(worker->names, name, (gssize)strlen(name) + 1);
+        g_array_append_val(worker->items, item);
+    }
+
+    // sub folders are visited nevertheless, so we need their current modification time
+    const uint32_t num_previous_folders = darray_get_num_items(previous->folders);
+    for (uint32_t i = db_scan_previous_lower_bound(previous->folders, previous_folder, NULL);
+         i < num_previous_folders;
+         i++) {
+        FsearchDatabaseEntry *previous_entry = darray_get_item(previous->folders, i);
+        if (!db_scan_previous_is_child(previous_entry, previous_folder)) {
+            break;
+        }
+        const char *name = db_entry_get_name(previous_entry);
+
+        struct stat st;
+        const bool is_valid = !fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT) && S_ISDIR(st.st_mode);
+        DatabaseScanItem item = {
+            .previous = (FsearchDatabaseEntryFolder *)previous_entry,
+            .name_offset = worker->names->len,
+            .mtime = is_valid ? st.st_mtime : 0,
+            .is_dir = true,
+            .is_valid = is_valid,
+        };
+        g_string_append_len(worker->names, name, (gssize)strlen(name) + 1);
+        g_array_append_val(worker->items, item);
+    }
+}
+
+static void
+db_scan_worker_process_task(DatabaseScanWorker *worker, DatabaseScanTask *task) {
+    DatabaseParallelWalkContext *ctx = worker->ctx;
+    DatabaseWalkContext *walk_context = ctx->walk_context;
+    FsearchDatabase *db = walk_context->db;
+
+    GString *path = worker->path;
+    g_string_assign(path, task->path);
+    g_string_append_c(path, G_DIR_SEPARATOR);
+
+    // remember end of parent path
+    const gsize path_len = path->len;
+
+    g_array_set_size(worker->items, 0);
+    g_string_truncate(worker->names, 0);
+
+    const bool reuse = db_scan_previous_folder_is_unchanged(walk_context->previous, task->folder, task->previous);
+    if (reuse) {
+        // the folder is only opened to look up the modification times of its sub folders
+        const int dir_fd = open(path->str, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0) {
+            g_debug("[db_scan] failed to open directory: %s", path->str);
+            return;
+        }
+        db_scan_worker_reuse_items(worker, task->previous, dir_fd);
+        close(dir_fd);
+    }
+    else {
+        DIR *dir = NULL;
+        if (!(dir = opendir(path->str))) {
+            g_debug("[db_scan] failed to open directory: %s", path->str);
+            if (!db_entry_get_parent((FsearchDatabaseEntry *)task->folder)) {
+                g_atomic_int_set(&ctx->root_failed, 1);
+            }
+            return;
+        }
+
+        // first collect the names of all directory entries without holding any lock
+        if (!db_scan_worker_read_items(worker, dir)) {
+            g_clear_pointer(&dir, closedir);
+            return;
+        }
+
+        // then fetch their metadata
+        db_scan_worker_stat_items(worker, dirfd(dir));
+        g_clear_pointer(&dir, closedir);
+    }
+
+    for (uint32_t i = 0; i < worker->items->len; i++) {
+        DatabaseScanItem *item = &g_array_index(worker->items, DatabaseScanItem, i);
+        if (!item->is_valid) {
+            g_debug("[db_scan] can't stat: %s%s", path->str, worker->names->str + item->name_offset);
+            continue;
+        }
+        if (!item->is_dir) {
+            continue;
+        }
+        // create full path of folder
+        g_string_truncate(path, path_len);
+        g_string_append(path, worker->names->str + item->name_offset);
+        if (directory_is_excluded(path->str, db->excludes)) {
+            g_debug("[db_scan] excluded directory: %s", path->str);
+            item->is_valid = false;
+        }
+        else if (!reuse && task->previous) {
+            item->previous = db_scan_previous_find_folder(walk_context->previous,
+                                                          task->previous,
+                                                          worker->names->str + item->name_offset);
+        }
+    }
+
+    g_string_truncate(path, path_len);
+
+    // then add them to the database in one go
+    g_mutex_lock(ctx->entry_mutex);
+
+    const double elapsed_seconds = g_timer_elapsed(walk_context->timer, NULL);
+    if (elapsed_seconds > 0.1) {
+        if (walk_context->status_cb) {
+            walk_context->status_cb(path->str);
+        }
+        g_timer_start(walk_context->timer);
+    }
+
+    for (uint32_t i = 0; i < worker->items->len; i++) {
+        DatabaseScanItem *item = &g_array_index(worker->items, DatabaseScanItem, i);
+        if (!item->is_valid) {
+            continue;
+        }
+        const char *name = worker->names->str + item->name_offset;
+        FsearchDatabaseEntry *entry =
+            db_alloc_entry(db, item->is_dir ? DATABASE_ENTRY_TYPE_FOLDER : DATABASE_ENTRY_TYPE_FILE, name);
+        if (!entry) {
+            g_atomic_int_set(&ctx->no_space, 1);
+            break;
+        }
+        if (item->is_dir) {
+            db_entry_set_mtime(entry, item->mtime);
+            db_entry_set_parent(entry, task->folder);
+
+            item->folder = (FsearchDatabaseEntryFolder *)entry;
+            darray_add_item(worker->folders, entry);
+
+            db->num_folders++;
+        }
+        else {
+            db_entry_set_size(entry, item->size);
+            db_entry_set_mtime(entry, item->mtime);
+            db_entry_set_parent(entry, task->folder);
+            if (!db_entry_update_parent_size(entry)) {
+                g_atomic_int_set(&ctx->no_space, 1);
+            }
+
+            darray_add_item(worker->files, entry);
+
+            db->num_files++;
+        }
+        db->num_entries++;
+    }
+
+    g_mutex_unlock(ctx->entry_mutex);
+
+    if (g_atomic_int_get(&ctx->no_space)) {
+        return;
+    }
+
+    // finally queue the sub directories
+    for (uint32_t i = 0; i < worker->items->len; i++) {
+        DatabaseScanItem *item = &g_array_index(worker->items, DatabaseScanItem, i);
+        if (!item->is_valid || !item->is_dir) {
+            continue;
+        }
+        g_string_truncate(path, path_len);
+        g_string_append(path, worker->names->str + item->name_offset);
+        db_scan_worker_push_task(worker, db_scan_task_new(path->str, item->folder, item->previous));
+    }
+}
+
+static gpointer
+db_scan_worker_thread(gpointer data) {
+    DatabaseScanWorker *worker = data;
+    DatabaseParallelWalkContext *ctx = worker->ctx;
+    GCancellable *cancellable = ctx->walk_context->cancellable;
+
+    while (true) {
+        DatabaseScanTask *task = db_scan_worker_pop_task(worker);
+        if (task) {
+            // when the scan was cancelled or failed the remaining tasks are only drained
+            if ((!cancellable || !g_cancellable_is_cancelled(cancellable)) && !g_atomic_int_get(&ctx->no_space)) {
+                db_scan_worker_process_task(worker, task);
+            }
+            g_clear_pointer(&task, db_scan_task_free);
+
+            if (g_atomic_int_dec_and_test(&ctx->num_pending)) {
+                // this was the last directory, wake up all idle workers so they can quit
+                g_mutex_lock(&ctx->idle_mutex);
+                g_cond_broadcast(&ctx->idle_cond);
+                g_mutex_unlock(&ctx->idle_mutex);
+            }
+            continue;
+        }
+
+        g_mutex_lock(&ctx->idle_mutex);
+        g_atomic_int_inc(&ctx->num_idle);
+        while (g_atomic_int_get(&ctx->num_queued) == 0 && g_atomic_int_get(&ctx->num_pending) > 0) {
+            g_cond_wait(&ctx->idle_cond, &ctx->idle_mutex);
+        }
+        g_atomic_int_add(&ctx->num_idle, -1);
+        const bool finished = g_atomic_int_get(&ctx->num_pending) == 0;
+        g_mutex_unlock(&ctx->idle_mutex);
+
+        if (finished) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int
+db_folder_scan_parallel(DatabaseWalkContext *walk_context,
+                        FsearchDatabaseEntryFolder *root,
+                        FsearchDatabaseEntryFolder *previous_root,
+                        uint32_t num_threads) {
+    FsearchDatabase *db = walk_context->db;
+
+    DatabaseParallelWalkContext ctx = {
+        .walk_context = walk_context,
+        .num_workers = num_threads,
+    };
+    g_mutex_init(&ctx.idle_mutex);
+    // roots which are scanned at the same time share the entry stores too
+    GMutex entry_mutex;
+    g_mutex_init(&entry_mutex);
+    ctx.entry_mutex = walk_context->entry_mutex ? walk_context->entry_mutex : &entry_mutex;
+    g_cond_init(&ctx.idle_cond);
+
+    ctx.workers = calloc(num_threads, sizeof(DatabaseScanWorker));
+    assert(ctx.workers != NULL);
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        DatabaseScanWorker *worker = &ctx.workers[i];
+        worker->ctx = &ctx;
+        worker->id = i;
+        g_queue_init(&worker->tasks);
+        g_mutex_init(&worker->tasks_mutex);
+        worker->folders = darray_new(1024);
+        worker->files = darray_new(1024);
+        worker->path = g_string_sized_new(PATH_MAX);
+        worker->names = g_string_sized_new(4096);
+        worker->items = g_array_new(FALSE, FALSE, sizeof(DatabaseScanItem));
+        worker->stat_names = g_ptr_array_new();
+        worker->stat_results = g_array_new(FALSE, FALSE, sizeof(struct statx));
+        worker->stat_errors = g_array_new(FALSE, FALSE, sizeof(int32_t));
+        // every worker needs its own ring, they aren't thread safe
+        worker->statx_batch = fsearch_statx_batch_new(db->scan_queue_depth);
+    }
+
+    db_scan_worker_push_task(&ctx.workers[0], db_scan_task_new(walk_context->path->str, root, previous_root));
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        ctx.workers[i].thread = g_thread_new("fsearch_db_scan", db_scan_worker_thread, &ctx.workers[i]);
+    }
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        DatabaseScanWorker *worker = &ctx.workers[i];
+        g_thread_join(g_steal_pointer(&worker->thread));
+
+        // merge the thread local results into the database
+        const uint32_t num_folders = darray_get_num_items(worker->folders);
+        for (uint32_t j = 0; j < num_folders; j++) {
+            darray_add_item(walk_context->folders, darray_get_item(worker->folders, j));
+        }
+        const uint32_t num_files = darray_get_num_items(worker->files);
+        for (uint32_t j = 0; j < num_files; j++) {
+            darray_add_item(walk_context->files, darray_get_item(worker->files, j));
+        }
+
+        g_clear_pointer(&worker->folders, darray_unref);
+        g_clear_pointer(&worker->files, darray_unref);
+        g_string_free(g_steal_pointer(&worker->path), TRUE);
+        g_string_free(g_steal_pointer(&worker->names), TRUE);
+        g_array_free(g_steal_pointer(&worker->items), TRUE);
+        g_ptr_array_free(g_steal_pointer(&worker->stat_names), TRUE);
+        g_array_free(g_steal_pointer(&worker->stat_results), TRUE);
+        g_array_free(g_steal_pointer(&worker->stat_errors), TRUE);
+        g_clear_pointer(&worker->statx_batch, fsearch_statx_batch_free);
+        g_mutex_clear(&worker->tasks_mutex);
+    }
+
+    g_clear_pointer(&ctx.workers, free);
+    g_cond_clear(&ctx.idle_cond);
+    g_mutex_clear(&entry_mutex);
+    g_mutex_clear(&ctx.idle_mutex);
+
+    if (walk_context->cancellable && g_cancellable_is_cancelled(walk_context->cancellable)) {
+        return WALK_CANCEL;
+    }
+    if (g_atomic_int_get(&ctx.no_space)) {
+        return WALK_NOSPACE;
+    }
+    return g_atomic_int_get(&ctx.root_failed) ? WALK_BADIO : WALK_OK;
+}
+
+// Shared by all index roots of a scan
+typedef struct DatabaseScanContext {
+    FsearchDatabase *db;
+    DatabaseScanPrevious *previous;
+    // entry_mutex: NULL when the roots are scanned one after another
+    GMutex *entry_mutex;
+    GCancellable *cancellable;
+    void (*status_cb)(const char *);
+    // no_space: set when the database ran out of room for the entries of any root
+    volatile gint no_space;
+} DatabaseScanContext;
+
+typedef struct DatabaseScanRoot {
+    const char *path;
+    // folders, files: entries of this root, they get merged into the database once all roots are scanned
+    DynamicArray *folders;
+    DynamicArray *files;
+    bool scanned;
+} DatabaseScanRoot;
+
+static bool
+db_scan_folder(DatabaseScanContext *scan_context, DatabaseScanRoot *root) {
+    const char *dname = root->path;
+    assert(dname != NULL);
+    assert(dname[0] == G_DIR_SEPARATOR);
+    g_debug("[db_scan] scan path: %s", dname);
+
+    if (!g_file_test(dname, G_FILE_TEST_IS_DIR)) {
+        g_warning("[db_scan] %s doesn't exist", dname);
+        return false;
+    }
+
+    FsearchDatabase *db = scan_context->db;
+
+    GString *path = g_string_new(dname);
+    // remove leading path separator '/' for root directory
+    if (strcmp(path->str, G_DIR_SEPARATOR_S) == 0) {
+        g_string_erase(path, 0, 1);
+    }
+
+    GTimer *timer = g_timer_new();
+    g_timer_start(timer);
+    DatabaseWalkContext walk_context = {
+        .db = db,
+        .path = path,
+        .timer = timer,
+        .cancellable = scan_context->cancellable,
+        .status_cb = scan_context->status_cb,
+        .folders = root->folders,
+        .files = root->files,
+        .previous = scan_context->previous,
+        .entry_mutex = scan_context->entry_mutex,
+        .exclude_hidden = db->exclude_hidden,
+    };
+
+    uint32_t res = WALK_NOSPACE;
+    db_walk_context_lock(&walk_context);
+    FsearchDatabaseEntry *entry = db_alloc_entry(db, DATABASE_ENTRY_TYPE_FOLDER, path->str);
+    FsearchDatabaseEntryFolder *parent = (FsearchDatabaseEntryFolder *)entry;
+    if (entry) {
+        db->num_folders++;
+        db->num_entries++;
+    }
+    db_walk_context_unlock(&walk_context);
+
+    if (entry) {
+        darray_add_item(root->folders, parent);
+
+        FsearchDatabaseEntryFolder *previous_parent =
+            db_scan_previous_find_folder(scan_context->previous, NULL, path->str);
+
+        // batched metadata requests are only supported by the task based walker, which also works with a single thread
+        res = db->num_scan_threads > 1 || db->scan_queue_depth > 0
+                ? db_folder_scan_parallel(&walk_context, parent, previous_parent, db->num_scan_threads)
+                : db_folder_scan_recursive(&walk_context, parent, previous_parent);
+    }
 
     g_string_free(g_steal_pointer(&path), TRUE);
 
     g_clear_pointer(&timer, g_timer_destroy);
 
     if (res == WALK_OK) {
-        g_debug("[db_scan] scanned: %d files, %d folders -> %d total", db->num_files, db->num_folders, db->num_entries);
+        g_debug("[db_scan] scanned %s: %d files, %d folders",
+                dname,
+                darray_get_num_items(root->files),
+                darray_get_num_items(root->folders));
         return true;
     }
 
+    if (res == WALK_NOSPACE) {
+        g_atomic_int_set(&scan_context->no_space, 1);
+    }
     g_warning("[db_scan] walk error: %d", res);
     return false;
 }
 
+// The roots which reside on the same device. They are scanned one after another, because the walker of a single
+// root already keeps a device busy and running several of them only makes the disk seek back and forth.
+typedef struct DatabaseScanDevice {
+    DatabaseScanContext *scan_context;
+    GThread *thread;
+    dev_t device;
+    GPtrArray *roots;
+} DatabaseScanDevice;
+
+static gpointer
+db_scan_device_thread(gpointer data) {
+    DatabaseScanDevice *device = data;
+    for (uint32_t i = 0; i < device->roots->len; i++) {
+        DatabaseScanRoot *root = g_ptr_array_index(device->roots, i);
+        root->scanned = db_scan_folder(device->scan_context, root);
+    }
+    return NULL;
+}
+
+static DatabaseScanDevice *
+db_scan_device_find(GPtrArray *devices, dev_t dev) {
+    for (uint32_t i = 0; i < devices->len; i++) {
+        DatabaseScanDevice *device = g_ptr_array_index(devices, i);
+        if (device->device == dev) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static void
+db_scan_device_free(DatabaseScanDevice *device) {
+    if (!device) {
+        return;
+    }
+    g_clear_pointer(&device->roots, g_ptr_array_unref);
+    g_clear_pointer(&device, free);
+}
+
+static void
+db_scan_roots(DatabaseScanContext *scan_context, DatabaseScanRoot *roots, uint32_t num_roots) {
+    GPtrArray *devices = g_ptr_array_new_with_free_func((GDestroyNotify)db_scan_device_free);
+    for (uint32_t i = 0; i < num_roots; i++) {
+        struct stat st;
+        // roots which can't be accessed get a device of their own, db_scan_folder reports the error
+        const bool has_device = stat(roots[i].path, &st) == 0;
+
+        DatabaseScanDevice *device = has_device ? db_scan_device_find(devices, st.st_dev) : NULL;
+        if (!device) {
+            device = calloc(1, sizeof(DatabaseScanDevice));
+            assert(device != NULL);
+            device->scan_context = scan_context;
+            device->device = has_device ? st.st_dev : 0;
+            device->roots = g_ptr_array_new();
+            g_ptr_array_add(devices, device);
+        }
+        g_ptr_array_add(device->roots, &roots[i]);
+    }
+
+    if (devices->len == 1) {
+        db_scan_device_thread(g_ptr_array_index(devices, 0));
+    }
+    else {
+        GMutex entry_mutex;
+        g_mutex_init(&entry_mutex);
+        scan_context->entry_mutex = &entry_mutex;
+
+        g_debug("[db_scan] scan %d devices in parallel", devices->len);
+        for (uint32_t i = 0; i < devices->len; i++) {
+            DatabaseScanDevice *device = g_ptr_array_index(devices, i);
+            device->thread = g_thread_new("fsearch_db_scan_device", db_scan_device_thread, device);
+        }
+        for (uint32_t i = 0; i < devices->len; i++) {
+            DatabaseScanDevice *device = g_ptr_array_index(devices, i);
+            g_thread_join(g_steal_pointer(&device->thread));
+        }
+
+        scan_context->entry_mutex = NULL;
+        g_mutex_clear(&entry_mutex);
+    }
+
+    g_clear_pointer(&devices, g_ptr_array_unref);
+}
+
 static gint
 compare_index_path(FsearchIndex *p1, FsearchIndex *p2) {
     return strcmp(p1->path, p2->path);
@@ -1373,6 +3746,8 @@ db_new(GList *indexes, GList *excludes, char **exclude_files, bool exclude_hidde
     FsearchDatabase *db = g_new0(FsearchDatabase, 1);
     g_assert(db != NULL);
     g_mutex_init(&db->mutex);
+    g_mutex_init(&db->save_mutex);
+    g_mutex_init(&db->generation_mutex);
     if (indexes) {
         db->indexes = g_list_copy_deep(indexes, (GCopyFunc)fsearch_index_copy, NULL);
         db->indexes = g_list_sort(db->indexes, (GCompareFunc)compare_index_path);
@@ -1389,16 +3764,14 @@ db_new(GList *indexes, GList *excludes, char **exclude_files, bool exclude_hidde
         db->sorted_files[i] = NULL;
         db->sorted_folders[i] = NULL;
     }
-    db->file_pool = fsearch_memory_pool_new(NUM_DB_ENTRIES_FOR_POOL_BLOCK,
-                                            db_entry_get_sizeof_file_entry(),
-                                            (GDestroyNotify)db_file_entry_destroy);
-    db->folder_pool = fsearch_memory_pool_new(NUM_DB_ENTRIES_FOR_POOL_BLOCK,
-                                              db_entry_get_sizeof_folder_entry(),
-                                              (GDestroyNotify)db_folder_entry_destroy);
+    db->name_arena = fsearch_string_arena_new();
+    db->folder_store = db_entry_store_new(db->name_arena, NULL);
+    db->file_store = db_entry_store_new(db->name_arena, db->folder_store);
 
     db->thread_pool = fsearch_thread_pool_init();
 
     db->exclude_hidden = exclude_hidden;
+    db->num_scan_threads = 1;
     db->ref_count = 1;
     return db;
 }
@@ -1408,15 +3781,25 @@ db_free(FsearchDatabase *db) {
     assert(db != NULL);
 
     g_debug("[db_free] freeing...");
+    // the sort tasks need the lock, so they have to be stopped first. Background saves hold a reference, so none of
+    // them is left by now.
+    g_clear_pointer(&db->sort_queue, fsearch_task_queue_free);
+
+    db_search_cache_remove_database(db);
+
     db_lock(db);
     if (db->ref_count > 0) {
         g_warning("[db_free] pending references on free: %d", db->ref_count);
     }
 
     db_sorted_entries_free(db);
+    g_clear_pointer(&db->generation, db_generation_unref);
+    g_clear_pointer(&db->file_trigram_index, fsearch_trigram_index_unref);
+    g_clear_pointer(&db->folder_trigram_index, fsearch_trigram_index_unref);
 
-    g_clear_pointer(&db->file_pool, fsearch_memory_pool_free_pool);
-    g_clear_pointer(&db->folder_pool, fsearch_memory_pool_free_pool);
+    g_clear_pointer(&db->file_store, db_entry_store_free);
+    g_clear_pointer(&db->folder_store, db_entry_store_free);
+    g_clear_pointer(&db->name_arena, fsearch_string_arena_free);
 
     if (db->indexes) {
         g_list_free_full(g_steal_pointer(&db->indexes), (GDestroyNotify)fsearch_index_free);
@@ -1427,10 +3810,13 @@ db_free(FsearchDatabase *db) {
 
     g_clear_pointer(&db->exclude_files, g_strfreev);
     g_clear_pointer(&db->thread_pool, fsearch_thread_pool_free);
+    g_clear_pointer(&db->previous, db_unref);
 
     db_unlock(db);
 
     g_mutex_clear(&db->mutex);
+    g_mutex_clear(&db->save_mutex);
+    g_mutex_clear(&db->generation_mutex);
 
     g_clear_pointer(&db, free);
 
@@ -1489,34 +3875,95 @@ is_valid_sort_type(FsearchDatabaseIndexType sort_type) {
     return false;
 }
 
+static DynamicArray *
+db_generation_get_sorted_array(FsearchDatabaseGeneration *generation,
+                               FsearchDatabaseIndexType sort_type,
+                               FsearchDatabaseEntryType type) {
+    if (!generation || !is_valid_sort_type(sort_type)) {
+        return NULL;
+    }
+    DynamicArray *array = type == DATABASE_ENTRY_TYPE_FOLDER ? generation->sorted_folders[sort_type]
+                                                             : generation->sorted_files[sort_type];
+    return darray_ref(array);
+}
+
+bool
+db_generation_get_entries_sorted(FsearchDatabaseGeneration *generation,
+                                 FsearchDatabaseIndexType requested_sort_type,
+                                 FsearchDatabaseIndexType *returned_sort_type,
+                                 DynamicArray **folders,
+                                 DynamicArray **files) {
+    assert(returned_sort_type != NULL);
+    assert(folders != NULL);
+    assert(files != NULL);
+    if (!generation || !is_valid_sort_type(requested_sort_type)) {
+        return false;
+    }
+
+    FsearchDatabaseIndexType sort_type = requested_sort_type;
+    if (!generation->sorted_folders[sort_type]) {
+        sort_type = DATABASE_INDEX_TYPE_NAME;
+    }
+    if (!generation->sorted_folders[sort_type] || !generation->sorted_files[sort_type]) {
+        return false;
+    }
+
+    *folders = darray_ref(generation->sorted_folders[sort_type]);
+    *files = darray_ref(generation->sorted_files[sort_type]);
+    *returned_sort_type = sort_type;
+    return true;
+}
+
+DynamicArray *
+db_generation_get_folders(FsearchDatabaseGeneration *generation) {
+    return db_generation_get_sorted_array(generation, DATABASE_INDEX_TYPE_NAME, DATABASE_ENTRY_TYPE_FOLDER);
+}
+
+FsearchTrigramIndex *
+db_generation_get_trigram_index(FsearchDatabaseGeneration *generation, FsearchDatabaseEntryType type) {
+    if (!generation) {
+        return NULL;
+    }
+    return fsearch_trigram_index_ref(type == DATABASE_ENTRY_TYPE_FOLDER ? generation->folder_trigram_index
+                                                                        : generation->file_trigram_index);
+}
+
+static DynamicArray *
+db_get_sorted_array(FsearchDatabase *db,
+                    FsearchDatabaseIndexType sort_type,
+                    FsearchDatabaseEntryType type,
+                    bool copy) {
+    FsearchDatabaseGeneration *generation = db_get_generation(db);
+    DynamicArray *array = db_generation_get_sorted_array(generation, sort_type, type);
+    g_clear_pointer(&generation, db_generation_unref);
+    if (copy && array) {
+        DynamicArray *array_copy = darray_copy(array);
+        g_clear_pointer(&array, darray_unref);
+        return array_copy;
+    }
+    return array;
+}
+
 bool
 db_has_entries_sorted_by_type(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
     assert(db != NULL);
 
-    if (is_valid_sort_type(sort_type)) {
-        return db->sorted_folders[sort_type] ? true : false;
-    }
-    return false;
+    DynamicArray *folders = db_get_sorted_array(db, sort_type, DATABASE_ENTRY_TYPE_FOLDER, false);
+    const bool res = folders ? true : false;
+    g_clear_pointer(&folders, darray_unref);
+    return res;
 }
 
 DynamicArray *
 db_get_folders_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
     assert(db != NULL);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
-    }
-    DynamicArray *folders = db->sorted_folders[sort_type];
-    return folders ? darray_copy(folders) : NULL;
+    return db_get_sorted_array(db, sort_type, DATABASE_ENTRY_TYPE_FOLDER, true);
 }
 
 DynamicArray *
 db_get_files_sorted_copy(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
     assert(db != NULL);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
-    }
-    DynamicArray *files = db->sorted_files[sort_type];
-    return files ? darray_copy(files) : NULL;
+    return db_get_sorted_array(db, sort_type, DATABASE_ENTRY_TYPE_FILE, true);
 }
 
 DynamicArray *
@@ -1536,48 +3983,62 @@ db_get_entries_sorted(FsearchDatabase *db,
                       DynamicArray **folders,
                       DynamicArray **files) {
     assert(db != NULL);
-    assert(returned_sort_type != NULL);
-    assert(folders != NULL);
-    assert(files != NULL);
-    if (!is_valid_sort_type(requested_sort_type)) {
-        return false;
-    }
 
-    FsearchDatabaseIndexType sort_type = requested_sort_type;
-    if (!db_has_entries_sorted_by_type(db, requested_sort_type)) {
-        sort_type = DATABASE_INDEX_TYPE_NAME;
+    db_request_entries_sorted(db, requested_sort_type);
+
+    FsearchDatabaseGeneration *generation = db_get_generation(db);
+    const bool res =
+        db_generation_get_entries_sorted(generation, requested_sort_type, returned_sort_type, folders, files);
+    g_clear_pointer(&generation, db_generation_unref);
+    return res;
+}
+
+void
+db_request_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
+    assert(db != NULL);
+    if (!is_valid_sort_type(sort_type)) {
+        return;
     }
 
-    if (!db_has_entries_sorted_by_type(db, sort_type)) {
-        return false;
+    g_mutex_lock(&db->generation_mutex);
+    if (db->generation && db->generation->sorted_folders[sort_type]) {
+        // only the secondary sort types can be dropped, so there's no need to track the name index
+        if (sort_type != DATABASE_INDEX_TYPE_NAME) {
+            db->sorted_entries_last_used[sort_type] = g_get_monotonic_time();
+        }
     }
+    else if (db->generation && !db->sorted_entries_pending[sort_type] && db_can_build_sorted_entries(db, sort_type)) {
+        if (!db->sort_queue) {
+            db->sort_queue = fsearch_task_queue_new("fsearch_db_sort_queue");
+        }
 
-    *folders = darray_ref(db->sorted_folders[sort_type]);
-    *files = darray_ref(db->sorted_files[sort_type]);
-    *returned_sort_type = sort_type;
-    return true;
+        DatabaseSortTask *task = calloc(1, sizeof(DatabaseSortTask));
+        assert(task != NULL);
+        task->db = db;
+        task->sort_type = sort_type;
+
+        db->sorted_entries_pending[sort_type] = true;
+        fsearch_task_queue(db->sort_queue,
+                           FSEARCH_TASK_ID_SORT,
+                           db_sort_task,
+                           db_sort_task_finished,
+                           db_sort_task_cancelled,
+                           FSEARCH_TASK_CLEAR_NONE,
+                           g_steal_pointer(&task));
+    }
+    g_mutex_unlock(&db->generation_mutex);
 }
 
 DynamicArray *
 db_get_folders_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
     assert(db != NULL);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
-    }
-
-    DynamicArray *folders = db->sorted_folders[sort_type];
-    return darray_ref(folders);
+    return db_get_sorted_array(db, sort_type, DATABASE_ENTRY_TYPE_FOLDER, false);
 }
 
 DynamicArray *
 db_get_files_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type) {
     assert(db != NULL);
-    if (!is_valid_sort_type(sort_type)) {
-        return NULL;
-    }
-
-    DynamicArray *files = db->sorted_files[sort_type];
-    return darray_ref(files);
+    return db_get_sorted_array(db, sort_type, DATABASE_ENTRY_TYPE_FILE, false);
 }
 
 DynamicArray *
@@ -1598,6 +4059,59 @@ db_get_thread_pool(FsearchDatabase *db) {
     return db->thread_pool;
 }
 
+void
+db_set_num_scan_threads(FsearchDatabase *db, uint32_t num_threads) {
+    assert(db != NULL);
+    db->num_scan_threads = num_threads > 0 ? num_threads : g_get_num_processors();
+}
+
+void
+db_set_compression(FsearchDatabase *db, bool compress) {
+    assert(db != NULL);
+    db->compress = compress;
+}
+
+void
+db_set_trigram_index(FsearchDatabase *db, bool trigram_index) {
+    assert(db != NULL);
+    db_lock(db);
+    db->trigram_index = trigram_index;
+    if (!trigram_index && (db->file_trigram_index || db->folder_trigram_index)) {
+        g_clear_pointer(&db->file_trigram_index, fsearch_trigram_index_unref);
+        g_clear_pointer(&db->folder_trigram_index, fsearch_trigram_index_unref);
+        db_publish_generation(db);
+    }
+    else if (trigram_index && db->generation && !db->file_trigram_index) {
+        db_request_trigram_index(db);
+    }
+    db_unlock(db);
+}
+
+void
+db_set_scan_queue_depth(FsearchDatabase *db, uint32_t queue_depth) {
+    assert(db != NULL);
+    db->scan_queue_depth = queue_depth;
+}
+
+void
+db_set_previous_database(FsearchDatabase *db, FsearchDatabase *previous) {
+    assert(db != NULL);
+    g_clear_pointer(&db->previous, db_unref);
+    db->previous = previous ? db_ref(previous) : NULL;
+}
+
+void
+db_set_sorted_entries_memory_limit(FsearchDatabase *db, size_t limit) {
+    assert(db != NULL);
+    db_lock(db);
+    db->sorted_entries_memory_limit = limit;
+    db_sorted_entries_evict(db, DATABASE_INDEX_TYPE_NAME);
+    if (db->generation) {
+        db_publish_generation(db);
+    }
+    db_unlock(db);
+}
+
 bool
 db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const char *)) {
     assert(db != NULL);
@@ -1606,6 +4120,15 @@ db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const
 
     db_sorted_entries_free(db);
 
+    DatabaseScanPrevious *previous = NULL;
+    if (db->previous) {
+        previous = db_scan_previous_new(db, db->previous);
+        g_clear_pointer(&db->previous, db_unref);
+    }
+
+    // anything which changes from now on might be missed by the walker
+    db->scan_timestamp = time(NULL);
+
     db->index_flags |= DATABASE_INDEX_FLAG_NAME;
     db->index_flags |= DATABASE_INDEX_FLAG_SIZE;
     db->index_flags |= DATABASE_INDEX_FLAG_MODIFICATION_TIME;
@@ -1613,6 +4136,9 @@ db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const
     db->sorted_files[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
     db->sorted_folders[DATABASE_INDEX_TYPE_NAME] = darray_new(1024);
 
+    DatabaseScanRoot *roots = calloc(g_list_length(db->indexes) + 1, sizeof(DatabaseScanRoot));
+    assert(roots != NULL);
+    uint32_t num_roots = 0;
     for (GList *l = db->indexes; l != NULL; l = l->next) {
         FsearchIndex *fs_path = l->data;
         if (!fs_path->path) {
@@ -1622,16 +4148,799 @@ db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const
             continue;
         }
         if (fs_path->update) {
-            ret = db_scan_folder(db, fs_path->path, cancellable, status_cb) || ret;
+            DatabaseScanRoot *root = &roots[num_roots++];
+            root->path = fs_path->path;
+            root->folders = darray_new(1024);
+            root->files = darray_new(1024);
+        }
+    }
+
+    DatabaseScanContext scan_context = {
+        .db = db,
+        .previous = previous,
+        .cancellable = cancellable,
+        .status_cb = status_cb,
+    };
+    db_scan_roots(&scan_context, roots, num_roots);
+
+    // merge the results in the order of the indexes
+    for (uint32_t i = 0; i < num_roots; i++) {
+        DatabaseScanRoot *root = &roots[i];
+        ret = root->scanned || ret;
+        const uint32_t num_folders = darray_get_num_items(root->folders);
+        for (uint32_t j = 0; j < num_folders; j++) {
+            darray_add_item(db->sorted_folders[DATABASE_INDEX_TYPE_NAME], darray_get_item(root->folders, j));
         }
+        const uint32_t num_files = darray_get_num_items(root->files);
+        for (uint32_t j = 0; j < num_files; j++) {
+            darray_add_item(db->sorted_files[DATABASE_INDEX_TYPE_NAME], darray_get_item(root->files, j));
+        }
+        g_clear_pointer(&root->folders, darray_unref);
+        g_clear_pointer(&root->files, darray_unref);
     }
+    g_clear_pointer(&roots, free);
+    g_debug("[db_scan] scanned: %d files, %d folders -> %d total", db->num_files, db->num_folders, db->num_entries);
+
+    g_clear_pointer(&previous, db_scan_previous_free);
     if (status_cb) {
         status_cb(_("Sorting…"));
     }
     db_sort(db);
+    if (!db_fold_names(db)) {
+        g_atomic_int_set(&scan_context.no_space, 1);
+    }
+    if (g_atomic_int_get(&scan_context.no_space)) {
+        // the database only holds part of the file system, so the scan isn't reported as successful
+        g_warning("[db_scan] the database has no room left for more entries");
+        ret = false;
+    }
+    db_publish_generation(db);
+    db_request_trigram_index(db);
     return ret;
 }
 
+// Published entries are never modified, the changes are applied to copies of them which replace them in the sorted
+// arrays (see db_entry_get_writable). Entries are tracked by their original, which all of their copies share.
+typedef struct DatabaseChangeContext {
+    FsearchDatabase *db;
+    // removed: originals of the entries which are no longer part of the database
+    GHashTable *removed;
+    // changed: maps the originals of the entries whose sort keys might have changed to the versions of them which are
+    // part of the sorted arrays
+    GHashTable *changed;
+    DynamicArray *added_folders;
+    DynamicArray *added_files;
+    bool has_removed_folders;
+    // rebuild_path_arrays: too many entries changed to insert them into the path arrays one by one
+    bool rebuild_path_arrays;
+} DatabaseChangeContext;
+
+// Changes of at most 1/DATABASE_CHANGES_MAX_SPLICE_RATIO of the entries of a sorted array are spliced into it with
+// binary searches, more are merged with all of its entries
+#define DATABASE_CHANGES_MAX_SPLICE_RATIO 16
+
+// Below this number the storage of removed and replaced entries never triggers a rescan, because scanning a small
+// database takes longer than the few megabytes of entries which it would reclaim are worth
+#define DATABASE_CHANGES_MIN_DEAD_ENTRIES 100000
+
+enum {
+    FOLDER_STATE_ATTACHED = 1,
+    FOLDER_STATE_DETACHED,
+};
+
+// Unlike db_entry_compare_entries_by_size and db_entry_compare_entries_by_modification_time these return 0 for equal
+// keys, so the entries with the same key as a given one can be found with a binary search
+static int32_t
+db_change_compare_entries_by_size(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
+    const off_t size_a = db_entry_get_size(*a);
+    const off_t size_b = db_entry_get_size(*b);
+    return size_a < size_b ? -1 : size_a > size_b;
+}
+
+static int32_t
+db_change_compare_entries_by_modification_time(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
+    const time_t mtime_a = db_entry_get_mtime(*a);
+    const time_t mtime_b = db_entry_get_mtime(*b);
+    return mtime_a < mtime_b ? -1 : mtime_a > mtime_b;
+}
+
+static DynamicArrayCompareFunc
+db_get_compare_func(FsearchDatabaseIndexType sort_type) {
+    switch (sort_type) {
+    case DATABASE_INDEX_TYPE_NAME:
+        return (DynamicArrayCompareFunc)db_entry_compare_entries_by_name;
+    case DATABASE_INDEX_TYPE_PATH:
+        return (DynamicArrayCompareFunc)db_entry_compare_entries_by_path;
+    case DATABASE_INDEX_TYPE_SIZE:
+        return (DynamicArrayCompareFunc)db_change_compare_entries_by_size;
+    case DATABASE_INDEX_TYPE_MODIFICATION_TIME:
+        return (DynamicArrayCompareFunc)db_change_compare_entries_by_modification_time;
+    case DATABASE_INDEX_TYPE_EXTENSION:
+        return (DynamicArrayCompareFunc)db_entry_compare_entries_by_extension;
+    default:
+        return NULL;
+    }
+}
+
+static FsearchDatabaseEntry *
+db_change_find_child(DatabaseChangeContext *ctx,
+                     DynamicArray *entries,
+                     FsearchDatabaseEntryFolder *parent,
+                     const char *name) {
+    // entries are sorted by name, so all entries with this name are next to each other
+    const uint32_t num_entries = darray_get_num_items(entries);
+    uint32_t left = 0;
+    uint32_t right = num_entries;
+    while (left < right) {
+        const uint32_t middle = left + (right - left) / 2;
+        if (strverscmp(db_entry_get_name(darray_get_item(entries, middle)), name) < 0) {
+            left = middle + 1;
+        }
+        else {
+            right = middle;
+        }
+    }
+    const uint32_t parent_id = db_entry_get_id((FsearchDatabaseEntry *)parent);
+    for (uint32_t i = left; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (strcmp(db_entry_get_name(entry), name) != 0) {
+            break;
+        }
+        if (db_entry_get_id((FsearchDatabaseEntry *)db_entry_get_parent(entry)) == parent_id
+            && !g_hash_table_contains(ctx->removed, db_entry_get_original(entry))) {
+            // the entry might have been copied already by an earlier change of this batch
+            return db_entry_get_latest(entry);
+        }
+    }
+    return NULL;
+}
+
+// Has to be called before entry gets copied for the first time, so the version of it in the sorted arrays is known
+static void
+db_change_mark_changed(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntry *original = db_entry_get_original(entry);
+    if (!g_hash_table_contains(ctx->changed, original)) {
+        g_hash_table_insert(ctx->changed, original, db_entry_get_latest(entry));
+    }
+}
+
+// Returns a version of entry which can be modified and marks it as changed. Returns NULL when the database has no
+// room left for a copy of it.
+static FsearchDatabaseEntry *
+db_change_modify_entry(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry) {
+    db_change_mark_changed(ctx, entry);
+    return db_entry_get_writable(entry);
+}
+
+static void
+db_change_mark_parents_changed(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryFolder *folder = db_entry_get_parent(entry);
+    while (folder) {
+        db_change_mark_changed(ctx, (FsearchDatabaseEntry *)folder);
+        folder = db_entry_get_parent((FsearchDatabaseEntry *)folder);
+    }
+}
+
+static bool
+db_change_update_parent_sizes(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry, off_t size_delta) {
+    FsearchDatabaseEntryFolder *folder = db_entry_get_parent(entry);
+    while (folder) {
+        FsearchDatabaseEntry *folder_entry = db_change_modify_entry(ctx, (FsearchDatabaseEntry *)folder);
+        if (!folder_entry) {
+            return false;
+        }
+        db_entry_set_size(folder_entry, db_entry_get_size(folder_entry) + size_delta);
+        folder = db_entry_get_parent(folder_entry);
+    }
+    return true;
+}
+
+static void
+db_change_drop_entry(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry) {
+    // the storage of the entry stays valid until the database gets freed,
+    // because views and search results might still point to it
+    g_hash_table_add(ctx->removed, db_entry_get_original(entry));
+    if (db_entry_get_type(entry) == DATABASE_ENTRY_TYPE_FOLDER) {
+        ctx->db->num_folders--;
+        ctx->has_removed_folders = true;
+    }
+    else {
+        ctx->db->num_files--;
+    }
+    ctx->db->num_entries--;
+}
+
+static bool
+db_change_remove_entry(DatabaseChangeContext *ctx, FsearchDatabaseEntry *entry) {
+    if (!db_change_update_parent_sizes(ctx, entry, -db_entry_get_size(entry))) {
+        return false;
+    }
+    db_change_drop_entry(ctx, entry);
+    return true;
+}
+
+// Returns false when the database has no room left for the new entries
+static bool
+db_change_add_entry(DatabaseChangeContext *ctx,
+                    DatabaseWalkContext *walk_context,
+                    FsearchDatabaseEntryFolder *parent,
+                    const char *name,
+                    GString *path,
+                    struct stat *st) {
+    FsearchDatabase *db = ctx->db;
+    if (S_ISDIR(st->st_mode)) {
+        FsearchDatabaseEntry *entry = db_alloc_entry(db, DATABASE_ENTRY_TYPE_FOLDER, name);
+        if (!entry) {
+            return false;
+        }
+        db_entry_set_mtime(entry, st->st_mtime);
+        db_entry_set_parent(entry, parent);
+
+        darray_add_item(ctx->added_folders, entry);
+        db->num_folders++;
+        db->num_entries++;
+
+        // the sizes of all parents grow by the content of the new folder
+        db_change_mark_parents_changed(ctx, entry);
+        // the walker adds the content of the new folder to the same arrays
+        g_string_assign(walk_context->path, path->str);
+        if (db_folder_scan_recursive(walk_context, (FsearchDatabaseEntryFolder *)entry, NULL) == WALK_NOSPACE) {
+            return false;
+        }
+    }
+    else {
+        FsearchDatabaseEntry *entry = db_alloc_entry(db, DATABASE_ENTRY_TYPE_FILE, name);
+        if (!entry) {
+            return false;
+        }
+        db_entry_set_size(entry, st->st_size);
+        db_entry_set_mtime(entry, st->st_mtime);
+        db_entry_set_parent(entry, parent);
+        darray_add_item(ctx->added_files, entry);
+        db->num_files++;
+        db->num_entries++;
+
+        db_change_mark_parents_changed(ctx, entry);
+        if (!db_entry_update_parent_size(entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool
+db_change_update_entry(DatabaseChangeContext *ctx,
+                       DatabaseWalkContext *walk_context,
+                       FsearchDatabaseEntryFolder *parent,
+                       int dir_fd,
+                       const char *name,
+                       GString *path) {
+    FsearchDatabase *db = ctx->db;
+
+    FsearchDatabaseEntry *entry =
+        db_change_find_child(ctx, db->sorted_folders[DATABASE_INDEX_TYPE_NAME], parent, name);
+    if (!entry) {
+        entry = db_change_find_child(ctx, db->sorted_files[DATABASE_INDEX_TYPE_NAME], parent, name);
+    }
+
+    // apply the same rules as the walker, an entry which would be skipped by a rescan is treated as deleted
+    struct stat st;
+    bool exists = !fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT);
+    if (exists) {
+        if ((db->exclude_hidden && name[0] == '.') || file_is_excluded(name, db->exclude_files)
+            || strlen(name) >= 256 || (S_ISDIR(st.st_mode) && directory_is_excluded(path->str, db->excludes))) {
+            exists = false;
+        }
+    }
+
+    if (entry && exists && S_ISDIR(st.st_mode) == (db_entry_get_type(entry) == DATABASE_ENTRY_TYPE_FOLDER)) {
+        // entry was modified, the content of folders is handled by the changes inside of them
+        if (!S_ISDIR(st.st_mode) && db_entry_get_size(entry) != st.st_size) {
+            if (!db_change_update_parent_sizes(ctx, entry, st.st_size - db_entry_get_size(entry))
+                || !(entry = db_change_modify_entry(ctx, entry))) {
+                return false;
+            }
+            db_entry_set_size(entry, st.st_size);
+        }
+        if (db_entry_get_mtime(entry) != st.st_mtime) {
+            if (!(entry = db_change_modify_entry(ctx, entry))) {
+                return false;
+            }
+            db_entry_set_mtime(entry, st.st_mtime);
+        }
+        return true;
+    }
+
+    if (entry && !db_change_remove_entry(ctx, entry)) {
+        return false;
+    }
+    if (exists) {
+        return db_change_add_entry(ctx, walk_context, parent, name, path, &st);
+    }
+    return true;
+}
+
+// Returns false when the database has no room left for the changes
+static bool
+db_change_update_folder(DatabaseChangeContext *ctx,
+                        DatabaseWalkContext *walk_context,
+                        FsearchDatabaseEntryFolder *folder,
+                        GHashTable *names) {
+    FsearchDatabaseEntry *folder_entry = db_entry_get_latest((FsearchDatabaseEntry *)folder);
+    if (g_hash_table_contains(ctx->removed, db_entry_get_original(folder_entry))) {
+        return true;
+    }
+
+    GString *path = db_entry_get_path_full(folder_entry);
+    const int dir_fd = open(path->str, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        // the folder itself is gone, that's handled with the changes of its parent
+        g_debug("[db_apply_folder_changes] failed to open directory: %s", path->str);
+        g_string_free(g_steal_pointer(&path), TRUE);
+        return true;
+    }
+
+    bool res = true;
+    // index roots don't carry any metadata, just like after a scan
+    struct stat st;
+    if (db_entry_get_parent(folder_entry) && !fstat(dir_fd, &st) && db_entry_get_mtime(folder_entry) != st.st_mtime) {
+        folder_entry = db_change_modify_entry(ctx, folder_entry);
+        if (folder_entry) {
+            db_entry_set_mtime(folder_entry, st.st_mtime);
+        }
+        res = folder_entry != NULL;
+    }
+
+    if (path->str[path->len - 1] != G_DIR_SEPARATOR) {
+        g_string_append_c(path, G_DIR_SEPARATOR);
+    }
+    const gsize path_len = path->len;
+
+    if (names && res) {
+        GHashTableIter iter;
+        gpointer name = NULL;
+        g_hash_table_iter_init(&iter, names);
+        while (res && g_hash_table_iter_next(&iter, &name, NULL)) {
+            g_string_truncate(path, path_len);
+            g_string_append(path, name);
+            res = db_change_update_entry(ctx,
+                                         walk_context,
+                                         (FsearchDatabaseEntryFolder *)folder_entry,
+                                         dir_fd,
+                                         name,
+                                         path);
+        }
+    }
+
+    close(dir_fd);
+    g_string_free(g_steal_pointer(&path), TRUE);
+    return res;
+}
+
+static bool
+db_change_folder_is_detached(DatabaseChangeContext *ctx,
+                             GHashTable *folder_states,
+                             FsearchDatabaseEntryFolder *folder) {
+    if (!folder) {
+        return false;
+    }
+    if (g_hash_table_contains(ctx->removed, db_entry_get_original((FsearchDatabaseEntry *)folder))) {
+        return true;
+    }
+    const int state = GPOINTER_TO_INT(g_hash_table_lookup(folder_states, folder));
+    if (state != 0) {
+        return state == FOLDER_STATE_DETACHED;
+    }
+    const bool detached =
+        db_change_folder_is_detached(ctx, folder_states, db_entry_get_parent((FsearchDatabaseEntry *)folder));
+    g_hash_table_insert(folder_states,
+                        folder,
+                        GINT_TO_POINTER(detached ? FOLDER_STATE_DETACHED : FOLDER_STATE_ATTACHED));
+    return detached;
+}
+
+static void
+db_change_drop_detached_entries(DatabaseChangeContext *ctx, GHashTable *folder_states, DynamicArray *entries) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        if (g_hash_table_contains(ctx->removed, db_entry_get_original(entry))) {
+            continue;
+        }
+        if (db_change_folder_is_detached(ctx, folder_states, db_entry_get_parent(entry))) {
+            db_change_drop_entry(ctx, entry);
+        }
+    }
+}
+
+static void
+db_change_drop_removed_sub_trees(DatabaseChangeContext *ctx) {
+    // the content of removed folders doesn't show up as individual changes
+    // (e.g. when a folder was moved out of the index), so it has to be found through the parents
+    GHashTable *folder_states = g_hash_table_new(NULL, NULL);
+    db_change_drop_detached_entries(ctx, folder_states, ctx->db->sorted_folders[DATABASE_INDEX_TYPE_NAME]);
+    db_change_drop_detached_entries(ctx, folder_states, ctx->added_folders);
+    db_change_drop_detached_entries(ctx, folder_states, ctx->db->sorted_files[DATABASE_INDEX_TYPE_NAME]);
+    db_change_drop_detached_entries(ctx, folder_states, ctx->added_files);
+    g_clear_pointer(&folder_states, g_hash_table_destroy);
+}
+
+static DynamicArray *
+db_change_get_inserted_entries(DatabaseChangeContext *ctx, DynamicArray *added, FsearchDatabaseEntryType type) {
+    DynamicArray *inserted = darray_new(darray_get_num_items(added) + 128);
+
+    // added entries weren't published yet, so they're originals and were never copied
+    const uint32_t num_added = darray_get_num_items(added);
+    for (uint32_t i = 0; i < num_added; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(added, i);
+        if (!g_hash_table_contains(ctx->removed, entry)) {
+            darray_add_item(inserted, entry);
+        }
+    }
+
+    // changed entries get removed from the sorted arrays and their latest copy is inserted at its new position
+    GHashTableIter iter;
+    gpointer original = NULL;
+    g_hash_table_iter_init(&iter, ctx->changed);
+    while (g_hash_table_iter_next(&iter, &original, NULL)) {
+        if (db_entry_get_type(original) == type && !g_hash_table_contains(ctx->removed, original)) {
+            darray_add_item(inserted, db_entry_get_latest(original));
+        }
+    }
+    return inserted;
+}
+
+// Returns the versions of the removed and changed entries of the given type which are part of the sorted arrays
+static DynamicArray *
+db_change_get_replaced_entries(DatabaseChangeContext *ctx, FsearchDatabaseEntryType type) {
+    DynamicArray *replaced = darray_new(g_hash_table_size(ctx->removed) + g_hash_table_size(ctx->changed) + 1);
+
+    GHashTableIter iter;
+    gpointer original = NULL;
+    gpointer published = NULL;
+    g_hash_table_iter_init(&iter, ctx->removed);
+    while (g_hash_table_iter_next(&iter, &original, NULL)) {
+        if (db_entry_get_type(original) == type) {
+            // removed entries which weren't modified before have never been copied in this batch
+            published = g_hash_table_lookup(ctx->changed, original);
+            darray_add_item(replaced, published ? published : db_entry_get_latest(original));
+        }
+    }
+    g_hash_table_iter_init(&iter, ctx->changed);
+    while (g_hash_table_iter_next(&iter, &original, &published)) {
+        if (db_entry_get_type(original) == type && !g_hash_table_contains(ctx->removed, original)) {
+            darray_add_item(replaced, published);
+        }
+    }
+    return replaced;
+}
+
+// Returns the index of the first item of entries which isn't less than entry
+static uint32_t
+db_change_lower_bound(DynamicArray *entries, FsearchDatabaseEntry *entry, DynamicArrayCompareFunc compare_func) {
+    uint32_t left = 0;
+    uint32_t right = darray_get_num_items(entries);
+    while (left < right) {
+        const uint32_t middle = left + (right - left) / 2;
+        FsearchDatabaseEntry *item = darray_get_item(entries, middle);
+        if (compare_func(&item, &entry) < 0) {
+            left = middle + 1;
+        }
+        else {
+            right = middle;
+        }
+    }
+    return left;
+}
+
+static int
+db_change_compare_positions(gconstpointer a, gconstpointer b) {
+    const uint32_t position_a = *(const uint32_t *)a;
+    const uint32_t position_b = *(const uint32_t *)b;
+    return position_a < position_b ? -1 : position_a > position_b;
+}
+
+// Returns a copy of entries without the ones of replaced and with the ones of inserted, which have to be sorted, at
+// their positions. Only the changed entries are compared with the others, everything in between is copied in blocks.
+// Returns NULL when an entry of replaced isn't part of entries, e.g. because it was added and removed again by the
+// same changes.
+static DynamicArray *
+db_change_splice_sorted_entries(DynamicArray *entries,
+                                DynamicArray *replaced,
+                                DynamicArray *inserted,
+                                DynamicArrayCompareFunc compare_func) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_replaced = darray_get_num_items(replaced);
+    const uint32_t num_inserted = darray_get_num_items(inserted);
+
+    uint32_t *replaced_positions = calloc(num_replaced + 1, sizeof(uint32_t));
+    uint32_t *inserted_positions = calloc(num_inserted + 1, sizeof(uint32_t));
+    assert(replaced_positions != NULL);
+    assert(inserted_positions != NULL);
+
+    // entries with equal keys are next to each other in no particular order, so the replaced one is searched among them
+    for (uint32_t i = 0; i < num_replaced; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(replaced, i);
+        uint32_t position = db_change_lower_bound(entries, entry, compare_func);
+        for (; position < num_entries; position++) {
+            FsearchDatabaseEntry *item = darray_get_item(entries, position);
+            if (item == entry || compare_func(&item, &entry) != 0) {
+                break;
+            }
+        }
+        if (position >= num_entries || darray_get_item(entries, position) != entry) {
+            g_clear_pointer(&replaced_positions, free);
+            g_clear_pointer(&inserted_positions, free);
+            return NULL;
+        }
+        replaced_positions[i] = position;
+    }
+    qsort(replaced_positions, num_replaced, sizeof(uint32_t), db_change_compare_positions);
+
+    for (uint32_t i = 0; i < num_inserted; i++) {
+        inserted_positions[i] = db_change_lower_bound(entries, darray_get_item(inserted, i), compare_func);
+    }
+
+    DynamicArray *spliced = darray_new(num_entries - num_replaced + num_inserted + 1);
+    uint32_t position = 0;
+    uint32_t next_replaced = 0;
+    uint32_t next_inserted = 0;
+    while (true) {
+        const uint32_t replaced_position =
+            next_replaced < num_replaced ? replaced_positions[next_replaced] : num_entries;
+        const uint32_t inserted_position =
+            next_inserted < num_inserted ? inserted_positions[next_inserted] : num_entries;
+        const uint32_t end = MIN(replaced_position, inserted_position);
+        darray_add_array_items(spliced, entries, position, end - position);
+        position = end;
+
+        if (next_inserted < num_inserted && inserted_position == position) {
+            darray_add_item(spliced, darray_get_item(inserted, next_inserted++));
+        }
+        else if (next_replaced < num_replaced && replaced_position == position) {
+            next_replaced++;
+            position++;
+        }
+        else {
+            break;
+        }
+    }
+
+    g_clear_pointer(&replaced_positions, free);
+    g_clear_pointer(&inserted_positions, free);
+    return spliced;
+}
+
+static DynamicArray *
+db_change_merge_sorted_entries(DatabaseChangeContext *ctx,
+                               DynamicArray *entries,
+                               DynamicArray *inserted,
+                               DynamicArrayCompareFunc compare_func) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    const uint32_t num_inserted = darray_get_num_items(inserted);
+    DynamicArray *merged = darray_new(num_entries + num_inserted);
+
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        FsearchDatabaseEntry *original = db_entry_get_original(entry);
+        if (g_hash_table_contains(ctx->removed, original) || g_hash_table_contains(ctx->changed, original)) {
+            continue;
+        }
+        while (j < num_inserted) {
+            FsearchDatabaseEntry *next = darray_get_item(inserted, j);
+            if (compare_func(&next, &entry) >= 0) {
+                break;
+            }
+            darray_add_item(merged, next);
+            j++;
+        }
+        darray_add_item(merged, entry);
+    }
+    for (; j < num_inserted; j++) {
+        darray_add_item(merged, darray_get_item(inserted, j));
+    }
+    return merged;
+}
+
+static void
+db_change_update_sorted_arrays(DatabaseChangeContext *ctx,
+                               DynamicArray **sorted_entries,
+                               DynamicArray *added,
+                               FsearchDatabaseEntryType type) {
+    DynamicArray *inserted = db_change_get_inserted_entries(ctx, added, type);
+    DynamicArray *replaced = db_change_get_replaced_entries(ctx, type);
+    const uint32_t num_changes = darray_get_num_items(inserted) + darray_get_num_items(replaced);
+
+    for (uint32_t i = 0; i < NUM_DATABASE_INDEX_TYPES; i++) {
+        DynamicArrayCompareFunc compare_func = db_get_compare_func(i);
+        if (!sorted_entries[i] || !compare_func) {
+            continue;
+        }
+        if (type == DATABASE_ENTRY_TYPE_FOLDER && i == DATABASE_INDEX_TYPE_EXTENSION) {
+            // Folders don't have a file extension -> the name array is used instead
+            continue;
+        }
+        // new arrays are built, because the old ones might be shared with views and search results
+        DynamicArray *inserted_sorted = darray_copy(inserted);
+        darray_sort(inserted_sorted, compare_func);
+        DynamicArray *updated = NULL;
+        if (num_changes <= darray_get_num_items(sorted_entries[i]) / DATABASE_CHANGES_MAX_SPLICE_RATIO) {
+            updated = db_change_splice_sorted_entries(sorted_entries[i], replaced, inserted_sorted, compare_func);
+        }
+        if (!updated && i == DATABASE_INDEX_TYPE_PATH) {
+            // rebuilt once the folders are up to date, see db_change_update_path_arrays
+            ctx->rebuild_path_arrays = true;
+        }
+        else if (!updated) {
+            updated = db_change_merge_sorted_entries(ctx, sorted_entries[i], inserted_sorted, compare_func);
+        }
+        g_clear_pointer(&inserted_sorted, darray_unref);
+
+        if (updated) {
+            g_clear_pointer(&sorted_entries[i], darray_unref);
+            sorted_entries[i] = g_steal_pointer(&updated);
+        }
+    }
+
+    if (type == DATABASE_ENTRY_TYPE_FOLDER && sorted_entries[DATABASE_INDEX_TYPE_EXTENSION]) {
+        g_clear_pointer(&sorted_entries[DATABASE_INDEX_TYPE_EXTENSION], darray_unref);
+        sorted_entries[DATABASE_INDEX_TYPE_EXTENSION] = darray_ref(sorted_entries[DATABASE_INDEX_TYPE_NAME]);
+    }
+
+    g_clear_pointer(&replaced, darray_unref);
+    g_clear_pointer(&inserted, darray_unref);
+}
+
+static void
+db_change_update_path_array(DynamicArray **sorted_entries, DynamicArray *folders) {
+    if (!sorted_entries[DATABASE_INDEX_TYPE_PATH]) {
+        return;
+    }
+    // sorting by path only compares numbers and name keys, which is cheaper than merging the changed entries into the
+    // old array with a comparison that walks up the parents of both entries
+    DynamicArray *entries = darray_copy(sorted_entries[DATABASE_INDEX_TYPE_NAME]);
+    db_entry_sort_entries_by_path(entries, folders);
+    g_clear_pointer(&sorted_entries[DATABASE_INDEX_TYPE_PATH], darray_unref);
+    sorted_entries[DATABASE_INDEX_TYPE_PATH] = entries;
+}
+
+static void
+db_change_update_path_arrays(FsearchDatabase *db) {
+    DynamicArray *folders = db->sorted_folders[DATABASE_INDEX_TYPE_NAME];
+    db_change_update_path_array(db->sorted_folders, folders);
+    db_change_update_path_array(db->sorted_files, folders);
+}
+
+static uint32_t
+db_get_num_dead_entries(FsearchDatabase *db) {
+    // removed entries and the ones which were replaced by a copy stay in the stores until the database gets freed
+    const uint64_t num_stored =
+        (uint64_t)db_entry_store_get_num_entries(db->folder_store) + db_entry_store_get_num_entries(db->file_store);
+    return num_stored > db->num_entries ? (uint32_t)MIN(num_stored - db->num_entries, UINT32_MAX) : 0;
+}
+
+FsearchDatabaseChangesResult
+db_apply_folder_changes(FsearchDatabase *db,
+                        GHashTable *changes,
+                        GPtrArray *added_folders,
+                        GPtrArray *removed_folders) {
+    assert(db != NULL);
+    assert(changes != NULL);
+
+    db_lock(db);
+
+    if (!db->sorted_folders[DATABASE_INDEX_TYPE_NAME] || !db->sorted_files[DATABASE_INDEX_TYPE_NAME]) {
+        db_unlock(db);
+        return DATABASE_CHANGES_SKIPPED;
+    }
+
+    const uint32_t num_dead_entries = db_get_num_dead_entries(db);
+    if (num_dead_entries > MAX(db->num_entries, DATABASE_CHANGES_MIN_DEAD_ENTRIES)) {
+        g_debug("[db_apply_folder_changes] %d of the stored entries are no longer used, a rescan is needed",
+                num_dead_entries);
+        db_unlock(db);
+        return DATABASE_CHANGES_RESCAN_NEEDED;
+    }
+
+    // the entry counts are restored when the changes can't be applied, the sorted arrays are only replaced after all
+    // changes were applied successfully
+    const uint32_t num_entries = db->num_entries;
+    const uint32_t num_folders = db->num_folders;
+    const uint32_t num_files = db->num_files;
+
+    GTimer *timer = g_timer_new();
+    g_timer_start(timer);
+
+    DatabaseChangeContext ctx = {
+        .db = db,
+        .removed = g_hash_table_new(NULL, NULL),
+        .changed = g_hash_table_new(NULL, NULL),
+        .added_folders = darray_new(128),
+        .added_files = darray_new(128),
+    };
+
+    DatabaseWalkContext walk_context = {
+        .db = db,
+        .path = g_string_new(NULL),
+        .timer = timer,
+        .folders = ctx.added_folders,
+        .files = ctx.added_files,
+        .exclude_hidden = db->exclude_hidden,
+    };
+
+    GHashTableIter iter;
+    gpointer folder = NULL;
+    gpointer names = NULL;
+    bool applied = true;
+    g_hash_table_iter_init(&iter, changes);
+    while (applied && g_hash_table_iter_next(&iter, &folder, &names)) {
+        applied = db_change_update_folder(&ctx, &walk_context, folder, names);
+    }
+
+    if (applied && ctx.has_removed_folders) {
+        db_change_drop_removed_sub_trees(&ctx);
+    }
+
+    const bool has_changes = g_hash_table_size(ctx.removed) > 0 || g_hash_table_size(ctx.changed) > 0
+                          || darray_get_num_items(ctx.added_folders) > 0 || darray_get_num_items(ctx.added_files) > 0;
+    // the new entries are folded before anything gets replaced, because that might fail as well
+    applied = applied && (!has_changes || db_fold_names(db));
+    if (!applied) {
+        g_warning("[db_apply_folder_changes] the database has no room left for the changes");
+        db->num_entries = num_entries;
+        db->num_folders = num_folders;
+        db->num_files = num_files;
+    }
+    else if (has_changes) {
+        if (removed_folders) {
+            g_hash_table_iter_init(&iter, ctx.removed);
+            gpointer entry = NULL;
+            while (g_hash_table_iter_next(&iter, &entry, NULL)) {
+                if (db_entry_get_type(entry) == DATABASE_ENTRY_TYPE_FOLDER) {
+                    g_ptr_array_add(removed_folders, entry);
+                }
+            }
+        }
+        if (added_folders) {
+            const uint32_t num_added_folders = darray_get_num_items(ctx.added_folders);
+            for (uint32_t i = 0; i < num_added_folders; i++) {
+                FsearchDatabaseEntry *entry = darray_get_item(ctx.added_folders, i);
+                if (!g_hash_table_contains(ctx.removed, entry)) {
+                    g_ptr_array_add(added_folders, entry);
+                }
+            }
+        }
+
+        db_change_update_sorted_arrays(&ctx, db->sorted_folders, ctx.added_folders, DATABASE_ENTRY_TYPE_FOLDER);
+        db_change_update_sorted_arrays(&ctx, db->sorted_files, ctx.added_files, DATABASE_ENTRY_TYPE_FILE);
+        if (ctx.rebuild_path_arrays) {
+            db_change_update_path_arrays(db);
+        }
+        db_update_timestamp(db);
+        db_publish_generation(db);
+        db_update_trigram_index(db);
+    }
+
+    g_debug("[db_apply_folder_changes] %d changed, %d removed, %d folders and %d files added in %.2f ms",
+            g_hash_table_size(ctx.changed),
+            g_hash_table_size(ctx.removed),
+            darray_get_num_items(ctx.added_folders),
+            darray_get_num_items(ctx.added_files),
+            g_timer_elapsed(timer, NULL) * 1000);
+
+    g_string_free(g_steal_pointer(&walk_context.path), TRUE);
+    g_clear_pointer(&ctx.added_folders, darray_unref);
+    g_clear_pointer(&ctx.added_files, darray_unref);
+    g_clear_pointer(&ctx.changed, g_hash_table_destroy);
+    g_clear_pointer(&ctx.removed, g_hash_table_destroy);
+    g_clear_pointer(&timer, g_timer_destroy);
+
+    db_unlock(db);
+
+    return applied ? DATABASE_CHANGES_APPLIED : DATABASE_CHANGES_RESCAN_NEEDED;
+}
+
 FsearchDatabase *
 db_ref(FsearchDatabase *db) {
     if (!db || db->ref_count <= 0) {
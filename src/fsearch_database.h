@@ -21,6 +21,7 @@
 #include "fsearch_array.h"
 #include "fsearch_database_index.h"
 #include "fsearch_thread_pool.h"
+#include "fsearch_trigram_index.h"
 
 #include <gio/gio.h>
 #include <glib.h>
@@ -28,6 +29,7 @@
 #include <stdint.h>
 
 typedef struct FsearchDatabase FsearchDatabase;
+typedef struct FsearchDatabaseGeneration FsearchDatabaseGeneration;
 
 bool
 db_register_view(FsearchDatabase *db, gpointer view);
@@ -38,9 +40,60 @@ db_unregister_view(FsearchDatabase *db, gpointer view);
 bool
 db_load(FsearchDatabase *db, const char *path, void (*status_cb)(const char *));
 
+// num_threads: 0 uses one thread per processor, 1 scans the file system sequentially
+void
+db_set_num_scan_threads(FsearchDatabase *db, uint32_t num_threads);
+
+// queue_depth: number of metadata requests each scan thread keeps in flight with io_uring,
+// 0 or an unsupported kernel fall back to synchronous fstatat calls
+void
+db_set_scan_queue_depth(FsearchDatabase *db, uint32_t queue_depth);
+
+// The next db_scan reuses the entries of previous for folders whose modification time didn't change, instead of
+// reading them again. Changes which don't touch the modification time of their folder (e.g. files being written to)
+// aren't picked up that way. previous is ignored when it was created with different exclude rules.
+void
+db_set_previous_database(FsearchDatabase *db, FsearchDatabase *previous);
+
+// limit: number of bytes the sorted arrays of all sort types except the name may take, 0 means no limit.
+// When the limit is exceeded the least recently used arrays are dropped, they're built again once they're requested.
+void
+db_set_sorted_entries_memory_limit(FsearchDatabase *db, size_t limit);
+
+// compress: db_save stores the folders and files in compressed blocks, which makes the database file a lot smaller
+// at the cost of some CPU time when saving and loading it. Both variants can always be loaded.
+void
+db_set_compression(FsearchDatabase *db, bool compress);
+
+// trigram_index: build trigram indexes of the names in the background after the database was scanned or loaded.
+// They let searches skip most names which can't contain a query, at the cost of some memory.
+void
+db_set_trigram_index(FsearchDatabase *db, bool trigram_index);
+
 bool
 db_scan(FsearchDatabase *db, GCancellable *cancellable, void (*status_cb)(const char *));
 
+typedef enum {
+    DATABASE_CHANGES_APPLIED,
+    // the database wasn't scanned or loaded yet, so there was nothing to apply the changes to
+    DATABASE_CHANGES_SKIPPED,
+    // the changes weren't applied, only a rescan brings the database back in sync
+    DATABASE_CHANGES_RESCAN_NEEDED,
+} FsearchDatabaseChangesResult;
+
+// Brings the database in sync with the file system after entries inside of some folders have changed.
+// changes maps folders of the database to sets of names of entries which were created, deleted or modified inside of
+// them. New folders (including the ones of new sub trees) are appended to added_folders, the originals of folders
+// which are no longer part of the database to removed_folders (see db_entry_get_original). The sorted arrays are
+// replaced and modified entries are copied, so references handed out earlier stay valid and unchanged.
+// The storage of removed and replaced entries is only reclaimed by a rescan, which is requested once it takes up more
+// room than the entries which are still part of the database, or when the database has no room left for the changes.
+FsearchDatabaseChangesResult
+db_apply_folder_changes(FsearchDatabase *db,
+                        GHashTable *changes,
+                        GPtrArray *added_folders,
+                        GPtrArray *removed_folders);
+
 FsearchDatabase *
 db_ref(FsearchDatabase *db);
 
@@ -50,9 +103,17 @@ db_unref(FsearchDatabase *db);
 FsearchDatabase *
 db_new(GList *includes, GList *excludes, char **exclude_files, bool exclude_hidden);
 
+// Writes the database to path/fsearch.db. The database is only locked while a snapshot of it is taken, the
+// snapshot gets encoded with the database thread pool, so no search may run in the meantime.
 bool
 db_save(FsearchDatabase *db, const char *path);
 
+// Like db_save, but the snapshot is written by a low priority background thread, which leaves the thread pool to
+// searches. Saves which haven't started yet are replaced by newer ones. The save holds a reference to the database,
+// so it's completed even when all other references are dropped in the meantime.
+void
+db_save_in_background(FsearchDatabase *db, const char *path);
+
 time_t
 db_get_timestamp(FsearchDatabase *db);
 
@@ -89,9 +150,49 @@ db_get_files(FsearchDatabase *db);
 FsearchThreadPool *
 db_get_thread_pool(FsearchDatabase *db);
 
+// Returns a reference to the sorted arrays of the database as they were published last. Neither the arrays nor the
+// entries in them ever change, changes to the database modify copies of the entries and publish a new generation
+// instead, so they can be used without holding the database lock. NULL until the database was scanned or loaded.
+FsearchDatabaseGeneration *
+db_get_generation(FsearchDatabase *db);
+
+FsearchDatabaseGeneration *
+db_generation_ref(FsearchDatabaseGeneration *generation);
+
+void
+db_generation_unref(FsearchDatabaseGeneration *generation);
+
+// Returns a number which identifies the generation among all generations of all databases, 0 for NULL. Unlike its
+// address it's never reused, so it can be kept after the generation was released.
+uint32_t
+db_generation_get_id(FsearchDatabaseGeneration *generation);
+
+// Like db_get_entries_sorted, but it doesn't request missing sort types
+bool
+db_generation_get_entries_sorted(FsearchDatabaseGeneration *generation,
+                                 FsearchDatabaseIndexType requested_sort_type,
+                                 FsearchDatabaseIndexType *returned_sort_type,
+                                 DynamicArray **folders,
+                                 DynamicArray **files);
+
+DynamicArray *
+db_generation_get_folders(FsearchDatabaseGeneration *generation);
+
+// Returns a reference to the trigram index of the files or folders of the generation, NULL if there's none (yet).
+// Entries with an id beyond the ones covered by the index are newer than the index and might match anything.
+FsearchTrigramIndex *
+db_generation_get_trigram_index(FsearchDatabaseGeneration *generation, FsearchDatabaseEntryType type);
+
+// The getters below use the current generation, none of them requires the database lock
 bool
 db_has_entries_sorted_by_type(FsearchDatabase *db, FsearchDatabaseIndexType sort_type);
 
+// Only the entries sorted by name and path are built with the database, the other sort types get built in the
+// background once they're requested. Until then db_get_entries_sorted returns the entries sorted by name and the
+// caller has to sort them by itself.
+void
+db_request_entries_sorted(FsearchDatabase *db, FsearchDatabaseIndexType sort_type);
+
 bool
 db_get_entries_sorted(FsearchDatabase *db,
                       FsearchDatabaseIndexType requested_sort_type,
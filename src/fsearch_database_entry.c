@@ -4,59 +4,296 @@
 #include "fsearch_file_utils.h"
 #include "fsearch_string_utils.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+
+// Entries are stored column-wise: every attribute lives in its own dense array within a block, so scanning
+// names or sorting by a single attribute only touches the memory of that attribute.
+// Blocks are aligned to their size and an entry handle points into the type column of its block,
+// which allows to find the block and the slot of an entry from the handle alone.
+#define DATABASE_ENTRY_BLOCK_SIZE (1 << 20)
+#define DATABASE_ENTRY_BLOCK_CAPACITY 31700
+#define DATABASE_ENTRY_MAX_BLOCKS (UINT32_MAX / DATABASE_ENTRY_BLOCK_CAPACITY)
+#define DATABASE_ENTRY_NO_PARENT UINT32_MAX
+// the type column holds the entry type in its lower bits and flags in the upper ones
+#define DATABASE_ENTRY_TYPE_MASK 0x0f
+// the name consists of ASCII characters only
+#define DATABASE_ENTRY_FLAG_ASCII_NAME 0x80
+// the entry is a copy of the entry with the id stored in its link
+#define DATABASE_ENTRY_FLAG_COPY 0x40
+
+typedef struct FsearchDatabaseEntryBlock {
+    FsearchDatabaseEntryStore *store;
+    uint32_t block_idx;
+    uint32_t num_used;
+
+    off_t size[DATABASE_ENTRY_BLOCK_CAPACITY];
+    time_t mtime[DATABASE_ENTRY_BLOCK_CAPACITY];
+    // link: for copies the id of the entry they were copied from, for all other entries the position of their latest
+    // copy or 0 if they were never copied (position 0 is always taken by an entry which isn't a copy)
+    uint32_t link[DATABASE_ENTRY_BLOCK_CAPACITY];
+    // parent: id of the parent folder within the folder store
+    uint32_t parent[DATABASE_ENTRY_BLOCK_CAPACITY];
+    // name: id of the name within the name arena
+    uint32_t name[DATABASE_ENTRY_BLOCK_CAPACITY];
+    // folded_name: id of the case folded and normalized name within the name arena, 0 if it's the same as the name
+    // with its ASCII letters in lower case
+    uint32_t folded_name[DATABASE_ENTRY_BLOCK_CAPACITY];
+    // type: the entry type combined with DATABASE_ENTRY_FLAG_* bits
+    uint8_t type[DATABASE_ENTRY_BLOCK_CAPACITY];
+} FsearchDatabaseEntryBlock;
+
+G_STATIC_ASSERT(sizeof(FsearchDatabaseEntryBlock) <= DATABASE_ENTRY_BLOCK_SIZE);
+
+struct FsearchDatabaseEntryStore {
+    // blocks: fixed size table, so resolving parent ids never races with the store growing
+    FsearchDatabaseEntryBlock **blocks;
+    uint32_t num_blocks;
+
+    // num_published: entries at positions below it are read-only, see db_entry_store_publish
+    uint32_t num_published;
+
+    // folder_store: the store parent ids refer to
+    FsearchDatabaseEntryStore *folder_store;
+    FsearchStringArena *name_arena;
+};
 
-struct FsearchDatabaseEntryCommon {
-    FsearchDatabaseEntryFolder *parent;
-    char *name;
-    off_t size;
-    time_t mtime;
+static inline FsearchDatabaseEntryBlock *
+entry_get_block(FsearchDatabaseEntry *entry) {
+    return (FsearchDatabaseEntryBlock *)((uintptr_t)entry & ~((uintptr_t)DATABASE_ENTRY_BLOCK_SIZE - 1));
+}
 
-    // idx: index of this entry in the sorted list at pos DATABASE_INDEX_TYPE_NAME
-    uint32_t idx;
-    uint8_t type;
-};
+static inline uint32_t
+entry_get_slot(FsearchDatabaseEntryBlock *block, FsearchDatabaseEntry *entry) {
+    return (uint8_t *)entry - block->type;
+}
 
-struct FsearchDatabaseEntryFile {
-    struct FsearchDatabaseEntryCommon shared;
-};
+static inline uint32_t
+entry_get_position(FsearchDatabaseEntryBlock *block, FsearchDatabaseEntry *entry) {
+    return block->block_idx * DATABASE_ENTRY_BLOCK_CAPACITY + entry_get_slot(block, entry);
+}
 
-struct FsearchDatabaseEntryFolder {
-    struct FsearchDatabaseEntryCommon shared;
+static inline FsearchDatabaseEntry *
+store_get_entry_at(FsearchDatabaseEntryStore *store, uint32_t position) {
+    FsearchDatabaseEntryBlock *block = store->blocks[position / DATABASE_ENTRY_BLOCK_CAPACITY];
+    return (FsearchDatabaseEntry *)&block->type[position % DATABASE_ENTRY_BLOCK_CAPACITY];
+}
 
-    // db_idx: the database index this folder belongs to
-    uint32_t db_idx;
-};
+// Returns the latest copy of the entry with the given id, or the entry itself if it was never copied
+static inline FsearchDatabaseEntry *
+store_get_latest_entry(FsearchDatabaseEntryStore *store, uint32_t id) {
+    FsearchDatabaseEntryBlock *block = store->blocks[id / DATABASE_ENTRY_BLOCK_CAPACITY];
+    const uint32_t slot = id % DATABASE_ENTRY_BLOCK_CAPACITY;
+    // the writer sets the link once the copy is complete, while readers resolve parents without holding a lock
+    const uint32_t copy = (uint32_t)g_atomic_int_get((gint *)&block->link[slot]);
+    return copy ? store_get_entry_at(store, copy) : (FsearchDatabaseEntry *)&block->type[slot];
+}
 
-static void
-build_path_recursively(FsearchDatabaseEntryFolder *folder, GString *str) {
-    if (!folder) {
+static inline uint32_t
+entry_get_id(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    const uint32_t slot = entry_get_slot(block, entry);
+    return (block->type[slot] & DATABASE_ENTRY_FLAG_COPY) ? block->link[slot] : entry_get_position(block, entry);
+}
+
+static inline bool
+entry_is_published(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    return entry_get_position(block, entry) < block->store->num_published;
+}
+
+// pointer to the attribute of entry in the given column
+#define ENTRY_COLUMN(entry, column)                                                                                    \
+    (&entry_get_block((FsearchDatabaseEntry *)(entry))                                                                 \
+          ->column[entry_get_slot(entry_get_block((FsearchDatabaseEntry *)(entry)), (FsearchDatabaseEntry *)(entry))])
+
+static inline FsearchDatabaseEntryFolder *
+entry_get_parent(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    const uint32_t parent_id = block->parent[entry_get_slot(block, entry)];
+    if (parent_id == DATABASE_ENTRY_NO_PARENT) {
+        return NULL;
+    }
+    return (FsearchDatabaseEntryFolder *)store_get_latest_entry(block->store->folder_store, parent_id);
+}
+
+static inline uint32_t
+entry_get_parent_id(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    return block->parent[entry_get_slot(block, entry)];
+}
+
+static inline const char *
+entry_get_name(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    return fsearch_string_arena_get(block->store->name_arena, block->name[entry_get_slot(block, entry)]);
+}
+
+static FsearchDatabaseEntryBlock *
+db_entry_block_new(FsearchDatabaseEntryStore *store) {
+    // over-allocate so the block can be aligned to its size, then hand the excess back
+    uint8_t *mem = mmap(NULL,
+                        2 * DATABASE_ENTRY_BLOCK_SIZE,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    assert(mem != MAP_FAILED);
+
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)mem + DATABASE_ENTRY_BLOCK_SIZE - 1)
+                                   & ~((uintptr_t)DATABASE_ENTRY_BLOCK_SIZE - 1));
+    uint8_t *aligned_end = aligned + DATABASE_ENTRY_BLOCK_SIZE;
+    if (aligned > mem) {
+        munmap(mem, aligned - mem);
+    }
+    if (mem + 2 * DATABASE_ENTRY_BLOCK_SIZE > aligned_end) {
+        munmap(aligned_end, mem + 2 * DATABASE_ENTRY_BLOCK_SIZE - aligned_end);
+    }
+
+    FsearchDatabaseEntryBlock *block = (FsearchDatabaseEntryBlock *)aligned;
+    block->store = store;
+    block->block_idx = store->num_blocks;
+    block->num_used = 0;
+    return block;
+}
+
+FsearchDatabaseEntryStore *
+db_entry_store_new(FsearchStringArena *name_arena, FsearchDatabaseEntryStore *folder_store) {
+    assert(name_arena != NULL);
+
+    FsearchDatabaseEntryStore *store = calloc(1, sizeof(FsearchDatabaseEntryStore));
+    assert(store != NULL);
+
+    store->blocks = calloc(DATABASE_ENTRY_MAX_BLOCKS, sizeof(FsearchDatabaseEntryBlock *));
+    assert(store->blocks != NULL);
+
+    store->name_arena = name_arena;
+    store->folder_store = folder_store ? folder_store : store;
+
+    return store;
+}
+
+void
+db_entry_store_free(FsearchDatabaseEntryStore *store) {
+    if (!store) {
         return;
     }
-    if (folder->shared.parent) {
-        build_path_recursively(folder->shared.parent, str);
-        g_string_append_c(str, G_DIR_SEPARATOR);
+    for (uint32_t i = 0; i < store->num_blocks; i++) {
+        munmap(store->blocks[i], DATABASE_ENTRY_BLOCK_SIZE);
+        store->blocks[i] = NULL;
+    }
+    g_clear_pointer(&store->blocks, free);
+    g_clear_pointer(&store, free);
+}
+
+FsearchDatabaseEntry *
+db_entry_store_alloc(FsearchDatabaseEntryStore *store, FsearchDatabaseEntryType type) {
+    assert(store != NULL);
+
+    FsearchDatabaseEntryBlock *block = store->num_blocks > 0 ? store->blocks[store->num_blocks - 1] : NULL;
+    if (!block || block->num_used >= DATABASE_ENTRY_BLOCK_CAPACITY) {
+        if (store->num_blocks >= DATABASE_ENTRY_MAX_BLOCKS) {
+            g_debug("[db_entry_store] maximum number of entries reached");
+            return NULL;
+        }
+        block = db_entry_block_new(store);
+        store->blocks[store->num_blocks++] = block;
+    }
+
+    // the block memory is zero initialized, which is a valid state for all other attributes
+    const uint32_t slot = block->num_used++;
+    block->parent[slot] = DATABASE_ENTRY_NO_PARENT;
+    // the name is empty until it's set
+    block->type[slot] = type | DATABASE_ENTRY_FLAG_ASCII_NAME;
+
+    return (FsearchDatabaseEntry *)&block->type[slot];
+}
+
+uint32_t
+db_entry_store_get_num_entries(FsearchDatabaseEntryStore *store) {
+    assert(store != NULL);
+    if (store->num_blocks == 0) {
+        return 0;
+    }
+    return (store->num_blocks - 1) * DATABASE_ENTRY_BLOCK_CAPACITY + store->blocks[store->num_blocks - 1]->num_used;
+}
+
+FsearchDatabaseEntry *
+db_entry_store_get_entry(FsearchDatabaseEntryStore *store, uint32_t position) {
+    assert(store != NULL);
+    return store_get_entry_at(store, position);
+}
+
+void
+db_entry_store_publish(FsearchDatabaseEntryStore *store) {
+    assert(store != NULL);
+    store->num_published = db_entry_store_get_num_entries(store);
+}
+
+FsearchDatabaseEntry *
+db_entry_get_writable(FsearchDatabaseEntry *entry) {
+    assert(entry != NULL);
+    FsearchDatabaseEntryStore *store = entry_get_block(entry)->store;
+    const uint32_t id = entry_get_id(entry);
+    FsearchDatabaseEntry *latest = store_get_latest_entry(store, id);
+    if (!entry_is_published(latest)) {
+        return latest;
     }
-    if (strcmp(folder->shared.name, "") != 0) {
-        g_string_append(str, folder->shared.name);
+
+    FsearchDatabaseEntryBlock *block = entry_get_block(latest);
+    const uint32_t slot = entry_get_slot(block, latest);
+    FsearchDatabaseEntry *copy = db_entry_store_alloc(store, DATABASE_ENTRY_TYPE_NONE);
+    if (!copy) {
+        return NULL;
     }
+    FsearchDatabaseEntryBlock *copy_block = entry_get_block(copy);
+    const uint32_t copy_slot = entry_get_slot(copy_block, copy);
+    copy_block->size[copy_slot] = block->size[slot];
+    copy_block->mtime[copy_slot] = block->mtime[slot];
+    copy_block->parent[copy_slot] = block->parent[slot];
+    copy_block->name[copy_slot] = block->name[slot];
+    copy_block->folded_name[copy_slot] = block->folded_name[slot];
+    copy_block->type[copy_slot] = block->type[slot] | DATABASE_ENTRY_FLAG_COPY;
+    copy_block->link[copy_slot] = id;
+
+    FsearchDatabaseEntryBlock *original_block = store->blocks[id / DATABASE_ENTRY_BLOCK_CAPACITY];
+    g_atomic_int_set((gint *)&original_block->link[id % DATABASE_ENTRY_BLOCK_CAPACITY],
+                     (gint)entry_get_position(copy_block, copy));
+    return copy;
+}
+
+FsearchDatabaseEntry *
+db_entry_get_latest(FsearchDatabaseEntry *entry) {
+    return entry ? store_get_latest_entry(entry_get_block(entry)->store, entry_get_id(entry)) : NULL;
 }
 
-size_t
-db_entry_get_sizeof_folder_entry() {
-    return sizeof(FsearchDatabaseEntryFolder);
+FsearchDatabaseEntry *
+db_entry_get_original(FsearchDatabaseEntry *entry) {
+    return entry ? store_get_entry_at(entry_get_block(entry)->store, entry_get_id(entry)) : NULL;
 }
 
-size_t
-db_entry_get_sizeof_file_entry() {
-    return sizeof(FsearchDatabaseEntryFile);
+static void
+build_path_recursively(FsearchDatabaseEntryFolder *folder, GString *str) {
+    if (!folder) {
+        return;
+    }
+    FsearchDatabaseEntryFolder *parent = entry_get_parent((FsearchDatabaseEntry *)folder);
+    if (parent) {
+        build_path_recursively(parent, str);
+        g_string_append_c(str, G_DIR_SEPARATOR);
+    }
+    const char *name = entry_get_name((FsearchDatabaseEntry *)folder);
+    if (strcmp(name, "") != 0) {
+        g_string_append(str, name);
+    }
 }
 
 GString *
 db_entry_get_path(FsearchDatabaseEntry *entry) {
     GString *path = g_string_new(NULL);
-    build_path_recursively(entry->shared.parent, path);
+    build_path_recursively(entry_get_parent(entry), path);
     return path;
 }
 
@@ -66,26 +303,27 @@ db_entry_get_path_full(FsearchDatabaseEntry *entry) {
     if (!path_full) {
         return NULL;
     }
-    if (entry->shared.name[0] != G_DIR_SEPARATOR) {
+    const char *name = entry_get_name(entry);
+    if (name[0] != G_DIR_SEPARATOR) {
         g_string_append_c(path_full, G_DIR_SEPARATOR);
     }
-    g_string_append(path_full, entry->shared.name);
+    g_string_append(path_full, name);
     return path_full;
 }
 
 void
 db_entry_append_path(FsearchDatabaseEntry *entry, GString *str) {
-    build_path_recursively(entry->shared.parent, str);
+    build_path_recursively(entry_get_parent(entry), str);
 }
 
 time_t
 db_entry_get_mtime(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.mtime : 0;
+    return entry ? *ENTRY_COLUMN(entry, mtime) : 0;
 }
 
 off_t
 db_entry_get_size(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.size : 0;
+    return entry ? *ENTRY_COLUMN(entry, size) : 0;
 }
 
 const char *
@@ -93,10 +331,10 @@ db_entry_get_extension(FsearchDatabaseEntry *entry) {
     if (G_UNLIKELY(!entry)) {
         return NULL;
     }
-    if (entry->shared.type == DATABASE_ENTRY_TYPE_FOLDER) {
+    if ((*ENTRY_COLUMN(entry, type) & DATABASE_ENTRY_TYPE_MASK) == DATABASE_ENTRY_TYPE_FOLDER) {
         return NULL;
     }
-    return fs_str_get_extension(entry->shared.name);
+    return fs_str_get_extension(entry_get_name(entry));
 }
 
 const char *
@@ -104,53 +342,62 @@ db_entry_get_name(FsearchDatabaseEntry *entry) {
     if (G_UNLIKELY(!entry)) {
         return NULL;
     }
-    if (strcmp(entry->shared.name, "") != 0) {
-        return entry->shared.name;
+    const char *name = entry_get_name(entry);
+    if (strcmp(name, "") != 0) {
+        return name;
     }
     return G_DIR_SEPARATOR_S;
 }
 
 const char *
 db_entry_get_name_raw(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.name : NULL;
+    return entry ? entry_get_name(entry) : NULL;
+}
+
+const char *
+db_entry_get_folded_name(FsearchDatabaseEntry *entry) {
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    const uint32_t folded_name = block->folded_name[entry_get_slot(block, entry)];
+    return folded_name ? fsearch_string_arena_get(block->store->name_arena, folded_name) : NULL;
+}
+
+bool
+db_entry_has_ascii_name(FsearchDatabaseEntry *entry) {
+    return (*ENTRY_COLUMN(entry, type) & DATABASE_ENTRY_FLAG_ASCII_NAME) != 0;
+}
+
+bool
+db_entry_has_ascii_path(FsearchDatabaseEntry *entry) {
+    while (entry) {
+        if (!db_entry_has_ascii_name(entry)) {
+            return false;
+        }
+        entry = (FsearchDatabaseEntry *)entry_get_parent(entry);
+    }
+    return true;
 }
 
 FsearchDatabaseEntryFolder *
 db_entry_get_parent(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.parent : NULL;
+    return entry ? entry_get_parent(entry) : NULL;
 }
 
 FsearchDatabaseEntryType
 db_entry_get_type(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.type : DATABASE_ENTRY_TYPE_NONE;
+    return entry ? *ENTRY_COLUMN(entry, type) & DATABASE_ENTRY_TYPE_MASK : DATABASE_ENTRY_TYPE_NONE;
 }
 
 uint32_t
-db_entry_get_idx(FsearchDatabaseEntry *entry) {
-    return entry ? entry->shared.idx : 0;
-}
-
-void
-db_file_entry_destroy(FsearchDatabaseEntryFolder *entry) {
-    if (G_UNLIKELY(!entry)) {
-        return;
-    }
-    g_clear_pointer(&entry->shared.name, free);
-}
-
-void
-db_folder_entry_destroy(FsearchDatabaseEntryFolder *entry) {
-    if (G_UNLIKELY(!entry)) {
-        return;
-    }
-    g_clear_pointer(&entry->shared.name, free);
+db_entry_get_id(FsearchDatabaseEntry *entry) {
+    return entry_get_id(entry);
 }
 
 static uint32_t
 db_entry_get_depth(FsearchDatabaseEntry *entry) {
     uint32_t depth = 0;
-    while (entry && entry->shared.parent) {
-        entry = (FsearchDatabaseEntry *)entry->shared.parent;
+    FsearchDatabaseEntryFolder *parent = NULL;
+    while (entry && (parent = entry_get_parent(entry))) {
+        entry = (FsearchDatabaseEntry *)parent;
         depth++;
     }
     return depth;
@@ -159,7 +406,7 @@ db_entry_get_depth(FsearchDatabaseEntry *entry) {
 static FsearchDatabaseEntryFolder *
 db_entry_get_parent_nth(FsearchDatabaseEntryFolder *entry, uint32_t nth) {
     while (entry && nth > 0) {
-        entry = entry->shared.parent;
+        entry = entry_get_parent((FsearchDatabaseEntry *)entry);
         nth--;
     }
     return entry;
@@ -170,13 +417,15 @@ sort_entry_by_path_recursive(FsearchDatabaseEntryFolder *entry_a, FsearchDatabas
     if (G_UNLIKELY(!entry_a || !entry_b)) {
         return;
     }
-    if (entry_a->shared.parent && entry_a->shared.parent != entry_b->shared.parent) {
-        sort_entry_by_path_recursive(entry_a->shared.parent, entry_b->shared.parent, res);
+    FsearchDatabaseEntryFolder *parent_a = entry_get_parent((FsearchDatabaseEntry *)entry_a);
+    FsearchDatabaseEntryFolder *parent_b = entry_get_parent((FsearchDatabaseEntry *)entry_b);
+    if (parent_a && parent_a != parent_b) {
+        sort_entry_by_path_recursive(parent_a, parent_b, res);
     }
     if (*res != 0) {
         return;
     }
-    *res = strverscmp(entry_a->shared.name, entry_b->shared.name);
+    *res = strverscmp(entry_get_name((FsearchDatabaseEntry *)entry_a), entry_get_name((FsearchDatabaseEntry *)entry_b));
 }
 
 int
@@ -210,7 +459,7 @@ db_entry_compare_entries_by_type(FsearchDatabaseEntry **a, FsearchDatabaseEntry
 
 int
 db_entry_compare_entries_by_modification_time(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
-    return ((*a)->shared.mtime > (*b)->shared.mtime) ? 1 : -1;
+    return (*ENTRY_COLUMN(*a, mtime) > *ENTRY_COLUMN(*b, mtime)) ? 1 : -1;
 }
 
 int
@@ -227,30 +476,34 @@ db_entry_compare_entries_by_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry
 
     int res = 0;
     if (a_depth == b_depth) {
-        sort_entry_by_path_recursive(entry_a->shared.parent, entry_b->shared.parent, &res);
+        sort_entry_by_path_recursive(entry_get_parent(entry_a), entry_get_parent(entry_b), &res);
         return res == 0 ? db_entry_compare_entries_by_name(a, b) : res;
     }
     else if (a_depth > b_depth) {
         const uint32_t diff = a_depth - b_depth;
-        FsearchDatabaseEntryFolder *parent_a = db_entry_get_parent_nth(entry_a->shared.parent, diff);
-        sort_entry_by_path_recursive(parent_a, entry_b->shared.parent, &res);
+        FsearchDatabaseEntryFolder *parent_a = db_entry_get_parent_nth(entry_get_parent(entry_a), diff);
+        sort_entry_by_path_recursive(parent_a, entry_get_parent(entry_b), &res);
         return res == 0 ? 1 : res;
     }
     else {
         const uint32_t diff = b_depth - a_depth;
-        FsearchDatabaseEntryFolder *parent_b = db_entry_get_parent_nth(entry_b->shared.parent, diff);
-        sort_entry_by_path_recursive(entry_a->shared.parent, parent_b, &res);
+        FsearchDatabaseEntryFolder *parent_b = db_entry_get_parent_nth(entry_get_parent(entry_b), diff);
+        sort_entry_by_path_recursive(entry_get_parent(entry_a), parent_b, &res);
         return res == 0 ? -1 : res;
     }
 }
 
-static void
+static bool
 db_entry_update_folder_size(FsearchDatabaseEntryFolder *folder, off_t size) {
-    if (!folder) {
-        return;
+    while (folder) {
+        FsearchDatabaseEntry *writable = db_entry_get_writable((FsearchDatabaseEntry *)folder);
+        if (!writable) {
+            return false;
+        }
+        *ENTRY_COLUMN(writable, size) += size;
+        folder = entry_get_parent(writable);
     }
-    folder->shared.size += size;
-    db_entry_update_folder_size(folder->shared.parent, size);
+    return true;
 }
 
 int
@@ -266,43 +519,260 @@ db_entry_compare_entries_by_extension(FsearchDatabaseEntry **a, FsearchDatabaseE
 
 int
 db_entry_compare_entries_by_name(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b) {
-    return strverscmp((*a)->shared.name, (*b)->shared.name);
+    return strverscmp(entry_get_name(*a), entry_get_name(*b));
+}
+
+typedef struct DatabaseEntrySortKey {
+    FsearchDatabaseEntry *entry;
+    const uint8_t *key;
+    size_t key_offset;
+    uint32_t key_len;
+    // parent_rank: the path order of the parent, which breaks ties between entries with the same key
+    uint32_t parent_rank;
+    // idx: position before sorting, which breaks the remaining ties so the sort is stable even when it runs on
+    // multiple threads
+    uint32_t idx;
+} DatabaseEntrySortKey;
+
+static int
+db_entry_compare_sort_keys(DatabaseEntrySortKey **a, DatabaseEntrySortKey **b) {
+    const DatabaseEntrySortKey *key_a = *a;
+    const DatabaseEntrySortKey *key_b = *b;
+    const int res = memcmp(key_a->key, key_b->key, MIN(key_a->key_len, key_b->key_len));
+    if (res != 0) {
+        return res;
+    }
+    if (key_a->key_len != key_b->key_len) {
+        return key_a->key_len < key_b->key_len ? -1 : 1;
+    }
+    if (key_a->parent_rank != key_b->parent_rank) {
+        return key_a->parent_rank < key_b->parent_rank ? -1 : 1;
+    }
+    return key_a->idx < key_b->idx ? -1 : 1;
+}
+
+// Numbers all folders in path order (a pre-order traversal of the folder tree with children sorted by name),
+// starting at 1 so 0 is left for entries without a parent. The result is indexed by the id of a folder within its
+// store. folders must be sorted by name and contain the parents of all of them.
+static uint32_t *
+db_entry_get_folder_ranks(DynamicArray *folders) {
+    const uint32_t num_folders = folders ? darray_get_num_items(folders) : 0;
+    if (num_folders == 0) {
+        return NULL;
+    }
+
+    FsearchDatabaseEntryStore *store = entry_get_block(darray_get_item(folders, 0))->store;
+    const uint32_t num_ids = store->num_blocks * DATABASE_ENTRY_BLOCK_CAPACITY;
+    uint32_t *ranks = calloc(num_ids, sizeof(uint32_t));
+    uint32_t *first_child = malloc(num_ids * sizeof(uint32_t));
+    uint32_t *next_sibling = malloc(num_ids * sizeof(uint32_t));
+    uint32_t *pending = malloc(num_folders * sizeof(uint32_t));
+    assert(ranks != NULL);
+    assert(first_child != NULL);
+    assert(next_sibling != NULL);
+    assert(pending != NULL);
+    memset(first_child, 0xff, num_ids * sizeof(uint32_t));
+
+    // link the children of every folder, walking backwards leaves them in name order
+    uint32_t first_root = DATABASE_ENTRY_NO_PARENT;
+    for (uint32_t i = num_folders; i > 0; i--) {
+        FsearchDatabaseEntry *folder = darray_get_item(folders, i - 1);
+        const uint32_t id = entry_get_id(folder);
+        const uint32_t parent_id = entry_get_parent_id(folder);
+        uint32_t *children = parent_id == DATABASE_ENTRY_NO_PARENT ? &first_root : &first_child[parent_id];
+        next_sibling[id] = *children;
+        *children = id;
+    }
+
+    // pending: siblings which are visited once the sub tree of their predecessor is done
+    uint32_t num_pending = 0;
+    uint32_t rank = 0;
+    uint32_t id = first_root;
+    while (id != DATABASE_ENTRY_NO_PARENT || num_pending > 0) {
+        if (id == DATABASE_ENTRY_NO_PARENT) {
+            id = pending[--num_pending];
+            continue;
+        }
+        ranks[id] = ++rank;
+        if (next_sibling[id] != DATABASE_ENTRY_NO_PARENT) {
+            pending[num_pending++] = next_sibling[id];
+        }
+        id = first_child[id];
+    }
+
+    g_clear_pointer(&pending, free);
+    g_clear_pointer(&next_sibling, free);
+    g_clear_pointer(&first_child, free);
+    return ranks;
+}
+
+// folder_ranks: the path order of the folders (see db_entry_get_folder_ranks) or NULL. If rank_first is set, entries
+// are ordered by the rank of their parent before their key, otherwise it only breaks ties.
+static void
+db_entry_sort_entries_by_key(DynamicArray *entries,
+                             bool by_extension,
+                             const uint32_t *folder_ranks,
+                             bool rank_first) {
+    const uint32_t num_entries = darray_get_num_items(entries);
+    if (num_entries < 2) {
+        return;
+    }
+
+    DatabaseEntrySortKey *sort_keys = calloc(num_entries, sizeof(DatabaseEntrySortKey));
+    assert(sort_keys != NULL);
+
+    // all keys are stored in one buffer, so only their offsets are known until it stops growing
+    GByteArray *key_data = g_byte_array_sized_new(num_entries * 16);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        const char *name = entry_get_name(entry);
+        const char *ext = by_extension ? db_entry_get_extension(entry) : NULL;
+        const size_t ext_len = ext ? strlen(ext) : 0;
+
+        const size_t offset = key_data->len;
+        g_byte_array_set_size(key_data,
+                              offset + sizeof(uint32_t) + ext_len + 1 + FS_STR_NATURAL_SORT_KEY_SIZE(strlen(name)));
+        uint8_t *key = key_data->data + offset;
+        const uint32_t parent_id = folder_ranks ? entry_get_parent_id(entry) : DATABASE_ENTRY_NO_PARENT;
+        const uint32_t rank = parent_id == DATABASE_ENTRY_NO_PARENT ? 0 : folder_ranks[parent_id];
+        if (rank_first) {
+            // the rank of the parent is stored big endian, so memcmp orders it numerically
+            key[0] = rank >> 24;
+            key[1] = rank >> 16;
+            key[2] = rank >> 8;
+            key[3] = rank;
+            key += sizeof(uint32_t);
+        }
+        if (by_extension) {
+            // extensions are compared with strcmp, the terminating null byte makes shorter ones sort first
+            memcpy(key, ext ? ext : "", ext_len);
+            key[ext_len] = '\0';
+            key += ext_len + 1;
+        }
+        key += fs_str_get_natural_sort_key(name, key);
+        g_byte_array_set_size(key_data, key - key_data->data);
+
+        sort_keys[i].entry = entry;
+        sort_keys[i].key_offset = offset;
+        sort_keys[i].key_len = key_data->len - offset;
+        sort_keys[i].parent_rank = rank;
+        sort_keys[i].idx = i;
+    }
+
+    DynamicArray *sorted_keys = darray_new(num_entries);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        sort_keys[i].key = key_data->data + sort_keys[i].key_offset;
+        darray_add_item(sorted_keys, &sort_keys[i]);
+    }
+
+    darray_sort_multi_threaded(sorted_keys, (DynamicArrayCompareFunc)db_entry_compare_sort_keys);
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        DatabaseEntrySortKey *sort_key = darray_get_item(sorted_keys, i);
+        darray_set_item(entries, sort_key->entry, i);
+    }
+
+    g_clear_pointer(&sorted_keys, darray_unref);
+    g_byte_array_free(g_steal_pointer(&key_data), TRUE);
+    g_clear_pointer(&sort_keys, free);
 }
 
 void
-db_entry_set_mtime(FsearchDatabaseEntry *entry, time_t mtime) {
-    entry->shared.mtime = mtime;
+db_entry_sort_entries_by_name(DynamicArray *entries) {
+    db_entry_sort_entries_by_key(entries, false, NULL, false);
 }
 
 void
-db_entry_set_size(FsearchDatabaseEntry *entry, off_t size) {
-    entry->shared.size = size;
+db_entry_sort_entries_by_extension(DynamicArray *entries) {
+    db_entry_sort_entries_by_key(entries, true, NULL, false);
 }
 
 void
-db_entry_set_name(FsearchDatabaseEntry *entry, const char *name) {
-    if (entry->shared.name) {
-        free(entry->shared.name);
+db_entry_sort_entries_by_path(DynamicArray *entries, DynamicArray *folders) {
+    if (darray_get_num_items(entries) < 2) {
+        return;
     }
-    entry->shared.name = strdup(name ? name : "");
+    // without folders no entry has a parent, so the name order is the path order as well
+    uint32_t *folder_ranks = db_entry_get_folder_ranks(folders);
+    db_entry_sort_entries_by_key(entries, false, folder_ranks, true);
+    g_clear_pointer(&folder_ranks, free);
 }
 
 void
-db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent) {
-    entry->shared.parent = parent;
+db_entry_sort_entries_by_name_and_path(DynamicArray *entries, DynamicArray *folders) {
+    if (darray_get_num_items(entries) < 2) {
+        return;
+    }
+    uint32_t *folder_ranks = db_entry_get_folder_ranks(folders);
+    db_entry_sort_entries_by_key(entries, false, folder_ranks, false);
+    g_clear_pointer(&folder_ranks, free);
 }
 
 void
-db_entry_set_type(FsearchDatabaseEntry *entry, FsearchDatabaseEntryType type) {
-    entry->shared.type = type;
+db_entry_set_mtime(FsearchDatabaseEntry *entry, time_t mtime) {
+    assert(!entry_is_published(entry));
+    *ENTRY_COLUMN(entry, mtime) = mtime;
+}
+
+void
+db_entry_set_size(FsearchDatabaseEntry *entry, off_t size) {
+    assert(!entry_is_published(entry));
+    *ENTRY_COLUMN(entry, size) = size;
+}
+
+bool
+db_entry_set_name(FsearchDatabaseEntry *entry, const char *name) {
+    assert(!entry_is_published(entry));
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    const uint32_t slot = entry_get_slot(block, entry);
+    uint32_t name_id = 0;
+    if (name && name[0] != '\0' && !fsearch_string_arena_add(block->store->name_arena, name, strlen(name), &name_id)) {
+        return false;
+    }
+    block->name[slot] = name_id;
+    if (!name || g_str_is_ascii(name)) {
+        block->type[slot] |= DATABASE_ENTRY_FLAG_ASCII_NAME;
+    }
+    else {
+        block->type[slot] &= ~DATABASE_ENTRY_FLAG_ASCII_NAME;
+    }
+    return true;
+}
+
+bool
+db_entry_set_folded_name(FsearchDatabaseEntry *entry, const char *folded_name) {
+    assert(!entry_is_published(entry));
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    uint32_t folded_name_id = 0;
+    if (folded_name && folded_name[0] != '\0'
+        && !fsearch_string_arena_add(block->store->name_arena, folded_name, strlen(folded_name), &folded_name_id)) {
+        return false;
+    }
+    block->folded_name[entry_get_slot(block, entry)] = folded_name_id;
+    return true;
 }
 
 void
-db_entry_set_idx(FsearchDatabaseEntry *entry, uint32_t idx) {
-    entry->shared.idx = idx;
+db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent) {
+    assert(!entry_is_published(entry));
+    FsearchDatabaseEntryBlock *block = entry_get_block(entry);
+    uint32_t parent_id = DATABASE_ENTRY_NO_PARENT;
+    if (parent) {
+        assert(entry_get_block((FsearchDatabaseEntry *)parent)->store == block->store->folder_store);
+        // copies of the parent share its id, so the entry stays attached to it when it gets modified
+        parent_id = entry_get_id((FsearchDatabaseEntry *)parent);
+    }
+    block->parent[entry_get_slot(block, entry)] = parent_id;
 }
 
 void
+db_entry_set_type(FsearchDatabaseEntry *entry, FsearchDatabaseEntryType type) {
+    assert(!entry_is_published(entry));
+    uint8_t *type_and_flags = ENTRY_COLUMN(entry, type);
+    *type_and_flags = (*type_and_flags & ~DATABASE_ENTRY_TYPE_MASK) | type;
+}
+
+bool
 db_entry_update_parent_size(FsearchDatabaseEntry *entry) {
-    db_entry_update_folder_size(entry->shared.parent, entry->shared.size);
+    return db_entry_update_folder_size(entry_get_parent(entry), *ENTRY_COLUMN(entry, size));
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "fsearch_array.h"
+#include "fsearch_string_arena.h"
+
 #include <glib.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -15,14 +18,48 @@ typedef struct FsearchDatabaseEntryFile FsearchDatabaseEntry;
 typedef struct FsearchDatabaseEntryFile FsearchDatabaseEntryFile;
 typedef struct FsearchDatabaseEntryFolder FsearchDatabaseEntryFolder;
 
-size_t
-db_entry_get_sizeof_folder_entry();
+// Owns the storage of entries, which are only released together with the store.
+// Parents of entries must be allocated from the folder store, names are copied into the name arena.
+typedef struct FsearchDatabaseEntryStore FsearchDatabaseEntryStore;
 
-size_t
-db_entry_get_sizeof_file_entry();
+FsearchDatabaseEntryStore *
+db_entry_store_new(FsearchStringArena *name_arena, FsearchDatabaseEntryStore *folder_store);
 
 void
-db_entry_set_idx(FsearchDatabaseEntry *entry, uint32_t idx);
+db_entry_store_free(FsearchDatabaseEntryStore *store);
+
+// Returns NULL when the store can't hold any more entries
+FsearchDatabaseEntry *
+db_entry_store_alloc(FsearchDatabaseEntryStore *store, FsearchDatabaseEntryType type);
+
+// Entries are numbered in the order they were allocated from their store, starting at 0.
+// Positions are never reused, since entries are only released together with the store.
+uint32_t
+db_entry_store_get_num_entries(FsearchDatabaseEntryStore *store);
+
+// Returns the entry at position, which might be a copy of another entry (see db_entry_get_writable)
+FsearchDatabaseEntry *
+db_entry_store_get_entry(FsearchDatabaseEntryStore *store, uint32_t position);
+
+// Makes all entries which were allocated so far read-only. Published entries are read by searches and views without
+// holding any lock, so they must never change: the setters below assert that they're only used on entries which
+// weren't published yet and modifications go through db_entry_get_writable instead.
+void
+db_entry_store_publish(FsearchDatabaseEntryStore *store);
+
+// Returns a version of entry which can be modified: its latest copy if that wasn't published yet, otherwise a new
+// copy. The copy takes the place of entry, it has the same id and parents resolve to it, while entry itself stays
+// untouched for the readers which still use it. Returns NULL when the store has no room left for the copy.
+FsearchDatabaseEntry *
+db_entry_get_writable(FsearchDatabaseEntry *entry);
+
+// Returns the latest copy of entry, or entry itself if it was never copied
+FsearchDatabaseEntry *
+db_entry_get_latest(FsearchDatabaseEntry *entry);
+
+// Returns the entry which all copies of entry were made from, which identifies it no matter how often it was modified
+FsearchDatabaseEntry *
+db_entry_get_original(FsearchDatabaseEntry *entry);
 
 void
 db_entry_set_mtime(FsearchDatabaseEntry *entry, time_t mtime);
@@ -30,20 +67,29 @@ db_entry_set_mtime(FsearchDatabaseEntry *entry, time_t mtime);
 void
 db_entry_set_size(FsearchDatabaseEntry *entry, off_t size);
 
-void
+// The name setters return false when the name arena has no room left for the name
+bool
 db_entry_set_name(FsearchDatabaseEntry *entry, const char *name);
 
+// folded_name: the case folded and NFD normalized form of the name, NULL or "" if it's the same as the name with its
+// ASCII letters in lower case
+bool
+db_entry_set_folded_name(FsearchDatabaseEntry *entry, const char *folded_name);
+
 void
 db_entry_set_parent(FsearchDatabaseEntry *entry, FsearchDatabaseEntryFolder *parent);
 
 void
 db_entry_set_type(FsearchDatabaseEntry *entry, FsearchDatabaseEntryType type);
 
-void
+// Adds the size of entry to all of its parents, parents which were published are copied. Returns false when a copy
+// couldn't be made.
+bool
 db_entry_update_parent_size(FsearchDatabaseEntry *entry);
 
+// id: position of the entry within its store, copies share the id of the entry they were made from
 uint32_t
-db_entry_get_idx(FsearchDatabaseEntry *entry);
+db_entry_get_id(FsearchDatabaseEntry *entry);
 
 GString *
 db_entry_get_path(FsearchDatabaseEntry *entry);
@@ -69,18 +115,25 @@ db_entry_get_name(FsearchDatabaseEntry *entry);
 const char *
 db_entry_get_name_raw(FsearchDatabaseEntry *entry);
 
+// Returns the case folded and NFD normalized form of the name, NULL if that's the name with its ASCII letters in lower
+// case (which is true for all pure ASCII names) or if it wasn't set
+const char *
+db_entry_get_folded_name(FsearchDatabaseEntry *entry);
+
+// Returns true if the name consists of ASCII characters only
+bool
+db_entry_has_ascii_name(FsearchDatabaseEntry *entry);
+
+// Returns true if the names of the entry and all of its parents consist of ASCII characters only
+bool
+db_entry_has_ascii_path(FsearchDatabaseEntry *entry);
+
 FsearchDatabaseEntryFolder *
 db_entry_get_parent(FsearchDatabaseEntry *entry);
 
 FsearchDatabaseEntryType
 db_entry_get_type(FsearchDatabaseEntry *entry);
 
-void
-db_file_entry_destroy(FsearchDatabaseEntryFolder *entry);
-
-void
-db_folder_entry_destroy(FsearchDatabaseEntryFolder *entry);
-
 int
 db_entry_compare_entries_by_extension(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b);
 
@@ -101,3 +154,23 @@ db_entry_compare_entries_by_path(FsearchDatabaseEntry **a, FsearchDatabaseEntry
 
 int
 db_entry_compare_entries_by_name(FsearchDatabaseEntry **a, FsearchDatabaseEntry **b);
+
+// Sort entries in the same order as db_entry_compare_entries_by_name and db_entry_compare_entries_by_extension, but
+// generate a binary sort key for every entry once and compare those instead of the names. Entries which compare
+// equal keep their order.
+void
+db_entry_sort_entries_by_name(DynamicArray *entries);
+
+void
+db_entry_sort_entries_by_extension(DynamicArray *entries);
+
+// Sort entries in the same order as db_entry_compare_entries_by_path. folders must hold the parents of all entries
+// and their ancestors, sorted by name. They're numbered in path order once, so every entry only needs to be compared
+// by the number of its parent and its name.
+void
+db_entry_sort_entries_by_path(DynamicArray *entries, DynamicArray *folders);
+
+// Like db_entry_sort_entries_by_name, but entries with the same name are ordered by the path of their parents, as if
+// they had been sorted by path before. folders must be the same as for db_entry_sort_entries_by_path.
+void
+db_entry_sort_entries_by_name_and_path(DynamicArray *entries, DynamicArray *folders);
@@ -0,0 +1,435 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#define _GNU_SOURCE
+
+#define G_LOG_DOMAIN "fsearch-database-monitor"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fsearch_database_monitor.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#include "fsearch_database_entry.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Changes are collected for this long before they're applied, so bursts of events (e.g. extracting an archive)
+// only cause a single update of the sorted arrays
+#define DATABASE_MONITOR_BATCH_INTERVAL_MS 1000
+
+// Size changes are picked up when the writer closes the file, which keeps the event queue small
+// compared to IN_MODIFY, which is sent for every single write.
+#define DATABASE_MONITOR_EVENT_MASK                                                                                    \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW    \
+     | IN_EXCL_UNLINK)
+
+typedef enum {
+    DATABASE_MONITOR_JOB_WATCH_FOLDERS,
+    DATABASE_MONITOR_JOB_APPLY_CHANGES,
+} DatabaseMonitorJobType;
+
+typedef struct {
+    DatabaseMonitorJobType type;
+    GHashTable *changes;
+} DatabaseMonitorJob;
+
+struct FsearchDatabaseMonitor {
+    FsearchDatabase *db;
+
+    int fd;
+    guint fd_source_id;
+    guint batch_source_id;
+
+    // changes: collected on the main thread, maps folders to sets of names which changed inside of them
+    GHashTable *changes;
+
+    // worker: applies the changes and updates the watches, one job at a time
+    GThreadPool *worker;
+
+    // mutex: protects the watch tables and pending notifications, which are shared with the worker
+    GMutex mutex;
+    GHashTable *watch_to_folder;
+    GHashTable *folder_to_watch;
+    guint notify_source_id;
+    uint32_t pending_notifications;
+
+    FsearchDatabaseMonitorNotifyFunc notify_func;
+    gpointer notify_func_data;
+
+    volatile int stopped;
+};
+
+static GHashTable *
+db_monitor_changes_new(void) {
+    return g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_hash_table_destroy);
+}
+
+static gboolean
+db_monitor_on_notify(gpointer user_data) {
+    FsearchDatabaseMonitor *monitor = user_data;
+
+    g_mutex_lock(&monitor->mutex);
+    const uint32_t pending = monitor->pending_notifications;
+    monitor->pending_notifications = 0;
+    monitor->notify_source_id = 0;
+    g_mutex_unlock(&monitor->mutex);
+
+    // only the most severe notification is sent, the receiver is allowed to free the monitor in response
+    FsearchDatabaseMonitorNotify id = DATABASE_MONITOR_NOTIFY_CHANGED;
+    if (pending & (1 << DATABASE_MONITOR_NOTIFY_FAILED)) {
+        id = DATABASE_MONITOR_NOTIFY_FAILED;
+    }
+    else if (pending & (1 << DATABASE_MONITOR_NOTIFY_OVERFLOW)) {
+        id = DATABASE_MONITOR_NOTIFY_OVERFLOW;
+    }
+
+    if (monitor->notify_func) {
+        monitor->notify_func(monitor, id, monitor->notify_func_data);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+db_monitor_notify(FsearchDatabaseMonitor *monitor, FsearchDatabaseMonitorNotify id) {
+    g_mutex_lock(&monitor->mutex);
+    monitor->pending_notifications |= 1 << id;
+    if (!monitor->notify_source_id) {
+        monitor->notify_source_id = g_idle_add(db_monitor_on_notify, monitor);
+    }
+    g_mutex_unlock(&monitor->mutex);
+}
+
+static void
+db_monitor_fail(FsearchDatabaseMonitor *monitor, FsearchDatabaseMonitorNotify id) {
+    // the database can't be kept in sync anymore, so all further events are ignored
+    g_atomic_int_set(&monitor->stopped, 1);
+    db_monitor_notify(monitor, id);
+}
+
+static bool
+db_monitor_add_watch(FsearchDatabaseMonitor *monitor, FsearchDatabaseEntryFolder *folder) {
+    // copies replace the folder whenever it's modified, the watch refers to the original which they all share
+    folder = (FsearchDatabaseEntryFolder *)db_entry_get_original((FsearchDatabaseEntry *)folder);
+    GString *path = db_entry_get_path_full((FsearchDatabaseEntry *)folder);
+
+    g_mutex_lock(&monitor->mutex);
+    const int wd = inotify_add_watch(monitor->fd, path->str, DATABASE_MONITOR_EVENT_MASK);
+    const int error = errno;
+    if (wd >= 0) {
+        g_hash_table_insert(monitor->watch_to_folder, GINT_TO_POINTER(wd), folder);
+        g_hash_table_insert(monitor->folder_to_watch, folder, GINT_TO_POINTER(wd));
+    }
+    g_mutex_unlock(&monitor->mutex);
+
+    bool res = true;
+    if (wd < 0) {
+        if (error == ENOSPC || error == ENOMEM) {
+            g_warning("[db_monitor] inotify watch limit reached, consider raising fs.inotify.max_user_watches");
+            res = false;
+        }
+        else {
+            // the folder might be gone already or isn't accessible, it won't be updated in this case
+            g_debug("[db_monitor] failed to watch %s: %s", path->str, strerror(error));
+        }
+    }
+
+    g_string_free(g_steal_pointer(&path), TRUE);
+    return res;
+}
+
+static void
+db_monitor_remove_watch(FsearchDatabaseMonitor *monitor, FsearchDatabaseEntryFolder *folder) {
+    folder = (FsearchDatabaseEntryFolder *)db_entry_get_original((FsearchDatabaseEntry *)folder);
+    g_mutex_lock(&monitor->mutex);
+    gpointer wd = NULL;
+    if (g_hash_table_lookup_extended(monitor->folder_to_watch, folder, NULL, &wd)) {
+        // watches of deleted folders are gone already, which makes this fail silently
+        inotify_rm_watch(monitor->fd, GPOINTER_TO_INT(wd));
+        g_hash_table_remove(monitor->folder_to_watch, folder);
+        g_hash_table_remove(monitor->watch_to_folder, wd);
+    }
+    g_mutex_unlock(&monitor->mutex);
+}
+
+static void
+db_monitor_watch_folders(FsearchDatabaseMonitor *monitor) {
+    DynamicArray *folders = db_get_folders(monitor->db);
+
+    if (!folders) {
+        return;
+    }
+
+    GTimer *timer = g_timer_new();
+    g_timer_start(timer);
+
+    // the folders array is never modified, changes replace it, so it can be used without holding the lock
+    const uint32_t num_folders = darray_get_num_items(folders);
+    uint32_t num_processed = 0;
+    for (; num_processed < num_folders; num_processed++) {
+        if (g_atomic_int_get(&monitor->stopped)) {
+            break;
+        }
+        if (!db_monitor_add_watch(monitor, darray_get_item(folders, num_processed))) {
+            db_monitor_fail(monitor, DATABASE_MONITOR_NOTIFY_FAILED);
+            break;
+        }
+    }
+
+    g_debug("[db_monitor] set up watches for %d/%d folders in %.2f ms",
+            num_processed,
+            num_folders,
+            g_timer_elapsed(timer, NULL) * 1000);
+
+    g_clear_pointer(&timer, g_timer_destroy);
+    g_clear_pointer(&folders, darray_unref);
+}
+
+static void
+db_monitor_apply_changes(FsearchDatabaseMonitor *monitor, GHashTable *changes) {
+    // events which were read before the previous batch was applied might still refer to removed folders
+    g_mutex_lock(&monitor->mutex);
+    GHashTableIter iter;
+    gpointer folder = NULL;
+    g_hash_table_iter_init(&iter, changes);
+    while (g_hash_table_iter_next(&iter, &folder, NULL)) {
+        if (!g_hash_table_contains(monitor->folder_to_watch, folder)) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    g_mutex_unlock(&monitor->mutex);
+
+    GPtrArray *added_folders = g_ptr_array_new();
+    GPtrArray *removed_folders = g_ptr_array_new();
+
+    const FsearchDatabaseChangesResult res =
+        db_apply_folder_changes(monitor->db, changes, added_folders, removed_folders);
+    if (res == DATABASE_CHANGES_RESCAN_NEEDED) {
+        db_monitor_fail(monitor, DATABASE_MONITOR_NOTIFY_OVERFLOW);
+    }
+    else if (res == DATABASE_CHANGES_APPLIED) {
+        // removed watches first: a folder which was moved inside of the index keeps its watch descriptor
+        for (guint i = 0; i < removed_folders->len; i++) {
+            db_monitor_remove_watch(monitor, g_ptr_array_index(removed_folders, i));
+        }
+        bool failed = false;
+        for (guint i = 0; i < added_folders->len && !failed; i++) {
+            failed = !db_monitor_add_watch(monitor, g_ptr_array_index(added_folders, i));
+        }
+        if (failed) {
+            db_monitor_fail(monitor, DATABASE_MONITOR_NOTIFY_FAILED);
+        }
+        else if (g_hash_table_size(changes) > 0) {
+            db_monitor_notify(monitor, DATABASE_MONITOR_NOTIFY_CHANGED);
+        }
+    }
+
+    g_ptr_array_free(g_steal_pointer(&added_folders), TRUE);
+    g_ptr_array_free(g_steal_pointer(&removed_folders), TRUE);
+}
+
+static void
+db_monitor_worker_func(gpointer data, gpointer user_data) {
+    DatabaseMonitorJob *job = data;
+    FsearchDatabaseMonitor *monitor = user_data;
+
+    if (!g_atomic_int_get(&monitor->stopped)) {
+        switch (job->type) {
+        case DATABASE_MONITOR_JOB_WATCH_FOLDERS:
+            db_monitor_watch_folders(monitor);
+            break;
+        case DATABASE_MONITOR_JOB_APPLY_CHANGES:
+            db_monitor_apply_changes(monitor, job->changes);
+            break;
+        }
+    }
+
+    g_clear_pointer(&job->changes, g_hash_table_destroy);
+    g_clear_pointer(&job, free);
+}
+
+static void
+db_monitor_push_job(FsearchDatabaseMonitor *monitor, DatabaseMonitorJobType type, GHashTable *changes) {
+    DatabaseMonitorJob *job = calloc(1, sizeof(DatabaseMonitorJob));
+    assert(job != NULL);
+    job->type = type;
+    job->changes = changes;
+    g_thread_pool_push(monitor->worker, job, NULL);
+}
+
+static gboolean
+db_monitor_on_batch_timeout(gpointer user_data) {
+    FsearchDatabaseMonitor *monitor = user_data;
+    monitor->batch_source_id = 0;
+
+    db_monitor_push_job(monitor, DATABASE_MONITOR_JOB_APPLY_CHANGES, g_steal_pointer(&monitor->changes));
+    monitor->changes = db_monitor_changes_new();
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+db_monitor_handle_event(FsearchDatabaseMonitor *monitor, const struct inotify_event *event) {
+    if (event->mask & IN_IGNORED) {
+        // the watch is gone, the folder itself gets removed with the changes of its parent
+        return;
+    }
+
+    g_mutex_lock(&monitor->mutex);
+    FsearchDatabaseEntryFolder *folder = g_hash_table_lookup(monitor->watch_to_folder, GINT_TO_POINTER(event->wd));
+    g_mutex_unlock(&monitor->mutex);
+
+    if (!folder) {
+        return;
+    }
+
+    // events without a name only affect the folder itself, which gets updated anyway
+    GHashTable *names = g_hash_table_lookup(monitor->changes, folder);
+    if (!names) {
+        names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_insert(monitor->changes, folder, names);
+    }
+    if (event->len > 0 && event->name[0] != '\0') {
+        g_hash_table_add(names, g_strdup(event->name));
+    }
+
+    if (!monitor->batch_source_id) {
+        monitor->batch_source_id =
+            g_timeout_add(DATABASE_MONITOR_BATCH_INTERVAL_MS, db_monitor_on_batch_timeout, monitor);
+    }
+}
+
+static gboolean
+db_monitor_on_events(gint fd, GIOCondition condition, gpointer user_data) {
+    FsearchDatabaseMonitor *monitor = user_data;
+
+    char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    const struct inotify_event *event = NULL;
+    for (char *ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + event->len) {
+        event = (const struct inotify_event *)ptr;
+        if (event->mask & IN_Q_OVERFLOW) {
+            g_warning("[db_monitor] event queue overflow, database needs to be rescanned");
+            db_monitor_fail(monitor, DATABASE_MONITOR_NOTIFY_OVERFLOW);
+            monitor->fd_source_id = 0;
+            return G_SOURCE_REMOVE;
+        }
+        db_monitor_handle_event(monitor, event);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorNotifyFunc notify_func, gpointer notify_func_data) {
+    assert(db != NULL);
+
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        g_warning("[db_monitor] failed to initialize inotify: %s", strerror(errno));
+        return NULL;
+    }
+
+    FsearchDatabaseMonitor *monitor = calloc(1, sizeof(FsearchDatabaseMonitor));
+    assert(monitor != NULL);
+
+    g_mutex_init(&monitor->mutex);
+    monitor->db = db_ref(db);
+    monitor->fd = fd;
+    monitor->notify_func = notify_func;
+    monitor->notify_func_data = notify_func_data;
+    monitor->changes = db_monitor_changes_new();
+    monitor->watch_to_folder = g_hash_table_new(NULL, NULL);
+    monitor->folder_to_watch = g_hash_table_new(NULL, NULL);
+
+    monitor->worker = g_thread_pool_new(db_monitor_worker_func, monitor, 1, FALSE, NULL);
+    // Setting up the watches takes a while for large databases, so it's done by the worker as well.
+    // Events of folders which are already watched queue up in the meantime.
+    db_monitor_push_job(monitor, DATABASE_MONITOR_JOB_WATCH_FOLDERS, NULL);
+
+    monitor->fd_source_id = g_unix_fd_add(fd, G_IO_IN, db_monitor_on_events, monitor);
+
+    return monitor;
+}
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor) {
+    if (!monitor) {
+        return;
+    }
+
+    g_atomic_int_set(&monitor->stopped, 1);
+
+    if (monitor->fd_source_id) {
+        g_source_remove(monitor->fd_source_id);
+        monitor->fd_source_id = 0;
+    }
+    if (monitor->batch_source_id) {
+        g_source_remove(monitor->batch_source_id);
+        monitor->batch_source_id = 0;
+    }
+
+    // queued jobs return immediately once the monitor is stopped
+    g_thread_pool_free(g_steal_pointer(&monitor->worker), FALSE, TRUE);
+
+    // the worker is gone, so no further notifications can be added
+    if (monitor->notify_source_id) {
+        g_source_remove(monitor->notify_source_id);
+        monitor->notify_source_id = 0;
+    }
+
+    g_clear_pointer(&monitor->changes, g_hash_table_destroy);
+    g_clear_pointer(&monitor->watch_to_folder, g_hash_table_destroy);
+    g_clear_pointer(&monitor->folder_to_watch, g_hash_table_destroy);
+
+    close(monitor->fd);
+    g_clear_pointer(&monitor->db, db_unref);
+
+    g_mutex_clear(&monitor->mutex);
+
+    g_clear_pointer(&monitor, free);
+}
+
+#else
+
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorNotifyFunc notify_func, gpointer notify_func_data) {
+    g_debug("[db_monitor] file system monitoring isn't supported on this platform");
+    return NULL;
+}
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor) {
+}
+
+#endif
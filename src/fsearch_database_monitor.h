@@ -0,0 +1,51 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#pragma once
+
+#include "fsearch_database.h"
+
+#include <glib.h>
+
+// Keeps a database in sync with the file system by watching all of its folders with inotify.
+// Events are collected for a short while and then applied in a background thread with db_apply_folder_changes,
+// so the database doesn't need to be rescanned periodically. Entries which searches and views already use are never
+// modified by this, the changes are applied to copies of them which get published in a new generation.
+typedef struct FsearchDatabaseMonitor FsearchDatabaseMonitor;
+
+typedef enum {
+    // entries of the database were added, removed or modified
+    DATABASE_MONITOR_NOTIFY_CHANGED,
+    // the kernel dropped events or the database can't take any more changes, only a rescan brings it back in sync
+    DATABASE_MONITOR_NOTIFY_OVERFLOW,
+    // the folders can't be watched anymore (e.g. the inotify watch limit was reached)
+    DATABASE_MONITOR_NOTIFY_FAILED,
+} FsearchDatabaseMonitorNotify;
+
+typedef void (*FsearchDatabaseMonitorNotifyFunc)(FsearchDatabaseMonitor *monitor,
+                                                 FsearchDatabaseMonitorNotify id,
+                                                 gpointer user_data);
+
+// Returns NULL when file system monitoring isn't supported.
+// The monitor must be created and freed on the thread running the default main context,
+// notify_func is called there as well and may free the monitor.
+FsearchDatabaseMonitor *
+db_monitor_new(FsearchDatabase *db, FsearchDatabaseMonitorNotifyFunc notify_func, gpointer notify_func_data);
+
+void
+db_monitor_free(FsearchDatabaseMonitor *monitor);
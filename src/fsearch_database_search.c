@@ -32,30 +32,86 @@
 #include "fsearch_task.h"
 #include "fsearch_task_ids.h"
 #include "fsearch_token.h"
+#include "fsearch_trigram_index.h"
 #include "fsearch_utf.h"
 
 #define THRESHOLD_FOR_PARALLEL_SEARCH 1000
+// number of entries the search workers take at once
+#define DATABASE_SEARCH_CHUNK_SIZE 2048
+// searches of at least DATABASE_SEARCH_PARTIAL_RESULTS_MIN_ENTRIES entries publish the results among the first
+// DATABASE_SEARCH_PARTIAL_RESULTS_NUM_ENTRIES of them before the remaining entries are searched
+#define DATABASE_SEARCH_PARTIAL_RESULTS_MIN_ENTRIES (1 << 18)
+#define DATABASE_SEARCH_PARTIAL_RESULTS_NUM_ENTRIES (1 << 16)
+#define DATABASE_SEARCH_CACHE_DEFAULT_LIMIT (32 * 1024 * 1024)
 
 struct DatabaseSearchResult {
     DynamicArray *files;
     DynamicArray *folders;
 
     FsearchDatabase *db;
+    // generation: the state of the database the results were found in
+    FsearchDatabaseGeneration *generation;
     FsearchDatabaseIndexType sort_type;
 
     volatile int ref_count;
 };
 
+typedef struct DatabaseSearchPathStates DatabaseSearchPathStates;
+
+// The entries are split into chunks, which the workers take one after another until none are left, so a worker which
+// got entries that are slow to search (e.g. long paths or expensive regular expressions) doesn't hold up the others
+typedef struct DatabaseSearchChunks {
+    // results: the matches of every chunk, stored from the position of its first entry on
+    void **results;
+    // num_results: the number of matches of every chunk
+    uint32_t *num_results;
+    // start_pos, end_pos: the range of the entries which gets searched, end_pos isn't part of it
+    uint32_t start_pos;
+    uint32_t end_pos;
+    uint32_t num_chunks;
+    // next_chunk: the chunk which gets taken next
+    volatile int next_chunk;
+} DatabaseSearchChunks;
+
 typedef struct DatabaseSearchWorkerContext {
     FsearchQuery *query;
-    void **results;
+    DatabaseSearchChunks *chunks;
     DynamicArray *entries;
     GCancellable *cancellable;
-    uint32_t num_results;
-    uint32_t start_pos;
-    uint32_t end_pos;
+    // candidates: bitmap of the entry ids whose names might match, the ids from num_indexed on aren't part of it and
+    // might always match. NULL when all entries need to be compared with the query.
+    const uint64_t *candidates;
+    uint32_t num_indexed;
+    // path_states: the state of the path tokens for the entries of every folder, NULL if the paths of all entries
+    // need to be built
+    const DatabaseSearchPathStates *path_states;
 } DatabaseSearchWorkerContext;
 
+// A cached search result. It doesn't hold references to the database or its generation, so it doesn't keep them
+// alive, instead it's only used as long as the database still publishes the generation with the same id.
+typedef struct DatabaseSearchCacheEntry {
+    // key: the texts of the query tokens, which ignores the whitespace between them
+    char *key;
+    FsearchFilter *filter;
+    FsearchQueryFlags flags;
+    int32_t sort_order;
+    uint32_t generation_id;
+    // db: only compared with, to find the entries of older generations of the same database and the ones to drop
+    // when it's freed
+    const FsearchDatabase *db;
+
+    DynamicArray *folders;
+    DynamicArray *files;
+    FsearchDatabaseIndexType sort_type;
+    size_t size;
+} DatabaseSearchCacheEntry;
+
+// db_search_cache: the results of recent searches of all views, the most recently used one first
+static GQueue db_search_cache = G_QUEUE_INIT;
+static size_t db_search_cache_size = 0;
+static size_t db_search_cache_limit = DATABASE_SEARCH_CACHE_DEFAULT_LIMIT;
+static GMutex db_search_cache_mutex;
+
 static DatabaseSearchResult *
 db_search(FsearchQuery *q, GCancellable *cancellable);
 
@@ -75,6 +131,7 @@ db_search_result_free(DatabaseSearchResult *result) {
     g_clear_pointer(&result->folders, darray_unref);
     g_clear_pointer(&result->files, darray_unref);
     g_clear_pointer(&result->db, db_unref);
+    g_clear_pointer(&result->generation, db_generation_unref);
     g_clear_pointer(&result, free);
 }
 
@@ -107,6 +164,11 @@ db_search_result_get_db(DatabaseSearchResult *result) {
     return db_ref(result->db);
 }
 
+FsearchDatabaseGeneration *
+db_search_result_get_generation(DatabaseSearchResult *result) {
+    return db_generation_ref(result->generation);
+}
+
 DynamicArray *
 db_search_result_get_files(DatabaseSearchResult *result) {
     return darray_ref(result->files);
@@ -117,6 +179,162 @@ db_search_result_get_folders(DatabaseSearchResult *result) {
     return darray_ref(result->folders);
 }
 
+static char *
+db_search_cache_key_new(FsearchQuery *query) {
+    GString *key = g_string_sized_new(strlen(query->text) + 1);
+    for (uint32_t i = 0; i < query->num_token; i++) {
+        g_string_append(key, query->token[i]->text);
+        g_string_append_c(key, '\n');
+    }
+    return g_string_free(key, FALSE);
+}
+
+static void
+db_search_cache_entry_free(DatabaseSearchCacheEntry *entry) {
+    g_clear_pointer(&entry->key, g_free);
+    g_clear_pointer(&entry->filter, fsearch_filter_unref);
+    g_clear_pointer(&entry->folders, darray_unref);
+    g_clear_pointer(&entry->files, darray_unref);
+    g_clear_pointer(&entry, free);
+}
+
+static bool
+db_search_cache_entry_matches(DatabaseSearchCacheEntry *entry, FsearchQuery *query, const char *key) {
+    return entry->filter == query->filter && entry->flags == query->flags && entry->sort_order == query->sort_order
+        && strcmp(entry->key, key) == 0;
+}
+
+static void
+db_search_cache_remove_link(GList *link) {
+    DatabaseSearchCacheEntry *entry = link->data;
+    db_search_cache_size -= entry->size;
+    g_queue_delete_link(&db_search_cache, link);
+    g_clear_pointer(&entry, db_search_cache_entry_free);
+}
+
+// Drops the least recently used entries until the cache fits into its limit, must be called with the cache locked
+static void
+db_search_cache_trim(void) {
+    while (db_search_cache_size > db_search_cache_limit && db_search_cache.tail) {
+        db_search_cache_remove_link(db_search_cache.tail);
+    }
+}
+
+void
+db_search_set_result_cache_size(size_t size) {
+    g_mutex_lock(&db_search_cache_mutex);
+    db_search_cache_limit = size;
+    db_search_cache_trim();
+    g_mutex_unlock(&db_search_cache_mutex);
+}
+
+size_t
+db_search_get_result_cache_usage(void) {
+    g_mutex_lock(&db_search_cache_mutex);
+    const size_t size = db_search_cache_size;
+    g_mutex_unlock(&db_search_cache_mutex);
+    return size;
+}
+
+void
+db_search_cache_remove_database(FsearchDatabase *db) {
+    g_mutex_lock(&db_search_cache_mutex);
+    GList *l = db_search_cache.head;
+    while (l != NULL) {
+        GList *next = l->next;
+        DatabaseSearchCacheEntry *entry = l->data;
+        if (entry->db == db) {
+            db_search_cache_remove_link(l);
+        }
+        l = next;
+    }
+    g_mutex_unlock(&db_search_cache_mutex);
+}
+
+static DatabaseSearchResult *
+db_search_cache_lookup(FsearchQuery *query) {
+    FsearchDatabaseGeneration *generation = db_get_generation(query->db);
+    if (!generation) {
+        return NULL;
+    }
+    const uint32_t generation_id = db_generation_get_id(generation);
+    char *key = db_search_cache_key_new(query);
+
+    DatabaseSearchResult *result = NULL;
+
+    g_mutex_lock(&db_search_cache_mutex);
+    for (GList *l = db_search_cache.head; l != NULL; l = l->next) {
+        DatabaseSearchCacheEntry *entry = l->data;
+        if (entry->generation_id != generation_id || !db_search_cache_entry_matches(entry, query, key)) {
+            continue;
+        }
+        // views sort their results in place, so they get a copy of the cached arrays
+        result = db_search_result_new();
+        result->folders = darray_copy(entry->folders);
+        result->files = darray_copy(entry->files);
+        result->db = db_ref(query->db);
+        result->generation = g_steal_pointer(&generation);
+        result->sort_type = entry->sort_type;
+
+        g_queue_unlink(&db_search_cache, l);
+        g_queue_push_head_link(&db_search_cache, l);
+        break;
+    }
+    g_mutex_unlock(&db_search_cache_mutex);
+
+    g_clear_pointer(&key, g_free);
+    g_clear_pointer(&generation, db_generation_unref);
+
+    return result;
+}
+
+static void
+db_search_cache_insert(FsearchQuery *query, DatabaseSearchResult *result) {
+    const uint32_t generation_id = db_generation_get_id(result->generation);
+    if (generation_id == 0) {
+        return;
+    }
+    const uint32_t num_folders = result->folders ? darray_get_num_items(result->folders) : 0;
+    const uint32_t num_files = result->files ? darray_get_num_items(result->files) : 0;
+    const size_t size = ((size_t)num_folders + num_files) * sizeof(void *) + sizeof(DatabaseSearchCacheEntry);
+
+    g_mutex_lock(&db_search_cache_mutex);
+    if (size > db_search_cache_limit) {
+        g_mutex_unlock(&db_search_cache_mutex);
+        return;
+    }
+
+    DatabaseSearchCacheEntry *entry = calloc(1, sizeof(DatabaseSearchCacheEntry));
+    assert(entry != NULL);
+    entry->key = db_search_cache_key_new(query);
+    entry->filter = fsearch_filter_ref(query->filter);
+    entry->flags = query->flags;
+    entry->sort_order = query->sort_order;
+    entry->generation_id = generation_id;
+    entry->db = query->db;
+    entry->folders = darray_copy(result->folders);
+    entry->files = darray_copy(result->files);
+    entry->sort_type = result->sort_type;
+    entry->size = size;
+
+    GList *l = db_search_cache.head;
+    while (l != NULL) {
+        GList *next = l->next;
+        DatabaseSearchCacheEntry *e = l->data;
+        // results of older generations can't be used anymore, the database changed since they were found
+        if (e->db == entry->db
+            && (e->generation_id != generation_id || db_search_cache_entry_matches(e, query, entry->key))) {
+            db_search_cache_remove_link(l);
+        }
+        l = next;
+    }
+
+    g_queue_push_head(&db_search_cache, entry);
+    db_search_cache_size += size;
+    db_search_cache_trim();
+    g_mutex_unlock(&db_search_cache_mutex);
+}
+
 static gpointer
 db_search_task(gpointer data, GCancellable *cancellable) {
     FsearchQuery *query = data;
@@ -129,7 +347,16 @@ db_search_task(gpointer data, GCancellable *cancellable) {
         result = db_search_empty(query);
     }
     else {
-        result = db_search(query, cancellable);
+        result = db_search_cache_lookup(query);
+        if (result) {
+            g_debug("[query %d.%d] using cached results", query->window_id, query->id);
+        }
+        else {
+            result = db_search(query, cancellable);
+            if (result && !g_cancellable_is_cancelled(cancellable)) {
+                db_search_cache_insert(query, result);
+            }
+        }
     }
 
     const char *debug_message = NULL;
@@ -154,7 +381,6 @@ db_search_worker_context_free(DatabaseSearchWorkerContext *ctx) {
         return;
     }
 
-    g_clear_pointer(&ctx->results, free);
     g_clear_pointer(&ctx->entries, darray_unref);
     g_clear_pointer(&ctx, free);
 }
@@ -162,22 +388,21 @@ db_search_worker_context_free(DatabaseSearchWorkerContext *ctx) {
 static DatabaseSearchWorkerContext *
 db_search_worker_context_new(FsearchQuery *query,
                              GCancellable *cancellable,
+                             DatabaseSearchChunks *chunks,
                              DynamicArray *entries,
-                             uint32_t start_pos,
-                             uint32_t end_pos) {
+                             const uint64_t *candidates,
+                             uint32_t num_indexed,
+                             const DatabaseSearchPathStates *path_states) {
     DatabaseSearchWorkerContext *ctx = calloc(1, sizeof(DatabaseSearchWorkerContext));
     assert(ctx != NULL);
-    assert(end_pos >= start_pos);
 
     ctx->query = query;
     ctx->cancellable = cancellable;
-    ctx->results = calloc(end_pos - start_pos + 1, sizeof(void *));
-    assert(ctx->results != NULL);
-
-    ctx->num_results = 0;
+    ctx->chunks = chunks;
     ctx->entries = darray_ref(entries);
-    ctx->start_pos = start_pos;
-    ctx->end_pos = end_pos;
+    ctx->candidates = candidates;
+    ctx->num_indexed = num_indexed;
+    ctx->path_states = path_states;
     return ctx;
 }
 
@@ -210,6 +435,19 @@ db_search_filter_entry(FsearchDatabaseEntry *entry,
             }
             FsearchToken *t = query->filter_token[num_found++];
 
+            if (t->text_folded && !(query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH)) {
+                if (!fsearch_token_search_folded(
+                        t, haystack, db_entry_get_folded_name(entry), db_entry_has_ascii_name(entry))) {
+                    return false;
+                }
+                continue;
+            }
+            if (t->text_folded && db_entry_has_ascii_path(entry)) {
+                if (!fsearch_token_search_folded(t, haystack, NULL, true)) {
+                    return false;
+                }
+                continue;
+            }
             if (t->is_utf && *utf_search_ready == false) {
                 *utf_search_ready =
                     fsearch_utf_normalize_and_fold_case(t->normalizer, t->case_map, utf_buffer, haystack);
@@ -232,11 +470,182 @@ db_search_build_path(FsearchDatabaseEntry *entry, GString *dest, const char *ent
     g_string_append(dest, entry_name);
 }
 
+// path tokens longer than this are matched against the whole path of every entry, because the end of the path of
+// every folder which has to be kept grows with them
+#define DATABASE_SEARCH_PATH_MAX_TAIL_LEN 64
+
+typedef enum {
+    DATABASE_SEARCH_PATH_UNKNOWN = 0,
+    // the path of the folder contains all path tokens, so only the name tokens are left for its entries
+    DATABASE_SEARCH_PATH_MATCHED,
+    // the paths of the entries of the folder might contain the path tokens which the folder path doesn't contain
+    DATABASE_SEARCH_PATH_PARTIAL,
+    // a path token can't be contained by the paths of any of the entries of the folder
+    DATABASE_SEARCH_PATH_IMPOSSIBLE,
+} DatabaseSearchPathState;
+
+// The state of the path tokens of a query for every folder, so the paths of the entries don't have to be built.
+// A token is contained by the path of an entry if it's contained by the path of its parent, or by the last
+// tail_len bytes of the path of the parent followed by a separator and the name of the entry, where tail_len is at
+// least the token length minus one. This requires tokens which match substrings byte by byte (see is_plain).
+struct DatabaseSearchPathStates {
+    // path_tokens: bit i is set if token i is matched against paths
+    uint32_t path_tokens;
+    // matched: per folder id, bit i is set if token i is contained by the path of the folder
+    uint32_t *matched;
+    // tails: per folder id, the last tail_len bytes of the path of the folder, null terminated
+    char *tails;
+    uint32_t tail_len;
+    // states: per folder id, the DatabaseSearchPathState for the entries of the folder
+    uint8_t *states;
+    uint32_t num_ids;
+};
+
+static inline bool
+db_search_is_path_token(FsearchQuery *q, FsearchToken *t) {
+    return (q->flags & QUERY_FLAG_SEARCH_IN_PATH) || ((q->flags & QUERY_FLAG_AUTO_SEARCH_IN_PATH) && t->has_separator);
+}
+
+static inline const char *
+db_search_path_states_get_tail(const DatabaseSearchPathStates *states, uint32_t id) {
+    return states->tails + (size_t)id * (states->tail_len + 1);
+}
+
+// A token with a separator which isn't contained by the path of a folder can only be contained by the paths of its
+// entries if the path of the folder ends with the part of the token before its last separator, since names have no
+// separators. path_end is the end of the path of the folder, it has at least tail_len bytes unless the path is shorter.
+static bool
+db_search_path_token_is_possible(FsearchToken *t, GString *path_end, GString *buffer) {
+    const char *last_separator = strrchr(t->text, G_DIR_SEPARATOR);
+    const size_t head_len = last_separator - t->text;
+    if (path_end->len < head_len) {
+        return false;
+    }
+    // the end of the path followed by the rest of the token contains the token only at the right place
+    g_string_truncate(buffer, 0);
+    g_string_append_len(buffer, path_end->str + path_end->len - head_len, (gssize)head_len);
+    g_string_append(buffer, last_separator);
+    return t->search_func(buffer->str, t->text, t, NULL) ? true : false;
+}
+
+static void
+db_search_path_states_update(DatabaseSearchPathStates *states,
+                             FsearchQuery *q,
+                             FsearchDatabaseEntryFolder *folder,
+                             GString *path_end,
+                             GString *buffer) {
+    const uint32_t id = db_entry_get_id((FsearchDatabaseEntry *)folder);
+    if (states->states[id] != DATABASE_SEARCH_PATH_UNKNOWN) {
+        return;
+    }
+    FsearchDatabaseEntryFolder *parent = db_entry_get_parent((FsearchDatabaseEntry *)folder);
+    uint32_t matched = 0;
+    g_string_truncate(path_end, 0);
+    if (parent) {
+        db_search_path_states_update(states, q, parent, path_end, buffer);
+        const uint32_t parent_id = db_entry_get_id((FsearchDatabaseEntry *)parent);
+        matched = states->matched[parent_id];
+        g_string_assign(path_end, db_search_path_states_get_tail(states, parent_id));
+        g_string_append_c(path_end, G_DIR_SEPARATOR);
+    }
+    // the folder path is built the same way as by db_entry_append_path
+    g_string_append(path_end, db_entry_get_name_raw((FsearchDatabaseEntry *)folder));
+
+    uint8_t state = DATABASE_SEARCH_PATH_MATCHED;
+    for (uint32_t i = 0; i < q->num_token; i++) {
+        const uint32_t bit = 1u << i;
+        FsearchToken *t = q->token[i];
+        if (!(states->path_tokens & bit) || (matched & bit)) {
+            continue;
+        }
+        if (t->search_func(path_end->str, t->text, t, NULL)) {
+            matched |= bit;
+            continue;
+        }
+        if (state != DATABASE_SEARCH_PATH_IMPOSSIBLE) {
+            state = t->has_separator && !db_search_path_token_is_possible(t, path_end, buffer)
+                      ? DATABASE_SEARCH_PATH_IMPOSSIBLE
+                      : DATABASE_SEARCH_PATH_PARTIAL;
+        }
+    }
+
+    const size_t tail_len = MIN(path_end->len, states->tail_len);
+    char *tail = (char *)db_search_path_states_get_tail(states, id);
+    memcpy(tail, path_end->str + path_end->len - tail_len, tail_len);
+    tail[tail_len] = '\0';
+    states->matched[id] = matched;
+    states->states[id] = state;
+}
+
+static void
+db_search_path_states_free(DatabaseSearchPathStates *states) {
+    if (!states) {
+        return;
+    }
+    g_clear_pointer(&states->matched, free);
+    g_clear_pointer(&states->tails, free);
+    g_clear_pointer(&states->states, free);
+    g_clear_pointer(&states, free);
+}
+
+// Evaluates the path tokens of q for all folders, NULL if the query has tokens which are matched against paths in
+// another way than byte by byte, or none at all
+static DatabaseSearchPathStates *
+db_search_path_states_new(FsearchQuery *q, DynamicArray *folders) {
+    if (!folders || q->num_token > 32 || ((q->filter->flags & QUERY_FLAG_SEARCH_IN_PATH) && q->num_filter_token > 0)) {
+        return NULL;
+    }
+    uint32_t path_tokens = 0;
+    size_t max_token_len = 0;
+    for (uint32_t i = 0; i < q->num_token; i++) {
+        FsearchToken *t = q->token[i];
+        if (!db_search_is_path_token(q, t)) {
+            continue;
+        }
+        if (!t->is_plain) {
+            return NULL;
+        }
+        path_tokens |= 1u << i;
+        max_token_len = MAX(max_token_len, t->text_len);
+    }
+    if (!path_tokens || max_token_len > DATABASE_SEARCH_PATH_MAX_TAIL_LEN + 1) {
+        return NULL;
+    }
+
+    const uint32_t num_folders = darray_get_num_items(folders);
+    uint32_t num_ids = 0;
+    for (uint32_t i = 0; i < num_folders; i++) {
+        num_ids = MAX(num_ids, db_entry_get_id(darray_get_item(folders, i)) + 1);
+    }
+
+    DatabaseSearchPathStates *states = calloc(1, sizeof(DatabaseSearchPathStates));
+    assert(states != NULL);
+    states->path_tokens = path_tokens;
+    states->tail_len = MAX(max_token_len, 1) - 1;
+    states->num_ids = num_ids;
+    states->matched = calloc(MAX(num_ids, 1), sizeof(uint32_t));
+    assert(states->matched != NULL);
+    states->tails = calloc(MAX(num_ids, 1), states->tail_len + 1);
+    assert(states->tails != NULL);
+    states->states = calloc(MAX(num_ids, 1), sizeof(uint8_t));
+    assert(states->states != NULL);
+
+    GString *path_end = g_string_sized_new(PATH_MAX);
+    GString *buffer = g_string_sized_new(PATH_MAX);
+    for (uint32_t i = 0; i < num_folders; i++) {
+        db_search_path_states_update(states, q, darray_get_item(folders, i), path_end, buffer);
+    }
+    g_string_free(g_steal_pointer(&path_end), TRUE);
+    g_string_free(g_steal_pointer(&buffer), TRUE);
+
+    return states;
+}
+
 static void
 db_search_worker(void *data) {
     DatabaseSearchWorkerContext *ctx = data;
     assert(ctx != NULL);
-    assert(ctx->results != NULL);
+    assert(ctx->chunks != NULL);
 
     FsearchUtfConversionBuffer utf_name_buffer = {};
     fsearch_utf_conversion_buffer_init(&utf_name_buffer, 4 * PATH_MAX);
@@ -245,130 +654,229 @@ db_search_worker(void *data) {
     fsearch_utf_conversion_buffer_init(&utf_path_buffer, 4 * PATH_MAX);
 
     FsearchQuery *query = ctx->query;
-    const uint32_t start = ctx->start_pos;
-    const uint32_t end = ctx->end_pos;
     const uint32_t num_token = query->num_token;
     FsearchToken **token = query->token;
     const uint32_t search_in_path = query->flags & QUERY_FLAG_SEARCH_IN_PATH;
     const uint32_t auto_search_in_path = query->flags & QUERY_FLAG_AUTO_SEARCH_IN_PATH;
-    FsearchDatabaseEntry **results = (FsearchDatabaseEntry **)ctx->results;
+    DatabaseSearchChunks *chunks = ctx->chunks;
     DynamicArray *entries = ctx->entries;
+    const uint64_t *candidates = ctx->candidates;
+    const uint32_t num_indexed = ctx->num_indexed;
+    const DatabaseSearchPathStates *path_states = ctx->path_states;
 
     if (!entries) {
-        ctx->num_results = 0;
         g_debug("[db_search] entries empty");
         return;
     }
 
-    uint32_t num_results = 0;
-
     GString *path_string = g_string_sized_new(PATH_MAX);
-    for (uint32_t i = start; i <= end; i++) {
-        if (G_UNLIKELY(g_cancellable_is_cancelled(ctx->cancellable))) {
+    // path_end: the end of the path of the parent of an entry followed by the name of the entry
+    GString *path_end = g_string_sized_new(PATH_MAX);
+    while (!g_cancellable_is_cancelled(ctx->cancellable)) {
+        const int chunk = g_atomic_int_add(&chunks->next_chunk, 1);
+        if (chunk >= (int)chunks->num_chunks) {
             break;
         }
-        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
-        const char *haystack_name = db_entry_get_name(entry);
-        if (G_UNLIKELY(!haystack_name)) {
-            continue;
-        }
+        const uint32_t start = chunks->start_pos + (uint32_t)chunk * DATABASE_SEARCH_CHUNK_SIZE;
+        const uint32_t end = MIN(start + DATABASE_SEARCH_CHUNK_SIZE, chunks->end_pos) - 1;
+        FsearchDatabaseEntry **results = (FsearchDatabaseEntry **)chunks->results + (start - chunks->start_pos);
+        uint32_t num_results = 0;
 
-        bool utf_name_ready = false;
-        bool utf_path_ready = false;
-
-        bool path_set = false;
-        if (search_in_path || query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH) {
-            db_search_build_path(entry, path_string, haystack_name);
-            path_set = true;
-        }
-
-        if (!db_search_filter_entry(
-                entry,
-                query,
-                query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? path_string->str : haystack_name,
-                query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? &utf_path_buffer : &utf_name_buffer,
-                query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? &utf_path_ready : &utf_name_ready)) {
-            continue;
-        }
-
-        uint32_t num_found = 0;
-        while (true) {
-            if (num_found == num_token) {
-                results[num_results] = entry;
-                num_results++;
+        for (uint32_t i = start; i <= end; i++) {
+            if (G_UNLIKELY(g_cancellable_is_cancelled(ctx->cancellable))) {
                 break;
             }
-            FsearchToken *t = token[num_found++];
-            const char *haystack = NULL;
-            FsearchUtfConversionBuffer *utf_buffer = NULL;
-            bool *utf_buffer_ready = NULL;
-
-            if (search_in_path || (auto_search_in_path && t->has_separator)) {
-                if (!path_set) {
-                    db_search_build_path(entry, path_string, haystack_name);
-                    path_set = true;
-                }
-                haystack = path_string->str;
-                utf_buffer = &utf_path_buffer;
-                utf_buffer_ready = &utf_path_ready;
+            FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+            if (candidates && !fsearch_trigram_index_bitmap_contains(candidates, num_indexed, db_entry_get_id(entry))) {
+                continue;
             }
-            else {
-                haystack = haystack_name;
-                utf_buffer = &utf_name_buffer;
-                utf_buffer_ready = &utf_name_ready;
+            const char *haystack_name = db_entry_get_name(entry);
+            if (G_UNLIKELY(!haystack_name)) {
+                continue;
             }
-            if (t->is_utf && *utf_buffer_ready == false) {
-                *utf_buffer_ready =
-                    fsearch_utf_normalize_and_fold_case(t->normalizer, t->case_map, utf_buffer, haystack);
+
+            bool utf_name_ready = false;
+            bool utf_path_ready = false;
+            // path_is_ascii: whether the names of the entry and its parents are pure ASCII, -1 until it's needed
+            int32_t path_is_ascii = -1;
+
+            FsearchDatabaseEntryFolder *parent = path_states ? db_entry_get_parent(entry) : NULL;
+            const uint32_t parent_id = parent ? db_entry_get_id((FsearchDatabaseEntry *)parent) : 0;
+            // parent_state: unknown if the path tokens have to be matched against the whole path
+            const uint8_t parent_state = parent && parent_id < path_states->num_ids ? path_states->states[parent_id]
+                                                                                    : DATABASE_SEARCH_PATH_UNKNOWN;
+            if (parent_state == DATABASE_SEARCH_PATH_IMPOSSIBLE) {
+                continue;
             }
+            bool path_end_set = false;
 
-            if (!t->search_func(haystack, t->text, t, utf_buffer)) {
-                break;
+            bool path_set = false;
+            if ((search_in_path && parent_state == DATABASE_SEARCH_PATH_UNKNOWN)
+                || query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH) {
+                db_search_build_path(entry, path_string, haystack_name);
+                path_set = true;
+            }
+
+            if (!db_search_filter_entry(
+                    entry,
+                    query,
+                    query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? path_string->str : haystack_name,
+                    query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? &utf_path_buffer : &utf_name_buffer,
+                    query->filter->flags & QUERY_FLAG_SEARCH_IN_PATH ? &utf_path_ready : &utf_name_ready)) {
+                continue;
+            }
+
+            uint32_t num_found = 0;
+            while (true) {
+                if (num_found == num_token) {
+                    results[num_results] = entry;
+                    num_results++;
+                    break;
+                }
+                FsearchToken *t = token[num_found++];
+                const char *haystack = NULL;
+                FsearchUtfConversionBuffer *utf_buffer = NULL;
+                bool *utf_buffer_ready = NULL;
+
+                if (parent_state != DATABASE_SEARCH_PATH_UNKNOWN && db_search_is_path_token(query, t)) {
+                    if (path_states->matched[parent_id] & (1u << (num_found - 1))) {
+                        continue;
+                    }
+                    if (!path_end_set) {
+                        g_string_assign(path_end, db_search_path_states_get_tail(path_states, parent_id));
+                        g_string_append_c(path_end, G_DIR_SEPARATOR);
+                        g_string_append(path_end, haystack_name);
+                        path_end_set = true;
+                    }
+                    if (!t->search_func(path_end->str, t->text, t, NULL)) {
+                        break;
+                    }
+                    continue;
+                }
+                if (search_in_path || (auto_search_in_path && t->has_separator)) {
+                    if (!path_set) {
+                        db_search_build_path(entry, path_string, haystack_name);
+                        path_set = true;
+                    }
+                    if (t->text_folded && path_is_ascii == -1) {
+                        path_is_ascii = db_entry_has_ascii_path(entry) ? 1 : 0;
+                    }
+                    if (t->text_folded && path_is_ascii == 1) {
+                        // ASCII paths are folded by lowering the case of their letters
+                        if (!fsearch_token_search_folded(t, path_string->str, NULL, true)) {
+                            break;
+                        }
+                        continue;
+                    }
+                    haystack = path_string->str;
+                    utf_buffer = &utf_path_buffer;
+                    utf_buffer_ready = &utf_path_ready;
+                }
+                else if (t->text_folded) {
+                    // the name was folded when it was added to the database
+                    if (!fsearch_token_search_folded(
+                            t, haystack_name, db_entry_get_folded_name(entry), db_entry_has_ascii_name(entry))) {
+                        break;
+                    }
+                    continue;
+                }
+                else {
+                    haystack = haystack_name;
+                    utf_buffer = &utf_name_buffer;
+                    utf_buffer_ready = &utf_name_ready;
+                }
+                if (t->is_utf && *utf_buffer_ready == false) {
+                    *utf_buffer_ready =
+                        fsearch_utf_normalize_and_fold_case(t->normalizer, t->case_map, utf_buffer, haystack);
+                }
+
+                if (!t->search_func(haystack, t->text, t, utf_buffer)) {
+                    break;
+                }
             }
         }
-    }
 
+        chunks->num_results[chunk] = num_results;
+    }
     fsearch_utf_conversion_buffer_clear(&utf_path_buffer);
     fsearch_utf_conversion_buffer_clear(&utf_name_buffer);
     g_string_free(g_steal_pointer(&path_string), TRUE);
+    g_string_free(g_steal_pointer(&path_end), TRUE);
+}
+
+// Looks up the names which might contain the tokens which are matched against names as they are.
+// Returns NULL if none of the tokens can be looked up, then all entries need to be searched.
+static uint64_t *
+db_search_get_candidates(FsearchQuery *q, FsearchTrigramIndex *trigram_index) {
+    if (!trigram_index || (q->flags & QUERY_FLAG_SEARCH_IN_PATH)) {
+        return NULL;
+    }
+    const uint32_t num_words = (fsearch_trigram_index_get_num_entries(trigram_index) + 63) / 64;
 
-    ctx->num_results = num_results;
+    uint64_t *candidates = NULL;
+    for (uint32_t i = 0; i < q->num_token; i++) {
+        FsearchToken *t = q->token[i];
+        if (!t->is_plain || ((q->flags & QUERY_FLAG_AUTO_SEARCH_IN_PATH) && t->has_separator)) {
+            continue;
+        }
+        uint64_t *token_candidates = fsearch_trigram_index_find(trigram_index, t->text);
+        if (!token_candidates) {
+            continue;
+        }
+        if (!candidates) {
+            candidates = token_candidates;
+            continue;
+        }
+        for (uint32_t w = 0; w < num_words; w++) {
+            candidates[w] &= token_candidates[w];
+        }
+        g_clear_pointer(&token_candidates, free);
+    }
+    return candidates;
 }
 
+// Searches the entries from start_pos up to end_pos and appends the matches to results, which is created if it's NULL
 static DynamicArray *
 db_search_entries(FsearchQuery *q,
                   GCancellable *cancellable,
                   DynamicArray *entries,
+                  uint32_t start_pos,
+                  uint32_t end_pos,
+                  const uint64_t *candidates,
+                  uint32_t num_indexed,
+                  const DatabaseSearchPathStates *path_states,
+                  DynamicArray *results,
                   FsearchThreadPoolFunc search_func) {
-    const uint32_t num_entries = darray_get_num_items(entries);
-    if (num_entries == 0) {
-        return NULL;
+    if (start_pos >= end_pos || !q->token) {
+        return results;
     }
-    const uint32_t num_threads =
-        num_entries < THRESHOLD_FOR_PARALLEL_SEARCH ? 1 : fsearch_thread_pool_get_num_threads(q->pool);
-    const uint32_t num_items_per_thread = num_entries / num_threads;
+    const uint32_t num_entries = end_pos - start_pos;
+
+    const uint32_t num_chunks = (num_entries + DATABASE_SEARCH_CHUNK_SIZE - 1) / DATABASE_SEARCH_CHUNK_SIZE;
+    const uint32_t num_threads = num_entries < THRESHOLD_FOR_PARALLEL_SEARCH
+                                   ? 1
+                                   : MIN(fsearch_thread_pool_get_num_threads(q->pool), num_chunks);
 
     DatabaseSearchWorkerContext *thread_data[num_threads];
     memset(thread_data, 0, sizeof(thread_data));
 
-    uint32_t start_pos = 0;
-    uint32_t end_pos = num_items_per_thread - 1;
-
-    if (!q->token) {
-        return NULL;
-    }
-
+    DatabaseSearchChunks chunks = {};
+    chunks.results = calloc(num_entries, sizeof(void *));
+    assert(chunks.results != NULL);
+    chunks.num_results = calloc(num_chunks, sizeof(uint32_t));
+    assert(chunks.num_results != NULL);
+    chunks.start_pos = start_pos;
+    chunks.end_pos = end_pos;
+    chunks.num_chunks = num_chunks;
+    chunks.next_chunk = 0;
+
+    // searches of other views might use the pool as well, they're no longer serialized by the database lock
+    fsearch_thread_pool_lock(q->pool);
     GList *threads = fsearch_thread_pool_get_threads(q->pool);
     for (uint32_t i = 0; i < num_threads; i++) {
 
-        thread_data[i] = db_search_worker_context_new(q,
-                                                      cancellable,
-                                                      entries,
-                                                      start_pos,
-                                                      i == num_threads - 1 ? num_entries - 1 : end_pos);
-
-        start_pos = end_pos + 1;
-        end_pos += num_items_per_thread;
+        thread_data[i] =
+            db_search_worker_context_new(q, cancellable, &chunks, entries, candidates, num_indexed, path_states);
 
         fsearch_thread_pool_push_data(q->pool, threads, search_func, thread_data[i]);
         threads = threads->next;
@@ -379,50 +887,71 @@ db_search_entries(FsearchQuery *q,
         fsearch_thread_pool_wait_for_thread(q->pool, threads);
         threads = threads->next;
     }
-    if (g_cancellable_is_cancelled(cancellable)) {
-        for (uint32_t i = 0; i < num_threads; i++) {
-            g_clear_pointer(&thread_data[i], db_search_worker_context_free);
-        }
-        return NULL;
-    }
-
-    // get total number of entries found
-    uint32_t num_results = 0;
-    for (uint32_t i = 0; i < num_threads; ++i) {
-        num_results += thread_data[i]->num_results;
+    fsearch_thread_pool_unlock(q->pool);
+    for (uint32_t i = 0; i < num_threads; i++) {
+        g_clear_pointer(&thread_data[i], db_search_worker_context_free);
     }
 
-    DynamicArray *results = darray_new(num_results);
-
-    for (uint32_t i = 0; i < num_threads; i++) {
-        DatabaseSearchWorkerContext *ctx = thread_data[i];
-        if (!ctx) {
-            break;
+    if (!g_cancellable_is_cancelled(cancellable)) {
+        // get total number of entries found
+        uint32_t num_results = 0;
+        for (uint32_t i = 0; i < num_chunks; i++) {
+            num_results += chunks.num_results[i];
         }
 
-        darray_add_items(results, (void **)ctx->results, ctx->num_results);
-
-        g_clear_pointer(&ctx, db_search_worker_context_free);
+        // the chunks are in the order of the entries, so the results stay sorted
+        if (!results) {
+            results = darray_new(num_results);
+        }
+        for (uint32_t i = 0; i < num_chunks; i++) {
+            darray_add_items(results, chunks.results + (size_t)i * DATABASE_SEARCH_CHUNK_SIZE, chunks.num_results[i]);
+        }
     }
+    g_clear_pointer(&chunks.results, free);
+    g_clear_pointer(&chunks.num_results, free);
 
     return results;
 }
 
+// Hands the results found so far to the partial_func of q. The arrays are copied, because the matches of the remaining
+// entries get appended to them, and entries which weren't searched yet are passed as empty arrays.
+static void
+db_search_publish_partial_result(FsearchQuery *q,
+                                 DynamicArray *folders,
+                                 DynamicArray *files,
+                                 FsearchDatabaseGeneration *generation,
+                                 FsearchDatabaseIndexType sort_type) {
+    DatabaseSearchResult *result = db_search_result_new();
+    result->folders = folders ? darray_copy(folders) : darray_new(0);
+    result->files = files ? darray_copy(files) : darray_new(0);
+    result->db = db_ref(q->db);
+    result->generation = db_generation_ref(generation);
+    result->sort_type = sort_type;
+
+    g_debug("[query %d.%d] publishing %d folders and %d files found so far",
+            q->window_id,
+            q->id,
+            darray_get_num_items(result->folders),
+            darray_get_num_items(result->files));
+    q->partial_func(result, q);
+}
+
 static DatabaseSearchResult *
 db_search_empty(FsearchQuery *q) {
     DatabaseSearchResult *result = db_search_result_new();
     DynamicArray *files = NULL;
     DynamicArray *folders = NULL;
 
-    FsearchDatabaseIndexType sort_type;
+    FsearchDatabaseIndexType sort_type = DATABASE_INDEX_TYPE_NAME;
 
-    db_lock(q->db);
-    db_get_entries_sorted(q->db, q->sort_order, &sort_type, &folders, &files);
+    db_request_entries_sorted(q->db, q->sort_order);
+    FsearchDatabaseGeneration *generation = db_get_generation(q->db);
+    db_generation_get_entries_sorted(generation, q->sort_order, &sort_type, &folders, &files);
     result->folders = folders;
     result->files = files;
     result->db = db_ref(q->db);
+    result->generation = g_steal_pointer(&generation);
     result->sort_type = sort_type;
-    db_unlock(q->db);
     return result;
 }
 
@@ -431,49 +960,155 @@ db_search(FsearchQuery *q, GCancellable *cancellable) {
     DynamicArray *files_in = NULL;
     DynamicArray *folders_in = NULL;
 
-    FsearchDatabaseIndexType sort_type;
+    FsearchDatabaseIndexType sort_type = DATABASE_INDEX_TYPE_NAME;
 
-    db_lock(q->db);
-    db_get_entries_sorted(q->db, q->sort_order, &sort_type, &folders_in, &files_in);
+    FsearchTrigramIndex *folder_index = NULL;
+    FsearchTrigramIndex *file_index = NULL;
+
+    // the arrays belong to one generation of the database, which never changes, so no lock is needed while searching
+    FsearchDatabaseGeneration *generation = db_get_generation(q->db);
+    if (generation && generation == q->previous_generation) {
+        // the database didn't change since the previous results were found, so the matches of the refined query are
+        // among them. They're usually few enough that looking up candidates in the trigram index isn't worth it.
+        folders_in = darray_ref(q->previous_folders);
+        files_in = darray_ref(q->previous_files);
+        sort_type = q->previous_sort_type;
+    }
+    else {
+        db_request_entries_sorted(q->db, q->sort_order);
+        db_generation_get_entries_sorted(generation, q->sort_order, &sort_type, &folders_in, &files_in);
+        folder_index = db_generation_get_trigram_index(generation, DATABASE_ENTRY_TYPE_FOLDER);
+        file_index = db_generation_get_trigram_index(generation, DATABASE_ENTRY_TYPE_FILE);
+    }
 
     DynamicArray *files_res = NULL;
     DynamicArray *folders_res = NULL;
 
     const uint32_t num_folders = folders_in ? darray_get_num_items(folders_in) : 0;
-    folders_res = num_folders > 0 ? db_search_entries(q, cancellable, folders_in, db_search_worker) : NULL;
-    g_clear_pointer(&folders_in, darray_unref);
+    const uint32_t num_files = files_in ? darray_get_num_items(files_in) : 0;
+
+    // Evaluating the path tokens for all folders up front only pays off if there are more entries to search than
+    // folders in the database, which might not be the case when only the previous results are searched
+    DatabaseSearchPathStates *path_states = NULL;
+    DynamicArray *all_folders = db_generation_get_folders(generation);
+    if (all_folders && (uint64_t)num_folders + num_files >= darray_get_num_items(all_folders)) {
+        path_states = db_search_path_states_new(q, all_folders);
+    }
+    g_clear_pointer(&all_folders, darray_unref);
+
+    uint64_t *folder_candidates = db_search_get_candidates(q, folder_index);
+    const uint32_t num_indexed_folders = fsearch_trigram_index_get_num_entries(folder_index);
+    g_clear_pointer(&folder_index, fsearch_trigram_index_unref);
+    uint64_t *file_candidates = db_search_get_candidates(q, file_index);
+    const uint32_t num_indexed_files = fsearch_trigram_index_get_num_entries(file_index);
+    g_clear_pointer(&file_index, fsearch_trigram_index_unref);
+
+    // When many entries need to be searched, the first ones are searched on their own, so their matches can be shown
+    // while the others are still being searched. Folders come before files in the results, so they're taken first.
+    uint32_t num_partial_folders = num_folders;
+    uint32_t num_partial_files = num_files;
+    if (q->partial_func && sort_type == q->sort_order
+        && (uint64_t)num_folders + num_files >= DATABASE_SEARCH_PARTIAL_RESULTS_MIN_ENTRIES) {
+        num_partial_folders = MIN(num_folders, DATABASE_SEARCH_PARTIAL_RESULTS_NUM_ENTRIES);
+        num_partial_files = MIN(num_files, DATABASE_SEARCH_PARTIAL_RESULTS_NUM_ENTRIES - num_partial_folders);
+    }
+
+    folders_res = db_search_entries(q,
+                                    cancellable,
+                                    folders_in,
+                                    0,
+                                    num_partial_folders,
+                                    folder_candidates,
+                                    num_indexed_folders,
+                                    path_states,
+                                    NULL,
+                                    db_search_worker);
     if (g_cancellable_is_cancelled(cancellable)) {
         goto search_was_cancelled;
     }
-    const uint32_t num_files = files_in ? darray_get_num_items(files_in) : 0;
-    files_res = num_files > 0 ? db_search_entries(q, cancellable, files_in, db_search_worker) : NULL;
-    g_clear_pointer(&files_in, darray_unref);
+    files_res = db_search_entries(q,
+                                  cancellable,
+                                  files_in,
+                                  0,
+                                  num_partial_files,
+                                  file_candidates,
+                                  num_indexed_files,
+                                  path_states,
+                                  NULL,
+                                  db_search_worker);
     if (g_cancellable_is_cancelled(cancellable)) {
         goto search_was_cancelled;
     }
 
+    if (num_partial_folders < num_folders || num_partial_files < num_files) {
+        const uint32_t num_partial_results = (folders_res ? darray_get_num_items(folders_res) : 0)
+                                           + (files_res ? darray_get_num_items(files_res) : 0);
+        if (num_partial_results > 0) {
+            db_search_publish_partial_result(q, folders_res, files_res, generation, sort_type);
+        }
+
+        folders_res = db_search_entries(q,
+                                        cancellable,
+                                        folders_in,
+                                        num_partial_folders,
+                                        num_folders,
+                                        folder_candidates,
+                                        num_indexed_folders,
+                                        path_states,
+                                        folders_res,
+                                        db_search_worker);
+        if (g_cancellable_is_cancelled(cancellable)) {
+            goto search_was_cancelled;
+        }
+        files_res = db_search_entries(q,
+                                      cancellable,
+                                      files_in,
+                                      num_partial_files,
+                                      num_files,
+                                      file_candidates,
+                                      num_indexed_files,
+                                      path_states,
+                                      files_res,
+                                      db_search_worker);
+        if (g_cancellable_is_cancelled(cancellable)) {
+            goto search_was_cancelled;
+        }
+    }
+    g_clear_pointer(&folders_in, darray_unref);
+    g_clear_pointer(&files_in, darray_unref);
+    g_clear_pointer(&folder_candidates, free);
+    g_clear_pointer(&file_candidates, free);
+    g_clear_pointer(&path_states, db_search_path_states_free);
+
     DatabaseSearchResult *result = db_search_result_new();
     result->files = files_res;
     result->folders = folders_res;
     result->db = db_ref(q->db);
+    result->generation = g_steal_pointer(&generation);
     result->sort_type = sort_type;
 
-    db_unlock(q->db);
     return result;
 
 search_was_cancelled:
+    g_clear_pointer(&generation, db_generation_unref);
+    g_clear_pointer(&folders_in, darray_unref);
+    g_clear_pointer(&files_in, darray_unref);
+    g_clear_pointer(&folder_candidates, free);
+    g_clear_pointer(&file_candidates, free);
+    g_clear_pointer(&path_states, db_search_path_states_free);
     g_clear_pointer(&folders_res, darray_unref);
     g_clear_pointer(&files_res, darray_unref);
 
-    db_unlock(q->db);
     return NULL;
 }
 
 void
 db_search_queue(FsearchTaskQueue *queue,
                 FsearchQuery *query,
+                FsearchTaskFinishedFunc partial_func,
                 FsearchTaskFinishedFunc finished_func,
                 FsearchTaskCancelledFunc cancelled_func) {
+    query->partial_func = partial_func;
     fsearch_task_queue(queue,
                        FSEARCH_TASK_ID_SEARCH,
                        db_search_task,
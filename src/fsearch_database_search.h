@@ -41,14 +41,34 @@ db_search_result_get_sort_type(DatabaseSearchResult *result);
 FsearchDatabase *
 db_search_result_get_db(DatabaseSearchResult *result);
 
+FsearchDatabaseGeneration *
+db_search_result_get_generation(DatabaseSearchResult *result);
+
 DatabaseSearchResult *
 db_search_result_ref(DatabaseSearchResult *result);
 
 void
 db_search_result_unref(DatabaseSearchResult *result);
 
+// size: number of bytes the results of recent searches may take, which are reused when the same query is searched in
+// the same state of the database again. 0 disables the cache.
+void
+db_search_set_result_cache_size(size_t size);
+
+// Returns the number of bytes which are taken by cached results at the moment
+size_t
+db_search_get_result_cache_usage(void);
+
+// Drops the cached results of searches in db. They hold arrays of its entries, so they have to go when db is freed.
+void
+db_search_cache_remove_database(FsearchDatabase *db);
+
+// partial_func: receives results before the search is finished, which are a prefix of the results in their final
+// order, for searches of many entries. The result is passed with the same ownership as to finished_func, query isn't.
+// NULL if only the complete results are of interest.
 void
 db_search_queue(FsearchTaskQueue *queue,
                 FsearchQuery *query,
+                FsearchTaskFinishedFunc partial_func,
                 FsearchTaskFinishedFunc finished_func,
                 FsearchTaskCancelledFunc cancelled_func);
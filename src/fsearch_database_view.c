@@ -32,11 +32,19 @@ struct FsearchDatabaseView {
     GHashTable *selection;
 
     FsearchDatabaseIndexType sort_order;
+    // generation: the state of the database the current results were found in, NULL if they don't belong to query
+    FsearchDatabaseGeneration *generation;
 
     char *query_text;
     FsearchFilter *filter;
     FsearchQueryFlags query_flags;
     uint32_t query_id;
+    // refresh_query_id: id of the last query which was started because the content of the database changed
+    uint32_t refresh_query_id;
+    bool has_refresh_query;
+    // partial_query_id: id of the query whose partial results are shown, until it's finished or cancelled
+    uint32_t partial_query_id;
+    bool has_partial_results;
 
     FsearchTaskQueue *task_queue;
 
@@ -68,6 +76,7 @@ db_view_free(FsearchDatabaseView *view) {
     g_clear_pointer(&view->query_text, free);
     g_clear_pointer(&view->task_queue, fsearch_task_queue_free);
     g_clear_pointer(&view->query, fsearch_query_unref);
+    g_clear_pointer(&view->generation, db_generation_unref);
     g_clear_pointer(&view->selection, fsearch_selection_free);
 
     db_view_unlock(view);
@@ -108,6 +117,7 @@ db_view_unregister(FsearchDatabaseView *view) {
     }
     g_clear_pointer(&view->files, darray_unref);
     g_clear_pointer(&view->folders, darray_unref);
+    g_clear_pointer(&view->generation, db_generation_unref);
     if (view->db) {
         db_unregister_view(view->db, view);
         g_clear_pointer(&view->db, db_unref);
@@ -176,14 +186,97 @@ db_view_search_task_cancelled(gpointer data) {
     FsearchQuery *query = data;
     FsearchDatabaseView *view = query->data;
 
+    db_view_lock(view);
+    // the partial results of query replaced the results of view->query, so neither of them can be shown anymore
+    const bool has_partial_results = view->has_partial_results && view->partial_query_id == query->id;
+    if (has_partial_results) {
+        view->has_partial_results = false;
+        if (view->selection) {
+            fsearch_selection_unselect_all(view->selection);
+        }
+        g_clear_pointer(&view->files, darray_unref);
+        view->files = darray_new(0);
+        g_clear_pointer(&view->folders, darray_unref);
+        view->folders = darray_new(0);
+    }
+    db_view_unlock(view);
+
     if (view->notify_func) {
         view->notify_func(view, DATABASE_VIEW_NOTIFY_SEARCH_FINISHED, view->notify_func_data);
+        if (has_partial_results) {
+            view->notify_func(view, DATABASE_VIEW_NOTIFY_CONTENT_CHANGED, view->notify_func_data);
+            view->notify_func(view, DATABASE_VIEW_NOTIFY_SELECTION_CHANGED, view->notify_func_data);
+        }
     }
 
     g_clear_pointer(&view, db_view_unref);
     g_clear_pointer(&query, fsearch_query_unref);
 }
 
+// Modified entries are replaced by copies of them, so the selection has to move on to those to survive a refresh
+static void
+db_view_selection_update_entries(FsearchDatabaseView *view) {
+    GHashTable *selection = fsearch_selection_new();
+    GHashTableIter iter;
+    gpointer entry = NULL;
+    g_hash_table_iter_init(&iter, view->selection);
+    while (g_hash_table_iter_next(&iter, &entry, NULL)) {
+        fsearch_selection_select(selection, db_entry_get_latest(entry));
+    }
+    g_clear_pointer(&view->selection, fsearch_selection_free);
+    view->selection = selection;
+}
+
+// Shows the results of query instead of the current ones, if they were found in the database of view
+static bool
+db_view_set_search_result(FsearchDatabaseView *view, FsearchQuery *query, DatabaseSearchResult *res) {
+    FsearchDatabase *db = db_search_result_get_db(res);
+    const bool is_same_db = view->db == db;
+    if (is_same_db) {
+        // entries stay valid while the database is alive, so a refresh can keep the selection
+        const bool is_refresh = view->has_refresh_query && query->id == view->refresh_query_id;
+        if (view->selection && !is_refresh) {
+            fsearch_selection_unselect_all(view->selection);
+        }
+        else if (view->selection) {
+            db_view_selection_update_entries(view);
+        }
+        g_clear_pointer(&view->files, darray_unref);
+        view->files = db_search_result_get_files(res);
+
+        g_clear_pointer(&view->folders, darray_unref);
+        view->folders = db_search_result_get_folders(res);
+
+        view->sort_order = db_search_result_get_sort_type(res);
+    }
+    g_clear_pointer(&db, db_unref);
+    return is_same_db;
+}
+
+static void
+db_view_search_task_partial(gpointer result, gpointer data) {
+    FsearchQuery *query = data;
+    FsearchDatabaseView *view = query->data;
+    DatabaseSearchResult *res = result;
+
+    db_view_lock(view);
+    // only a part of the results of query is shown until the search is finished, so they can't be refined
+    g_clear_pointer(&view->generation, db_generation_unref);
+    const bool changed = db_view_set_search_result(view, query, res);
+    if (changed) {
+        view->has_partial_results = true;
+        view->partial_query_id = query->id;
+    }
+    db_view_unlock(view);
+
+    g_clear_pointer(&res, db_search_result_unref);
+
+    if (changed && view->notify_func) {
+        view->notify_func(view, DATABASE_VIEW_NOTIFY_CONTENT_CHANGED, view->notify_func_data);
+        view->notify_func(view, DATABASE_VIEW_NOTIFY_SELECTION_CHANGED, view->notify_func_data);
+    }
+}
+
 static void
 db_view_search_task_finished(gpointer result, gpointer data) {
     FsearchQuery *query = data;
@@ -193,28 +286,26 @@ db_view_search_task_finished(gpointer result, gpointer data) {
 
     g_clear_pointer(&view->query, fsearch_query_unref);
     view->query = g_steal_pointer(&query);
+    g_clear_pointer(&view->generation, db_generation_unref);
+    view->has_partial_results = false;
 
+    bool needs_sort = false;
     if (result) {
         DatabaseSearchResult *res = result;
 
-        FsearchDatabase *db = db_search_result_get_db(res);
-        if (view->db == db) {
-            if (view->selection) {
-                fsearch_selection_unselect_all(view->selection);
-            }
-            g_clear_pointer(&view->files, darray_unref);
-            view->files = db_search_result_get_files(res);
-
-            g_clear_pointer(&view->folders, darray_unref);
-            view->folders = db_search_result_get_folders(res);
-
-            view->sort_order = db_search_result_get_sort_type(res);
+        if (db_view_set_search_result(view, view->query, res)) {
+            view->generation = db_search_result_get_generation(res);
+            // the database didn't have the entries in the requested order (yet), so the results need to be sorted
+            needs_sort = view->sort_order != view->query->sort_order;
         }
 
-        g_clear_pointer(&db, db_unref);
         g_clear_pointer(&res, db_search_result_unref);
     }
 
+    if (needs_sort) {
+        db_view_sort(view, view->query->sort_order);
+    }
+
     db_view_unlock(view);
 
     if (view->notify_func) {
@@ -231,19 +322,6 @@ typedef struct {
     FsearchDatabaseIndexType sort_order;
 } FsearchSortContext;
 
-static void
-sort_array(DynamicArray *array, DynamicArrayCompareDataFunc sort_func, bool parallel_sort) {
-    if (!array) {
-        return;
-    }
-    if (parallel_sort) {
-        darray_sort_multi_threaded(array, (DynamicArrayCompareFunc)sort_func);
-    }
-    else {
-        darray_sort(array, (DynamicArrayCompareFunc)sort_func);
-    }
-}
-
 static DynamicArrayCompareDataFunc
 get_sort_func(FsearchDatabaseIndexType sort_order) {
     DynamicArrayCompareDataFunc func = NULL;
@@ -272,6 +350,34 @@ get_sort_func(FsearchDatabaseIndexType sort_order) {
     return func;
 }
 
+static void
+sort_array(DynamicArray *array, FsearchDatabaseIndexType sort_order, DynamicArray *db_folders, bool parallel_sort) {
+    if (!array) {
+        return;
+    }
+    // names, paths and extensions are sorted with precomputed keys instead of a compare function
+    if (sort_order == DATABASE_INDEX_TYPE_PATH) {
+        db_entry_sort_entries_by_path(array, db_folders);
+        return;
+    }
+    if (sort_order == DATABASE_INDEX_TYPE_NAME) {
+        db_entry_sort_entries_by_name(array);
+        return;
+    }
+    if (sort_order == DATABASE_INDEX_TYPE_EXTENSION) {
+        db_entry_sort_entries_by_extension(array);
+        return;
+    }
+
+    DynamicArrayCompareDataFunc sort_func = get_sort_func(sort_order);
+    if (parallel_sort) {
+        darray_sort_multi_threaded(array, (DynamicArrayCompareFunc)sort_func);
+    }
+    else {
+        darray_sort(array, (DynamicArrayCompareFunc)sort_func);
+    }
+}
+
 static gpointer
 db_view_sort_task(gpointer data, GCancellable *cancellable) {
     FsearchSortContext *ctx = data;
@@ -292,42 +398,49 @@ db_view_sort_task(gpointer data, GCancellable *cancellable) {
     g_timer_start(timer);
 
     db_view_lock(view);
-    db_lock(view->db);
+    // the sorted arrays of one generation are used, which never change, so the database doesn't need to be locked
+    db_request_entries_sorted(view->db, ctx->sort_order);
+    FsearchDatabaseGeneration *generation = db_get_generation(view->db);
+    DynamicArray *db_folders = db_generation_get_folders(generation);
 
     if (!view->query || fsearch_query_matches_everything(view->query)) {
         // we're matching everything, so if the database has the entries already sorted we don't need
         // to sort again
-        if (db_has_entries_sorted_by_type(view->db, ctx->sort_order)) {
-            files = db_get_files_sorted(view->db, ctx->sort_order);
-            folders = db_get_folders_sorted(view->db, ctx->sort_order);
+        FsearchDatabaseIndexType sort_type = DATABASE_INDEX_TYPE_NAME;
+        db_generation_get_entries_sorted(generation, ctx->sort_order, &sort_type, &folders, &files);
+        if (sort_type == ctx->sort_order) {
             goto out;
         }
-        else {
-            files = db_get_files_copy(view->db);
-            folders = db_get_folders_copy(view->db);
-        }
+        // the database builds this sort order in the background, until then we sort a copy by ourselves
+        DynamicArray *folders_by_name = g_steal_pointer(&folders);
+        DynamicArray *files_by_name = g_steal_pointer(&files);
+        folders = darray_copy(folders_by_name);
+        files = darray_copy(files_by_name);
+        g_clear_pointer(&folders_by_name, darray_unref);
+        g_clear_pointer(&files_by_name, darray_unref);
     }
     else {
         folders = darray_ref(view->folders);
         files = darray_ref(view->files);
     }
 
-    DynamicArrayCompareDataFunc func = get_sort_func(ctx->sort_order);
     const bool parallel_sort = ctx->sort_order == DATABASE_INDEX_TYPE_FILETYPE ? false : true;
 
     g_debug("[sort] started: %d", ctx->sort_order);
 
-    sort_array(folders, func, parallel_sort);
-    sort_array(files, func, parallel_sort);
+    // the path order of the results depends on all folders of the database
+    sort_array(folders, ctx->sort_order, db_folders, parallel_sort);
+    sort_array(files, ctx->sort_order, db_folders, parallel_sort);
 
 out:
+    g_clear_pointer(&db_folders, darray_unref);
+    g_clear_pointer(&generation, db_generation_unref);
     g_clear_pointer(&view->folders, darray_unref);
     g_clear_pointer(&view->files, darray_unref);
     view->folders = g_steal_pointer(&folders);
     view->files = g_steal_pointer(&files);
     view->sort_order = ctx->sort_order;
 
-    db_unlock(view->db);
     db_view_unlock(view);
 
     g_timer_stop(timer);
@@ -392,7 +505,23 @@ db_view_search(FsearchDatabaseView *view) {
                                         view->id,
                                         db_view_ref(view));
 
-    db_search_queue(view->task_queue, g_steal_pointer(&q), db_view_search_task_finished, db_view_search_task_cancelled);
+    if (view->generation && !fsearch_query_matches_everything(view->query)
+        && fsearch_query_is_refinement_of(q, view->query)) {
+        // The new query only narrows down the current results (e.g. more characters were typed), so only those need
+        // to be searched. Sort tasks which are queued before the search reorder the current arrays in place, hence a
+        // copy in their current order is searched.
+        DynamicArray *folders = darray_copy(view->folders);
+        DynamicArray *files = darray_copy(view->files);
+        fsearch_query_set_previous_results(q, view->generation, folders, files, view->sort_order);
+        g_clear_pointer(&folders, darray_unref);
+        g_clear_pointer(&files, darray_unref);
+    }
+
+    db_search_queue(view->task_queue,
+                    g_steal_pointer(&q),
+                    db_view_search_task_partial,
+                    db_view_search_task_finished,
+                    db_view_search_task_cancelled);
 }
 
 void
@@ -448,6 +577,20 @@ db_view_set_query_text(FsearchDatabaseView *view, const char *query_text) {
     db_view_unlock(view);
 }
 
+void
+db_view_refresh(FsearchDatabaseView *view) {
+    if (!view) {
+        return;
+    }
+    db_view_lock(view);
+
+    view->refresh_query_id = view->query_id;
+    view->has_refresh_query = true;
+    db_view_search(view);
+
+    db_view_unlock(view);
+}
+
 void
 db_view_set_sort_order(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order) {
     if (!view) {
@@ -570,18 +713,6 @@ db_view_entry_get_name_raw_for_idx(FsearchDatabaseView *view, uint32_t idx) {
     return entry ? g_string_new(db_entry_get_name_raw(entry)) : NULL;
 }
 
-int32_t
-db_view_entry_get_parent_for_idx(FsearchDatabaseView *view, uint32_t idx) {
-    assert(view != NULL);
-
-    FsearchDatabaseEntry *entry = db_view_get_entry_for_idx(view, idx);
-    if (!entry) {
-        return -1;
-    }
-    FsearchDatabaseEntryFolder *folder = db_entry_get_parent(entry);
-    return folder ? (int32_t)db_entry_get_idx((FsearchDatabaseEntry *)folder) : -1;
-}
-
 FsearchDatabaseEntryType
 db_view_entry_get_type_for_idx(FsearchDatabaseView *view, uint32_t idx) {
     assert(view != NULL);
@@ -50,6 +50,10 @@ db_view_set_query_text(FsearchDatabaseView *view, const char *query_text);
 void
 db_view_set_sort_order(FsearchDatabaseView *view, FsearchDatabaseIndexType sort_order);
 
+// Runs the current query again, e.g. after the content of the database changed
+void
+db_view_refresh(FsearchDatabaseView *view);
+
 // NOTE: Getters are not thread save, they need to be wrapped with db_view_lock/db_view_unlock
 uint32_t
 db_view_get_num_folders(FsearchDatabaseView *view);
@@ -87,9 +91,6 @@ db_view_entry_get_name_for_idx(FsearchDatabaseView *view, uint32_t idx);
 GString *
 db_view_entry_get_name_raw_for_idx(FsearchDatabaseView *view, uint32_t idx);
 
-int32_t
-db_view_entry_get_parent_for_idx(FsearchDatabaseView *view, uint32_t idx);
-
 FsearchDatabaseEntryType
 db_view_entry_get_type_for_idx(FsearchDatabaseView *view, uint32_t idx);
 
@@ -78,6 +78,9 @@ fsearch_query_free(FsearchQuery *query) {
     g_clear_pointer(&query->highlight_tokens, fsearch_highlight_tokens_free);
     g_clear_pointer(&query->text, free);
     g_clear_pointer(&query->token, fsearch_tokens_free);
+    g_clear_pointer(&query->previous_generation, db_generation_unref);
+    g_clear_pointer(&query->previous_folders, darray_unref);
+    g_clear_pointer(&query->previous_files, darray_unref);
     g_clear_pointer(&query, free);
 }
 
@@ -109,6 +112,43 @@ fsearch_query_matches_everything(FsearchQuery *query) {
     return false;
 }
 
+bool
+fsearch_query_is_refinement_of(FsearchQuery *query, FsearchQuery *previous) {
+    if (!query || !previous) {
+        return false;
+    }
+    if (query->db != previous->db || query->filter != previous->filter || query->flags != previous->flags) {
+        return false;
+    }
+    // entries need to match all tokens, so every previous token must be narrowed down by one of the new ones
+    for (uint32_t i = 0; i < previous->num_token; i++) {
+        bool is_refined = false;
+        for (uint32_t j = 0; j < query->num_token && !is_refined; j++) {
+            is_refined = fsearch_token_is_refinement_of(query->token[j], previous->token[i]);
+        }
+        if (!is_refined) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+fsearch_query_set_previous_results(FsearchQuery *query,
+                                   FsearchDatabaseGeneration *generation,
+                                   DynamicArray *folders,
+                                   DynamicArray *files,
+                                   FsearchDatabaseIndexType sort_type) {
+    assert(query != NULL);
+    g_clear_pointer(&query->previous_generation, db_generation_unref);
+    g_clear_pointer(&query->previous_folders, darray_unref);
+    g_clear_pointer(&query->previous_files, darray_unref);
+    query->previous_generation = db_generation_ref(generation);
+    query->previous_folders = darray_ref(folders);
+    query->previous_files = darray_ref(files);
+    query->previous_sort_type = sort_type;
+}
+
 PangoAttrList *
 fsearch_query_highlight_match(FsearchQuery *q, const char *input) {
     return fsearch_highlight_tokens_match(q->highlight_tokens, q->flags, input);
@@ -28,6 +28,7 @@
 #include "fsearch_filter.h"
 #include "fsearch_list_view.h"
 #include "fsearch_query_flags.h"
+#include "fsearch_task.h"
 #include "fsearch_thread_pool.h"
 #include "fsearch_token.h"
 
@@ -57,6 +58,19 @@ typedef struct FsearchQuery {
     uint32_t id;
     uint32_t window_id;
 
+    // previous_folders, previous_files: results of an earlier query of previous_generation which are a superset of the
+    // results of this query, so only they need to be searched as long as the database didn't change in the meantime
+    FsearchDatabaseGeneration *previous_generation;
+    DynamicArray *previous_folders;
+    DynamicArray *previous_files;
+    // previous_sort_type: the order of the previous results
+    FsearchDatabaseIndexType previous_sort_type;
+
+    // partial_func: receives the results among the first entries of a large search while the remaining entries are
+    // still being searched, called like the finished func of the search task. NULL if only the complete results are
+    // of interest.
+    FsearchTaskFinishedFunc partial_func;
+
     gpointer data;
 
     volatile int ref_count;
@@ -83,4 +97,17 @@ PangoAttrList *
 fsearch_query_highlight_match(FsearchQuery *q, const char *input);
 
 bool
-fsearch_query_matches_everything(FsearchQuery *query);
\ No newline at end of file
+fsearch_query_matches_everything(FsearchQuery *query);
+
+// Returns true if query only matches entries which previous matches as well, e.g. because it was created by adding
+// characters or words to the text of previous
+bool
+fsearch_query_is_refinement_of(FsearchQuery *query, FsearchQuery *previous);
+
+// Limits the search of query to the results of a previous query of generation, which query is a refinement of
+void
+fsearch_query_set_previous_results(FsearchQuery *query,
+                                   FsearchDatabaseGeneration *generation,
+                                   DynamicArray *folders,
+                                   DynamicArray *files,
+                                   FsearchDatabaseIndexType sort_type);
\ No newline at end of file
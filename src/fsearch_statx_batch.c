@@ -0,0 +1,312 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#define _GNU_SOURCE
+
+#define G_LOG_DOMAIN "fsearch-statx-batch"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fsearch_statx_batch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct FsearchStatxBatch {
+    int ring_fd;
+    uint32_t queue_depth;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    void *cq_ring;
+    size_t cq_ring_size;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // num_in_flight: requests which were submitted to the kernel and whose completion wasn't reaped yet
+    uint32_t num_in_flight;
+};
+
+static int
+io_uring_setup(uint32_t entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+io_uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+FsearchStatxBatch *
+fsearch_statx_batch_new(uint32_t queue_depth) {
+    if (queue_depth == 0) {
+        return NULL;
+    }
+
+    struct io_uring_params params = {};
+    const int ring_fd = io_uring_setup(queue_depth, &params);
+    if (ring_fd < 0) {
+        g_debug("[statx_batch] io_uring is not available: %s", strerror(errno));
+        return NULL;
+    }
+
+    FsearchStatxBatch *batch = calloc(1, sizeof(FsearchStatxBatch));
+    assert(batch != NULL);
+    batch->ring_fd = ring_fd;
+    batch->queue_depth = params.sq_entries;
+
+    batch->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    batch->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        batch->sq_ring_size = MAX(batch->sq_ring_size, batch->cq_ring_size);
+        batch->cq_ring_size = batch->sq_ring_size;
+    }
+
+    batch->sq_ring = mmap(NULL,
+                          batch->sq_ring_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          ring_fd,
+                          IORING_OFF_SQ_RING);
+    if (batch->sq_ring == MAP_FAILED) {
+        batch->sq_ring = NULL;
+        goto setup_fail;
+    }
+
+    if (single_mmap) {
+        batch->cq_ring = batch->sq_ring;
+    }
+    else {
+        batch->cq_ring = mmap(NULL,
+                              batch->cq_ring_size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE,
+                              ring_fd,
+                              IORING_OFF_CQ_RING);
+        if (batch->cq_ring == MAP_FAILED) {
+            batch->cq_ring = NULL;
+            goto setup_fail;
+        }
+    }
+
+    batch->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    batch->sqes =
+        mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (batch->sqes == MAP_FAILED) {
+        batch->sqes = NULL;
+        goto setup_fail;
+    }
+
+    batch->sq_head = (uint32_t *)((uint8_t *)batch->sq_ring + params.sq_off.head);
+    batch->sq_tail = (uint32_t *)((uint8_t *)batch->sq_ring + params.sq_off.tail);
+    batch->sq_mask = (uint32_t *)((uint8_t *)batch->sq_ring + params.sq_off.ring_mask);
+    batch->sq_array = (uint32_t *)((uint8_t *)batch->sq_ring + params.sq_off.array);
+
+    batch->cq_head = (uint32_t *)((uint8_t *)batch->cq_ring + params.cq_off.head);
+    batch->cq_tail = (uint32_t *)((uint8_t *)batch->cq_ring + params.cq_off.tail);
+    batch->cq_mask = (uint32_t *)((uint8_t *)batch->cq_ring + params.cq_off.ring_mask);
+    batch->cqes = (struct io_uring_cqe *)((uint8_t *)batch->cq_ring + params.cq_off.cqes);
+
+    g_debug("[statx_batch] created io_uring with queue depth: %d", batch->queue_depth);
+
+    return batch;
+
+setup_fail:
+    g_debug("[statx_batch] failed to map io_uring: %s", strerror(errno));
+    fsearch_statx_batch_free(batch);
+    return NULL;
+}
+
+void
+fsearch_statx_batch_free(FsearchStatxBatch *batch) {
+    if (!batch) {
+        return;
+    }
+    if (batch->sqes) {
+        munmap(batch->sqes, batch->sqes_size);
+    }
+    if (batch->cq_ring && batch->cq_ring != batch->sq_ring) {
+        munmap(batch->cq_ring, batch->cq_ring_size);
+    }
+    if (batch->sq_ring) {
+        munmap(batch->sq_ring, batch->sq_ring_size);
+    }
+    close(batch->ring_fd);
+    g_clear_pointer(&batch, free);
+}
+
+static bool
+is_transient_error(int error) {
+    return error == EINTR || error == EAGAIN || error == EBUSY;
+}
+
+// Reaps all available completions and stores their result in errors, returns how many were reaped
+static uint32_t
+fsearch_statx_batch_reap(FsearchStatxBatch *batch, uint32_t num_names, int32_t *errors) {
+    uint32_t num_reaped = 0;
+    uint32_t cq_head = *batch->cq_head;
+    const uint32_t cq_tail = __atomic_load_n(batch->cq_tail, __ATOMIC_ACQUIRE);
+    while (cq_head != cq_tail) {
+        struct io_uring_cqe *cqe = &batch->cqes[cq_head & *batch->cq_mask];
+        const uint64_t idx = cqe->user_data;
+        if (errors && idx < num_names) {
+            errors[idx] = cqe->res < 0 ? cqe->res : 0;
+        }
+        cq_head++;
+        num_reaped++;
+    }
+    __atomic_store_n(batch->cq_head, cq_head, __ATOMIC_RELEASE);
+    batch->num_in_flight -= num_reaped;
+    return num_reaped;
+}
+
+// Waits until the kernel is done with all submitted requests, so their buffers can be reused
+static bool
+fsearch_statx_batch_drain(FsearchStatxBatch *batch) {
+    while (batch->num_in_flight > 0) {
+        if (io_uring_enter(batch->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && !is_transient_error(errno)) {
+            g_debug("[statx_batch] failed to wait for %d requests: %s", batch->num_in_flight, strerror(errno));
+            return false;
+        }
+        fsearch_statx_batch_reap(batch, 0, NULL);
+    }
+    return true;
+}
+
+bool
+fsearch_statx_batch_run(FsearchStatxBatch *batch,
+                        int dir_fd,
+                        const char **names,
+                        uint32_t num_names,
+                        struct statx *results,
+                        int32_t *errors) {
+    assert(batch != NULL);
+    assert(batch->num_in_flight == 0);
+
+    uint32_t num_queued = 0;
+    uint32_t num_completed = 0;
+
+    while (num_completed < num_names) {
+        // fill the submission queue as far as possible
+        uint32_t sq_tail = *batch->sq_tail;
+        while (num_queued < num_names && batch->num_in_flight < batch->queue_depth) {
+            const uint32_t sqe_idx = sq_tail & *batch->sq_mask;
+            struct io_uring_sqe *sqe = &batch->sqes[sqe_idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dir_fd;
+            sqe->addr = (uint64_t)(uintptr_t)names[num_queued];
+            sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME;
+            sqe->off = (uint64_t)(uintptr_t)&results[num_queued];
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+            sqe->user_data = num_queued;
+            batch->sq_array[sqe_idx] = sqe_idx;
+
+            sq_tail++;
+            num_queued++;
+            batch->num_in_flight++;
+        }
+        // make the new entries visible to the kernel
+        __atomic_store_n(batch->sq_tail, sq_tail, __ATOMIC_RELEASE);
+
+        const uint32_t num_unsubmitted = sq_tail - __atomic_load_n(batch->sq_head, __ATOMIC_ACQUIRE);
+        int res = io_uring_enter(batch->ring_fd, num_unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (res < 0 && (errno == EAGAIN || errno == EBUSY)) {
+            // the kernel rejects new submissions while its completion queue is full or it's short of resources, so
+            // instead of retrying right away we make room in the queue or wait for a request which was submitted
+            const uint32_t num_submitted = batch->num_in_flight - num_unsubmitted;
+            const uint32_t num_reaped = fsearch_statx_batch_reap(batch, num_names, errors);
+            num_completed += num_reaped;
+            if (num_reaped > 0) {
+                res = 0;
+            }
+            else if (num_submitted > 0) {
+                res = io_uring_enter(batch->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+            }
+        }
+        if (res < 0 && errno != EINTR) {
+            g_debug("[statx_batch] io_uring_enter failed: %s", strerror(errno));
+            // the kernel only consumes entries while we're in io_uring_enter, so the ones it didn't take yet can
+            // be withdrawn and never refer to the buffers of this run later on
+            const uint32_t sq_head = __atomic_load_n(batch->sq_head, __ATOMIC_ACQUIRE);
+            batch->num_in_flight -= sq_tail - sq_head;
+            __atomic_store_n(batch->sq_tail, sq_head, __ATOMIC_RELEASE);
+            fsearch_statx_batch_drain(batch);
+            return false;
+        }
+
+        num_completed += fsearch_statx_batch_reap(batch, num_names, errors);
+    }
+
+    return true;
+}
+
+uint32_t
+fsearch_statx_batch_get_num_pending(FsearchStatxBatch *batch) {
+    return batch ? batch->num_in_flight : 0;
+}
+
+#else
+
+FsearchStatxBatch *
+fsearch_statx_batch_new(uint32_t queue_depth) {
+    return NULL;
+}
+
+void
+fsearch_statx_batch_free(FsearchStatxBatch *batch) {
+}
+
+bool
+fsearch_statx_batch_run(FsearchStatxBatch *batch,
+                        int dir_fd,
+                        const char **names,
+                        uint32_t num_names,
+                        struct statx *results,
+                        int32_t *errors) {
+    return false;
+}
+
+uint32_t
+fsearch_statx_batch_get_num_pending(FsearchStatxBatch *batch) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Collects the metadata of many directory entries at once by submitting statx requests to an io_uring,
+// so the latency of hundreds of requests overlaps instead of adding up.
+typedef struct FsearchStatxBatch FsearchStatxBatch;
+
+// returns NULL when io_uring isn't supported by the build or the running kernel
+FsearchStatxBatch *
+fsearch_statx_batch_new(uint32_t queue_depth);
+
+void
+fsearch_statx_batch_free(FsearchStatxBatch *batch);
+
+// Stats all names relative to dir_fd without following symbolic links.
+// results[i] is only valid when errors[i] is 0, otherwise errors[i] holds the negative errno of the request.
+// Returns false when the ring itself failed, in this case none of the results are valid. Requests which were
+// already submitted are waited for before it returns, unless even that fails (see
+// fsearch_statx_batch_get_num_pending).
+bool
+fsearch_statx_batch_run(FsearchStatxBatch *batch,
+                        int dir_fd,
+                        const char **names,
+                        uint32_t num_names,
+                        struct statx *results,
+                        int32_t *errors);
+
+// Returns the number of requests of the last run which the kernel might still be working on. When a failed run leaves
+// any of them behind, the kernel can still write to its results, so they must not be freed or reused.
+uint32_t
+fsearch_statx_batch_get_num_pending(FsearchStatxBatch *batch);
@@ -0,0 +1,96 @@
+#include "fsearch_string_arena.h"
+
+#include <assert.h>
+#include <glib.h>
+#include <string.h>
+
+// string ids are composed of the block number in the upper bits and the offset within the block in the lower bits
+#define STRING_ARENA_BLOCK_BITS 20
+#define STRING_ARENA_BLOCK_SIZE (1 << STRING_ARENA_BLOCK_BITS)
+#define STRING_ARENA_MAX_BLOCKS (1 << (32 - STRING_ARENA_BLOCK_BITS))
+
+struct FsearchStringArena {
+    // blocks: fixed size table, so resolving ids never races with the arena growing
+    char **blocks;
+    uint32_t num_blocks;
+    uint32_t block_num_used;
+    size_t size;
+};
+
+static bool
+fsearch_string_arena_new_block(FsearchStringArena *arena) {
+    if (arena->num_blocks >= STRING_ARENA_MAX_BLOCKS) {
+        g_debug("[string_arena] maximum number of blocks reached");
+        return false;
+    }
+    char *block = malloc(STRING_ARENA_BLOCK_SIZE);
+    assert(block != NULL);
+
+    arena->blocks[arena->num_blocks++] = block;
+    arena->block_num_used = 0;
+    return true;
+}
+
+FsearchStringArena *
+fsearch_string_arena_new(void) {
+    FsearchStringArena *arena = calloc(1, sizeof(FsearchStringArena));
+    assert(arena != NULL);
+
+    arena->blocks = calloc(STRING_ARENA_MAX_BLOCKS, sizeof(char *));
+    assert(arena->blocks != NULL);
+
+    // reserve id 0 for the empty string
+    uint32_t empty_id = 0;
+    fsearch_string_arena_add(arena, "", 0, &empty_id);
+
+    return arena;
+}
+
+void
+fsearch_string_arena_free(FsearchStringArena *arena) {
+    if (!arena) {
+        return;
+    }
+    for (uint32_t i = 0; i < arena->num_blocks; i++) {
+        g_clear_pointer(&arena->blocks[i], free);
+    }
+    g_clear_pointer(&arena->blocks, free);
+    g_clear_pointer(&arena, free);
+}
+
+bool
+fsearch_string_arena_add(FsearchStringArena *arena, const char *str, size_t len, uint32_t *id) {
+    assert(arena != NULL);
+    assert(str != NULL);
+    assert(id != NULL);
+    assert(len < FSEARCH_STRING_ARENA_MAX_STRING_SIZE);
+
+    if (arena->num_blocks == 0 || STRING_ARENA_BLOCK_SIZE - arena->block_num_used < len + 1) {
+        if (!fsearch_string_arena_new_block(arena)) {
+            return false;
+        }
+    }
+
+    const uint32_t block_idx = arena->num_blocks - 1;
+    const uint32_t offset = arena->block_num_used;
+
+    char *dest = arena->blocks[block_idx] + offset;
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+
+    arena->block_num_used += len + 1;
+    arena->size += len + 1;
+
+    *id = (block_idx << STRING_ARENA_BLOCK_BITS) | offset;
+    return true;
+}
+
+const char *
+fsearch_string_arena_get(FsearchStringArena *arena, uint32_t id) {
+    return arena->blocks[id >> STRING_ARENA_BLOCK_BITS] + (id & (STRING_ARENA_BLOCK_SIZE - 1));
+}
+
+size_t
+fsearch_string_arena_get_size(FsearchStringArena *arena) {
+    return arena ? arena->size : 0;
+}
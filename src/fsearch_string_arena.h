@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Append-only storage for many small, immutable strings.
+// Strings are packed back to back into large blocks, which are only released all at once
+// when the arena is freed. Every string is identified by a 32-bit id, which stays valid for the
+// lifetime of the arena. The id 0 always refers to the empty string.
+typedef struct FsearchStringArena FsearchStringArena;
+
+// the longest string (including the terminating null byte) which can be added to an arena
+#define FSEARCH_STRING_ARENA_MAX_STRING_SIZE 4096
+
+FsearchStringArena *
+fsearch_string_arena_new(void);
+
+void
+fsearch_string_arena_free(FsearchStringArena *arena);
+
+// Copies str into the arena and stores its id in id. Returns false when the arena has no room left for it.
+bool
+fsearch_string_arena_add(FsearchStringArena *arena, const char *str, size_t len, uint32_t *id);
+
+const char *
+fsearch_string_arena_get(FsearchStringArena *arena, uint32_t id);
+
+size_t
+fsearch_string_arena_get_size(FsearchStringArena *arena);
@@ -61,6 +61,163 @@ fs_str_case_is_ascii(const char *str) {
     return ret;
 }
 
+static inline uint8_t
+ascii_fold(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline bool
+equal_ascii_icase(const char *s1, const char *s2, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (ascii_fold(s1[i]) != ascii_fold(s2[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool
+equal_at(const char *haystack, const char *needle, size_t needle_len, bool ignore_case) {
+    return ignore_case ? equal_ascii_icase(haystack, needle, needle_len) : memcmp(haystack, needle, needle_len) == 0;
+}
+
+static const char *
+find_scalar(const char *haystack,
+            size_t haystack_len,
+            size_t start,
+            const char *needle,
+            size_t needle_len,
+            bool ignore_case) {
+    const uint8_t first = ignore_case ? ascii_fold(needle[0]) : needle[0];
+    for (size_t i = start; i + needle_len <= haystack_len; i++) {
+        const uint8_t c = ignore_case ? ascii_fold(haystack[i]) : haystack[i];
+        if (c == first && equal_at(haystack + i + 1, needle + 1, needle_len - 1, ignore_case)) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define FS_STR_FIND_X86 1
+#include <immintrin.h>
+
+// The vectorized searches compare 16 or 32 positions at once: a position is a candidate if the first byte of needle
+// is found there and its last byte needle_len - 1 bytes later. Only candidates get compared with the whole needle.
+// Upper case letters are folded to lower case by moving 'A'..'Z' to the bottom of the signed range, where a single
+// comparison finds them, and setting their 0x20 bit.
+// Most names are shorter than a block, so the last block is loaded past the end of haystack as long as that doesn't
+// cross a page boundary (like the vectorized string functions of the C library do), the extra positions are ignored.
+#define FIND_PAGE_SIZE 4096
+
+static inline bool
+can_load_block(const char *p, size_t block_size) {
+    return ((uintptr_t)p & (FIND_PAGE_SIZE - 1)) <= FIND_PAGE_SIZE - block_size;
+}
+
+static inline __m128i
+fold_sse2(__m128i v) {
+    const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+    const __m128i is_upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 - 'A' + 'Z' + 1 - 256)));
+    return _mm_or_si128(v, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((no_sanitize_address)) static const char *
+find_sse2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, bool ignore_case) {
+    const size_t last = needle_len - 1;
+    const __m128i first_char = _mm_set1_epi8((char)(ignore_case ? ascii_fold(needle[0]) : needle[0]));
+    const __m128i last_char = _mm_set1_epi8((char)(ignore_case ? ascii_fold(needle[last]) : needle[last]));
+
+    // positions at which needle can start
+    const size_t num_positions = haystack_len - last;
+    for (size_t i = 0; i < num_positions; i += 16) {
+        uint32_t valid = UINT32_MAX;
+        if (i + 16 > num_positions) {
+            if (!can_load_block(haystack + i, 16) || !can_load_block(haystack + i + last, 16)) {
+                return find_scalar(haystack, haystack_len, i, needle, needle_len, ignore_case);
+            }
+            valid = (1u << (num_positions - i)) - 1;
+        }
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + i + last));
+        if (ignore_case) {
+            block_first = fold_sse2(block_first);
+            block_last = fold_sse2(block_last);
+        }
+        uint32_t mask = valid & (uint32_t)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first_char), _mm_cmpeq_epi8(block_last, last_char)));
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (last < 2 || equal_at(haystack + pos + 1, needle + 1, last - 1, ignore_case)) {
+                return haystack + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return NULL;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+fold_avx2(__m256i v) {
+    const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - 'A')));
+    const __m256i is_upper = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 - 'A' + 'Z' + 1 - 256)), shifted);
+    return _mm256_or_si256(v, _mm256_and_si256(is_upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static const char *
+find_avx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, bool ignore_case) {
+    const size_t last = needle_len - 1;
+    const __m256i first_char = _mm256_set1_epi8((char)(ignore_case ? ascii_fold(needle[0]) : needle[0]));
+    const __m256i last_char = _mm256_set1_epi8((char)(ignore_case ? ascii_fold(needle[last]) : needle[last]));
+
+    // positions at which needle can start
+    const size_t num_positions = haystack_len - last;
+    for (size_t i = 0; i < num_positions; i += 32) {
+        uint32_t valid = UINT32_MAX;
+        if (i + 32 > num_positions) {
+            if (!can_load_block(haystack + i, 32) || !can_load_block(haystack + i + last, 32)) {
+                return find_scalar(haystack, haystack_len, i, needle, needle_len, ignore_case);
+            }
+            valid = (1u << (num_positions - i)) - 1;
+        }
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(haystack + i + last));
+        if (ignore_case) {
+            block_first = fold_avx2(block_first);
+            block_last = fold_avx2(block_last);
+        }
+        uint32_t mask = valid & (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first_char), _mm256_cmpeq_epi8(block_last, last_char)));
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (last < 2 || equal_at(haystack + pos + 1, needle + 1, last - 1, ignore_case)) {
+                return haystack + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return NULL;
+}
+#endif
+
+const char *
+fs_str_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, bool ignore_case) {
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return NULL;
+    }
+#ifdef FS_STR_FIND_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return find_avx2(haystack, haystack_len, needle, needle_len, ignore_case);
+    }
+    return find_sse2(haystack, haystack_len, needle, needle_len, ignore_case);
+#else
+    return find_scalar(haystack, haystack_len, 0, needle, needle_len, ignore_case);
+#endif
+}
+
 int
 fs_str_is_regex(const char *str) {
     char regex_chars[] = {'$', '(', ')', '*', '+', '.', '?', '[', '\\', '^', '{', '|', '\0'};
@@ -214,3 +371,51 @@ fs_str_split(const char *src) {
 
     return (char **)g_ptr_array_free(new, FALSE);
 }
+
+size_t
+fs_str_get_natural_sort_key(const char *str, uint8_t *dest) {
+    const uint8_t *s = (const uint8_t *)str;
+    uint8_t *d = dest;
+    // Everything but digits is copied as is. Digits are in a range of their own, so every digit sequence can be
+    // encoded with a leading '0' or '1' and still sorts correctly against other characters.
+    // File names are at most 255 bytes long, so the length of a digit sequence always fits into a single byte.
+    while (*s) {
+        if (!isdigit(*s)) {
+            *d++ = *s++;
+            continue;
+        }
+
+        const uint8_t *digits = s;
+        while (isdigit(*s)) {
+            s++;
+        }
+        const size_t num_digits = s - digits;
+
+        if (digits[0] != '0') {
+            // integers: fewer digits sort first, numbers with the same number of digits digit by digit
+            *d++ = '1';
+            *d++ = (uint8_t)MIN(num_digits, UINT8_MAX);
+            memcpy(d, digits, num_digits);
+            d += num_digits;
+            continue;
+        }
+
+        // fractional parts: more leading zeros sort first, then the remaining digits are compared like any other
+        // character. A sequence of only zeros sorts after all sequences with the same number of zeros and more digits.
+        size_t num_zeros = 0;
+        while (num_zeros < num_digits && digits[num_zeros] == '0') {
+            num_zeros++;
+        }
+        *d++ = '0';
+        *d++ = (uint8_t)(UINT8_MAX - MIN(num_zeros, UINT8_MAX));
+        if (num_zeros == num_digits) {
+            *d++ = UINT8_MAX;
+        }
+        else {
+            memcpy(d, digits + num_zeros, num_digits - num_zeros);
+            d += num_digits - num_zeros;
+        }
+    }
+    return d - dest;
+}
+
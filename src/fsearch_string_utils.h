@@ -18,6 +18,7 @@
 
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 
 int
@@ -43,3 +44,18 @@ fs_str_split(const char *str);
 
 bool
 fs_str_case_is_ascii(const char *str);
+
+// Returns the first occurrence of needle in haystack or NULL. With ignore_case ASCII letters match regardless of their
+// case, like strcasestr does in a UTF-8 locale, every other byte has to be equal. Candidates are found 16 or 32 bytes
+// at a time with SSE2 or AVX2, depending on what the processor supports.
+const char *
+fs_str_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, bool ignore_case);
+
+// Upper bound of the size of the natural sort key of a string with len bytes
+#define FS_STR_NATURAL_SORT_KEY_SIZE(len) (3 * (len))
+
+// Writes a binary sort key for str to dest, which must have room for FS_STR_NATURAL_SORT_KEY_SIZE(strlen(str)) bytes,
+// and returns its length. Keys compared with memcmp (a key which is a prefix of another one sorts first) are in the
+// same order as the strings compared with strverscmp.
+size_t
+fs_str_get_natural_sort_key(const char *str, uint8_t *dest);
@@ -3,4 +3,6 @@
 typedef enum FsearchTaskId {
     FSEARCH_TASK_ID_SEARCH,
     FSEARCH_TASK_ID_SORT,
+    FSEARCH_TASK_ID_SAVE,
+    FSEARCH_TASK_ID_TRIGRAM_INDEX,
 } FsearchTaskId;
\ No newline at end of file
@@ -25,6 +25,8 @@
 struct _FsearchThreadPool {
     GList *threads;
     uint32_t num_threads;
+    // mutex: held by the user which currently pushes work to the threads and waits for it
+    GMutex mutex;
 };
 
 typedef struct thread_context_s {
@@ -116,12 +118,17 @@ thread_context_new(void) {
 
 FsearchThreadPool *
 fsearch_thread_pool_init(void) {
+    return fsearch_thread_pool_new(g_get_num_processors());
+}
+
+FsearchThreadPool *
+fsearch_thread_pool_new(uint32_t num_threads) {
     FsearchThreadPool *pool = g_new0(FsearchThreadPool, 1);
     pool->threads = NULL;
     pool->num_threads = 0;
+    g_mutex_init(&pool->mutex);
 
-    uint32_t num_cpus = g_get_num_processors();
-    for (uint32_t i = 0; i < num_cpus; i++) {
+    for (uint32_t i = 0; i < num_threads; i++) {
         thread_context_t *ctx = thread_context_new();
         if (ctx) {
             pool->threads = g_list_prepend(pool->threads, ctx);
@@ -144,9 +151,24 @@ fsearch_thread_pool_free(FsearchThreadPool *pool) {
         thread = thread->next;
     }
     pool->num_threads = 0;
+    g_mutex_clear(&pool->mutex);
     g_clear_pointer(&pool, g_free);
 }
 
+void
+fsearch_thread_pool_lock(FsearchThreadPool *pool) {
+    if (pool) {
+        g_mutex_lock(&pool->mutex);
+    }
+}
+
+void
+fsearch_thread_pool_unlock(FsearchThreadPool *pool) {
+    if (pool) {
+        g_mutex_unlock(&pool->mutex);
+    }
+}
+
 GList *
 fsearch_thread_pool_get_threads(FsearchThreadPool *pool) {
     if (!pool) {
@@ -28,12 +28,24 @@ typedef void (*FsearchThreadPoolFunc)(void *data);
 
 typedef enum _FsearchThreadStatus { THREAD_IDLE, THREAD_BUSY, THREAD_FINISHED } FsearchThreadStatus;
 
+// Creates a pool with one thread per processor
 FsearchThreadPool *
 fsearch_thread_pool_init(void);
 
+FsearchThreadPool *
+fsearch_thread_pool_new(uint32_t num_threads);
+
 void
 fsearch_thread_pool_free(FsearchThreadPool *pool);
 
+// The threads can only work for one user at a time, which has to hold the lock from pushing the first data until the
+// last thread finished
+void
+fsearch_thread_pool_lock(FsearchThreadPool *pool);
+
+void
+fsearch_thread_pool_unlock(FsearchThreadPool *pool);
+
 GList *
 fsearch_thread_pool_get_threads(FsearchThreadPool *pool);
 
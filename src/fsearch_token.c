@@ -76,7 +76,8 @@ fsearch_search_func_normal_icase(const char *haystack,
                                  const char *needle,
                                  void *token,
                                  FsearchUtfConversionBuffer *buffer) {
-    return strcasestr(haystack, needle) ? 1 : 0;
+    FsearchToken *t = token;
+    return fs_str_find(haystack, strlen(haystack), needle, t->text_len, true) ? 1 : 0;
 }
 
 static uint32_t
@@ -93,6 +94,7 @@ fsearch_token_free(void *data) {
     g_clear_pointer(&token->needle_buffer, free);
     g_clear_pointer(&token->case_map, ucasemap_close);
     g_clear_pointer(&token->text, g_free);
+    g_clear_pointer(&token->text_folded, free);
     g_clear_pointer(&token->regex_study, pcre_free_study);
     g_clear_pointer(&token->regex, pcre_free);
     g_clear_pointer(&token, g_free);
@@ -109,6 +111,37 @@ fsearch_tokens_free(FsearchToken **tokens) {
     g_clear_pointer(&tokens, free);
 }
 
+uint32_t
+fsearch_token_search_folded(FsearchToken *token, const char *haystack, const char *folded, bool is_ascii) {
+    assert(token->text_folded != NULL);
+    if (is_ascii && !token->text_folded_is_ascii) {
+        // ASCII characters are folded to ASCII characters
+        return 0;
+    }
+    if (folded) {
+        return fs_str_find(folded, strlen(folded), token->text_folded, token->text_folded_len, false) ? 1 : 0;
+    }
+    // text_folded has no upper case ASCII letters, so comparing those case insensitively matches the folded haystack
+    return fs_str_find(haystack, strlen(haystack), token->text_folded, token->text_folded_len, true) ? 1 : 0;
+}
+
+bool
+fsearch_token_is_refinement_of(FsearchToken *token, FsearchToken *previous) {
+    if (!token->is_plain || !previous->is_plain || token->has_separator != previous->has_separator) {
+        return false;
+    }
+    if (previous->text[0] == '!') {
+        // "!abc" is matched literally, but don't rely on that: if it ever negated the token, "!abcd" would match more
+        // names than "!abc"
+        return false;
+    }
+    if (previous->search_func == fsearch_search_func_normal) {
+        // a case sensitive match can't be narrowed down by a case insensitive one
+        return token->search_func == fsearch_search_func_normal && strstr(token->text, previous->text);
+    }
+    return strcasestr(token->text, previous->text) ? true : false;
+}
+
 static FsearchToken *
 fsearch_token_new(const char *text, FsearchQueryFlags flags) {
     FsearchToken *new = calloc(1, sizeof(FsearchToken));
@@ -156,15 +189,32 @@ fsearch_token_new(const char *text, FsearchQueryFlags flags) {
     }
     else {
         if (flags & QUERY_FLAG_MATCH_CASE) {
+            new->is_plain = 1;
             new->search_func = fsearch_search_func_normal;
         }
         else if (fs_str_case_is_ascii(text)) {
+            new->is_plain = 1;
             new->search_func = fsearch_search_func_normal_icase;
         }
         else {
             new->is_utf = 1;
             new->search_func = fsearch_search_func_normal_icase_u8;
             // new->search_func = fsearch_search_func_normal_icase_u8_fast;
+            if (new->fold_options == U_FOLD_CASE_DEFAULT) {
+                // the folded names of the entries are folded with the default options
+                const int32_t text_folded_size = 3 * new->needle_buffer->string_normalized_folded_len + 1;
+                new->text_folded = calloc(text_folded_size, sizeof(char));
+                assert(new->text_folded != NULL);
+                const int32_t text_folded_len =
+                    fsearch_utf_normalized_folded_to_utf8(new->needle_buffer, new->text_folded, text_folded_size);
+                if (text_folded_len >= 0) {
+                    new->text_folded_len = text_folded_len;
+                    new->text_folded_is_ascii = g_str_is_ascii(new->text_folded) ? 1 : 0;
+                }
+                else {
+                    g_clear_pointer(&new->text_folded, free);
+                }
+            }
         }
     }
     return new;
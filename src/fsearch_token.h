@@ -35,6 +35,15 @@ typedef struct FsearchToken {
     int ovector[OVECCOUNT];
 
     int32_t is_utf;
+    // text_folded: text case folded and NFD normalized as UTF-8, set for case insensitive Unicode tokens which can be
+    // matched against the folded names of the entries, see fsearch_token_search_folded
+    char *text_folded;
+    size_t text_folded_len;
+    // text_folded_is_ascii: text_folded consists of ASCII characters only, otherwise it can't match pure ASCII names
+    uint32_t text_folded_is_ascii;
+    // is_plain: the token matches names which contain text as is or with different ASCII case,
+    // so an index of the names can be used to look up candidates
+    uint32_t is_plain;
 } FsearchToken;
 
 FsearchToken **
@@ -43,3 +52,13 @@ fsearch_tokens_new(const char *query, FsearchQueryFlags flags);
 void
 fsearch_tokens_free(FsearchToken **tokens);
 
+// Matches a token with text_folded against a name or path, without folding it again. folded is the case folded and
+// normalized form of haystack, NULL if that's haystack with its ASCII letters in lower case. is_ascii tells that
+// haystack consists of ASCII characters only, which skips the search if text_folded has other characters.
+uint32_t
+fsearch_token_search_folded(FsearchToken *token, const char *haystack, const char *folded, bool is_ascii);
+
+// Returns true if every name which token matches is matched by previous as well
+bool
+fsearch_token_is_refinement_of(FsearchToken *token, FsearchToken *previous);
+
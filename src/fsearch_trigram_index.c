@@ -0,0 +1,283 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#include "fsearch_trigram_index.h"
+
+#include <assert.h>
+#include <glib.h>
+#include <string.h>
+
+// the number of buckets grows with the number of entries, up to 2^TRIGRAM_INDEX_MAX_BUCKET_BITS
+#define TRIGRAM_INDEX_MIN_BUCKET_BITS 8
+#define TRIGRAM_INDEX_MAX_BUCKET_BITS 18
+#define TRIGRAM_INDEX_NO_ID UINT32_MAX
+// the posting lists of more trigrams rarely shrink the candidates any further
+#define TRIGRAM_INDEX_MAX_LOOKUPS 16
+
+struct FsearchTrigramIndex {
+    // postings: for every bucket the ascending ids of the entries with a trigram in that bucket,
+    // stored as differences to the previous id in LEB128 encoding
+    uint8_t *postings;
+    // offsets: start of the posting list of every bucket, offsets[num_buckets] is the end of the last one
+    uint64_t *offsets;
+    // counts: number of ids in the posting list of every bucket
+    uint32_t *counts;
+    uint32_t bucket_bits;
+    uint32_t num_buckets;
+    uint32_t num_entries;
+
+    volatile int ref_count;
+};
+
+static inline uint8_t
+trigram_fold(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t
+trigram_bucket(const uint8_t *s, uint32_t bucket_bits) {
+    const uint32_t trigram = (uint32_t)trigram_fold(s[0]) << 16 | (uint32_t)trigram_fold(s[1]) << 8
+                           | trigram_fold(s[2]);
+    return (trigram * 2654435761u) >> (32 - bucket_bits);
+}
+
+static inline uint32_t
+varint_len(uint32_t value) {
+    uint32_t len = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static inline uint8_t *
+varint_write(uint8_t *dest, uint32_t value) {
+    while (value >= 0x80) {
+        *dest++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *dest++ = (uint8_t)value;
+    return dest;
+}
+
+static inline const uint8_t *
+varint_read(const uint8_t *src, uint32_t *value) {
+    uint32_t res = 0;
+    uint32_t shift = 0;
+    while (*src & 0x80) {
+        res |= (uint32_t)(*src++ & 0x7f) << shift;
+        shift += 7;
+    }
+    res |= (uint32_t)*src++ << shift;
+    *value = res;
+    return src;
+}
+
+FsearchTrigramIndex *
+fsearch_trigram_index_new(FsearchDatabaseEntryStore *store, uint32_t num_entries) {
+    assert(store != NULL);
+
+    FsearchTrigramIndex *index = calloc(1, sizeof(FsearchTrigramIndex));
+    assert(index != NULL);
+    index->num_entries = num_entries;
+    index->bucket_bits =
+        CLAMP(g_bit_storage(num_entries), TRIGRAM_INDEX_MIN_BUCKET_BITS, TRIGRAM_INDEX_MAX_BUCKET_BITS);
+    index->num_buckets = 1 << index->bucket_bits;
+    index->ref_count = 1;
+
+    const uint32_t num_buckets = index->num_buckets;
+    index->counts = calloc(num_buckets, sizeof(uint32_t));
+    assert(index->counts != NULL);
+    index->offsets = calloc(num_buckets + 1, sizeof(uint64_t));
+    assert(index->offsets != NULL);
+
+    // last_id: the id which was added to every bucket last, which also drops trigrams occurring repeatedly in a name
+    uint32_t *last_id = malloc(num_buckets * sizeof(uint32_t));
+    assert(last_id != NULL);
+
+    // the first pass computes the size of every posting list, the second one fills them
+    memset(last_id, 0xff, num_buckets * sizeof(uint32_t));
+    for (uint32_t id = 0; id < num_entries; id++) {
+        const uint8_t *name = (const uint8_t *)db_entry_get_name_raw(db_entry_store_get_entry(store, id));
+        const size_t name_len = name ? strlen((const char *)name) : 0;
+        for (size_t i = 0; i + 2 < name_len; i++) {
+            const uint32_t bucket = trigram_bucket(name + i, index->bucket_bits);
+            if (last_id[bucket] == id) {
+                continue;
+            }
+            const uint32_t delta = last_id[bucket] == TRIGRAM_INDEX_NO_ID ? id : id - last_id[bucket];
+            index->offsets[bucket + 1] += varint_len(delta);
+            index->counts[bucket]++;
+            last_id[bucket] = id;
+        }
+    }
+    for (uint32_t bucket = 0; bucket < num_buckets; bucket++) {
+        index->offsets[bucket + 1] += index->offsets[bucket];
+    }
+
+    index->postings = malloc(MAX(index->offsets[num_buckets], 1));
+    assert(index->postings != NULL);
+
+    uint64_t *write_pos = malloc(num_buckets * sizeof(uint64_t));
+    assert(write_pos != NULL);
+    memcpy(write_pos, index->offsets, num_buckets * sizeof(uint64_t));
+
+    memset(last_id, 0xff, num_buckets * sizeof(uint32_t));
+    for (uint32_t id = 0; id < num_entries; id++) {
+        const uint8_t *name = (const uint8_t *)db_entry_get_name_raw(db_entry_store_get_entry(store, id));
+        const size_t name_len = name ? strlen((const char *)name) : 0;
+        for (size_t i = 0; i + 2 < name_len; i++) {
+            const uint32_t bucket = trigram_bucket(name + i, index->bucket_bits);
+            if (last_id[bucket] == id) {
+                continue;
+            }
+            const uint32_t delta = last_id[bucket] == TRIGRAM_INDEX_NO_ID ? id : id - last_id[bucket];
+            uint8_t *dest = varint_write(index->postings + write_pos[bucket], delta);
+            write_pos[bucket] = dest - index->postings;
+            last_id[bucket] = id;
+        }
+    }
+
+    g_clear_pointer(&write_pos, free);
+    g_clear_pointer(&last_id, free);
+
+    return index;
+}
+
+static void
+fsearch_trigram_index_free(FsearchTrigramIndex *index) {
+    g_clear_pointer(&index->postings, free);
+    g_clear_pointer(&index->offsets, free);
+    g_clear_pointer(&index->counts, free);
+    g_clear_pointer(&index, free);
+}
+
+FsearchTrigramIndex *
+fsearch_trigram_index_ref(FsearchTrigramIndex *index) {
+    if (!index || g_atomic_int_get(&index->ref_count) <= 0) {
+        return NULL;
+    }
+    g_atomic_int_inc(&index->ref_count);
+    return index;
+}
+
+void
+fsearch_trigram_index_unref(FsearchTrigramIndex *index) {
+    if (!index || g_atomic_int_get(&index->ref_count) <= 0) {
+        return;
+    }
+    if (g_atomic_int_dec_and_test(&index->ref_count)) {
+        fsearch_trigram_index_free(index);
+    }
+}
+
+uint32_t
+fsearch_trigram_index_get_num_entries(FsearchTrigramIndex *index) {
+    return index ? index->num_entries : 0;
+}
+
+size_t
+fsearch_trigram_index_get_size(FsearchTrigramIndex *index) {
+    if (!index) {
+        return 0;
+    }
+    return index->offsets[index->num_buckets] + (index->num_buckets + 1) * sizeof(uint64_t)
+         + index->num_buckets * sizeof(uint32_t);
+}
+
+static void
+decode_posting_list(FsearchTrigramIndex *index, uint32_t bucket, uint64_t *bitmap) {
+    const uint8_t *src = index->postings + index->offsets[bucket];
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < index->counts[bucket]; i++) {
+        uint32_t delta = 0;
+        src = varint_read(src, &delta);
+        id = i == 0 ? delta : id + delta;
+        bitmap[id / 64] |= (uint64_t)1 << (id % 64);
+    }
+}
+
+typedef struct TrigramLookup {
+    // count: length of the posting list of bucket
+    uint32_t count;
+    uint32_t bucket;
+} TrigramLookup;
+
+static int
+compare_lookups_by_count(const void *a, const void *b) {
+    const uint32_t count_a = ((const TrigramLookup *)a)->count;
+    const uint32_t count_b = ((const TrigramLookup *)b)->count;
+    return count_a < count_b ? -1 : count_a > count_b ? 1 : 0;
+}
+
+uint64_t *
+fsearch_trigram_index_find(FsearchTrigramIndex *index, const char *needle) {
+    assert(index != NULL);
+    assert(needle != NULL);
+
+    const size_t needle_len = strlen(needle);
+    if (needle_len < FSEARCH_TRIGRAM_INDEX_MIN_NEEDLE_LEN) {
+        return NULL;
+    }
+
+    const size_t num_words = ((size_t)index->num_entries + 63) / 64;
+    uint64_t *bitmap = calloc(MAX(num_words, 1), sizeof(uint64_t));
+    assert(bitmap != NULL);
+
+    TrigramLookup *lookups = calloc(needle_len - 2, sizeof(TrigramLookup));
+    assert(lookups != NULL);
+    uint32_t num_trigrams = 0;
+    for (size_t i = 0; i + 2 < needle_len; i++) {
+        const uint32_t bucket = trigram_bucket((const uint8_t *)needle + i, index->bucket_bits);
+        bool found = false;
+        for (uint32_t j = 0; j < num_trigrams; j++) {
+            if (lookups[j].bucket == bucket) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            lookups[num_trigrams].count = index->counts[bucket];
+            lookups[num_trigrams].bucket = bucket;
+            num_trigrams++;
+        }
+    }
+    // start with the shortest posting lists, they narrow down the candidates the most
+    qsort(lookups, num_trigrams, sizeof(TrigramLookup), compare_lookups_by_count);
+
+    decode_posting_list(index, lookups[0].bucket, bitmap);
+
+    uint64_t *list_bitmap = NULL;
+    const uint32_t num_lookups = MIN(num_trigrams, TRIGRAM_INDEX_MAX_LOOKUPS);
+    for (uint32_t i = 1; i < num_lookups; i++) {
+        if (!list_bitmap) {
+            list_bitmap = malloc(MAX(num_words, 1) * sizeof(uint64_t));
+            assert(list_bitmap != NULL);
+        }
+        memset(list_bitmap, 0, num_words * sizeof(uint64_t));
+        decode_posting_list(index, lookups[i].bucket, list_bitmap);
+        for (size_t w = 0; w < num_words; w++) {
+            bitmap[w] &= list_bitmap[w];
+        }
+    }
+    g_clear_pointer(&lookups, free);
+    g_clear_pointer(&list_bitmap, free);
+
+    return bitmap;
+}
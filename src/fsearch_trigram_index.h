@@ -0,0 +1,63 @@
+/*
+   FSearch - A fast file search utility
+   Copyright © 2020 Christian Boxdörfer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+   */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fsearch_database_entry.h"
+
+// Inverted index from the trigrams (three consecutive bytes) of entry names to the ids of the entries within their
+// store. It answers which names might contain a given string, so only those need to be compared with it.
+// Trigrams are taken from the names with ASCII letters folded to lower case, which makes the answer a superset of the
+// matches of case sensitive and ASCII case insensitive substring searches. Trigrams are hashed into buckets, whose
+// number grows with the number of entries, collisions only add more candidates.
+// The index is immutable. Entries which are allocated from the store after the index was built aren't covered by it.
+typedef struct FsearchTrigramIndex FsearchTrigramIndex;
+
+// the shortest string the index can answer queries for
+#define FSEARCH_TRIGRAM_INDEX_MIN_NEEDLE_LEN 3
+
+// Builds the index of the first num_entries entries of store
+FsearchTrigramIndex *
+fsearch_trigram_index_new(FsearchDatabaseEntryStore *store, uint32_t num_entries);
+
+FsearchTrigramIndex *
+fsearch_trigram_index_ref(FsearchTrigramIndex *index);
+
+void
+fsearch_trigram_index_unref(FsearchTrigramIndex *index);
+
+// number of entries covered by the index, their ids are 0 to num_entries - 1
+uint32_t
+fsearch_trigram_index_get_num_entries(FsearchTrigramIndex *index);
+
+size_t
+fsearch_trigram_index_get_size(FsearchTrigramIndex *index);
+
+// Returns a bitmap with (num_entries + 63) / 64 words, which has the bits of all entries set whose names might contain
+// needle. NULL if needle is too short to be looked up.
+uint64_t *
+fsearch_trigram_index_find(FsearchTrigramIndex *index, const char *needle);
+
+static inline bool
+fsearch_trigram_index_bitmap_contains(const uint64_t *bitmap, uint32_t num_entries, uint32_t id) {
+    return id >= num_entries || (bitmap[id / 64] & ((uint64_t)1 << (id % 64))) != 0;
+}
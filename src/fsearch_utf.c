@@ -127,3 +127,23 @@ fail:
     buffer->string_utf8_is_folded = false;
     return false;
 }
+
+int32_t
+fsearch_utf_normalized_folded_to_utf8(FsearchUtfConversionBuffer *buffer, char *dest, int32_t dest_size) {
+    if (!buffer || !buffer->string_is_folded_and_normalized) {
+        return -1;
+    }
+    UErrorCode status = U_ZERO_ERROR;
+    int32_t dest_len = 0;
+    u_strToUTF8(dest,
+                dest_size,
+                &dest_len,
+                buffer->string_normalized_folded,
+                buffer->string_normalized_folded_len,
+                &status);
+    // a string which fills dest exactly isn't null terminated
+    if (U_FAILURE(status) || dest_len >= dest_size) {
+        return -1;
+    }
+    return dest_len;
+}
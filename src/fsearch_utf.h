@@ -34,3 +34,8 @@ fsearch_utf_normalize_and_fold_case(const UNormalizer2 *normalizer,
                                     UCaseMap *case_map,
                                     FsearchUtfConversionBuffer *buffer,
                                     const char *string);
+
+// Writes the result of fsearch_utf_normalize_and_fold_case as null terminated UTF-8 to dest, which has room for
+// dest_size bytes. Returns the length of the UTF-8 string, -1 if the conversion failed or dest is too small.
+int32_t
+fsearch_utf_normalized_folded_to_utf8(FsearchUtfConversionBuffer *buffer, char *dest, int32_t dest_size);
@@ -871,6 +871,14 @@ on_database_update_finished(gpointer data, gpointer user_data) {
     g_clear_pointer(&db, db_unref);
 }
 
+static void
+on_database_changed(gpointer data, gpointer user_data) {
+    FsearchApplicationWindow *win = (FsearchApplicationWindow *)user_data;
+    g_assert(FSEARCH_IS_APPLICATION_WINDOW(win));
+
+    db_view_refresh(win->result_view->database_view);
+}
+
 static void
 on_database_load_started(gpointer data, gpointer user_data) {
     FsearchApplicationWindow *win = (FsearchApplicationWindow *)user_data;
@@ -910,6 +918,7 @@ fsearch_application_window_init(FsearchApplicationWindow *self) {
                             self,
                             G_CONNECT_AFTER);
     g_signal_connect_object(app, "database-load-started", G_CALLBACK(on_database_load_started), self, G_CONNECT_AFTER);
+    g_signal_connect_object(app, "database-changed", G_CALLBACK(on_database_changed), self, G_CONNECT_AFTER);
 }
 
 static void
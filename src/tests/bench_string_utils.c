@@ -0,0 +1,88 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_string_utils.h>
+
+// Compares the throughput of fs_str_find with strcasestr and strstr on file name like strings.
+// Run it with `meson test --benchmark` or directly.
+
+#define NUM_NAMES 100000
+#define NUM_ROUNDS 20
+
+static char **
+create_names(GRand *rand) {
+    const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-. ";
+    char **names = calloc(NUM_NAMES, sizeof(char *));
+    g_assert(names != NULL);
+    for (uint32_t i = 0; i < NUM_NAMES; i++) {
+        // most file names are short, some are a lot longer
+        const int32_t len = g_rand_int_range(rand, 0, 8) == 0 ? g_rand_int_range(rand, 40, 200)
+                                                                : g_rand_int_range(rand, 4, 40);
+        names[i] = calloc(len + 1, sizeof(char));
+        g_assert(names[i] != NULL);
+        for (int32_t j = 0; j < len; j++) {
+            names[i][j] = alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+        }
+    }
+    return names;
+}
+
+static void
+print_result(const char *name, const char *needle, size_t num_bytes, uint32_t num_matches, gint64 time) {
+    g_print("%-12s %-12s %8.1f MB/s (%u matches)\n",
+            name,
+            needle,
+            (double)num_bytes / (double)MAX(time, 1),
+            num_matches / NUM_ROUNDS);
+}
+
+static void
+bench_needle(char **names, const char *needle, bool ignore_case) {
+    const size_t needle_len = strlen(needle);
+    size_t num_bytes = 0;
+    for (uint32_t i = 0; i < NUM_NAMES; i++) {
+        num_bytes += strlen(names[i]);
+    }
+    num_bytes *= NUM_ROUNDS;
+
+    uint32_t num_matches = 0;
+    gint64 start = g_get_monotonic_time();
+    for (uint32_t r = 0; r < NUM_ROUNDS; r++) {
+        for (uint32_t i = 0; i < NUM_NAMES; i++) {
+            const char *s = ignore_case ? strcasestr(names[i], needle) : strstr(names[i], needle);
+            num_matches += s ? 1 : 0;
+        }
+    }
+    print_result(ignore_case ? "strcasestr" : "strstr", needle, num_bytes, num_matches, g_get_monotonic_time() - start);
+
+    num_matches = 0;
+    start = g_get_monotonic_time();
+    for (uint32_t r = 0; r < NUM_ROUNDS; r++) {
+        for (uint32_t i = 0; i < NUM_NAMES; i++) {
+            const char *s = fs_str_find(names[i], strlen(names[i]), needle, needle_len, ignore_case);
+            num_matches += s ? 1 : 0;
+        }
+    }
+    print_result("fs_str_find", needle, num_bytes, num_matches, g_get_monotonic_time() - start);
+}
+
+int
+main(int argc, char *argv[]) {
+    GRand *rand = g_rand_new_with_seed(42);
+    char **names = create_names(rand);
+    g_clear_pointer(&rand, g_rand_free);
+
+    const char *needles[] = {"a", "ab", "abc", "Test", "config.h", "zzzzzzzzzzzz"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(needles); i++) {
+        bench_needle(names, needles[i], true);
+        bench_needle(names, needles[i], false);
+    }
+
+    for (uint32_t i = 0; i < NUM_NAMES; i++) {
+        g_clear_pointer(&names[i], free);
+    }
+    g_clear_pointer(&names, free);
+    return 0;
+}
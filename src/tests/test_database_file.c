@@ -0,0 +1,239 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_index.h>
+
+#include "test_utils.h"
+
+// Layout of the table of contents and trailer, as described in fsearch_database.c
+typedef struct TestFileSection {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t checksum;
+    uint32_t param;
+} TestFileSection;
+
+#define TEST_SECTION_TYPE_FILES 3
+#define TEST_SECTION_FLAG_COMPRESSED (1 << 1)
+#define TEST_TOC_HEADER_SIZE 8
+#define TEST_TRAILER_SIZE 16
+
+// more files than fit into a single block of a section
+#define TEST_NUM_FILES 1500
+
+static uint32_t
+test_crc32(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (uint32_t j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void
+create_tree(const char *root) {
+    for (uint32_t i = 0; i < TEST_NUM_FILES; i++) {
+        // names share long prefixes, so they're front-coded against each other
+        char *path = g_strdup_printf("%s/folder_%02d/sub_%d/%s_%04d.txt",
+                                     root,
+                                     i % 13,
+                                     i % 3,
+                                     i % 5 ? "document" : "Straße",
+                                     i);
+        test_create_file(path, i % 97, 1000000000 + i * 61);
+        g_free(path);
+    }
+}
+
+static FsearchDatabase *
+load_database(const char *file_path) {
+    FsearchDatabase *db = db_new(NULL, NULL, NULL, false);
+    if (!db_load(db, file_path, NULL)) {
+        g_clear_pointer(&db, db_unref);
+    }
+    return db;
+}
+
+// Writes contents to a file of its own and checks that it's rejected by db_load
+static void
+assert_load_fails(const char *dir, const uint8_t *contents, size_t size) {
+    char *file_path = g_build_filename(dir, "broken.db", NULL);
+    g_assert(g_file_set_contents(file_path, (const char *)contents, (gssize)size, NULL));
+
+    FsearchDatabase *db = load_database(file_path);
+    g_assert(db == NULL);
+
+    g_remove(file_path);
+    g_free(file_path);
+}
+
+// Copies the table of contents entry of the section of the given type to section and returns its position. The table
+// of contents isn't aligned, so its entries are only accessed through copies.
+static size_t
+find_section(const uint8_t *contents, size_t size, uint32_t type, TestFileSection *section) {
+    uint64_t toc_offset = 0;
+    memcpy(&toc_offset, contents + size - TEST_TRAILER_SIZE, 8);
+    uint32_t num_sections = 0;
+    memcpy(&num_sections, contents + toc_offset, 4);
+
+    for (uint32_t i = 0; i < num_sections; i++) {
+        const size_t pos = toc_offset + TEST_TOC_HEADER_SIZE + i * sizeof(TestFileSection);
+        memcpy(section, contents + pos, sizeof(TestFileSection));
+        if (section->type == type) {
+            return pos;
+        }
+    }
+    g_assert_not_reached();
+    return 0;
+}
+
+// Stores section at pos with a valid checksum and updates the checksum of the table of contents
+static void
+replace_section(uint8_t *contents, size_t size, size_t pos, TestFileSection *section) {
+    section->checksum = test_crc32(contents + section->offset, section->size);
+    memcpy(contents + pos, section, sizeof(TestFileSection));
+
+    uint64_t toc_offset = 0;
+    memcpy(&toc_offset, contents + size - TEST_TRAILER_SIZE, 8);
+    const uint32_t toc_checksum = test_crc32(contents + toc_offset, size - TEST_TRAILER_SIZE - toc_offset);
+    memcpy(contents + size - TEST_TRAILER_SIZE + 8, &toc_checksum, 4);
+}
+
+static void
+test_corrupt_checksum(const char *dir, const uint8_t *contents, size_t size) {
+    uint8_t *broken = g_malloc(size);
+    memcpy(broken, contents, size);
+
+    // a single flipped bit in the middle of the files section
+    TestFileSection files = {};
+    find_section(broken, size, TEST_SECTION_TYPE_FILES, &files);
+    broken[files.offset + files.size / 2] ^= 1;
+    assert_load_fails(dir, broken, size);
+
+    g_free(broken);
+}
+
+static void
+test_truncated(const char *dir, const uint8_t *contents, size_t size) {
+    // files which end early, e.g. because the disk was full while saving
+    const size_t sizes[] = {0, 7, 8, size / 2, size - TEST_TRAILER_SIZE, size - 1};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        assert_load_fails(dir, contents, sizes[i]);
+    }
+
+    // files sections with valid checksums, which end in the middle of the last block, the restart point index or the
+    // restart interval
+    TestFileSection files = {};
+    const size_t pos = find_section(contents, size, TEST_SECTION_TYPE_FILES, &files);
+    const uint64_t section_sizes[] = {files.size - 1, files.size - 8, files.size - 100, 12, 2};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(section_sizes); i++) {
+        uint8_t *broken = g_malloc(size);
+        memcpy(broken, contents, size);
+
+        TestFileSection truncated = files;
+        truncated.size = section_sizes[i];
+        replace_section(broken, size, pos, &truncated);
+        assert_load_fails(dir, broken, size);
+
+        g_free(broken);
+    }
+}
+
+static void
+test_round_trip(const char *root, bool compress) {
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    db_set_compression(db, compress);
+    g_assert(db_scan(db, NULL, NULL));
+    g_assert_cmpuint(db_get_num_files(db), ==, TEST_NUM_FILES);
+
+    char *dir = g_dir_make_tmp("fsearch_test_db_XXXXXX", NULL);
+    g_assert(dir != NULL);
+    g_assert(db_save(db, dir));
+
+    char *file_path = g_build_filename(dir, "fsearch.db", NULL);
+    FsearchDatabase *loaded = load_database(file_path);
+    g_assert(loaded != NULL);
+
+    GPtrArray *expected = test_describe_database(db);
+    GPtrArray *result = test_describe_database(loaded);
+    test_assert_descriptions_equal(expected, result);
+
+    uint8_t *contents = NULL;
+    gsize size = 0;
+    g_assert(g_file_get_contents(file_path, (char **)&contents, &size, NULL));
+
+    TestFileSection files = {};
+    find_section(contents, size, TEST_SECTION_TYPE_FILES, &files);
+    g_assert(((files.flags & TEST_SECTION_FLAG_COMPRESSED) != 0) == compress);
+
+    test_corrupt_checksum(dir, contents, size);
+    test_truncated(dir, contents, size);
+
+    g_free(contents);
+    g_ptr_array_free(expected, TRUE);
+    g_ptr_array_free(result, TRUE);
+    g_clear_pointer(&loaded, db_unref);
+    g_clear_pointer(&db, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(dir);
+    g_free(file_path);
+    g_free(dir);
+}
+
+static void
+test_save_in_background(const char *root) {
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    g_assert(db_scan(db, NULL, NULL));
+    GPtrArray *expected = test_describe_database(db);
+
+    char *dir = g_dir_make_tmp("fsearch_test_db_XXXXXX", NULL);
+    g_assert(dir != NULL);
+    char *file_path = g_build_filename(dir, "fsearch.db", NULL);
+
+    // the save keeps the database alive, dropping the last reference neither waits for it nor cancels it
+    db_save_in_background(db, dir);
+    g_clear_pointer(&db, db_unref);
+
+    // the file only shows up once it's complete, because it's written to a temporary file first
+    for (uint32_t i = 0; i < 1000 && !g_file_test(file_path, G_FILE_TEST_EXISTS); i++) {
+        g_usleep(10000);
+    }
+    FsearchDatabase *loaded = load_database(file_path);
+    g_assert(loaded != NULL);
+    GPtrArray *result = test_describe_database(loaded);
+    test_assert_descriptions_equal(expected, result);
+
+    g_ptr_array_free(expected, TRUE);
+    g_ptr_array_free(result, TRUE);
+    g_clear_pointer(&loaded, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(dir);
+    g_free(file_path);
+    g_free(dir);
+}
+
+int
+main(int argc, char *argv[]) {
+    char *root = g_dir_make_tmp("fsearch_test_tree_XXXXXX", NULL);
+    g_assert(root != NULL);
+    create_tree(root);
+
+    test_round_trip(root, false);
+    test_round_trip(root, true);
+    test_save_in_background(root);
+
+    test_remove_tree(root);
+    g_free(root);
+    return 0;
+}
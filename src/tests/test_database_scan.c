@@ -0,0 +1,104 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_exclude_path.h>
+#include <src/fsearch_index.h>
+
+#include "test_utils.h"
+
+// enough folders that the workers of the parallel scanner have to steal tasks from each other
+#define TEST_NUM_FOLDERS 400
+#define TEST_FILES_PER_FOLDER 7
+
+static void
+create_tree(const char *root) {
+    for (uint32_t i = 0; i < TEST_NUM_FOLDERS; i++) {
+        // folders of different depths, so some subtrees are a lot bigger than others
+        GString *dir = g_string_new(root);
+        for (uint32_t depth = 0; depth <= i % 6; depth++) {
+            g_string_append_printf(dir, "/level_%d_%d", depth, (i / (depth + 1)) % 5);
+        }
+        g_string_append_printf(dir, "/folder_%03d", i);
+
+        for (uint32_t j = 0; j < TEST_FILES_PER_FOLDER; j++) {
+            char *path = NULL;
+            if (j == 0) {
+                path = g_strdup_printf("%s/.hidden_%d", dir->str, i);
+            }
+            else if (j == 1) {
+                path = g_strdup_printf("%s/excluded_%d.tmp", dir->str, i);
+            }
+            else {
+                path = g_strdup_printf("%s/file_%d_%d.txt", dir->str, i, j);
+            }
+            test_create_file(path, i * j % 113, 1000000000 + i * 17 + j);
+            g_free(path);
+        }
+        g_string_free(dir, TRUE);
+    }
+
+    // excluded folders are skipped with their contents
+    char *excluded = g_build_filename(root, "level_0_0", "excluded", "file.txt", NULL);
+    test_create_file(excluded, 10, 1000000000);
+    g_free(excluded);
+}
+
+static FsearchDatabase *
+scan_database(const char *root, uint32_t num_threads, uint32_t queue_depth) {
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    char *excluded_path = g_build_filename(root, "level_0_0", "excluded", NULL);
+    GList *excludes = g_list_append(NULL, fsearch_exclude_path_new(excluded_path, true));
+    char *exclude_files[] = {"*.tmp", NULL};
+
+    FsearchDatabase *db = db_new(indexes, excludes, exclude_files, true);
+    db_set_num_scan_threads(db, num_threads);
+    db_set_scan_queue_depth(db, queue_depth);
+    g_assert(db_scan(db, NULL, NULL));
+
+    g_list_free_full(excludes, (GDestroyNotify)fsearch_exclude_path_free);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    g_free(excluded_path);
+    return db;
+}
+
+int
+main(int argc, char *argv[]) {
+    char *root = g_dir_make_tmp("fsearch_test_scan_XXXXXX", NULL);
+    g_assert(root != NULL);
+    create_tree(root);
+
+    // a single thread uses the recursive walker
+    FsearchDatabase *db = scan_database(root, 1, 0);
+    g_assert_cmpuint(db_get_num_files(db), ==, TEST_NUM_FOLDERS * (TEST_FILES_PER_FOLDER - 2));
+    GPtrArray *expected = test_describe_database(db);
+
+    const uint32_t num_threads[] = {2, 4, 16};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(num_threads); i++) {
+        FsearchDatabase *parallel_db = scan_database(root, num_threads[i], 0);
+        GPtrArray *result = test_describe_database(parallel_db);
+        test_assert_descriptions_equal(expected, result);
+
+        g_ptr_array_free(result, TRUE);
+        g_clear_pointer(&parallel_db, db_unref);
+    }
+
+    // batched statx requests, with queues which are shorter than most folders. Without io_uring support the scanner
+    // falls back to fstatat.
+    const uint32_t queue_depths[] = {1, 4, 64};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(queue_depths); i++) {
+        FsearchDatabase *batched_db = scan_database(root, 1 + i, queue_depths[i]);
+        GPtrArray *result = test_describe_database(batched_db);
+        test_assert_descriptions_equal(expected, result);
+
+        g_ptr_array_free(result, TRUE);
+        g_clear_pointer(&batched_db, db_unref);
+    }
+
+    g_ptr_array_free(expected, TRUE);
+    g_clear_pointer(&db, db_unref);
+    test_remove_tree(root);
+    g_free(root);
+    return 0;
+}
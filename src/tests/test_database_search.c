@@ -0,0 +1,346 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_database_search.h>
+#include <src/fsearch_index.h>
+
+#include "test_utils.h"
+
+// enough files for several chunks of the parallel search, every one of them bigger than the minimum for searching
+// in parallel
+#define TEST_NUM_PARALLEL_FILES 12000
+
+// enough entries for partial results, the files of a folder are hard links to the first one, which makes creating
+// them a lot faster
+#define TEST_NUM_PARTIAL_FOLDERS 520
+#define TEST_NUM_PARTIAL_FILES_PER_FOLDER 512
+
+// Mixes pure ASCII names with ones which only fold to ASCII, precomposed and decomposed characters
+static const char *test_paths[] = {
+    "Straße/Akten/Brief.txt",
+    "Straße/Akten/STRASSE.txt",
+    "strasse/notes.md",
+    "STRASSE/Straße 12.txt",
+    "Café/menu é.txt",
+    "Café/Menu.txt",
+    "Cafe\xcc\x81/decomposed.txt",
+    "cafe/plain.txt",
+    "ÄÖÜ/äöü.txt",
+    "ÄÖÜ/aou.txt",
+    "aou/ÄÖÜ.txt",
+    "plain/ascii/README",
+    // nested folders for path searches
+    "docs/reports/2020/summary.txt",
+    "docs/reports/2020/q1/summary.txt",
+    "docs/reports/old/summary.txt",
+    "docs/drafts/reports.txt",
+    "src/lib/a.c",
+    "src/lib/b.c",
+    "src/bin/a.c",
+    "src/lib/nested/deeper/lib/a.c",
+    "a/b/c/d/e/f/g/h/file.txt",
+    "a folder name which is longer than the end of the path that is kept for each folder/x/summary.txt",
+    // for "reports/2020" the folders named reports are partial matches and other is impossible, while the folders
+    // below other become partial and matched again or stay impossible
+    "deep/reports/2020.txt",
+    "deep/reports/other/2020/summary.txt",
+    "deep/reports/other/reports/2020.txt",
+    "deep/reports/other/reports/2020/summary.txt",
+    "deep/reports/other/reports/2020/q1/reports/2021.txt",
+};
+
+typedef struct TestSearch {
+    const char *text;
+    FsearchQueryFlags flags;
+} TestSearch;
+
+// Matches every token of q against the name or path of entry with its search function, which folds non-ASCII text
+// with ICU, instead of the folded names and the other shortcuts of the database search
+static bool
+entry_matches(FsearchQuery *q, FsearchDatabaseEntry *entry, FsearchUtfConversionBuffer *utf_buffer) {
+    GString *path = db_entry_get_path_full(entry);
+    bool matches = true;
+    for (uint32_t i = 0; i < q->num_token && matches; i++) {
+        FsearchToken *t = q->token[i];
+        const bool search_in_path = (q->flags & QUERY_FLAG_SEARCH_IN_PATH)
+                                 || ((q->flags & QUERY_FLAG_AUTO_SEARCH_IN_PATH) && t->has_separator);
+        const char *haystack = search_in_path ? path->str : db_entry_get_name_raw(entry);
+        if (t->is_utf) {
+            fsearch_utf_normalize_and_fold_case(t->normalizer, t->case_map, utf_buffer, haystack);
+        }
+        matches = t->search_func(haystack, t->text, t, utf_buffer) != 0;
+    }
+    g_string_free(path, TRUE);
+    return matches;
+}
+
+static void
+test_results(FsearchQuery *q, DynamicArray *entries, DynamicArray *results) {
+    GHashTable *result_set = g_hash_table_new(g_direct_hash, g_direct_equal);
+    const uint32_t num_results = results ? darray_get_num_items(results) : 0;
+    for (uint32_t i = 0; i < num_results; i++) {
+        g_hash_table_add(result_set, darray_get_item(results, i));
+    }
+
+    FsearchUtfConversionBuffer utf_buffer = {};
+    fsearch_utf_conversion_buffer_init(&utf_buffer, 4 * PATH_MAX);
+    uint32_t num_expected = 0;
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        const bool expected = entry_matches(q, entry, &utf_buffer);
+        if (expected != g_hash_table_contains(result_set, entry)) {
+            GString *path = db_entry_get_path_full(entry);
+            g_printerr("Searching %s (flags: %d) should %sfind %s.\n",
+                       q->text,
+                       q->flags,
+                       expected ? "" : "not ",
+                       path->str);
+            g_string_free(path, TRUE);
+        }
+        g_assert(expected == g_hash_table_contains(result_set, entry));
+        num_expected += expected ? 1 : 0;
+    }
+    g_assert_cmpuint(num_expected, ==, num_results);
+
+    fsearch_utf_conversion_buffer_clear(&utf_buffer);
+    g_hash_table_destroy(result_set);
+}
+
+static void
+test_search(FsearchDatabase *db, FsearchTaskQueue *queue, FsearchFilter *filter, TestSearch *test) {
+    FsearchQuery *q = fsearch_query_new(test->text, db, 0, filter, db_get_thread_pool(db), test->flags, 0, 0, NULL);
+
+    DatabaseSearchResult *result = test_search_sync(queue, q, NULL);
+
+    db_lock(db);
+    DynamicArray *folders = db_get_folders(db);
+    DynamicArray *files = db_get_files(db);
+    db_unlock(db);
+
+    DynamicArray *result_folders = db_search_result_get_folders(result);
+    DynamicArray *result_files = db_search_result_get_files(result);
+    test_results(q, folders, result_folders);
+    test_results(q, files, result_files);
+
+    g_clear_pointer(&result_folders, darray_unref);
+    g_clear_pointer(&result_files, darray_unref);
+    g_clear_pointer(&folders, darray_unref);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&result, db_search_result_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+}
+
+static DynamicArray *
+search_files(FsearchDatabase *db,
+             FsearchTaskQueue *queue,
+             FsearchFilter *filter,
+             FsearchThreadPool *pool,
+             const char *text,
+             DynamicArray *files) {
+    FsearchQuery *q = fsearch_query_new(text, db, 0, filter, pool, QUERY_FLAG_AUTO_SEARCH_IN_PATH, 0, 0, NULL);
+    DatabaseSearchResult *result = test_search_sync(queue, q, NULL);
+    DynamicArray *result_files = db_search_result_get_files(result);
+    test_results(q, files, result_files);
+
+    g_clear_pointer(&result, db_search_result_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+    return result_files;
+}
+
+// The chunks which are searched by several threads must be put together in the same order as a single thread finds
+// their matches
+static void
+test_parallel_search(FsearchTaskQueue *queue, FsearchFilter *filter) {
+    char *root = g_dir_make_tmp("fsearch_test_search_XXXXXX", NULL);
+    g_assert(root != NULL);
+    for (uint32_t i = 0; i < TEST_NUM_PARALLEL_FILES; i++) {
+        char *path = g_strdup_printf("%s/batch_%02d/entry_%05d.%s", root, i % 10, i, i % 3 ? "txt" : "md");
+        test_create_file(path, 0, 1000000000);
+        g_free(path);
+    }
+
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    g_assert(db_scan(db, NULL, NULL));
+    db_lock(db);
+    DynamicArray *files = db_get_files(db);
+    db_unlock(db);
+
+    FsearchThreadPool *single_thread = fsearch_thread_pool_new(1);
+    FsearchThreadPool *threads = fsearch_thread_pool_new(4);
+
+    const char *texts[] = {"entry", "entry_1", "7", "md", "batch_03/", "batch_0 9.txt", "nothing"};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(texts); i++) {
+        DynamicArray *expected = search_files(db, queue, filter, single_thread, texts[i], files);
+        DynamicArray *result = search_files(db, queue, filter, threads, texts[i], files);
+        test_assert_arrays_equal(expected, result);
+
+        g_clear_pointer(&expected, darray_unref);
+        g_clear_pointer(&result, darray_unref);
+    }
+
+    g_clear_pointer(&threads, fsearch_thread_pool_free);
+    g_clear_pointer(&single_thread, fsearch_thread_pool_free);
+    g_clear_pointer(&files, darray_unref);
+    g_clear_pointer(&db, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(root);
+    g_free(root);
+}
+
+static DatabaseSearchResult *partial_result;
+static uint32_t num_partial_results;
+
+static void
+search_partial(gpointer result, gpointer data) {
+    g_clear_pointer(&partial_result, db_search_result_unref);
+    partial_result = result;
+    num_partial_results++;
+}
+
+// The first results are handed out before the search is finished, they have to be the beginning of the final results
+static void
+assert_is_prefix(DynamicArray *prefix, DynamicArray *array) {
+    const uint32_t num_items = prefix ? darray_get_num_items(prefix) : 0;
+    g_assert_cmpuint(num_items, <=, array ? darray_get_num_items(array) : 0);
+    for (uint32_t i = 0; i < num_items; i++) {
+        g_assert(darray_get_item(prefix, i) == darray_get_item(array, i));
+    }
+}
+
+static void
+test_partial_results(FsearchTaskQueue *queue, FsearchFilter *filter) {
+    char *root = g_dir_make_tmp("fsearch_test_search_XXXXXX", NULL);
+    g_assert(root != NULL);
+    for (uint32_t i = 0; i < TEST_NUM_PARTIAL_FOLDERS; i++) {
+        char *first = g_strdup_printf("%s/part_%03d/entry_000.txt", root, i);
+        test_create_file(first, 0, 1000000000);
+        for (uint32_t j = 1; j < TEST_NUM_PARTIAL_FILES_PER_FOLDER; j++) {
+            char *path = g_strdup_printf("%s/part_%03d/entry_%03d.txt", root, i, j);
+            g_assert(link(first, path) == 0);
+            g_free(path);
+        }
+        g_free(first);
+    }
+
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    g_assert(db_scan(db, NULL, NULL));
+
+    FsearchQuery *q = fsearch_query_new("entry_1", db, 0, filter, db_get_thread_pool(db), 0, 0, 0, NULL);
+    DatabaseSearchResult *result = test_search_sync(queue, q, search_partial);
+    g_assert_cmpuint(num_partial_results, ==, 1);
+    g_assert(partial_result != NULL);
+
+    DynamicArray *partial_folders = db_search_result_get_folders(partial_result);
+    DynamicArray *partial_files = db_search_result_get_files(partial_result);
+    DynamicArray *result_folders = db_search_result_get_folders(result);
+    DynamicArray *result_files = db_search_result_get_files(result);
+    g_assert_cmpuint(darray_get_num_items(partial_files), >, 0);
+    g_assert_cmpuint(darray_get_num_items(partial_files), <, darray_get_num_items(result_files));
+    assert_is_prefix(partial_folders, result_folders);
+    assert_is_prefix(partial_files, result_files);
+
+    g_clear_pointer(&partial_folders, darray_unref);
+    g_clear_pointer(&partial_files, darray_unref);
+    g_clear_pointer(&result_folders, darray_unref);
+    g_clear_pointer(&result_files, darray_unref);
+    g_clear_pointer(&partial_result, db_search_result_unref);
+    g_clear_pointer(&result, db_search_result_unref);
+    g_clear_pointer(&q, fsearch_query_unref);
+    g_clear_pointer(&db, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(root);
+    g_free(root);
+}
+
+int
+main(int argc, char *argv[]) {
+    char *root = g_dir_make_tmp("fsearch_test_search_XXXXXX", NULL);
+    g_assert(root != NULL);
+    test_create_tree(root, test_paths, G_N_ELEMENTS(test_paths));
+
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    g_assert(db_scan(db, NULL, NULL));
+
+    FsearchTaskQueue *queue = fsearch_task_queue_new("test_database_search");
+    FsearchFilter *filter = fsearch_filter_new(FSEARCH_FILTER_NONE, "All", NULL, 0);
+
+    TestSearch tests[] = {
+        // Tokens which fold to ASCII text, so they're compared with ASCII names without ICU
+        {"Straße", 0},
+        {"STRAẞE", 0},
+        {"Straße", QUERY_FLAG_SEARCH_IN_PATH},
+        {"straße/akten", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"ß brief", QUERY_FLAG_SEARCH_IN_PATH},
+
+        // Tokens which don't fold to ASCII text, so they never match ASCII names
+        {"é", 0},
+        {"É", QUERY_FLAG_SEARCH_IN_PATH},
+        {"e\xcc\x81", 0},
+        {"café", QUERY_FLAG_SEARCH_IN_PATH},
+        {"äöü", 0},
+        {"Ä txt", QUERY_FLAG_SEARCH_IN_PATH},
+
+        // ASCII tokens
+        {"strasse", 0},
+        {"CAFE", QUERY_FLAG_SEARCH_IN_PATH},
+        {"aou", 0},
+        {"txt", QUERY_FLAG_SEARCH_IN_PATH},
+
+        // Path tokens across nested folders
+        {"reports", QUERY_FLAG_SEARCH_IN_PATH},
+        {"docs 2020", QUERY_FLAG_SEARCH_IN_PATH},
+        {"reports/2020", QUERY_FLAG_SEARCH_IN_PATH},
+        {"s/2", QUERY_FLAG_SEARCH_IN_PATH},
+        {"eports/2020/q", QUERY_FLAG_SEARCH_IN_PATH},
+        {"2020/summary", QUERY_FLAG_SEARCH_IN_PATH},
+        {"/lib/", QUERY_FLAG_SEARCH_IN_PATH},
+        {"lib/a.c", QUERY_FLAG_SEARCH_IN_PATH},
+        {"lib a.c", QUERY_FLAG_SEARCH_IN_PATH},
+        {"src/lib nested", QUERY_FLAG_SEARCH_IN_PATH},
+        {"c/d/e/f", QUERY_FLAG_SEARCH_IN_PATH},
+        {"b/c/d summary", QUERY_FLAG_SEARCH_IN_PATH},
+        {"d/e/f/g/h/file.txt", QUERY_FLAG_SEARCH_IN_PATH},
+        {"path that is kept/x/summary", QUERY_FLAG_SEARCH_IN_PATH},
+        {"longer than the end of the path that is kept for each folder/x/summary.txt", QUERY_FLAG_SEARCH_IN_PATH},
+        {"LIB/A", QUERY_FLAG_SEARCH_IN_PATH},
+        {"Reports/2020", QUERY_FLAG_SEARCH_IN_PATH | QUERY_FLAG_MATCH_CASE},
+        {"reports/2020", QUERY_FLAG_SEARCH_IN_PATH | QUERY_FLAG_MATCH_CASE},
+        {"reports/2020 summary", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"lib/a", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"src/ a.c", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"s/2 q1", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"old/ txt", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"deeper/lib/ lib/a", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"x/y", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+
+        // Folders whose state for a path token changes from one depth to the next
+        {"reports/2020", QUERY_FLAG_SEARCH_IN_PATH},
+        {"reports/2020/", QUERY_FLAG_SEARCH_IN_PATH},
+        {"other/2020", QUERY_FLAG_SEARCH_IN_PATH},
+        {"other/reports/2020/q1", QUERY_FLAG_SEARCH_IN_PATH},
+        {"reports/2020 other/r", QUERY_FLAG_SEARCH_IN_PATH},
+        {"deep/ reports/202", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+        {"q1/reports/", QUERY_FLAG_AUTO_SEARCH_IN_PATH},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(tests); i++) {
+        test_search(db, queue, filter, &tests[i]);
+    }
+
+    test_parallel_search(queue, filter);
+    test_partial_results(queue, filter);
+
+    g_clear_pointer(&filter, fsearch_filter_unref);
+    g_clear_pointer(&queue, fsearch_task_queue_free);
+    g_clear_pointer(&db, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(root);
+    g_free(root);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_database_search.h>
+#include <src/fsearch_index.h>
+
+#include "test_utils.h"
+
+static const char *test_paths[] = {
+    "notes/todo.txt",
+    "notes/ideas.txt",
+    "notes/old/2020.txt",
+    "other/readme.md",
+};
+
+static uint32_t num_cache_hits = 0;
+
+// Counts the searches which were answered from the cache, which is only reported by a debug message
+static void
+count_cache_hits(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer data) {
+    if (strstr(message, "using cached results")) {
+        num_cache_hits++;
+    }
+}
+
+static FsearchDatabase *
+scan_database(GList *indexes) {
+    FsearchDatabase *db = db_new(indexes, NULL, NULL, false);
+    g_assert(db_scan(db, NULL, NULL));
+    return db;
+}
+
+static DatabaseSearchResult *
+search(FsearchDatabase *db, FsearchTaskQueue *queue, FsearchFilter *filter, const char *text) {
+    FsearchQuery *q = fsearch_query_new(text, db, 0, filter, db_get_thread_pool(db), 0, 0, 0, NULL);
+    DatabaseSearchResult *result = test_search_sync(queue, q, NULL);
+    g_clear_pointer(&q, fsearch_query_unref);
+    return result;
+}
+
+static void
+assert_results_equal(DatabaseSearchResult *r1, DatabaseSearchResult *r2) {
+    DynamicArray *folders1 = db_search_result_get_folders(r1);
+    DynamicArray *folders2 = db_search_result_get_folders(r2);
+    DynamicArray *files1 = db_search_result_get_files(r1);
+    DynamicArray *files2 = db_search_result_get_files(r2);
+    test_assert_arrays_equal(folders1, folders2);
+    test_assert_arrays_equal(files1, files2);
+
+    g_clear_pointer(&folders1, darray_unref);
+    g_clear_pointer(&folders2, darray_unref);
+    g_clear_pointer(&files1, darray_unref);
+    g_clear_pointer(&files2, darray_unref);
+}
+
+static uint32_t
+get_num_files(DatabaseSearchResult *result) {
+    DynamicArray *files = db_search_result_get_files(result);
+    const uint32_t num_files = files ? darray_get_num_items(files) : 0;
+    g_clear_pointer(&files, darray_unref);
+    return num_files;
+}
+
+static FsearchDatabaseEntry *
+find_folder(FsearchDatabase *db, const char *name) {
+    FsearchDatabaseEntry *folder = NULL;
+    db_lock(db);
+    DynamicArray *folders = db_get_folders(db);
+    for (uint32_t i = 0; i < darray_get_num_items(folders) && !folder; i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(folders, i);
+        if (strcmp(db_entry_get_name_raw(entry), name) == 0) {
+            folder = entry;
+        }
+    }
+    g_clear_pointer(&folders, darray_unref);
+    db_unlock(db);
+    g_assert(folder != NULL);
+    return folder;
+}
+
+// Adds a file to the notes folder and applies the change to db, which publishes a new generation of it
+static void
+add_file(FsearchDatabase *db, const char *root) {
+    char *path = g_build_filename(root, "notes", "new.txt", NULL);
+    test_create_file(path, 0, 1000000000);
+    g_free(path);
+
+    GHashTable *names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_add(names, g_strdup("new.txt"));
+    GHashTable *changes = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_hash_table_destroy);
+    g_hash_table_insert(changes, find_folder(db, "notes"), names);
+
+    FsearchDatabaseGeneration *generation = db_get_generation(db);
+    g_assert(db_apply_folder_changes(db, changes, NULL, NULL) == DATABASE_CHANGES_APPLIED);
+    FsearchDatabaseGeneration *new_generation = db_get_generation(db);
+    g_assert_cmpuint(db_generation_get_id(new_generation), !=, db_generation_get_id(generation));
+
+    g_clear_pointer(&new_generation, db_generation_unref);
+    g_clear_pointer(&generation, db_generation_unref);
+    g_hash_table_destroy(changes);
+}
+
+int
+main(int argc, char *argv[]) {
+    g_log_set_handler("fsearch-search", G_LOG_LEVEL_DEBUG, count_cache_hits, NULL);
+
+    char *root = g_dir_make_tmp("fsearch_test_search_cache_XXXXXX", NULL);
+    g_assert(root != NULL);
+    test_create_tree(root, test_paths, G_N_ELEMENTS(test_paths));
+
+    GList *indexes = g_list_append(NULL, fsearch_index_new(FSEARCH_INDEX_FOLDER_TYPE, root, true, true, 0));
+    FsearchDatabase *db = scan_database(indexes);
+    FsearchTaskQueue *queue = fsearch_task_queue_new("test_database_search_cache");
+    FsearchFilter *filter = fsearch_filter_new(FSEARCH_FILTER_NONE, "All", NULL, 0);
+
+    // the same query again is answered from the cache, with the same results
+    DatabaseSearchResult *result = search(db, queue, filter, "txt");
+    g_assert_cmpuint(num_cache_hits, ==, 0);
+    g_assert_cmpuint(get_num_files(result), ==, 3);
+    g_assert_cmpuint(db_search_get_result_cache_usage(), >, 0);
+
+    DatabaseSearchResult *cached_result = search(db, queue, filter, "txt");
+    g_assert_cmpuint(num_cache_hits, ==, 1);
+    assert_results_equal(result, cached_result);
+    g_clear_pointer(&cached_result, db_search_result_unref);
+    g_clear_pointer(&result, db_search_result_unref);
+
+    // other queries aren't
+    result = search(db, queue, filter, "md");
+    g_assert_cmpuint(num_cache_hits, ==, 1);
+    g_clear_pointer(&result, db_search_result_unref);
+
+    // once the database changed, the cached results are outdated
+    add_file(db, root);
+    result = search(db, queue, filter, "txt");
+    g_assert_cmpuint(num_cache_hits, ==, 1);
+    g_assert_cmpuint(get_num_files(result), ==, 4);
+
+    cached_result = search(db, queue, filter, "txt");
+    g_assert_cmpuint(num_cache_hits, ==, 2);
+    assert_results_equal(result, cached_result);
+    g_clear_pointer(&cached_result, db_search_result_unref);
+    g_clear_pointer(&result, db_search_result_unref);
+
+    // the results of a database are dropped when it's freed, even though they don't keep it alive
+    g_clear_pointer(&db, db_unref);
+    g_assert_cmpuint(db_search_get_result_cache_usage(), ==, 0);
+
+    db = scan_database(indexes);
+    result = search(db, queue, filter, "txt");
+    g_assert_cmpuint(num_cache_hits, ==, 2);
+    g_assert_cmpuint(get_num_files(result), ==, 4);
+    g_clear_pointer(&result, db_search_result_unref);
+
+    g_clear_pointer(&filter, fsearch_filter_unref);
+    g_clear_pointer(&queue, fsearch_task_queue_free);
+    g_clear_pointer(&db, db_unref);
+    g_list_free_full(indexes, (GDestroyNotify)fsearch_index_free);
+    test_remove_tree(root);
+    g_free(root);
+    return 0;
+}
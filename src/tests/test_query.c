@@ -45,6 +45,35 @@ set_locale(const char *locale) {
     return true;
 }
 
+typedef struct QueryRefinementTest {
+    const char *text;
+    FsearchQueryFlags flags;
+    const char *previous_text;
+    FsearchQueryFlags previous_flags;
+    bool result;
+} QueryRefinementTest;
+
+static void
+test_query_refinement(const char *text,
+                      FsearchQueryFlags flags,
+                      FsearchFilter *filter,
+                      const char *previous_text,
+                      FsearchQueryFlags previous_flags,
+                      FsearchFilter *previous_filter,
+                      bool result) {
+    FsearchQuery *q = fsearch_query_new(text, NULL, 0, filter, NULL, flags, 0, 0, NULL);
+    FsearchQuery *previous =
+        fsearch_query_new(previous_text, NULL, 0, previous_filter, NULL, previous_flags, 0, 0, NULL);
+
+    if (fsearch_query_is_refinement_of(q, previous) != result) {
+        g_printerr("%s should %sbe a refinement of %s.\n", text, result ? "" : "not ", previous_text);
+    }
+    g_assert(fsearch_query_is_refinement_of(q, previous) == result);
+
+    g_clear_pointer(&q, fsearch_query_unref);
+    g_clear_pointer(&previous, fsearch_query_unref);
+}
+
 typedef struct QueryTest {
     const char *needle;
     const char *haystack;
@@ -195,4 +224,50 @@ main(int argc, char *argv[]) {
             test_query(t->needle, t->haystack, t->flags, t->result);
         }
     }
+
+    QueryRefinementTest refinement_tests[] = {
+        // Extended substrings and additional words
+        {"abc", 0, "ab", 0, true},
+        {"xabcx", 0, "abc", 0, true},
+        {"ab cd", 0, "ab", 0, true},
+        {"cd abc", 0, "ab", 0, true},
+        {"abc cde", 0, "ab cd", 0, true},
+        {"abc", 0, "ab cd", 0, false},
+        {"ab", 0, "abc", 0, false},
+        {"abd", 0, "abc", 0, false},
+
+        // Changed flags
+        {"abc", QUERY_FLAG_MATCH_CASE, "ab", 0, false},
+        {"abc", 0, "ab", QUERY_FLAG_MATCH_CASE, false},
+        {"abc", QUERY_FLAG_MATCH_CASE, "ab", QUERY_FLAG_MATCH_CASE, true},
+        {"abc", QUERY_FLAG_REGEX, "ab", 0, false},
+        {"abc", 0, "ab", QUERY_FLAG_REGEX, false},
+        {"abc", QUERY_FLAG_REGEX, "ab", QUERY_FLAG_REGEX, false},
+        {"abc", QUERY_FLAG_SEARCH_IN_PATH, "ab", 0, false},
+        {"abc", 0, "ab", QUERY_FLAG_SEARCH_IN_PATH, false},
+        {"abc", QUERY_FLAG_SEARCH_IN_PATH, "ab", QUERY_FLAG_SEARCH_IN_PATH, true},
+        {"ab/c", QUERY_FLAG_AUTO_SEARCH_IN_PATH, "ab", QUERY_FLAG_AUTO_SEARCH_IN_PATH, false},
+
+        // Negated terms
+        {"!abcd", 0, "!abc", 0, false},
+        {"!abc d", 0, "!abc", 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(refinement_tests); i++) {
+        QueryRefinementTest *t = &refinement_tests[i];
+        test_query_refinement(t->text, t->flags, NULL, t->previous_text, t->previous_flags, NULL, t->result);
+    }
+
+    // Changed filters
+    FsearchFilter *files = fsearch_filter_new(FSEARCH_FILTER_FILES, "Files", NULL, 0);
+    FsearchFilter *folders = fsearch_filter_new(FSEARCH_FILTER_FOLDERS, "Folders", NULL, 0);
+    FsearchFilter *pictures = fsearch_filter_new(FSEARCH_FILTER_FILES, "Pictures", "*.png *.jpg", 0);
+    test_query_refinement("abc", 0, files, "ab", 0, files, true);
+    test_query_refinement("abc", 0, files, "ab", 0, NULL, false);
+    test_query_refinement("abc", 0, NULL, "ab", 0, files, false);
+    test_query_refinement("abc", 0, folders, "ab", 0, files, false);
+    test_query_refinement("abc", 0, pictures, "ab", 0, files, false);
+    test_query_refinement("abc", 0, pictures, "ab", 0, pictures, true);
+    g_clear_pointer(&files, fsearch_filter_unref);
+    g_clear_pointer(&folders, fsearch_filter_unref);
+    g_clear_pointer(&pictures, fsearch_filter_unref);
 }
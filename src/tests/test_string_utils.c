@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_string_utils.h>
+
+static int
+compare_natural_sort_keys(const char *s1, const char *s2) {
+    uint8_t *k1 = calloc(FS_STR_NATURAL_SORT_KEY_SIZE(strlen(s1)) + 1, sizeof(uint8_t));
+    uint8_t *k2 = calloc(FS_STR_NATURAL_SORT_KEY_SIZE(strlen(s2)) + 1, sizeof(uint8_t));
+    const size_t k1_len = fs_str_get_natural_sort_key(s1, k1);
+    const size_t k2_len = fs_str_get_natural_sort_key(s2, k2);
+
+    int res = memcmp(k1, k2, MIN(k1_len, k2_len));
+    if (res == 0) {
+        res = k1_len < k2_len ? -1 : k1_len > k2_len ? 1 : 0;
+    }
+    free(k1);
+    free(k2);
+    return res;
+}
+
+static int
+sign(int val) {
+    return val < 0 ? -1 : val > 0 ? 1 : 0;
+}
+
+static void
+test_natural_sort_key(const char *s1, const char *s2) {
+    const int expected = sign(strverscmp(s1, s2));
+    const int result = sign(compare_natural_sort_keys(s1, s2));
+    if (expected != result) {
+        g_print("natural sort key of \"%s\" and \"%s\": %d, expected: %d\n", s1, s2, result, expected);
+    }
+    g_assert(expected == result);
+}
+
+static void
+test_find(const char *haystack, size_t haystack_len, const char *needle, bool ignore_case) {
+    const char *expected = ignore_case ? strcasestr(haystack, needle) : strstr(haystack, needle);
+    const char *result = fs_str_find(haystack, haystack_len, needle, strlen(needle), ignore_case);
+    if (expected != result) {
+        g_print("find \"%s\" in \"%s\" (ignore case: %d): %td, expected: %td\n",
+                needle,
+                haystack,
+                ignore_case,
+                result ? result - haystack : -1,
+                expected ? expected - haystack : -1);
+    }
+    g_assert(expected == result);
+}
+
+int
+main(int argc, char *argv[]) {
+    const char *names[] = {
+        "",          "a",         "a1",        "a2",       "a10",      "a01",    "a001",   "a010",
+        "a0",        "a00",       "file9.txt", "file10.txt", "file009", "000",    "00",     "0",
+        "1",         "9",         "10",        "0a",       "1a",       "01a",    "abc",    "ab",
+        "a1b2",      "a1b10",     "a10b1",     "x-1.2.3",  "x-1.10",   "ü9",     "ü10",    "99999999999999999999",
+        "100000000000000000000",
+    };
+
+    const uint32_t num_names = sizeof(names) / sizeof(names[0]);
+    for (uint32_t i = 0; i < num_names; i++) {
+        for (uint32_t j = 0; j < num_names; j++) {
+            test_natural_sort_key(names[i], names[j]);
+        }
+    }
+
+    const char alphabet[] = "0001239a.";
+    GRand *rand = g_rand_new_with_seed(42);
+    for (uint32_t i = 0; i < 100000; i++) {
+        char s1[9] = "";
+        char s2[9] = "";
+        const int32_t s1_len = g_rand_int_range(rand, 0, sizeof(s1));
+        const int32_t s2_len = g_rand_int_range(rand, 0, sizeof(s2));
+        for (int32_t j = 0; j < s1_len; j++) {
+            s1[j] = alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+        }
+        for (int32_t j = 0; j < s2_len; j++) {
+            s2[j] = alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+        }
+        test_natural_sort_key(s1, s2);
+    }
+
+    // haystacks of up to 100 bytes cover the vectorized loops as well as the remaining bytes after them,
+    // the small alphabet makes partial matches common
+    const char find_alphabet[] = "aAbB[{@`zZ\xc3\xa4";
+    for (uint32_t i = 0; i < 100000; i++) {
+        char haystack[101] = "";
+        char needle[9] = "";
+        const int32_t haystack_len = g_rand_int_range(rand, 0, sizeof(haystack));
+        const int32_t needle_len = g_rand_int_range(rand, 1, sizeof(needle));
+        for (int32_t j = 0; j < haystack_len; j++) {
+            haystack[j] = find_alphabet[g_rand_int_range(rand, 0, sizeof(find_alphabet) - 1)];
+        }
+        for (int32_t j = 0; j < needle_len; j++) {
+            needle[j] = find_alphabet[g_rand_int_range(rand, 0, sizeof(find_alphabet) - 1)];
+        }
+        if (haystack_len >= needle_len && g_rand_boolean(rand)) {
+            // make sure there's a match (in any case) at a random position
+            const int32_t pos = g_rand_int_range(rand, 0, haystack_len - needle_len + 1);
+            for (int32_t j = 0; j < needle_len; j++) {
+                haystack[pos + j] = g_rand_boolean(rand) ? g_ascii_toupper(needle[j]) : needle[j];
+            }
+        }
+        test_find(haystack, haystack_len, needle, true);
+        test_find(haystack, haystack_len, needle, false);
+    }
+    test_find("", 0, "", true);
+    test_find("abc", 3, "", false);
+    g_clear_pointer(&rand, g_rand_free);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <glib.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <src/fsearch_token.h>
 
@@ -29,6 +30,88 @@ new_strv(int num, ...) {
 
 #define Q_TEST(q, n, ...) {q, n, new_strv(n, ##__VA_ARGS__)}
 
+typedef struct TestRefinement {
+    const char *text;
+    FsearchQueryFlags flags;
+    const char *previous_text;
+    FsearchQueryFlags previous_flags;
+    bool result;
+} TestRefinement;
+
+static void
+test_refinement(TestRefinement *test) {
+    FsearchToken **tokens = fsearch_tokens_new(test->text, test->flags);
+    FsearchToken **previous_tokens = fsearch_tokens_new(test->previous_text, test->previous_flags);
+    g_assert(tokens[0] != NULL && tokens[1] == NULL);
+    g_assert(previous_tokens[0] != NULL && previous_tokens[1] == NULL);
+
+    const bool result = fsearch_token_is_refinement_of(tokens[0], previous_tokens[0]);
+    if (result != test->result) {
+        g_printerr("%s should %sbe a refinement of %s.\n", test->text, test->result ? "" : "not ", test->previous_text);
+    }
+    g_assert(result == test->result);
+
+    g_clear_pointer(&tokens, fsearch_tokens_free);
+    g_clear_pointer(&previous_tokens, fsearch_tokens_free);
+}
+
+// Returns the folded name the database stores for name, NULL if it's name with its ASCII letters in lower case
+static char *
+fold_name(const char *name) {
+    UErrorCode status = U_ZERO_ERROR;
+    UCaseMap *case_map = ucasemap_open("", U_FOLD_CASE_DEFAULT, &status);
+    const UNormalizer2 *normalizer = unorm2_getNFDInstance(&status);
+    g_assert(U_SUCCESS(status));
+
+    FsearchUtfConversionBuffer buffer = {};
+    fsearch_utf_conversion_buffer_init(&buffer, 4 * PATH_MAX);
+    g_assert(fsearch_utf_normalize_and_fold_case(normalizer, case_map, &buffer, name));
+
+    char *folded = calloc(4 * PATH_MAX, sizeof(char));
+    g_assert(fsearch_utf_normalized_folded_to_utf8(&buffer, folded, 4 * PATH_MAX) >= 0);
+    char *name_lower = g_ascii_strdown(name, -1);
+    if (strcmp(folded, name_lower) == 0) {
+        g_clear_pointer(&folded, free);
+    }
+
+    g_free(name_lower);
+    fsearch_utf_conversion_buffer_clear(&buffer);
+    g_clear_pointer(&case_map, ucasemap_close);
+    return folded;
+}
+
+// Matches needle against haystack with the stored folded name and with ICU, both have to return result
+static void
+test_search_folded(const char *needle, const char *haystack, bool result) {
+    FsearchToken **tokens = fsearch_tokens_new(needle, 0);
+    FsearchToken *t = tokens[0];
+    g_assert(t != NULL && tokens[1] == NULL);
+    g_assert(t->text_folded != NULL);
+
+    char *folded = fold_name(haystack);
+    const bool found_folded = fsearch_token_search_folded(t, haystack, folded, g_str_is_ascii(haystack)) != 0;
+
+    FsearchUtfConversionBuffer utf_buffer = {};
+    fsearch_utf_conversion_buffer_init(&utf_buffer, 4 * PATH_MAX);
+    fsearch_utf_normalize_and_fold_case(t->normalizer, t->case_map, &utf_buffer, haystack);
+    const bool found = t->search_func(haystack, t->text, t, &utf_buffer) != 0;
+    fsearch_utf_conversion_buffer_clear(&utf_buffer);
+
+    if (found_folded != result || found != result) {
+        g_printerr("Finding %s in %s should %s (folded: %d, ICU: %d).\n",
+                   needle,
+                   haystack,
+                   result ? "succeed" : "fail",
+                   found_folded,
+                   found);
+    }
+    g_assert(found_folded == result);
+    g_assert(found == result);
+
+    g_clear_pointer(&folded, free);
+    g_clear_pointer(&tokens, fsearch_tokens_free);
+}
+
 int
 main(int argc, char *argv[]) {
     TestQuery test_queries[] = {
@@ -62,4 +145,59 @@ main(int argc, char *argv[]) {
         g_clear_pointer(&tokens, fsearch_tokens_free);
         g_assert(tokens == NULL);
     }
+
+    TestRefinement refinement_tests[] = {
+        // Extended substrings
+        {"abc", 0, "ab", 0, true},
+        {"xabcx", 0, "abc", 0, true},
+        {"abc", 0, "abc", 0, true},
+        {"aBC", 0, "Ab", 0, true},
+        {"ab", 0, "abc", 0, false},
+        {"abd", 0, "abc", 0, false},
+        {"a/bc", 0, "a/b", 0, true},
+
+        // Changed case sensitivity
+        {"ABC", QUERY_FLAG_MATCH_CASE, "ab", 0, true},
+        {"abc", QUERY_FLAG_MATCH_CASE, "ab", QUERY_FLAG_MATCH_CASE, true},
+        {"abc", 0, "ab", QUERY_FLAG_MATCH_CASE, false},
+        {"Abc", QUERY_FLAG_MATCH_CASE, "ab", QUERY_FLAG_MATCH_CASE, false},
+        {"abc", QUERY_FLAG_AUTO_MATCH_CASE, "Ab", QUERY_FLAG_AUTO_MATCH_CASE, false},
+
+        // Regular expressions, wildcards and non-ASCII text
+        {"abc", QUERY_FLAG_REGEX, "ab", 0, false},
+        {"abc", 0, "ab", QUERY_FLAG_REGEX, false},
+        {"abc", QUERY_FLAG_REGEX, "ab", QUERY_FLAG_REGEX, false},
+        {"ab*c", 0, "ab", 0, false},
+        {"abc", 0, "a?", 0, false},
+        {"äbc", 0, "äb", 0, false},
+
+        // Paths
+        {"ab/c", 0, "ab", 0, false},
+        {"abc", 0, "/ab", 0, false},
+
+        // Negated terms
+        {"!abcd", 0, "!abc", 0, false},
+        {"!abc", 0, "!abc", 0, false},
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(refinement_tests); i++) {
+        test_refinement(&refinement_tests[i]);
+    }
+
+    // Case folding which changes the length of the text
+    test_search_folded("Straße", "STRASSE", true);
+    test_search_folded("Straße", "Die Strasse", true);
+    test_search_folded("straße", "DIE STRAßE", true);
+    test_search_folded("STRAẞE", "strasse", true);
+    test_search_folded("ß", "Strasse", true);
+    test_search_folded("ß", "Strase", false);
+    test_search_folded("Straße", "Strase", false);
+
+    // Precomposed and decomposed characters
+    test_search_folded("é", "Cafe\xcc\x81", true);
+    test_search_folded("e\xcc\x81", "CAFÉ", true);
+    test_search_folded("É", "café", true);
+    test_search_folded("é", "Cafe", false);
+    test_search_folded("é", "Cafè", false);
+    test_search_folded("Ä", "ä", true);
+    test_search_folded("a\xcc\x88", "Ä", true);
 }
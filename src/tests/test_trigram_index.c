@@ -0,0 +1,135 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <src/fsearch_database_entry.h>
+#include <src/fsearch_string_arena.h>
+#include <src/fsearch_trigram_index.h>
+
+#define TEST_NUM_ENTRIES 5000
+#define TEST_NUM_ADDED_ENTRIES 700
+
+static uint32_t random_state = 1;
+
+static uint32_t
+next_random(void) {
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 16) & 0x7fff;
+}
+
+static void
+add_entries(FsearchDatabaseEntryStore *store, uint32_t num) {
+    // a small alphabet, so most trigrams occur in many names and their posting lists overlap
+    const char *pieces[] = {"a", "b", "C", "d", "E", "ab", "Ab", ".", "_", "ß", "é", "e\xcc\x81"};
+    for (uint32_t i = 0; i < num; i++) {
+        GString *name = g_string_new(NULL);
+        const uint32_t len = 1 + next_random() % 12;
+        for (uint32_t j = 0; j < len; j++) {
+            g_string_append(name, pieces[next_random() % G_N_ELEMENTS(pieces)]);
+        }
+        FsearchDatabaseEntry *entry = db_entry_store_alloc(store, DATABASE_ENTRY_TYPE_FOLDER);
+        db_entry_set_name(entry, name->str);
+        g_string_free(name, TRUE);
+    }
+}
+
+static bool
+contains_ascii_case_insensitive(const char *haystack, const char *needle) {
+    char *haystack_down = g_ascii_strdown(haystack, -1);
+    char *needle_down = g_ascii_strdown(needle, -1);
+    const bool res = strstr(haystack_down, needle_down) != NULL;
+    g_free(haystack_down);
+    g_free(needle_down);
+    return res;
+}
+
+// Every entry of the store whose name contains needle (ignoring the case of ASCII letters) must be a candidate.
+// Returns the number of those entries.
+static uint32_t
+test_superset(FsearchDatabaseEntryStore *store, FsearchTrigramIndex *index, const char *needle) {
+    uint64_t *candidates = fsearch_trigram_index_find(index, needle);
+    if (strlen(needle) < FSEARCH_TRIGRAM_INDEX_MIN_NEEDLE_LEN) {
+        g_assert(candidates == NULL);
+    }
+    else {
+        g_assert(candidates != NULL);
+    }
+
+    const uint32_t num_indexed = fsearch_trigram_index_get_num_entries(index);
+    uint32_t num_matches = 0;
+    for (uint32_t id = 0; id < db_entry_store_get_num_entries(store); id++) {
+        const char *name = db_entry_get_name_raw(db_entry_store_get_entry(store, id));
+        const bool is_candidate = !candidates || fsearch_trigram_index_bitmap_contains(candidates, num_indexed, id);
+        if (contains_ascii_case_insensitive(name, needle)) {
+            num_matches++;
+            if (!is_candidate) {
+                g_printerr("%s (%d) is missing from the candidates of %s.\n", name, id, needle);
+            }
+            g_assert(is_candidate);
+        }
+    }
+    g_clear_pointer(&candidates, free);
+    return num_matches;
+}
+
+static void
+test_needles(FsearchDatabaseEntryStore *store, FsearchTrigramIndex *index) {
+    const char *needles[] = {
+        "ab",
+        "aba",
+        "ABA",
+        "bcd",
+        "a.b",
+        "_Ab_",
+        "abababab",
+        "ße",
+        "ßßß",
+        "é.",
+        "e\xcc\x81",
+        "xyz",
+        "dEdEdEdEdEdEdEdEdEdEdEdEdEdE",
+    };
+    for (uint32_t i = 0; i < G_N_ELEMENTS(needles); i++) {
+        test_superset(store, index, needles[i]);
+    }
+
+    // substrings of names which are part of the store, so every one of them has at least one match
+    for (uint32_t i = 0; i < 200; i++) {
+        const char *name = db_entry_get_name_raw(
+            db_entry_store_get_entry(store, next_random() % db_entry_store_get_num_entries(store)));
+        const size_t len = strlen(name);
+        const size_t start = next_random() % len;
+        char *needle = g_strndup(name + start, 1 + next_random() % (len - start));
+        g_assert_cmpuint(test_superset(store, index, needle), >, 0);
+        g_free(needle);
+    }
+}
+
+int
+main(int argc, char *argv[]) {
+    FsearchStringArena *arena = fsearch_string_arena_new();
+    FsearchDatabaseEntryStore *store = db_entry_store_new(arena, NULL);
+
+    add_entries(store, TEST_NUM_ENTRIES);
+    FsearchTrigramIndex *index = fsearch_trigram_index_new(store, TEST_NUM_ENTRIES);
+    g_assert_cmpuint(fsearch_trigram_index_get_num_entries(index), ==, TEST_NUM_ENTRIES);
+    test_needles(store, index);
+
+    // entries which are added after the index was built aren't covered by it, they have to be candidates as well
+    add_entries(store, TEST_NUM_ADDED_ENTRIES);
+    test_needles(store, index);
+
+    // an index of only some of the entries of the store
+    FsearchTrigramIndex *partial_index = fsearch_trigram_index_new(store, TEST_NUM_ENTRIES / 3);
+    test_needles(store, partial_index);
+
+    FsearchTrigramIndex *full_index = fsearch_trigram_index_new(store, TEST_NUM_ENTRIES + TEST_NUM_ADDED_ENTRIES);
+    test_needles(store, full_index);
+
+    g_clear_pointer(&full_index, fsearch_trigram_index_unref);
+    g_clear_pointer(&partial_index, fsearch_trigram_index_unref);
+    g_clear_pointer(&index, fsearch_trigram_index_unref);
+    g_clear_pointer(&store, db_entry_store_free);
+    g_clear_pointer(&arena, fsearch_string_arena_free);
+    return 0;
+}
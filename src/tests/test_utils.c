@@ -0,0 +1,146 @@
+#include "test_utils.h"
+
+#include <glib/gstdio.h>
+#include <utime.h>
+
+#include <src/fsearch_database_entry.h>
+
+void
+test_create_file(const char *path, size_t size, time_t mtime) {
+    char *dir = g_path_get_dirname(path);
+    g_assert(g_mkdir_with_parents(dir, 0755) == 0);
+    g_free(dir);
+
+    char *contents = g_malloc0(size + 1);
+    g_assert(g_file_set_contents(path, contents, (gssize)size, NULL));
+    g_free(contents);
+
+    struct utimbuf times = {.actime = mtime, .modtime = mtime};
+    g_assert(utime(path, &times) == 0);
+}
+
+void
+test_create_tree(const char *root, const char **paths, uint32_t num_paths) {
+    const time_t now = time(NULL);
+    for (uint32_t i = 0; i < num_paths; i++) {
+        char *path = g_build_filename(root, paths[i], NULL);
+        test_create_file(path, 0, now);
+        g_free(path);
+    }
+}
+
+void
+test_remove_tree(const char *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const char *name = NULL;
+        while ((name = g_dir_read_name(dir))) {
+            char *child = g_build_filename(path, name, NULL);
+            test_remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_remove(path);
+}
+
+static void
+add_entries(GPtrArray *description, DynamicArray *entries) {
+    if (!entries) {
+        return;
+    }
+    for (uint32_t i = 0; i < darray_get_num_items(entries); i++) {
+        FsearchDatabaseEntry *entry = darray_get_item(entries, i);
+        GString *path = db_entry_get_path_full(entry);
+        g_ptr_array_add(description,
+                        g_strdup_printf("%s %d %ld %ld",
+                                        path->str,
+                                        db_entry_get_type(entry),
+                                        (long)db_entry_get_size(entry),
+                                        (long)db_entry_get_mtime(entry)));
+        g_string_free(path, TRUE);
+    }
+    darray_unref(entries);
+}
+
+GPtrArray *
+test_describe_database(FsearchDatabase *db) {
+    GPtrArray *description = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(description,
+                    g_strdup_printf("%u folders, %u files", db_get_num_folders(db), db_get_num_files(db)));
+
+    // the arrays sorted by path are only built in the background once they're requested
+    db_request_entries_sorted(db, DATABASE_INDEX_TYPE_PATH);
+    for (uint32_t i = 0; i < 1000 && !db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_PATH); i++) {
+        g_usleep(10000);
+    }
+    g_assert(db_has_entries_sorted_by_type(db, DATABASE_INDEX_TYPE_PATH));
+
+    db_lock(db);
+    const FsearchDatabaseIndexType sort_types[] = {DATABASE_INDEX_TYPE_NAME, DATABASE_INDEX_TYPE_PATH};
+    for (uint32_t i = 0; i < G_N_ELEMENTS(sort_types); i++) {
+        add_entries(description, db_get_folders_sorted(db, sort_types[i]));
+        add_entries(description, db_get_files_sorted(db, sort_types[i]));
+    }
+    db_unlock(db);
+
+    return description;
+}
+
+void
+test_assert_descriptions_equal(GPtrArray *d1, GPtrArray *d2) {
+    g_assert_cmpuint(d1->len, ==, d2->len);
+    for (uint32_t i = 0; i < d1->len; i++) {
+        g_assert_cmpstr(d1->pdata[i], ==, d2->pdata[i]);
+    }
+}
+
+void
+test_assert_arrays_equal(DynamicArray *a1, DynamicArray *a2) {
+    const uint32_t num_items = a1 ? darray_get_num_items(a1) : 0;
+    g_assert_cmpuint(num_items, ==, a2 ? darray_get_num_items(a2) : 0);
+    for (uint32_t i = 0; i < num_items; i++) {
+        g_assert(darray_get_item(a1, i) == darray_get_item(a2, i));
+    }
+}
+
+static GMutex search_mutex;
+static GCond search_cond;
+static DatabaseSearchResult *search_result;
+static bool search_done;
+
+static void
+search_finished(gpointer result, gpointer data) {
+    FsearchQuery *query = data;
+    g_clear_pointer(&query, fsearch_query_unref);
+
+    g_mutex_lock(&search_mutex);
+    search_result = result;
+    search_done = true;
+    g_cond_signal(&search_cond);
+    g_mutex_unlock(&search_mutex);
+}
+
+static void
+search_cancelled(gpointer data) {
+    search_finished(NULL, data);
+}
+
+DatabaseSearchResult *
+test_search_sync(FsearchTaskQueue *queue, FsearchQuery *query, FsearchTaskFinishedFunc partial_func) {
+    g_mutex_lock(&search_mutex);
+    search_done = false;
+    g_mutex_unlock(&search_mutex);
+
+    db_search_queue(queue, fsearch_query_ref(query), partial_func, search_finished, search_cancelled);
+
+    g_mutex_lock(&search_mutex);
+    while (!search_done) {
+        g_cond_wait(&search_cond, &search_mutex);
+    }
+    DatabaseSearchResult *result = g_steal_pointer(&search_result);
+    g_mutex_unlock(&search_mutex);
+
+    g_assert(result != NULL);
+    return result;
+}
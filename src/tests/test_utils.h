@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <src/fsearch_database.h>
+#include <src/fsearch_database_search.h>
+
+// Creates a file of the given size and modification time at path, together with its missing parent folders
+void
+test_create_file(const char *path, size_t size, time_t mtime);
+
+// Creates an empty file at every one of paths, which are relative to root
+void
+test_create_tree(const char *root, const char **paths, uint32_t num_paths);
+
+// Removes path and everything below it
+void
+test_remove_tree(const char *path);
+
+// Returns a description of every entry of db, in the order of the arrays sorted by name and by path
+GPtrArray *
+test_describe_database(FsearchDatabase *db);
+
+void
+test_assert_descriptions_equal(GPtrArray *d1, GPtrArray *d2);
+
+// Compares the entries of two arrays, either of which may be NULL for no entries
+void
+test_assert_arrays_equal(DynamicArray *a1, DynamicArray *a2);
+
+// Searches query and waits until the search is finished. partial_func is passed on to db_search_queue and is called on
+// the thread of the search. Returns the results, which are owned by the caller.
+DatabaseSearchResult *
+test_search_sync(FsearchTaskQueue *queue, FsearchQuery *query, FsearchTaskFinishedFunc partial_func);